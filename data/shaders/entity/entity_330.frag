@@ -0,0 +1,21 @@
+#version 330 core
+
+// Must match DrawUniforms in gfx/shader.h
+layout(std140) uniform DrawBlock
+{
+	mat4 modelMatrix;
+	vec4 drawColor;
+};
+
+in vec3 localPosition;
+
+out vec4 fragColor;
+
+void main()
+{
+	// Darker towards the edges of the quad
+	vec2 edge = abs( localPosition.xy );
+	float shade = (max( edge.x, edge.y ) > 0.9) ? 0.6 : 1.0;
+
+	fragColor = vec4( drawColor.rgb * shade, drawColor.a );
+}
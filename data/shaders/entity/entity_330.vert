@@ -0,0 +1,37 @@
+#version 330 core
+
+layout(std140) uniform MatrixBlock
+{
+	mat4 perspectiveMatrix;
+	mat4 orthographicMatrix;
+	mat4 viewMatrix;
+};
+
+// Must match DrawUniforms in gfx/shader.h
+layout(std140) uniform DrawBlock
+{
+	mat4 modelMatrix;
+	vec4 drawColor;
+};
+
+layout(location = 0) in vec3 vertexPosition;
+// Per instance, must match EntityInstance in gfx/systems.h
+layout(location = 1) in vec3 instancePosition;
+layout(location = 2) in vec3 instanceRotation;
+layout(location = 3) in vec3 instanceScale;
+
+out vec3 localPosition;
+
+void main()
+{
+	vec3 s = sin( instanceRotation );
+	vec3 c = cos( instanceRotation );
+	// Rotate about x, then y, then z
+	mat3 rotateX = mat3( 1.0, 0.0, 0.0, 0.0, c.x, s.x, 0.0, -s.x, c.x );
+	mat3 rotateY = mat3( c.y, 0.0, -s.y, 0.0, 1.0, 0.0, s.y, 0.0, c.y );
+	mat3 rotateZ = mat3( c.z, s.z, 0.0, -s.z, c.z, 0.0, 0.0, 0.0, 1.0 );
+
+	localPosition = vertexPosition;
+	vec3 position = instancePosition + rotateZ * rotateY * rotateX * (vertexPosition * instanceScale);
+	gl_Position = perspectiveMatrix * viewMatrix * modelMatrix * vec4( position, 1.0 );
+}
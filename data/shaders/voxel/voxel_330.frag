@@ -0,0 +1,28 @@
+#version 330 core
+
+in vec2 texCoord;
+flat in uint textureLayer;
+in float shade;
+
+out vec4 fragColor;
+
+// Flat colours until there is a block texture array, index corresponds to the block texture layer
+const vec3 LayerColors[8] = vec3[8](
+	vec3( 1.0, 0.0, 1.0 ),
+	vec3( 0.5, 0.5, 0.5 ),
+	vec3( 0.45, 0.3, 0.15 ),
+	vec3( 0.3, 0.6, 0.2 ),
+	vec3( 0.85, 0.8, 0.55 ),
+	vec3( 0.8, 0.9, 1.0 ),
+	vec3( 1.0, 0.9, 0.6 ),
+	vec3( 0.2, 0.4, 0.85 ) );
+
+void main()
+{
+	vec3 color = textureLayer < 8u ? LayerColors[textureLayer] : LayerColors[0];
+	// Darken block edges so merged quads still read as blocks
+	vec2 edge = abs( fract( texCoord ) - 0.5 );
+	color *= (max( edge.x, edge.y ) > 0.47) ? 0.85 : 1.0;
+
+	fragColor = vec4( color * shade, 1.0 );
+}
@@ -0,0 +1,50 @@
+#version 330 core
+
+// Must match ChunkVertex in gfx/mesher.h
+#define X_SHIFT 0u
+#define Y_SHIFT 6u
+#define Z_SHIFT 12u
+#define FACE_SHIFT 18u
+#define AO_SHIFT 21u
+#define LAYER_SHIFT 0u
+#define U_SHIFT 16u
+#define V_SHIFT 22u
+#define COORD_MASK 0x3Fu
+#define FACE_MASK 0x7u
+#define AO_MASK 0x3u
+#define LAYER_MASK 0xFFFFu
+
+layout(std140) uniform MatrixBlock
+{
+	mat4 perspectiveMatrix;
+	mat4 orthographicMatrix;
+	mat4 viewMatrix;
+};
+
+layout(location = 0) in uint packedPosition;
+layout(location = 1) in uint packedTexture;
+// Per draw, from the draw origin buffer or a constant attribute
+layout(location = 2) in vec3 chunkOrigin;
+
+out vec2 texCoord;
+flat out uint textureLayer;
+out float shade;
+
+// Index corresponds to BlockFaces value
+const float FaceShades[6] = float[6]( 0.7, 0.7, 0.5, 1.0, 0.85, 0.85 );
+
+void main()
+{
+	vec3 position = vec3(
+		float( (packedPosition >> X_SHIFT) & COORD_MASK ),
+		float( (packedPosition >> Y_SHIFT) & COORD_MASK ),
+		float( (packedPosition >> Z_SHIFT) & COORD_MASK ) );
+	uint face = (packedPosition >> FACE_SHIFT) & FACE_MASK;
+	uint ao = (packedPosition >> AO_SHIFT) & AO_MASK;
+
+	texCoord = vec2( float( (packedTexture >> U_SHIFT) & COORD_MASK ), float( (packedTexture >> V_SHIFT) & COORD_MASK ) );
+	textureLayer = (packedTexture >> LAYER_SHIFT) & LAYER_MASK;
+	shade = FaceShades[face] * (0.4 + 0.2 * float( ao ));
+
+	gl_Position = perspectiveMatrix * viewMatrix * vec4( chunkOrigin + position, 1.0 );
+}
@@ -0,0 +1,98 @@
+/**
+* @file blocks.h
+* @brief Contains the block type identifiers and the hardcoded block definition table.
+*
+* @author Timothy Volpe
+* @date 5/10/2020
+*/
+
+#pragma once
+
+#include <cstdint>
+
+/** Identifies a type of block in the world. 0 is always air. */
+typedef uint16_t BlockId;
+
+/** Our block types are all hardcoded, the way to identify them can be found here. Must be continuous. */
+enum BlockTypes : BlockId
+{
+	BLOCK_AIR = 0,
+	BLOCK_STONE,
+	BLOCK_DIRT,
+	BLOCK_GRASS,
+	BLOCK_SAND,
+	BLOCK_GLASS,
+	BLOCK_LAMP,
+	BLOCK_WATER,
+	BLOCK_COUNT
+};
+
+/** The six faces of a block, ordered so the axis is face / 2 and the direction is positive for odd faces */
+enum BlockFaces : uint8_t
+{
+	FACE_NEG_X = 0,
+	FACE_POS_X,
+	FACE_NEG_Y,
+	FACE_POS_Y,
+	FACE_NEG_Z,
+	FACE_POS_Z,
+	FACE_COUNT
+};
+
+/** Unit normal of every face, index corresponds to BlockFaces value */
+static const int32_t FaceNormals[FACE_COUNT][3] ={
+	{ -1, 0, 0 }, { 1, 0, 0 },
+	{ 0, -1, 0 }, { 0, 1, 0 },
+	{ 0, 0, -1 }, { 0, 0, 1 }
+};
+
+/** Block is completely opaque, hides neighbouring faces and blocks light */
+#define BLOCK_FLAG_OPAQUE	(1 << 0)
+/** Block can be collided with */
+#define BLOCK_FLAG_SOLID	(1 << 1)
+/** Block falls when there is nothing under it */
+#define BLOCK_FLAG_FALLING	(1 << 2)
+
+/** Defines a hard-coded block type */
+struct BlockDefinition
+{
+	const char*		blockName;
+	uint8_t			flags;
+	/** Layer of the block texture array the block is drawn with */
+	uint16_t		textureLayer;
+	/** Block light level the block gives off, 0 if none */
+	uint8_t			lightEmission;
+};
+
+/** Block definition data, index corresponds to BlockTypes value */
+static const BlockDefinition BlockDefinitions[] ={
+	{ "air",	0,										0,	0 },
+	{ "stone",	BLOCK_FLAG_OPAQUE | BLOCK_FLAG_SOLID,	1,	0 },
+	{ "dirt",	BLOCK_FLAG_OPAQUE | BLOCK_FLAG_SOLID,	2,	0 },
+	{ "grass",	BLOCK_FLAG_OPAQUE | BLOCK_FLAG_SOLID,	3,	0 },
+	{ "sand",	BLOCK_FLAG_OPAQUE | BLOCK_FLAG_SOLID | BLOCK_FLAG_FALLING,	4,	0 },
+	{ "glass",	BLOCK_FLAG_SOLID,						5,	0 },
+	{ "lamp",	BLOCK_FLAG_OPAQUE | BLOCK_FLAG_SOLID,	6,	15 },
+	{ "water",	0,										7,	0 },
+};
+
+/** Returns true if the block type hides the faces behind it. Unknown block IDs are treated as opaque. */
+inline bool IsBlockOpaque( BlockId block ) {
+	return block >= BLOCK_COUNT || (BlockDefinitions[block].flags & BLOCK_FLAG_OPAQUE) != 0;
+}
+/** Returns true if entities collide with the block type. Unknown block IDs are treated as solid. */
+inline bool IsBlockSolid( BlockId block ) {
+	return block >= BLOCK_COUNT || (BlockDefinitions[block].flags & BLOCK_FLAG_SOLID) != 0;
+}
+/** Returns true if the block type falls when unsupported. Unknown block IDs do not fall. */
+inline bool IsBlockFalling( BlockId block ) {
+	return block < BLOCK_COUNT && (BlockDefinitions[block].flags & BLOCK_FLAG_FALLING) != 0;
+}
+/** Returns the texture array layer of the block type. Unknown block IDs use layer 0. */
+inline uint16_t GetBlockTextureLayer( BlockId block ) {
+	return block >= BLOCK_COUNT ? 0 : BlockDefinitions[block].textureLayer;
+}
+/** Returns the block light level the block type gives off. Unknown block IDs give off none. */
+inline uint8_t GetBlockLightEmission( BlockId block ) {
+	return block >= BLOCK_COUNT ? 0 : BlockDefinitions[block].lightEmission;
+}
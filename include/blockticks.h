@@ -0,0 +1,122 @@
+/**
+* @file blockticks.h
+* @brief Contains the CBlockTickScheduler class, which runs delayed block updates on later world ticks.
+* @details Updates are kept in a hierarchical timing wheel. The first level has a slot for each of the next
+*	256 ticks, and each further level has 64 slots that each cover a whole turn of the level below. When a level
+*	turns over, the next slot of the level above is emptied into the levels below. Scheduling and running an update
+*	are both constant time, no matter how many are waiting.
+*
+*	A block has at most one update waiting. Scheduling it again keeps whichever is sooner. Updates that come due
+*	in a chunk that is not loaded are parked with the chunk, and are scheduled again when it loads.
+*
+* @author Timothy Volpe
+* @date 5/17/2020
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <functional>
+#include <unordered_map>
+#include "chunk.h"
+
+/** Slots in the first level of the wheel, one per tick */
+#define BLOCK_TICK_WHEEL_BITS 8
+/** Slots in each further level */
+#define BLOCK_TICK_LEVEL_BITS 6
+#define BLOCK_TICK_LEVEL_COUNT 4
+/** Longest delay that can be scheduled, longer delays are shortened to it */
+#define BLOCK_TICK_MAX_DELAY ((1u << (BLOCK_TICK_WHEEL_BITS + BLOCK_TICK_LEVEL_BITS*(BLOCK_TICK_LEVEL_COUNT-1))) - 1)
+/** Most updates run in one tick, the rest are moved to the next tick so a huge contraption only slows itself down */
+#define BLOCK_TICK_MAX_UPDATES_PER_TICK 65536
+
+class CChunkStore;
+
+/**
+* @brief Schedules and runs delayed block updates.
+* @details Not thread-safe, must be used from the thread that owns the chunk store.
+*
+* @author Timothy Volpe
+* @date 5/17/2020
+*/
+class CBlockTickScheduler
+{
+public:
+	/** Called for every update that comes due in a loaded chunk, with the world block coordinates */
+	typedef std::function<void( int32_t x, int32_t y, int32_t z )> UpdateCallback;
+private:
+	struct TickNode
+	{
+		int32_t x, y, z;
+		uint64_t tick;
+		/** Next node in the same slot, or in the free list */
+		uint32_t next;
+		/** Cleared when the update was replaced by a sooner one, the node is freed when its slot is reached */
+		bool live;
+	};
+	struct BlockPosition
+	{
+		int32_t x, y, z;
+	};
+
+	CChunkStore *m_pChunkStore;
+
+	uint64_t m_currentTick;
+
+	/** Heads of the node lists of every slot, the first level uses all of its slots */
+	uint32_t m_slots[BLOCK_TICK_LEVEL_COUNT][1 << BLOCK_TICK_WHEEL_BITS];
+	std::vector<TickNode> m_nodes;
+	uint32_t m_freeNodes;
+
+	/** Live node of every block with an update waiting, keyed by PackBlockKey */
+	std::unordered_map<uint64_t, uint32_t> m_scheduled;
+	std::unordered_map<ChunkPos, std::vector<BlockPosition>, ChunkPosHash> m_parked;
+	size_t m_parkedCount;
+
+	/** Updates taken out of the wheel for the current tick */
+	std::vector<BlockPosition> m_due;
+
+	static inline uint64_t PackBlockKey( int32_t x, int32_t y, int32_t z ) {
+		return ((uint64_t)((uint32_t)x & 0xFFFFFFF) << 36) | ((uint64_t)((uint32_t)z & 0xFFFFFFF) << 8) | ((uint32_t)y & 0xFF);
+	}
+
+	uint32_t allocateNode();
+	void freeNode( uint32_t node );
+
+	/** Link a node into the slot for its tick, relative to the current tick */
+	void insertNode( uint32_t node );
+	/** Empty a slot of a higher level into the levels below */
+	void cascade( uint32_t level, uint32_t slot );
+public:
+	CBlockTickScheduler( CChunkStore *pChunkStore );
+	~CBlockTickScheduler();
+
+	/**
+	* @brief Schedule a block update.
+	* @param[in]	x, y, z		World block coordinates.
+	* @param[in]	delay		Ticks from now, at least 1.
+	* @returns True if the update was scheduled, false if the block already has one due no later.
+	*/
+	bool schedule( int32_t x, int32_t y, int32_t z, uint32_t delay );
+
+	/**
+	* @brief Advance one tick and run the updates that come due.
+	* @details Callbacks can schedule more updates, including for the block being updated.
+	*/
+	void advance( const UpdateCallback &callback );
+
+	/**
+	* @brief Schedule the parked updates of a chunk that has loaded to run on the next tick.
+	*/
+	void resumeChunk( const ChunkPos &position );
+
+	/**
+	* @brief Drop every waiting and parked update.
+	*/
+	void clear();
+
+	inline uint64_t getCurrentTick() const { return m_currentTick; }
+	inline size_t getScheduledCount() const { return m_scheduled.size(); }
+	inline size_t getParkedCount() const { return m_parkedCount; }
+};
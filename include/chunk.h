@@ -0,0 +1,341 @@
+/**
+* @file chunk.h
+* @brief Contains the CChunk class, which stores a cube of blocks, and the CChunkStore container.
+*
+* @author Timothy Volpe
+* @date 5/10/2020
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <unordered_map>
+#include <unordered_set>
+#include "blocks.h"
+
+/** Number of bits needed to address a block along one axis of a chunk */
+#define CHUNK_SIZE_BITS 5
+/** Width, height and depth of a chunk in blocks */
+#define CHUNK_SIZE (1 << CHUNK_SIZE_BITS)
+#define CHUNK_MASK (CHUNK_SIZE-1)
+/** Chunks are split into cubic sections of (1 << CHUNK_SECTION_BITS) blocks to track which parts are empty */
+#define CHUNK_SECTION_BITS 3
+#define CHUNK_SECTIONS_PER_AXIS (CHUNK_SIZE >> CHUNK_SECTION_BITS)
+#define CHUNK_AREA (CHUNK_SIZE*CHUNK_SIZE)
+#define CHUNK_VOLUME (CHUNK_AREA*CHUNK_SIZE)
+
+/** The world is a fixed number of chunks tall, chunk Y coordinates run from 0 to this value non-inclusive. */
+#define WORLD_HEIGHT_CHUNKS 8
+#define WORLD_HEIGHT (WORLD_HEIGHT_CHUNKS*CHUNK_SIZE)
+
+/**
+* @brief Identifies a chunk by its position in chunk coordinates.
+*/
+struct ChunkPos
+{
+	int32_t x, y, z;
+
+	inline bool operator==( const ChunkPos& other ) const { return x == other.x && y == other.y && z == other.z; }
+	inline bool operator!=( const ChunkPos& other ) const { return !(*this == other); }
+};
+
+/** Hash for using chunk positions as keys in unordered containers */
+struct ChunkPosHash
+{
+	inline size_t operator()( const ChunkPos& pos ) const {
+		// Large primes, good enough spread for neighbouring chunk coordinates
+		return (size_t)((uint64_t)(uint32_t)pos.x * 73856093ull ^ (uint64_t)(uint32_t)pos.y * 19349663ull ^ (uint64_t)(uint32_t)pos.z * 83492791ull);
+	}
+};
+
+/** Converts a chunk-local block coordinate to an index into the block array. Layout is Y-major, then Z, then X. */
+inline uint32_t ChunkBlockIndex( uint32_t x, uint32_t y, uint32_t z ) {
+	return (y << (CHUNK_SIZE_BITS*2)) | (z << CHUNK_SIZE_BITS) | x;
+}
+/** Converts chunk-local coordinates to the bit of the section containing them, see CChunk::getSectionMask */
+inline uint32_t ChunkSectionIndex( uint32_t x, uint32_t y, uint32_t z ) {
+	return ((y >> CHUNK_SECTION_BITS)*CHUNK_SECTIONS_PER_AXIS + (z >> CHUNK_SECTION_BITS))*CHUNK_SECTIONS_PER_AXIS + (x >> CHUNK_SECTION_BITS);
+}
+/** Converts a world block coordinate to the coordinate of the chunk containing it */
+inline int32_t BlockToChunkCoord( int32_t block ) {
+	return block >> CHUNK_SIZE_BITS;
+}
+
+/** Light levels run from 0, dark, to this value */
+#define LIGHT_LEVEL_MAX 15
+
+/**
+* @brief A light level for every block of a chunk, 4 bits each.
+* @details Like chunk blocks, the array is not allocated while every level is the same.
+*/
+class CLightArray
+{
+private:
+	/** Two levels per byte, the even index in the low bits */
+	std::vector<uint8_t> m_levels;
+	uint8_t m_uniformLevel;
+public:
+	CLightArray();
+	~CLightArray();
+
+	/**
+	* @brief Get the light level of a block by its index in the block array, see ChunkBlockIndex.
+	*/
+	inline uint8_t get( uint32_t index ) const {
+		return m_levels.empty() ? m_uniformLevel : (uint8_t)((m_levels[index >> 1] >> ((index & 1) << 2)) & 0xF);
+	}
+	/**
+	* @brief Set the light level of a block by its index in the block array, see ChunkBlockIndex.
+	*/
+	void set( uint32_t index, uint8_t level );
+	/**
+	* @brief Set every level to the same value and release the array.
+	*/
+	void fill( uint8_t level );
+
+	inline bool isUniform() const { return m_levels.empty(); }
+	inline uint8_t getUniformLevel() const { return m_uniformLevel; }
+};
+
+/** Describes how a chunk stores its blocks */
+enum ChunkStorageTypes : uint8_t
+{
+	/** Every block in the chunk is the same, no block array is allocated */
+	CHUNK_STORAGE_UNIFORM = 0,
+	/** The chunk stores one block ID per block */
+	CHUNK_STORAGE_DENSE = 1
+};
+
+/**
+* @brief A cube of #CHUNK_SIZE blocks on each side.
+* @details Chunks that are entirely one block type, which is common for air and underground stone, do not
+*	allocate a block array at all. The array is allocated the first time a different block is set.
+*	Every modification increments the chunk version, which is used to tell when derived data is out of date.
+*	Chunks are not thread-safe, and are owned by the thread that owns their CChunkStore.
+*
+* @author Timothy Volpe
+* @date 5/10/2020
+*/
+class CChunk
+{
+private:
+	ChunkPos m_position;
+
+	BlockId m_uniformBlock;
+	std::vector<BlockId> m_blocks;
+
+	uint32_t m_nonAirCount;
+	uint32_t m_version;
+	bool m_modified;
+
+	/** Built on demand, valid while the version matches */
+	mutable uint64_t m_sectionMask;
+	mutable uint32_t m_sectionMaskVersion;
+
+	CLightArray m_blockLight;
+	CLightArray m_skyLight;
+public:
+	CChunk( ChunkPos position );
+	~CChunk();
+
+	/**
+	* @brief Get a block from chunk-local coordinates.
+	* @details Coordinates must be within 0 and #CHUNK_SIZE non-inclusive.
+	*/
+	inline BlockId getBlock( uint32_t x, uint32_t y, uint32_t z ) const {
+		return m_blocks.empty() ? m_uniformBlock : m_blocks[ChunkBlockIndex( x, y, z )];
+	}
+	/**
+	* @brief Get a block by its index in the block array, see ChunkBlockIndex.
+	*/
+	inline BlockId getBlockByIndex( uint32_t index ) const {
+		return m_blocks.empty() ? m_uniformBlock : m_blocks[index];
+	}
+
+	/**
+	* @brief Set a block at chunk-local coordinates.
+	* @details If the chunk is uniform and the block differs, the block array will be allocated.
+	*/
+	void setBlock( uint32_t x, uint32_t y, uint32_t z, BlockId block );
+
+	/**
+	* @brief Set every block in the chunk to a single type and release the block array.
+	*/
+	void fill( BlockId block );
+
+	/**
+	* @brief Replace the contents of the chunk with a dense block array.
+	* @details The array must hold #CHUNK_VOLUME blocks laid out as described by ChunkBlockIndex.
+	*	If every block is the same the chunk will be stored as uniform.
+	*/
+	void setBlockData( const BlockId *pBlocks );
+
+	/**
+	* @brief Release the block array if every block in the chunk is the same.
+	* @returns True if the chunk is now uniform, false if otherwise.
+	*/
+	bool tryCompact();
+
+	/**
+	* @brief Append the blocks of the chunk to a byte buffer.
+	* @details Uniform chunks are written as a single block ID. Block IDs are stored little-endian.
+	* @param[out]	output	The buffer to append to.
+	*/
+	void serialize( std::vector<uint8_t> &output ) const;
+	/**
+	* @brief Replace the blocks of the chunk with data written by serialize.
+	* @param[in]	pData		The serialized data.
+	* @param[in]	length		The number of bytes available in pData.
+	* @param[out]	pBytesRead	The number of bytes consumed is stored here.
+	* @returns True if the data was valid, false if it was truncated or corrupt. The chunk is untouched on failure.
+	*/
+	bool deserialize( const uint8_t *pData, size_t length, size_t *pBytesRead );
+
+	inline const ChunkPos& getPosition() const { return m_position; }
+
+	/** Returns true if the chunk has no block array and is a single block type */
+	inline bool isUniform() const { return m_blocks.empty(); }
+	/** The block filling the chunk, only meaningful if isUniform is true */
+	inline BlockId getUniformBlock() const { return m_uniformBlock; }
+	/** Returns the block array, or a null pointer if the chunk is uniform */
+	inline const BlockId* getBlockData() const { return m_blocks.empty() ? 0 : &m_blocks[0]; }
+
+	/** Returns true if every block in the chunk is air */
+	inline bool isEmpty() const { return m_nonAirCount == 0; }
+	inline uint32_t getNonAirCount() const { return m_nonAirCount; }
+
+	/**
+	* @brief Get which sections of the chunk have blocks other than air.
+	* @details Bit ChunkSectionIndex is set if the section has any block that is not air. Rebuilt on the first call
+	*	after a modification.
+	*/
+	uint64_t getSectionMask() const;
+
+	/** Incremented on every modification */
+	inline uint32_t getVersion() const { return m_version; }
+
+	/** Light emitted by blocks, maintained by CLightEngine and not saved */
+	inline CLightArray& getBlockLight() { return m_blockLight; }
+	inline const CLightArray& getBlockLight() const { return m_blockLight; }
+	/** Light from the sky, maintained by CLightEngine and not saved */
+	inline CLightArray& getSkyLight() { return m_skyLight; }
+	inline const CLightArray& getSkyLight() const { return m_skyLight; }
+
+	/** Returns true if the chunk has changed since it was last saved */
+	inline bool isModified() const { return m_modified; }
+	inline void setModified( bool modified ) { m_modified = modified; }
+};
+
+/**
+* @brief Owns the loaded chunks of a world, keyed by chunk position.
+* @details Keeps a set of chunks whose mesh is out of date. Creating, removing and setting blocks through the store
+*	marks the affected chunks, including neighbours whose border changed. Code that edits a CChunk directly must
+*	call markDirty itself.
+*
+* @author Timothy Volpe
+* @date 5/10/2020
+*/
+class CChunkStore
+{
+private:
+	std::unordered_map<ChunkPos, std::shared_ptr<CChunk>, ChunkPosHash> m_chunks;
+	std::unordered_set<ChunkPos, ChunkPosHash> m_dirtyChunks;
+
+	/** Mark the chunk and the 26 chunks around it dirty */
+	void markNeighboursDirty( const ChunkPos& position );
+public:
+	CChunkStore();
+	~CChunkStore();
+
+	/**
+	* @brief Get a loaded chunk.
+	* @returns A pointer to the chunk, or a null pointer if it is not loaded. The pointer is valid until the chunk is removed.
+	*/
+	CChunk* getChunk( const ChunkPos& position );
+
+	/**
+	* @brief Create an empty chunk at the given position.
+	* @details If a chunk already exists at the position, the existing chunk is returned.
+	* @returns A pointer to the chunk.
+	*/
+	CChunk* createChunk( const ChunkPos& position );
+
+	/**
+	* @brief Unload the chunk at the given position, if loaded.
+	*/
+	void removeChunk( const ChunkPos& position );
+
+	/**
+	* @brief Unload every chunk.
+	*/
+	void clear();
+
+	/**
+	* @brief Calls the given function for every loaded chunk.
+	*/
+	void forEachChunk( const std::function<void( CChunk* )> &callback );
+
+	inline size_t getChunkCount() const { return m_chunks.size(); }
+
+	/**
+	* @brief Get a block by world block coordinates.
+	* @returns The block, or air if the chunk containing it is not loaded.
+	*/
+	BlockId getBlock( int32_t x, int32_t y, int32_t z );
+	/**
+	* @brief Set a block by world block coordinates.
+	* @returns True if the block was set, false if the chunk containing it is not loaded.
+	*/
+	bool setBlock( int32_t x, int32_t y, int32_t z, BlockId block );
+
+	/**
+	* @brief Mark a chunk as needing a new mesh.
+	*/
+	inline void markDirty( const ChunkPos& position ) { m_dirtyChunks.insert( position ); }
+	/**
+	* @brief Move the dirty chunks into a list and clear the dirty set.
+	* @details Dirty chunks that are not loaded are included, so their meshes can be dropped.
+	* @param[out]	chunks	The dirty chunk positions are appended here.
+	*/
+	void takeDirtyChunks( std::vector<ChunkPos> &chunks );
+};
+
+/**
+* @brief Remembers the last chunk looked up in a CChunkStore, for code that reads many blocks of one chunk in a row.
+* @details The cached pointer is only valid while the chunk stays loaded. Call reset before a batch of lookups if
+*	chunks may have been unloaded since the last one.
+*
+* @author Timothy Volpe
+* @date 5/17/2020
+*/
+class CChunkCache
+{
+private:
+	CChunkStore *m_pChunkStore;
+
+	ChunkPos m_cachedPosition;
+	CChunk *m_pCachedChunk;
+	bool m_cacheValid;
+
+	CChunk* lookupChunk( const ChunkPos& position );
+public:
+	CChunkCache( CChunkStore *pChunkStore );
+	~CChunkCache();
+
+	/**
+	* @brief Get a loaded chunk, reusing the last lookup if it was for the same position.
+	* @returns A pointer to the chunk, or a null pointer if it is not loaded.
+	*/
+	inline CChunk* getChunk( const ChunkPos& position ) {
+		if( m_cacheValid && position == m_cachedPosition )
+			return m_pCachedChunk;
+		return this->lookupChunk( position );
+	}
+	/**
+	* @brief Forget the last lookup.
+	*/
+	inline void reset() { m_cacheValid = false; }
+};
@@ -0,0 +1,212 @@
+/**
+* @file chunkcodec.h
+* @brief Contains the CChunkEncoder and CChunkDecoder classes, which compress chunk blocks for saves and network transfer.
+* @details Every chunk is written as one self-contained record, so chunks can be encoded and decoded one at a time as
+*	they are produced or consumed. Uniform chunks are stored as a single block ID. Other chunks are first mapped to a
+*	palette of the block IDs they contain, then transformed in one of two ways:
+*	- Runs: run-length pairs of palette index and count, in block array order. Best for layered terrain.
+*	- Bit planes: one plane per bit of the palette index, each layer XORed with the layer below it. Best for noisy
+*	  chunks with few block types, the deltas are mostly zero.
+*	The transformed bytes are then compressed with an LZ77 block compressor using LZ4-style sequences.
+*
+*	Record layout, all values little-endian:
+*	- uint8 mode, see ChunkCodecModes
+*	- Uniform: uint16 block ID
+*	- Otherwise: uint32 transformed length, uint32 compressed length, compressed bytes. The transformed bytes begin
+*	  with a uint16 palette size and the palette, followed by the runs or bit planes.
+*
+* @author Timothy Volpe
+* @date 5/13/2020
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "blocks.h"
+
+class CChunk;
+
+/** Size of the record header for transformed chunks */
+#define CODEC_RECORD_HEADER_SIZE 9
+/** Number of bits of the LZ hash table index */
+#define CODEC_LZ_HASH_BITS 12
+/** Shortest match the LZ compressor emits */
+#define CODEC_LZ_MIN_MATCH 4
+/** Matches can reach back at most this many bytes */
+#define CODEC_LZ_MAX_OFFSET 65535
+
+enum ChunkCodecModes : uint8_t
+{
+	CODEC_MODE_UNIFORM = 0,
+	CODEC_MODE_RUNS = 1,
+	CODEC_MODE_BITPLANES = 2
+};
+
+/**
+* @brief Running totals for measuring codec throughput and compression ratio.
+* @details Raw bytes count every chunk as a full block array, uniform or not, since that is what the codec replaces.
+*/
+struct ChunkCodecStats
+{
+	uint64_t chunkCount;
+	uint64_t rawBytes;
+	uint64_t encodedBytes;
+	double seconds;
+
+	inline double getRatio() const { return encodedBytes ? (double)rawBytes / (double)encodedBytes : 0.0; }
+	/** Throughput in raw megabytes per second */
+	inline double getMBPerSecond() const { return seconds > 0.0 ? (double)rawBytes / (1024.0*1024.0) / seconds : 0.0; }
+};
+
+/**
+* @brief Compresses a block of bytes into LZ4-style sequences.
+* @param[in]	pSource		The bytes to compress.
+* @param[in]	length		The number of bytes to compress.
+* @param[out]	output		The compressed bytes are appended here.
+* @param[in]	pHashTable	Scratch table of (1 << #CODEC_LZ_HASH_BITS) entries.
+*/
+void LZCompress( const uint8_t *pSource, size_t length, std::vector<uint8_t> &output, uint32_t *pHashTable );
+/**
+* @brief Decompress a block compressed with LZCompress.
+* @param[in]	pSource				The compressed bytes.
+* @param[in]	length				The number of compressed bytes.
+* @param[out]	pDest				Where to decompress to.
+* @param[in]	decompressedLength	The exact decompressed length.
+* @returns True if the block decompressed to exactly decompressedLength bytes, false if it was corrupt.
+*/
+bool LZDecompress( const uint8_t *pSource, size_t length, uint8_t *pDest, size_t decompressedLength );
+
+/**
+* @brief Encodes a stream of chunks.
+* @details Scratch buffers are kept between chunks, so a single encoder should be reused. Not thread-safe.
+*
+* @author Timothy Volpe
+* @date 5/13/2020
+*/
+class CChunkEncoder
+{
+private:
+	std::vector<uint8_t> *m_pOutput;
+
+	/** Palette index of every block ID, only entries in the current palette are valid */
+	std::vector<uint16_t> m_paletteLookup;
+	std::vector<BlockId> m_palette;
+	std::vector<uint16_t> m_indices;
+	std::vector<uint8_t> m_transformed;
+	std::vector<uint32_t> m_hashTable;
+
+	ChunkCodecStats m_stats;
+
+	/** Build the palette and index array, returns the number of runs */
+	uint32_t buildPalette( const BlockId *pBlocks );
+	void transformRuns();
+	void transformBitPlanes();
+public:
+	CChunkEncoder();
+	~CChunkEncoder();
+
+	/**
+	* @brief Start appending encoded chunks to a buffer.
+	* @param[in]	pOutput		The buffer to append to. It must stay valid until finish is called.
+	*/
+	void begin( std::vector<uint8_t> *pOutput );
+	/**
+	* @brief Encode a chunk and append it to the output.
+	*/
+	void writeChunk( const CChunk *pChunk );
+	/**
+	* @brief Stop appending to the output.
+	*/
+	void finish();
+
+	inline const ChunkCodecStats& getStats() const { return m_stats; }
+	inline void resetStats() { m_stats = ChunkCodecStats(); }
+};
+
+/**
+* @brief Decodes a stream of chunks written by CChunkEncoder.
+* @details Scratch buffers are kept between chunks, so a single decoder should be reused. Not thread-safe.
+*
+* @author Timothy Volpe
+* @date 5/13/2020
+*/
+class CChunkDecoder
+{
+private:
+	const uint8_t *m_pData;
+	size_t m_length;
+	size_t m_readOffset;
+
+	std::vector<uint8_t> m_transformed;
+	std::vector<BlockId> m_palette;
+	std::vector<uint16_t> m_indices;
+	std::vector<BlockId> m_blocks;
+
+	ChunkCodecStats m_stats;
+
+	bool untransformRuns( const uint8_t *pBody, size_t length, uint32_t paletteSize );
+	bool untransformBitPlanes( const uint8_t *pBody, size_t length, uint32_t paletteSize );
+public:
+	CChunkDecoder();
+	~CChunkDecoder();
+
+	/**
+	* @brief Start reading encoded chunks from a buffer.
+	* @param[in]	pData	The encoded data. It must stay valid while chunks are read.
+	* @param[in]	length	The number of bytes available.
+	*/
+	void begin( const uint8_t *pData, size_t length );
+	/**
+	* @brief Decode the next chunk into the given chunk, replacing its blocks.
+	* @returns True if a chunk was read, false if the data was truncated or corrupt. The chunk is untouched on failure.
+	*/
+	bool readChunk( CChunk *pChunk );
+
+	/** The number of bytes consumed since begin */
+	inline size_t getBytesRead() const { return m_readOffset; }
+
+	inline const ChunkCodecStats& getStats() const { return m_stats; }
+	inline void resetStats() { m_stats = ChunkCodecStats(); }
+};
+
+/** Kinds of sample chunks round tripped by BenchmarkChunkCodec */
+enum ChunkCodecSamples : uint8_t
+{
+	/** A single block type, stored as one ID */
+	CODEC_SAMPLE_UNIFORM = 0,
+	/** Layered terrain with few long runs */
+	CODEC_SAMPLE_LAYERED,
+	/** A small palette of block types scattered at random */
+	CODEC_SAMPLE_PALETTE,
+	/** A different block ID in every block, the largest possible palette */
+	CODEC_SAMPLE_FULL,
+	CODEC_SAMPLE_COUNT
+};
+
+/**
+* @brief Results of BenchmarkChunkCodec, one entry per ChunkCodecSamples.
+*/
+struct ChunkCodecBenchmark
+{
+	/** The mode the encoder chose for each sample */
+	ChunkCodecModes modes[CODEC_SAMPLE_COUNT];
+	/** Set if every decode of the sample matched the blocks it was encoded from */
+	bool roundTrip[CODEC_SAMPLE_COUNT];
+	ChunkCodecStats encodeStats[CODEC_SAMPLE_COUNT];
+	ChunkCodecStats decodeStats[CODEC_SAMPLE_COUNT];
+};
+
+/**
+* @brief Returns the display name of a sample kind.
+*/
+const char* GetChunkCodecSampleName( ChunkCodecSamples sample );
+/**
+* @brief Encode and decode each kind of sample chunk, checking the decoded blocks and timing both directions.
+* @details Every sample is encoded repeatCount times into one buffer and decoded back, so the timings cover the
+*	uniform, runs and bit plane paths separately.
+* @param[in]	repeatCount		How many times each sample is encoded and decoded.
+* @param[out]	pResults		Receives the chosen modes, round trip results and timings.
+* @returns True if every sample round tripped, false if any decode failed or did not match.
+*/
+bool BenchmarkChunkCodec( uint32_t repeatCount, ChunkCodecBenchmark *pResults );
@@ -15,6 +15,12 @@
 #define CONFIG_STR_REFRESH_RATE "WindowRefreshRate"
 #define CONFIG_STR_FOV "FOV"
 #define CONFIG_STR_WINDOW_MODE "WindowMode"
+/** See RenderBackendType */
+#define CONFIG_STR_RENDER_BACKEND "RenderBackend"
+/** Frames to run before quitting without a window, 0 to run until stopped */
+#define CONFIG_STR_HEADLESS_FRAME_LIMIT "HeadlessFrameLimit"
+/** Set to false to send every state change to the render backend, see CRenderStateCache */
+#define CONFIG_STR_RENDER_STATE_CACHE "RenderStateCache"
 
 #define CONFIG_STR_KEYBOARD_FORWARD "KeyboardForward"
 #define CONFIG_STR_KEYBOARD_BACKWARD "KeyboardBackward"
@@ -31,6 +37,7 @@ class CGraphics;
 class CConfig;
 class CUserInput;
 class CWorldRenderer;
+class CMeshWorkerPool;
 
 /**
 * @brief The client-sided handler.
@@ -51,6 +58,9 @@ private:
 
 	CUserInput *m_pUserInput;
 
+	/** Frames drawn without a window, and how many to draw before quitting */
+	unsigned int m_headlessFrameCount, m_headlessFrameLimit;
+
 	Entity testEntity;
 
 	void handleSDLEvents();
@@ -115,6 +125,12 @@ public:
 	*/
 	inline CConfig* getClientConfig() { return m_pClientConfig;  }
 
+	/**
+	* @brief Returns the workers that mesh chunks for the world renderer.
+	* @return Mesh workers, or a null pointer if the client has no world renderer.
+	*/
+	CMeshWorkerPool* getMeshWorkers();
+
 	/**
 	* @brief Returns the user input handler class
 	* @returns User input handler.
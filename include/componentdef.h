@@ -46,4 +46,17 @@ struct Transform3DComponent
 {
 	Rotation3D	rotation;
 	Scale3D		scale;
+};
+
+// Moving 3D objects collide with blocks as an axis-aligned box around their position
+struct AABBComponent
+{
+	glm::vec3	halfExtents;
+};
+
+struct VelocityComponent
+{
+	glm::vec3	velocity;
+	// Set while standing on a block
+	bool		onGround;
 };
\ No newline at end of file
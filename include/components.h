@@ -189,6 +189,32 @@ public:
 		return m_componentArray[m_entityToIndexMap[entity]];
 	}
 
+	/**
+	* @brief Get the index of an entities component in the dense component data.
+	* @param[out]	pIndex	The index of the component, untouched if the entity has none.
+	* @returns True if the entity has a component in this array, false otherwise.
+	*/
+	bool FindComponentIndex( Entity entity, size_t *pIndex ) const
+	{
+		auto it = m_entityToIndexMap.find( entity );
+		if( it == m_entityToIndexMap.end() )
+			return false;
+		(*pIndex) = it->second;
+		return true;
+	}
+
+	/**
+	* @brief The components of every entity, packed without gaps.
+	* @details Valid up to GetComponentCount, in no particular order. Adding or removing components moves them.
+	*/
+	inline const T* GetComponentData() const { return m_componentArray.data(); }
+	inline EntityInt GetComponentCount() const { return m_activeComponents; }
+	/** The entity the component at the given index of the dense component data belongs to */
+	inline Entity GetEntityAtIndex( size_t index ) const {
+		assert( index < m_activeComponents );
+		return m_indexToEntityMap.at( index );
+	}
+
 	/**
 	* @brief Destroy an entities data in the component array
 	*/
@@ -214,8 +240,16 @@ private:
 	std::unordered_map<const char*, std::shared_ptr<IComponentArray>> m_componentArrays;
 
 	ComponentType m_activeComponentTypes;
+public:
+	CComponentManager() {
+		m_activeComponentTypes = 0;
+	}
 
-	/** Retrieves a pointer to a component array of the given type, if registered. */
+	/**
+	* @brief Retrieves a pointer to a component array of the given type, if registered.
+	* @details Systems that touch every component of a type can walk the dense data of the array instead of
+	*	looking up each entity, see CComponentArray::GetComponentData.
+	*/
 	template<typename T>
 	std::shared_ptr<CComponentArray<T>> GetComponentArray()
 	{
@@ -225,10 +259,6 @@ private:
 
 		return std::static_pointer_cast<CComponentArray<T>>( m_componentArrays[typeName] );
 	}
-public:
-	CComponentManager() {
-		m_activeComponentTypes = 0;
-	}
 
 	/**
 	* @brief Registers a component type with the manager.
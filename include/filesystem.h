@@ -30,7 +30,8 @@ enum FilesystemLocations
 	LOCATION_DATA,
 	LOCATION_SHADERS,
 	LOCATION_LOCALIZATION,
-	LOCATION_MODELS
+	LOCATION_MODELS,
+	LOCATION_SAVES
 };
 
 /**
@@ -56,7 +57,8 @@ public:
 		{LOCATION_DATA,			"data"},
 		{LOCATION_SHADERS,		"data/shaders"},
 		{LOCATION_LOCALIZATION,	"data/localization"},
-		{LOCATION_MODELS,		"models"}
+		{LOCATION_MODELS,		"models"},
+		{LOCATION_SAVES,		"saves"}
 	};
 
 	/**
@@ -0,0 +1,195 @@
+/**
+* @file fluid.h
+* @brief Contains the CFluidSimulator class, which moves water through the loaded chunks as a cellular automaton.
+* @details Every cell holds from 0 to #FLUID_LEVEL_MAX units of water. Each update, a cell pours as much as fits into
+*	the cell below, then evens itself out with lower neighbours on the same level. The simulation never creates or loses
+*	water, so floods spread thinner until they settle. Only edits do: placing water fills a cell, and replacing
+*	water with another block removes all of it. Partial water an edit leaves alone keeps its level.
+*
+*	Only active cells are visited. Each chunk keeps a sparse set of the cells that may move, and a cell is added
+*	when it or a neighbour changes. Settled water costs nothing.
+*
+*	Chunks are updated in parallel in eight passes, by the parity of their coordinates on each axis. Chunks in the
+*	same pass are never neighbours, so the cells a chunk reads across its faces do not change under it. Water that
+*	crosses into a neighbour is posted as a message and delivered between passes.
+*
+*	Each update visits a limited number of cells, shared between the active chunks. Cells beyond a chunk's share
+*	stay active for the next update, so a large flood slows down instead of stalling the server.
+*
+* @author Timothy Volpe
+* @date 5/17/2020
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <functional>
+#include <unordered_map>
+#include "chunk.h"
+#include "threadpool.h"
+
+/** Units of water in a full cell, blocks of water placed or loaded are full */
+#define FLUID_LEVEL_MAX 8
+/** World ticks between fluid updates */
+#define FLUID_TICK_INTERVAL 4
+/** Most cells visited in one update across every chunk, the rest carry over to the next update */
+#define FLUID_MAX_CELLS_PER_UPDATE 65536
+
+/** Chunk passes run one after another, chunks in the same pass are never neighbours */
+#define FLUID_PASS_COUNT 8
+
+class CGame;
+
+/**
+* @brief Counts of fluid updates.
+*/
+struct FluidStats
+{
+	uint64_t updateCount;
+	/** Active cells visited */
+	uint64_t cellCount;
+	/** Active cells left for a later update because of the limit */
+	uint64_t deferredCount;
+	double seconds;
+
+	inline double getCellsPerSecond() const { return seconds > 0.0 ? (double)cellCount / seconds : 0.0; }
+	inline double getMillisecondsPerUpdate() const { return updateCount > 0 ? seconds * 1000.0 / (double)updateCount : 0.0; }
+};
+
+/**
+* @brief Simulates water in the loaded chunks.
+* @details Not thread-safe, must be used from the thread that owns the chunk store. Parallel work is done internally.
+*	Water levels are not saved, water loaded from a save is full.
+*
+* @author Timothy Volpe
+* @date 5/17/2020
+*/
+class CFluidSimulator
+{
+public:
+	/** Called when a cell gains or loses all its water, to set the block to water or air */
+	typedef std::function<void( int32_t x, int32_t y, int32_t z, BlockId block )> BlockChangeCallback;
+private:
+	struct FluidChunk
+	{
+		/** Water in every cell, laid out as described by ChunkBlockIndex */
+		std::vector<uint8_t> levels;
+		/** Cells to visit, the ones left over from the last update first */
+		std::vector<uint16_t> active;
+		/** Cells activated while visiting, visited next update */
+		std::vector<uint16_t> pending;
+		/** One bit per cell, set while it is in active or pending */
+		std::vector<uint64_t> activeBits;
+		/** Cells whose block may need to change between air and water */
+		std::vector<uint16_t> changed;
+		/** Set once the chunk had nothing to visit at the end of an update */
+		bool idle;
+	};
+	struct FluidMessage
+	{
+		ChunkPos target;
+		uint16_t index;
+		/** Units of water arriving, 0 to only activate the cell */
+		uint8_t amount;
+	};
+	struct FluidTask
+	{
+		ChunkPos position;
+		CChunk *pChunk;
+		FluidChunk *pFluid;
+		/** Chunks across each face, see BlockFaces. Null if not loaded or no water state. */
+		CChunk *pNeighbourChunks[FACE_COUNT];
+		FluidChunk *pNeighbourFluids[FACE_COUNT];
+		size_t cellBudget;
+		size_t cellCount;
+		std::vector<FluidMessage> outbox;
+	};
+
+	CGame *m_pGameHandle;
+
+	CChunkStore *m_pChunkStore;
+	CThreadPool m_threadPool;
+
+	std::unordered_map<ChunkPos, FluidChunk, ChunkPosHash> m_chunks;
+	std::vector<FluidTask> m_tasks;
+	/** Tasks from the fewest active cells to the most, for sharing out the cell limit */
+	std::vector<size_t> m_taskOrder;
+	std::vector<size_t> m_passTasks[FLUID_PASS_COUNT];
+	uint64_t m_updateCount;
+
+	FluidStats m_stats;
+
+	/** Get the water state of a chunk, created from its blocks the first time, or null if the chunk is not loaded */
+	FluidChunk* getFluidChunk( const ChunkPos &position );
+
+	static inline bool IsCellOpen( BlockId block ) { return block == BLOCK_AIR || block == BLOCK_WATER; }
+	static inline void ActivateCell( FluidChunk &fluid, uint32_t index ) {
+		uint64_t bit = (uint64_t)1 << (index & 63);
+		if( fluid.levels[index] == 0 || (fluid.activeBits[index >> 6] & bit) )
+			return;
+		fluid.activeBits[index >> 6] |= bit;
+		fluid.pending.push_back( (uint16_t)index );
+	}
+	/** Activate a cell by world block coordinates, from the owning thread */
+	void activate( int32_t x, int32_t y, int32_t z );
+	/** Activate a cell and the cells that could flow into it */
+	void activateAround( int32_t x, int32_t y, int32_t z );
+	/** Activate the cells with water on one face of a chunk, see BlockFaces */
+	void activateBorder( FluidChunk &fluid, uint8_t face );
+
+	/** Visit the active cells of one chunk, only writes to that chunk */
+	void processChunk( FluidTask &task );
+	/** Move water out of one cell, returns true if any moved */
+	bool processCell( FluidTask &task, uint32_t index );
+	void deliverMessages( FluidTask &task );
+	/** Set the blocks of cells that filled or emptied, and drop the state of chunks that settled */
+	void applyChanges( const BlockChangeCallback &callback );
+public:
+	CFluidSimulator( CGame *pGameHandle );
+	~CFluidSimulator();
+
+	/**
+	* @brief Start the simulation threads.
+	* @param[in]	pChunkStore		The chunks to simulate.
+	* @returns True if successful, false if otherwise.
+	*/
+	bool initialize( CChunkStore *pChunkStore );
+	/**
+	* @brief Stop the simulation threads and drop the water state.
+	*/
+	void shutdown();
+
+	/**
+	* @brief Wake the water around a block edit that was not made by the simulator. The block must already be set.
+	* @details Placing water adds a full cell, replacing water removes it.
+	* @param[in]	x, y, z		World block coordinates of the edit.
+	* @param[in]	oldBlock	The block that was replaced.
+	* @param[in]	newBlock	The block that was placed.
+	*/
+	void onBlockChanged( int32_t x, int32_t y, int32_t z, BlockId oldBlock, BlockId newBlock );
+	/**
+	* @brief Wake the water held back at the edges of the chunks around a newly loaded column.
+	*/
+	void onColumnLoaded( int32_t columnX, int32_t columnZ );
+	/**
+	* @brief Update the water state of chunks whose blocks were replaced in bulk, and wake the water in and around them.
+	* @details Cells that are no longer water are emptied and new water is full, partly filled cells the edit did not
+	*	touch keep their level.
+	*/
+	void onChunksEdited( const std::vector<ChunkPos> &positions );
+
+	/**
+	* @brief Run one update of every chunk with active water.
+	* @param[in]	callback	Sets the blocks of cells that filled or emptied.
+	*/
+	void update( const BlockChangeCallback &callback );
+
+	/**
+	* @brief Get the water level at a world block, 0 if there is none or the chunk is not loaded.
+	*/
+	uint8_t getLevel( int32_t x, int32_t y, int32_t z );
+
+	inline const FluidStats& getStats() const { return m_stats; }
+	inline void resetStats() { m_stats = FluidStats(); }
+};
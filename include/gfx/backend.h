@@ -0,0 +1,278 @@
+/**
+* @file backend.h
+* @brief Contains the IRenderBackend interface, which every OpenGL call made by the client goes through.
+* @details The methods follow the OpenGL functions of the same name. CGLRenderBackend passes them on to the driver,
+*	CNullRenderBackend records them without a context, see nullbackend.h. Which one is used is read from the client
+*	config by CGraphics, and the active one can be reached from anywhere with CGraphics::GetActiveBackend.
+*
+*	Both backends count the commands, draws and bytes uploaded, so a frame can be measured the same way with and
+*	without a GPU.
+*
+* @author Timothy Volpe
+* @date 5/17/2020
+*/
+
+#pragma once
+
+#include <cstdint>
+#include "gfx/graphics.h"
+
+/** Values of the render backend config property */
+enum RenderBackendType : int
+{
+	RENDER_BACKEND_OPENGL = 0,
+	/** Records commands without a window or context, see CNullRenderBackend */
+	RENDER_BACKEND_NULL = 1
+};
+#define DEFAULT_RENDER_BACKEND RenderBackendType::RENDER_BACKEND_OPENGL
+
+/**
+* @brief Counts of commands sent to a render backend.
+*/
+struct RenderBackendStats
+{
+	uint64_t frameCount;
+	/** Every call except getError */
+	uint64_t commandCount;
+	uint64_t drawCount;
+	/** Vertices or indices drawn */
+	uint64_t vertexCount;
+	/** Binds, capability and fixed state changes, uniforms and attribute setup */
+	uint64_t stateChangeCount;
+	/** State changes that set what was already set, only counted by backends that track state */
+	uint64_t redundantStateCount;
+	/** State changes that never reached the backend, counted by CRenderStateCache */
+	uint64_t skippedStateCount;
+	/** Bytes of data passed to buffers */
+	uint64_t uploadedBytes;
+	/** Commands that would have failed, only counted by backends that validate */
+	uint64_t errorCount;
+
+	inline double getCommandsPerFrame() const { return frameCount ? (double)commandCount / (double)frameCount : 0.0; }
+	inline double getDrawsPerFrame() const { return frameCount ? (double)drawCount / (double)frameCount : 0.0; }
+	inline double getRedundantStatePerFrame() const { return frameCount ? (double)redundantStateCount / (double)frameCount : 0.0; }
+	inline double getSkippedStatePerFrame() const { return frameCount ? (double)skippedStateCount / (double)frameCount : 0.0; }
+	inline double getUploadedBytesPerFrame() const { return frameCount ? (double)uploadedBytes / (double)frameCount : 0.0; }
+};
+
+/**
+* @brief The OpenGL functions used by the client.
+* @details Parameters and errors are those of the OpenGL function with the same name. Errors are reported through
+*	getError, as with OpenGL.
+*/
+class IRenderBackend
+{
+public:
+	virtual ~IRenderBackend() {}
+
+	/**
+	* @brief Prepare the backend, the OpenGL backend needs a current context.
+	* @returns True if successful, false if otherwise.
+	*/
+	virtual bool initialize() = 0;
+	virtual void shutdown() = 0;
+
+	virtual const char* getName() const = 0;
+	/** The feature set available, see GLSupportLevel */
+	virtual char getSupportLevel() const = 0;
+	virtual bool isExtensionSupported( const char *pExtension ) = 0;
+	/** Called once the frame has been drawn */
+	virtual void endFrame() = 0;
+
+	virtual const RenderBackendStats& getStats() const = 0;
+	virtual void resetStats() = 0;
+
+	virtual GLenum getError() = 0;
+	/** Only implementation limits are queried, not bound state */
+	virtual void getIntegerv( GLenum name, GLint *pValue ) = 0;
+	virtual const char* getString( GLenum name ) = 0;
+
+	// Fixed function state
+	virtual void enable( GLenum capability ) = 0;
+	virtual void disable( GLenum capability ) = 0;
+	virtual void depthFunc( GLenum function ) = 0;
+	virtual void cullFace( GLenum face ) = 0;
+	virtual void frontFace( GLenum winding ) = 0;
+	virtual void pointSize( GLfloat size ) = 0;
+	virtual void clearColor( GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha ) = 0;
+	virtual void clear( GLbitfield mask ) = 0;
+
+	// Buffer objects
+	virtual void genBuffers( GLsizei count, GLuint *pBuffers ) = 0;
+	virtual void deleteBuffers( GLsizei count, const GLuint *pBuffers ) = 0;
+	virtual void bindBuffer( GLenum target, GLuint buffer ) = 0;
+	virtual void bindBufferRange( GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size ) = 0;
+	virtual void bufferData( GLenum target, GLsizeiptr size, const void *pData, GLenum usage ) = 0;
+	virtual void bufferStorage( GLenum target, GLsizeiptr size, const void *pData, GLbitfield flags ) = 0;
+	virtual void bufferSubData( GLenum target, GLintptr offset, GLsizeiptr size, const void *pData ) = 0;
+	/** Persistent mappings need storage from bufferStorage with the same map bits */
+	virtual void* mapBufferRange( GLenum target, GLintptr offset, GLsizeiptr length, GLbitfield access ) = 0;
+	virtual GLboolean unmapBuffer( GLenum target ) = 0;
+
+	// Sync objects
+	virtual GLsync fenceSync( GLenum condition, GLbitfield flags ) = 0;
+	virtual GLenum clientWaitSync( GLsync sync, GLbitfield flags, GLuint64 timeout ) = 0;
+	virtual void deleteSync( GLsync sync ) = 0;
+
+	// Vertex arrays
+	virtual void genVertexArrays( GLsizei count, GLuint *pArrays ) = 0;
+	virtual void deleteVertexArrays( GLsizei count, const GLuint *pArrays ) = 0;
+	virtual void bindVertexArray( GLuint array ) = 0;
+	virtual void vertexAttribPointer( GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride, const void *pPointer ) = 0;
+	virtual void vertexAttribIPointer( GLuint index, GLint size, GLenum type, GLsizei stride, const void *pPointer ) = 0;
+	virtual void vertexAttribLPointer( GLuint index, GLint size, GLenum type, GLsizei stride, const void *pPointer ) = 0;
+	virtual void enableVertexAttribArray( GLuint index ) = 0;
+	virtual void vertexAttribDivisor( GLuint index, GLuint divisor ) = 0;
+	/** Sets the value an attribute reads while its array is disabled */
+	virtual void vertexAttrib3f( GLuint index, GLfloat x, GLfloat y, GLfloat z ) = 0;
+
+	// Shaders and programs
+	virtual GLuint createShader( GLenum type ) = 0;
+	virtual void deleteShader( GLuint shader ) = 0;
+	/** Takes a single null terminated source string */
+	virtual void shaderSource( GLuint shader, const GLchar *pSource ) = 0;
+	virtual void compileShader( GLuint shader ) = 0;
+	virtual void getShaderiv( GLuint shader, GLenum name, GLint *pValue ) = 0;
+	virtual void getShaderInfoLog( GLuint shader, GLsizei maxLength, GLsizei *pLength, GLchar *pLog ) = 0;
+	virtual GLuint createProgram() = 0;
+	virtual void deleteProgram( GLuint program ) = 0;
+	virtual void attachShader( GLuint program, GLuint shader ) = 0;
+	virtual void detachShader( GLuint program, GLuint shader ) = 0;
+	virtual void linkProgram( GLuint program ) = 0;
+	virtual void getProgramiv( GLuint program, GLenum name, GLint *pValue ) = 0;
+	virtual void getProgramInfoLog( GLuint program, GLsizei maxLength, GLsizei *pLength, GLchar *pLog ) = 0;
+	virtual void useProgram( GLuint program ) = 0;
+	/** Program binaries need GL_ARB_get_program_binary */
+	virtual void programParameteri( GLuint program, GLenum name, GLint value ) = 0;
+	virtual void getProgramBinary( GLuint program, GLsizei bufferSize, GLsizei *pLength, GLenum *pFormat, void *pBinary ) = 0;
+	virtual void programBinary( GLuint program, GLenum format, const void *pBinary, GLsizei length ) = 0;
+
+	// Uniforms
+	virtual GLint getUniformLocation( GLuint program, const GLchar *pName ) = 0;
+	virtual GLuint getUniformBlockIndex( GLuint program, const GLchar *pName ) = 0;
+	virtual void uniformBlockBinding( GLuint program, GLuint blockIndex, GLuint binding ) = 0;
+	virtual void uniform3fv( GLint location, GLsizei count, const GLfloat *pValue ) = 0;
+	virtual void uniformMatrix4fv( GLint location, GLsizei count, GLboolean transpose, const GLfloat *pValue ) = 0;
+
+	// Drawing
+	virtual void drawArrays( GLenum mode, GLint first, GLsizei count ) = 0;
+	virtual void drawElements( GLenum mode, GLsizei count, GLenum type, const void *pIndices ) = 0;
+	virtual void drawElementsBaseVertex( GLenum mode, GLsizei count, GLenum type, const void *pIndices, GLint baseVertex ) = 0;
+	virtual void drawElementsInstanced( GLenum mode, GLsizei count, GLenum type, const void *pIndices, GLsizei instanceCount ) = 0;
+	/** Needs GL_ARB_multi_draw_indirect, pIndirect is an offset into the draw indirect buffer */
+	virtual void multiDrawElementsIndirect( GLenum mode, GLenum type, const void *pIndirect, GLsizei drawCount, GLsizei stride ) = 0;
+};
+
+/**
+* @brief Passes every command on to OpenGL.
+* @details Needs an OpenGL context to be current on the calling thread before initialize is called.
+*	initialize loads the OpenGL functions with GLEW and finds the supported feature set.
+*
+* @author Timothy Volpe
+* @date 5/17/2020
+*/
+class CGLRenderBackend : public IRenderBackend
+{
+private:
+	static bool GLEWInitialized;
+
+	CGame *m_pGameHandle;
+
+	char m_glSupportLevel;
+
+	RenderBackendStats m_stats;
+public:
+#ifdef _DEBUG
+	/**
+	* @brief See debugCallback
+	* @details Reroutes to the debugCallback of the CGLRenderBackend class pointer stored in userParam
+	*/
+	static void MasterDebugCallback( GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length, const GLchar* message, const void* userParam );
+	/**
+	* @brief The debug callback for openGL 4.3+ in debug mode
+	* @details See glDebugMessageCallback
+	*/
+	void debugCallback( GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length, const GLchar* message );
+#endif
+
+	CGLRenderBackend( CGame *pGameHandle );
+	~CGLRenderBackend();
+
+	bool initialize();
+	void shutdown();
+
+	inline const char* getName() const { return "OpenGL"; }
+	inline char getSupportLevel() const { return m_glSupportLevel; }
+	bool isExtensionSupported( const char *pExtension );
+	void endFrame();
+
+	inline const RenderBackendStats& getStats() const { return m_stats; }
+	inline void resetStats() { m_stats = RenderBackendStats(); }
+
+	GLenum getError();
+	void getIntegerv( GLenum name, GLint *pValue );
+	const char* getString( GLenum name );
+
+	void enable( GLenum capability );
+	void disable( GLenum capability );
+	void depthFunc( GLenum function );
+	void cullFace( GLenum face );
+	void frontFace( GLenum winding );
+	void pointSize( GLfloat size );
+	void clearColor( GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha );
+	void clear( GLbitfield mask );
+
+	void genBuffers( GLsizei count, GLuint *pBuffers );
+	void deleteBuffers( GLsizei count, const GLuint *pBuffers );
+	void bindBuffer( GLenum target, GLuint buffer );
+	void bindBufferRange( GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size );
+	void bufferData( GLenum target, GLsizeiptr size, const void *pData, GLenum usage );
+	void bufferStorage( GLenum target, GLsizeiptr size, const void *pData, GLbitfield flags );
+	void bufferSubData( GLenum target, GLintptr offset, GLsizeiptr size, const void *pData );
+	void* mapBufferRange( GLenum target, GLintptr offset, GLsizeiptr length, GLbitfield access );
+	GLboolean unmapBuffer( GLenum target );
+
+	GLsync fenceSync( GLenum condition, GLbitfield flags );
+	GLenum clientWaitSync( GLsync sync, GLbitfield flags, GLuint64 timeout );
+	void deleteSync( GLsync sync );
+
+	void genVertexArrays( GLsizei count, GLuint *pArrays );
+	void deleteVertexArrays( GLsizei count, const GLuint *pArrays );
+	void bindVertexArray( GLuint array );
+	void vertexAttribPointer( GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride, const void *pPointer );
+	void vertexAttribIPointer( GLuint index, GLint size, GLenum type, GLsizei stride, const void *pPointer );
+	void vertexAttribLPointer( GLuint index, GLint size, GLenum type, GLsizei stride, const void *pPointer );
+	void enableVertexAttribArray( GLuint index );
+	void vertexAttribDivisor( GLuint index, GLuint divisor );
+	void vertexAttrib3f( GLuint index, GLfloat x, GLfloat y, GLfloat z );
+
+	GLuint createShader( GLenum type );
+	void deleteShader( GLuint shader );
+	void shaderSource( GLuint shader, const GLchar *pSource );
+	void compileShader( GLuint shader );
+	void getShaderiv( GLuint shader, GLenum name, GLint *pValue );
+	void getShaderInfoLog( GLuint shader, GLsizei maxLength, GLsizei *pLength, GLchar *pLog );
+	GLuint createProgram();
+	void deleteProgram( GLuint program );
+	void attachShader( GLuint program, GLuint shader );
+	void detachShader( GLuint program, GLuint shader );
+	void linkProgram( GLuint program );
+	void getProgramiv( GLuint program, GLenum name, GLint *pValue );
+	void getProgramInfoLog( GLuint program, GLsizei maxLength, GLsizei *pLength, GLchar *pLog );
+	void useProgram( GLuint program );
+	void programParameteri( GLuint program, GLenum name, GLint value );
+	void getProgramBinary( GLuint program, GLsizei bufferSize, GLsizei *pLength, GLenum *pFormat, void *pBinary );
+	void programBinary( GLuint program, GLenum format, const void *pBinary, GLsizei length );
+
+	GLint getUniformLocation( GLuint program, const GLchar *pName );
+	GLuint getUniformBlockIndex( GLuint program, const GLchar *pName );
+	void uniformBlockBinding( GLuint program, GLuint blockIndex, GLuint binding );
+	void uniform3fv( GLint location, GLsizei count, const GLfloat *pValue );
+	void uniformMatrix4fv( GLint location, GLsizei count, GLboolean transpose, const GLfloat *pValue );
+
+	void drawArrays( GLenum mode, GLint first, GLsizei count );
+	void drawElements( GLenum mode, GLsizei count, GLenum type, const void *pIndices );
+	void drawElementsBaseVertex( GLenum mode, GLsizei count, GLenum type, const void *pIndices, GLint baseVertex );
+	void drawElementsInstanced( GLenum mode, GLsizei count, GLenum type, const void *pIndices, GLsizei instanceCount );
+	void multiDrawElementsIndirect( GLenum mode, GLenum type, const void *pIndirect, GLsizei drawCount, GLsizei stride );
+};
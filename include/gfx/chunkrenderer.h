@@ -0,0 +1,169 @@
+/**
+* @file chunkrenderer.h
+* @brief Contains the CChunkRenderer class, which uploads and draws chunk meshes.
+* @details Meshes are built by a CMeshWorkerPool owned by the chunk renderer, from chunk copies submitted by the world.
+*	The shader program is expected to read the two packed ChunkVertex words from unsigned integer attributes 0 and 1,
+*	and to take the chunk origin in world blocks from the vec3 attribute at #CHUNK_ORIGIN_ATTRIB.
+*
+* @author Timothy Volpe
+* @date 5/15/2020
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <unordered_map>
+#include "chunk.h"
+#include "gfx/frustum.h"
+#include "gfx/visibility.h"
+#include "gfx/occlusion.h"
+#include "gfx/mesher.h"
+#include "gfx/vertexarena.h"
+#include "gfx/streambuffer.h"
+#include "gfx/graphics.h"
+
+/** Name of the shader program chunks are drawn with */
+#define CHUNK_SHADER_PROGRAM "voxel"
+#define CHUNK_ORIGIN_ATTRIB 2
+/** Bytes of mesh data uploaded per frame, at least one mesh is always uploaded */
+#define CHUNK_UPLOAD_BUDGET_BYTES (2*1024*1024)
+/** Initial number of quads the shared index buffer covers */
+#define CHUNK_INDEX_BUFFER_QUADS 16384
+/** Vertices in each buffer of the chunk vertex arena, 16 MB of vertices */
+#define CHUNK_ARENA_PAGE_VERTICES (2*1024*1024)
+/** Initial number of chunks the draw stream buffer holds each frame */
+#define CHUNK_DRAW_BUFFER_DRAWS 4096
+
+class CGame;
+class CMeshWorkerPool;
+struct MeshResult;
+
+/**
+* @brief Keeps the GPU copies of chunk meshes and submits them for drawing.
+* @details Every frame, finished meshes are collected from the workers, stale ones are dropped, and the rest are
+*	uploaded closest to the camera first until the upload budget is spent. Meshes left over wait for the next frame.
+*	All of the quads share one index buffer, see CChunkMesher::BuildQuadIndices. The vertices are packed into the
+*	few large buffers of a CVertexArena, and the chunks in each buffer share one vertex array.
+*
+*	Whenever the camera enters another chunk, meshes whose level of detail no longer fits their distance are
+*	requested again. The old mesh is drawn until the new one arrives.
+*
+*	Before drawing, the bounds of every mesh are tested against the view frustum. Meshes in view are only submitted
+*	if a CChunkVisibilityGraph search from the camera chunk reaches them, so terrain hidden behind solid ground is
+*	skipped. The largest opaque quads of the nearest of those meshes are then drawn into a COcclusionCuller, and meshes
+*	whose bounds are entirely behind them are not submitted either.
+*
+*	If the GPU supports multi draw indirect and base instance, a draw command is written for every chunk left and
+*	each arena buffer is drawn with one multi draw. The chunk origins are read from an instanced attribute with one
+*	origin per draw, indexed by the base instance. Both are written to a CStreamBuffer every frame. Otherwise every
+*	chunk is submitted alone, with a constant origin attribute.
+*
+* @author Timothy Volpe
+* @date 5/15/2020
+*/
+class CChunkRenderer
+{
+private:
+	struct ChunkRenderData
+	{
+		VertexArenaBlock vertices;
+		unsigned int indexCount;
+		uint32_t version;
+		uint8_t lod;
+		/** Set once the chunk was asked to be meshed at another level of detail */
+		bool remeshRequested;
+		/** Index of the mesh bounds in the culler */
+		uint32_t cullIndex;
+		/** Mesh bounds in world blocks */
+		glm::vec3 boundsMin, boundsMax;
+		std::vector<ChunkOccluder> occluders;
+	};
+	/** The chunk of each box in the culler, at the same index */
+	struct CullEntry
+	{
+		ChunkPos position;
+		ChunkRenderData *pRenderData;
+	};
+
+	CGame *m_pGameHandle;
+
+	CMeshWorkerPool *m_pMeshWorkers;
+
+	unsigned int m_shaderIndex;
+
+	std::unordered_map<ChunkPos, ChunkRenderData, ChunkPosHash> m_chunkMeshes;
+	CFrustumCuller m_culler;
+	std::vector<CullEntry> m_cullEntries;
+	std::vector<uint32_t> m_visibleChunks;
+	/** Face connections of every chunk with a mesh result, including chunks with nothing to draw */
+	CChunkVisibilityGraph m_visibility;
+	COcclusionCuller m_occlusion;
+	/** Current meshes that did not fit in the upload budget yet */
+	std::vector<MeshResult*> m_readyMeshes;
+	ChunkPos m_cameraChunk;
+	/** Camera chunk the levels of detail were last checked against */
+	ChunkPos m_lodCameraChunk;
+
+	std::shared_ptr<CBufferObject> m_indexBuffer;
+	std::vector<uint32_t> m_quadIndices;
+	uint32_t m_indexBufferQuads;
+
+	CVertexArena m_vertexArena;
+	/** Vertex array of each arena buffer, with the shared index buffer and the draw stream buffer */
+	std::vector<std::shared_ptr<CVertexArray>> m_pageArrays;
+
+	/** Set if every arena buffer is drawn with one multi draw */
+	bool m_multiDrawIndirect;
+	/** Draw commands and chunk origins, written every frame */
+	CStreamBuffer m_drawStream;
+	/** Draws the stream buffer has room for each frame */
+	uint32_t m_drawStreamDraws;
+	/** Chunks drawn from each arena buffer this frame, then the first command of each */
+	std::vector<uint32_t> m_pageDrawOffsets;
+
+	/** Make sure the shared index buffer covers the given number of quads */
+	void reserveIndexBuffer( uint32_t quadCount );
+	/** Make sure the draw stream buffer has room for the given number of draws each frame */
+	bool reserveDrawStream( uint32_t drawCount );
+	/** Create the vertex arrays of arena buffers that do not have one yet */
+	bool createPageArrays();
+	/** Submit the visible chunks, with one multi draw per arena buffer */
+	void submitMultiDraws( const std::vector<uint32_t> &drawChunks );
+	/** Replace the GPU copy of a chunk mesh, returns the number of bytes uploaded */
+	size_t uploadMesh( const MeshResult *pResult );
+	/** Free the GPU copy of a chunk mesh, if there is one */
+	void removeMesh( const ChunkPos &position );
+	/** Ask for meshes at the wrong level of detail for their distance to be meshed again */
+	void selectLevelsOfDetail();
+public:
+	CChunkRenderer( CGame *pGameHandle );
+	~CChunkRenderer();
+
+	/**
+	* @brief Start the mesh workers and find the chunk shader.
+	* @details A missing shader program only disables drawing, chunks are still meshed and uploaded.
+	* @returns True if successful, false if otherwise.
+	*/
+	bool initialize();
+	/**
+	* @brief Stop the mesh workers and free every chunk mesh.
+	*/
+	void destroy();
+
+	/**
+	* @brief Collect finished meshes and upload as many as the budget allows.
+	*/
+	void update();
+	/**
+	* @brief Submit every chunk mesh for drawing.
+	*/
+	void render();
+
+	/**
+	* @brief Returns the pool that chunk copies are submitted to for meshing.
+	*/
+	inline CMeshWorkerPool* getMeshWorkers() { return m_pMeshWorkers; }
+	inline size_t getChunkMeshCount() const { return m_chunkMeshes.size(); }
+};
@@ -0,0 +1,115 @@
+/**
+* @file frustum.h
+* @brief Contains the CFrustumCuller class, which finds the boxes inside the view frustum.
+* @details Boxes are kept as centers and half extents in separate arrays for each axis, so one plane can be tested
+*	against several boxes at once. A box is outside if it is entirely behind any one plane. Eight boxes are tested
+*	at a time with AVX if the CPU has it, otherwise four with SSE. The AVX kernel is built on its own with AVX enabled,
+*	see CMakeLists.txt, and picked when the culler is created.
+*
+*	The test is conservative. A box near a corner of the frustum may pass without being visible, but a visible box
+*	never fails.
+*
+* @author Timothy Volpe
+* @date 5/17/2020
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+
+/** Left, right, bottom, top, near and far */
+#define FRUSTUM_PLANE_COUNT 6
+
+/**
+* @brief Get the frustum planes of a combined projection and view matrix.
+* @details Each plane is (normal, distance), a point is in front of it if dot( normal, point ) + distance >= 0.
+*	Planes are not normalized, which does not change which side of them a point is on.
+* @param[in]	viewProjection	The projection matrix times the view matrix.
+* @param[out]	pPlanes			Receives #FRUSTUM_PLANE_COUNT planes.
+*/
+void ExtractFrustumPlanes( const glm::mat4 &viewProjection, glm::vec4 *pPlanes );
+
+/**
+* @brief Test one box against the frustum, see CFrustumCuller for testing many.
+* @param[in]	pPlanes		#FRUSTUM_PLANE_COUNT planes, see ExtractFrustumPlanes.
+* @returns True if the box is at least partly in front of every plane.
+*/
+bool IsBoxInFrustum( const glm::vec4 *pPlanes, const glm::vec3 &minimum, const glm::vec3 &maximum );
+
+#ifdef FRUSTUM_AVX_SUPPORTED
+/**
+* @brief Test boxes against the frustum eight at a time with AVX, used by CFrustumCuller. The CPU must support AVX.
+* @param[in]	pPlanes			#FRUSTUM_PLANE_COUNT planes of four floats.
+* @param[in]	pAbsNormals		The absolute value of the normal of each plane, three floats per plane.
+* @param[in]	ppBoxArrays		Center x, y and z then extent x, y and z, one array of boxCount floats each.
+* @param[out]	pVisible		Receives the indices of the visible boxes, starting at index *pVisibleCount.
+* @param[in,out]	pVisibleCount	The number of indices in pVisible, updated with the ones added.
+* @returns The number of boxes tested, a multiple of eight. The remaining boxes are not tested.
+*/
+uint32_t CullBoxesAVX( const float *pPlanes, const float *pAbsNormals, const float *const *ppBoxArrays, uint32_t boxCount, uint32_t *pVisible, uint32_t *pVisibleCount );
+#endif
+
+/**
+* @brief Counts of culled boxes.
+*/
+struct CullStats
+{
+	uint64_t cullCount;
+	/** Boxes tested */
+	uint64_t boxCount;
+	/** Boxes found inside the frustum */
+	uint64_t visibleCount;
+	double seconds;
+
+	inline double getBoxesPerSecond() const { return seconds > 0.0 ? (double)boxCount / seconds : 0.0; }
+	inline double getVisibleFraction() const { return boxCount ? (double)visibleCount / (double)boxCount : 0.0; }
+};
+
+/**
+* @brief Tests axis-aligned boxes against a view frustum.
+* @details Boxes are referred to by index. Removing a box moves the last box into its place, like removing from a
+*	vector by swapping with the back, so the owner must update the index it keeps for the moved box.
+*
+* @author Timothy Volpe
+* @date 5/17/2020
+*/
+class CFrustumCuller
+{
+private:
+	std::vector<float> m_centerX, m_centerY, m_centerZ;
+	std::vector<float> m_extentX, m_extentY, m_extentZ;
+
+	/** Set if the AVX kernel was built and the CPU supports it */
+	bool m_useAVX;
+
+	CullStats m_stats;
+public:
+	CFrustumCuller();
+	~CFrustumCuller();
+
+	/**
+	* @brief Add a box.
+	* @returns The index of the box, which is the number of boxes before it was added.
+	*/
+	uint32_t addBox( const glm::vec3 &minimum, const glm::vec3 &maximum );
+	/**
+	* @brief Remove a box, the last box takes its index.
+	*/
+	void removeBox( uint32_t index );
+	void clear();
+
+	/**
+	* @brief Find every box inside the frustum.
+	* @param[in]	pPlanes		#FRUSTUM_PLANE_COUNT planes, see ExtractFrustumPlanes.
+	* @param[out]	visible		Receives the indices of the visible boxes in increasing order. It is cleared first.
+	*/
+	void cull( const glm::vec4 *pPlanes, std::vector<uint32_t> &visible );
+
+	inline uint32_t getBoxCount() const { return (uint32_t)m_centerX.size(); }
+	inline bool isUsingAVX() const { return m_useAVX; }
+
+	inline const CullStats& getStats() const { return m_stats; }
+	inline void resetStats() { m_stats = CullStats(); }
+};
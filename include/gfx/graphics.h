@@ -26,15 +26,19 @@
 #include <gl\glew.h>
 #include <GL\GL.h>
 #include <glm/glm.hpp>
+#include <cstdint>
 #include <memory>
 #include <vector>
 #include <queue>
 #include <assert.h>
+#include "gfx/frustum.h"
 
 class CGame;
 class CShaderManager;
 class CVertexArray;
 class CCamera;
+class IRenderBackend;
+class CStreamBuffer;
 
 /**
 * @brief Defines which feature sets are support on the client computer
@@ -58,14 +62,71 @@ static const int GLSupportVersion[][2] ={ {0,0}, {3,3}, {4,1}, {4,6} };
 /** The GLSL version defines which shaders to load */
 static const int GLSLVersion[] ={ 0, 330, 410, 460 };
 
+/** Bits of the render job sort key, from the most significant */
+#define RENDER_KEY_SHADER_BITS 16
+#define RENDER_KEY_VERTEX_ARRAY_BITS 24
+#define RENDER_KEY_DEPTH_BITS 24
+/** Depth buckets per unit of view distance, the key saturates past 2^24 buckets */
+#define RENDER_KEY_DEPTH_SCALE 64.0f
+
+/**
+* @brief A draw submitted for the next frame.
+* @details Plain data, the vertex array is referenced by its GL name and must live until the frame is drawn.
+*	Jobs are drawn in the order of their sort key, which packs the shader, the vertex array and the view depth.
+*	Draws with the same shader are grouped so the program changes at most once per shader, and within a shader
+*	draws from the same vertex array are grouped so it is bound once. Only then do the closest draws go first, so
+*	the depth test discards more of what is behind them. Rebinding costs more than the overdraw saved.
+*/
 struct RenderJob
 {
-	std::shared_ptr<CVertexArray> vertexArray;
+	uint64_t sortKey;
+	GLuint vertexArrayId;
 	unsigned int shaderIndex;
+	/** Number of vertices, or indices if indexType is set, or draw commands if indirectBuffer is set */
 	unsigned int vertexCount;
+	GLenum primitiveType;
+	/** Type of the element buffer bound to the vertex array, or 0 to draw without indices */
+	GLenum indexType;
+	/** Added to every index, for meshes that share a vertex buffer, or the first vertex without indices */
+	GLint baseVertex;
+	/** Buffer of DrawElementsIndirectCommand to draw from, or 0 */
+	GLuint indirectBuffer;
+	/** Byte offset of the first command in the indirect buffer */
+	GLintptr indirectOffset;
+	/** Number of instances of an indexed draw, or 0 to draw without instancing */
+	GLuint instanceCount;
+	/** Vertex attribute without an array to set to offset just before drawing, or -1 for none */
+	GLint offsetAttrib;
+	glm::vec3 offset;
+	/** Offset of the DrawBlock of this draw in the uniform arena, or -1 for none */
+	GLintptr drawUniformOffset;
+};
+/**
+* @brief The layout of a command in a draw indirect buffer, see glMultiDrawElementsIndirect.
+*/
+struct DrawElementsIndirectCommand
+{
+	GLuint count;
+	GLuint instanceCount;
+	GLuint firstIndex;
+	GLint baseVertex;
+	GLuint baseInstance;
 };
 typedef std::pair<GLuint, unsigned int> ArrayShaderPair;
-bool RenderJobSort( RenderJob& a, RenderJob& b );
+/** A render job sort key and the index of its job */
+typedef std::pair<uint64_t, uint32_t> RenderJobKey;
+/**
+* @brief Pack a render job sort key, fields wider than their bits are clamped.
+*/
+uint64_t MakeRenderJobKey( unsigned int shaderIndex, float viewDepth, GLuint vertexArrayId );
+/**
+* @brief Sort render job keys by key with a least significant digit radix sort.
+* @details Sorts a byte at a time, skipping bytes that are the same in every key. The sort is stable, so
+*	jobs with equal keys are drawn in the order they were submitted.
+* @param[in,out]	keys		The keys to sort.
+* @param[in]		scratch		Storage for the passes, resized to the number of keys.
+*/
+void RadixSortRenderJobKeys( std::vector<RenderJobKey> &keys, std::vector<RenderJobKey> &scratch );
 
 enum WindowModes
 {
@@ -88,21 +149,31 @@ class CGraphics
 {
 private:
 	static int SDLReferenceCount;
-	static bool GLEWInitialized;
+	static IRenderBackend *ActiveBackend;
 
 	CGame *m_pGameHandle;
 
 	char m_glSupportLevel;
 
+	/** Set if the null render backend was chosen, there is no window */
+	bool m_headless;
 	SDL_Window *m_pSDLWindow;
 	SDL_GLContext m_sdlContext;
+	IRenderBackend *m_pBackend;
 
 	CShaderManager *m_pShaderManager;
 
 	std::vector<RenderJob> m_renderJobs;
+	std::vector<RenderJobKey> m_renderJobKeys, m_renderJobKeyScratch;
+	/** Flushed before every frame is drawn and told when it was */
+	std::vector<CStreamBuffer*> m_streamBuffers;
 
 	glm::mat4 m_projectionPerspMat, m_projectionOrthoMat;
 	std::shared_ptr<glm::mat4> m_viewMat;
+	/** The perspective projection times the view matrix, from the last update */
+	glm::mat4 m_viewProjectionMat;
+	/** Planes of the perspective view frustum, from the matrices of the last update */
+	glm::vec4 m_frustumPlanes[FRUSTUM_PLANE_COUNT];
 
 	std::shared_ptr<CCamera> m_activeCamera;
 
@@ -115,14 +186,14 @@ private:
 	* @returns True if successfully set video mode, false if there was an issue with the video modes.
 	*/
 	bool setupViewport();
+	/** Create the SDL window and the OpenGL context */
+	bool createWindow();
 public:
-#ifdef _DEBUG
 	/**
-	* @brief See debugCallback
-	* @details Reroutes to the debugCallback of the CGraphics class pointer stored in userParam
+	* @brief Get the render backend every OpenGL call goes through, for classes without a graphics handle.
+	* @returns The backend of the initialized graphics class, or null if there is none.
 	*/
-	static void MasterDebugCallback( GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length, const GLchar* message, const void* userParam );
-#endif
+	static inline IRenderBackend* GetActiveBackend() { return ActiveBackend; }
 
 	/**
 	* @brief Constructor. Initializes all variables to NULL or 0.
@@ -166,29 +237,75 @@ public:
 	*/
 	bool draw();
 
-	
-#ifdef _DEBUG
-	/**
-	* @brief The debug callback for openGL 4.3+ in debug mode
-	* @details See glDebugMessageCallback
-	*/
-	void debugCallback( GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length, const GLchar* message );
-#endif
-
 	/**
 	* @brief Submits a vertex array for rendering when the frame is drawn.
 	* @details The information passed to this function is saved and used to draw the frame. It is cleared after the draw call.
+	*	The vertex array must not be destroyed before then.
 	* @param[in]	vertexArray		Pointer to the vertex array to render.
 	* @param[in]	shaderIndex		Index of the shader to render with, retrieved from the shader manager.
 	* @param[in]	vertexCount		The number of vertices to render
+	* @param[in]	firstVertex		Index of the first vertex to render, for vertices written to a stream buffer.
+	*/
+	void submitForDraw( const std::shared_ptr<CVertexArray> &vertexArray, unsigned int shaderIndex, unsigned int vertexCount, GLint firstVertex );
+	/**
+	* @brief Submits an indexed vertex array for rendering when the frame is drawn.
+	* @details Like submitForDraw, but draws triangles from the element buffer bound to the vertex array.
+	*	The offset is for objects that share a shader but not a position, like chunks. It is also the position
+	*	the draw is sorted by, closest first among draws with the same shader and vertex array.
+	* @param[in]	vertexArray		Pointer to the vertex array to render, with an element buffer bound.
+	* @param[in]	shaderIndex		Index of the shader to render with, retrieved from the shader manager.
+	* @param[in]	indexCount		The number of indices to render.
+	* @param[in]	indexType		The type of the indices, GL_UNSIGNED_SHORT or GL_UNSIGNED_INT.
+	* @param[in]	baseVertex		Added to every index, to draw a mesh from the middle of a shared vertex buffer.
+	* @param[in]	offsetAttrib	A vec3 vertex attribute with no array enabled to set to offset, or -1 for none.
+	* @param[in]	offset			The value of the offset attribute for this draw.
 	*/
-	void submitForDraw( std::shared_ptr<CVertexArray> vertexArray, unsigned int shaderIndex, unsigned int vertexCount );
+	void submitIndexedForDraw( const std::shared_ptr<CVertexArray> &vertexArray, unsigned int shaderIndex, unsigned int indexCount, GLenum indexType,
+		GLint baseVertex, GLint offsetAttrib, const glm::vec3 &offset );
+	/**
+	* @brief Submits draw commands from a buffer for rendering when the frame is drawn.
+	* @details Draws triangles from the element buffer bound to the vertex array once per DrawElementsIndirectCommand,
+	*	with a single glMultiDrawElementsIndirect. Needs GL_ARB_multi_draw_indirect. The commands must be in the
+	*	buffer when the frame is drawn.
+	* @param[in]	vertexArray		Pointer to the vertex array to render, with an element buffer bound.
+	* @param[in]	shaderIndex		Index of the shader to render with, retrieved from the shader manager.
+	* @param[in]	indirectBuffer	Name of the buffer holding the commands.
+	* @param[in]	indirectOffset	Byte offset of the first command in the buffer.
+	* @param[in]	drawCount		The number of commands to draw.
+	* @param[in]	indexType		The type of the indices, GL_UNSIGNED_SHORT or GL_UNSIGNED_INT.
+	*/
+	void submitIndirectForDraw( const std::shared_ptr<CVertexArray> &vertexArray, unsigned int shaderIndex, GLuint indirectBuffer, GLintptr indirectOffset,
+		unsigned int drawCount, GLenum indexType );
+	/**
+	* @brief Submits an indexed vertex array for rendering many times with one draw when the frame is drawn.
+	* @details Draws triangles from the element buffer bound to the vertex array instanceCount times, with
+	*	glDrawElementsInstanced. Attributes with a divisor advance once per instance.
+	* @param[in]	vertexArray		Pointer to the vertex array to render, with an element buffer bound.
+	* @param[in]	shaderIndex		Index of the shader to render with, retrieved from the shader manager.
+	* @param[in]	indexCount		The number of indices of one instance.
+	* @param[in]	indexType		The type of the indices, GL_UNSIGNED_SHORT or GL_UNSIGNED_INT.
+	* @param[in]	instanceCount	The number of instances to render.
+	* @param[in]	drawUniformOffset	Offset of a DrawBlock allocated with CShaderManager::allocateUniformBlock, or -1 for none.
+	*/
+	void submitInstancedForDraw( const std::shared_ptr<CVertexArray> &vertexArray, unsigned int shaderIndex, unsigned int indexCount, GLenum indexType,
+		unsigned int instanceCount, GLintptr drawUniformOffset );
+
+	/**
+	* @brief Flush a stream buffer before each frame is drawn, and end its frame after, see CStreamBuffer.
+	*/
+	void addStreamBuffer( CStreamBuffer *pStreamBuffer );
+	void removeStreamBuffer( CStreamBuffer *pStreamBuffer );
 
 	/**
 	* @brief Get shader manager.
 	* @returns The shader manager.
 	*/
 	inline CShaderManager* getShaderManager() { return m_pShaderManager; }
+	inline IRenderBackend* getBackend() { return m_pBackend; }
+	/**
+	* @brief Check if the client runs without a window, see CNullRenderBackend.
+	*/
+	inline bool isHeadless() const { return m_headless; }
 
 	inline char getGLSupportLevel() { return m_glSupportLevel; }
 	inline int getGLSLVersion() { assert( m_glSupportLevel >= 0 && m_glSupportLevel < GLSupportLevel::GL_SUPPORT_COUNT ); return GLSLVersion[m_glSupportLevel]; }
@@ -199,6 +316,14 @@ public:
 	* @returns A shared pointer to the view matrix.
 	*/
 	inline std::shared_ptr<glm::mat4> getViewMatrixPtr() { return m_viewMat; }
+	/**
+	* @brief Get the #FRUSTUM_PLANE_COUNT planes of the perspective view frustum, see ExtractFrustumPlanes.
+	*/
+	inline const glm::vec4* getFrustumPlanes() const { return m_frustumPlanes; }
+	/**
+	* @brief Get the perspective projection matrix times the view matrix, from the last update.
+	*/
+	inline const glm::mat4& getViewProjectionMatrix() const { return m_viewProjectionMat; }
 
 	/**
 	* @brief Sets the active camera to render from.
@@ -296,6 +421,8 @@ private:
 		GLboolean normalized;
 
 		unsigned char internalType;
+		/** Instances per attribute value, 0 to advance per vertex */
+		GLuint divisor;
 	};
 
 	typedef std::pair<GLenum, std::shared_ptr<CBufferObject>> BufferPair;
@@ -310,7 +437,7 @@ private:
 
 	unsigned int m_vertexAttribsActive;
 
-	GLuint addVertexAttribInternal( unsigned char internalType, GLint size, GLenum type, GLsizei stride, const void *pointer, GLboolean normalized );
+	GLuint addVertexAttribInternal( unsigned char internalType, GLint size, GLenum type, GLsizei stride, const void *pointer, GLboolean normalized, GLuint divisor );
 public:
 	CVertexArray( CGame* pGameHandle );
 	~CVertexArray();
@@ -356,9 +483,16 @@ public:
 	* @brief See addVertexAttrib, performs the same function but for glVertexAttribLPointer.
 	*/
 	GLuint addVertexLAttrib( GLint size, GLenum type, GLsizei stride, const void *pointer );
+	/**
+	* @brief See addVertexAttrib, but the attribute advances once every divisor instances instead of every vertex.
+	* @details With a base instance, each draw of a multi draw can read its own value, see glVertexAttribDivisor.
+	*/
+	GLuint addInstancedVertexAttrib( GLint size, GLenum type, GLsizei stride, const void *pointer, GLuint divisor );
 
 	/**
 	* @brief Binds all the buffer objects waiting to be bound, and adds vertex attribs.
+	* @details Attributes read from the array buffer added last, to read from several array buffers flush once after
+	*	adding each buffer and its attributes.
 	* @returns True if successfully bound all buffers and vertex attribs, false if something failed.
 	*/
 	bool flushBindsAndAttribs();
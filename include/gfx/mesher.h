@@ -0,0 +1,281 @@
+/**
+* @file mesher.h
+* @brief Contains the CChunkMesher class, which turns chunk blocks into renderable quads.
+* @details Faces between two opaque blocks are culled, and the remaining faces are merged into the largest
+*	rectangles of the same block type in each slice of the chunk (greedy meshing). Texture coordinates are in
+*	blocks, so a textured block repeats across a merged quad. Vertices are bit-packed into 8 bytes.
+*
+*	Every vertex has an ambient occlusion level from the three blocks touching its corner in front of the face.
+*	Faces only merge if all four of their corner levels match, so merged quads shade the same as single faces.
+*
+*	Distant chunks are meshed at a lower level of detail. Each level halves the resolution of the one before it,
+*	every cell taking the most common block of the eight below it, or air if most of them are air. The coarse grid
+*	is meshed the same way with its quads scaled up. Coarse meshes keep the outward faces of exposed cells on the
+*	edge of the chunk even against solid neighbours. These skirts hide the gaps where a neighbour meshed at a
+*	different level has its surface at a different height.
+*
+*	Every mesh also records which faces of the chunk can see each other through blocks that are not opaque, found by
+*	flood filling from the faces. The renderer uses them to skip chunks hidden behind solid ground.
+*
+*	The largest opaque quads of a full detail mesh are kept as occluders, for the renderer to draw into its occlusion
+*	buffer.
+*
+* @author Timothy Volpe
+* @date 5/14/2020
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <utility>
+#include <assert.h>
+#include "chunk.h"
+
+/** Stands in for blocks in chunks that are not loaded. Unknown block IDs are opaque, so faces against them are culled. */
+#define MESHER_UNLOADED_BLOCK 0xFFFF
+
+/** Side length of a chunk copy with a one block border from its neighbours */
+#define MESHER_PADDED_SIZE (CHUNK_SIZE+2)
+#define MESHER_PADDED_AREA (MESHER_PADDED_SIZE*MESHER_PADDED_SIZE)
+#define MESHER_PADDED_VOLUME (MESHER_PADDED_AREA*MESHER_PADDED_SIZE)
+
+/** Field layout of the first word of a ChunkVertex */
+#define CHUNK_VERTEX_X_SHIFT 0
+#define CHUNK_VERTEX_Y_SHIFT 6
+#define CHUNK_VERTEX_Z_SHIFT 12
+#define CHUNK_VERTEX_FACE_SHIFT 18
+#define CHUNK_VERTEX_AO_SHIFT 21
+/** Field layout of the second word of a ChunkVertex */
+#define CHUNK_VERTEX_LAYER_SHIFT 0
+#define CHUNK_VERTEX_U_SHIFT 16
+#define CHUNK_VERTEX_V_SHIFT 22
+
+#define CHUNK_VERTEX_COORD_MASK 0x3F
+#define CHUNK_VERTEX_FACE_MASK 0x7
+#define CHUNK_VERTEX_AO_MASK 0x3
+#define CHUNK_VERTEX_LAYER_MASK 0xFFFF
+
+/** Ambient occlusion level of a corner with nothing around it, 0 is the darkest */
+#define CHUNK_VERTEX_AO_NONE 3
+
+/** Levels of detail, level n is meshed at 1 / 2^n of the block resolution */
+#define CHUNK_LOD_COUNT 4
+/** Distance in chunks to the camera where chunks switch from level 0 to level 1, each further level is twice as far */
+#define CHUNK_LOD_DISTANCE 6
+/** Chunks only change level once their distance is this many chunks past the switch, so they do not flicker between levels */
+#define CHUNK_LOD_HYSTERESIS 1
+
+/** Smallest area in blocks of a quad kept as an occluder */
+#define CHUNK_OCCLUDER_MIN_AREA 16
+/** Most occluders kept for a chunk, the largest ones */
+#define CHUNK_OCCLUDER_MAX_COUNT 32
+
+/** Every pair of chunk faces connected, see ChunkFacePairBit */
+#define CHUNK_FACE_CONNECTIONS_ALL 0x7FFF
+
+/**
+* @brief Get the bit of a pair of different chunk faces in ChunkMesh::faceConnections, in either order.
+*/
+inline uint16_t ChunkFacePairBit( uint32_t faceA, uint32_t faceB ) {
+	assert( faceA != faceB && faceA < FACE_COUNT && faceB < FACE_COUNT );
+	if( faceA > faceB )
+		std::swap( faceA, faceB );
+	// The 15 pairs numbered in order, 0-1 to 0-5, then 1-2 to 1-5 and so on
+	return (uint16_t)(1 << (faceA*(11 - faceA)/2 + faceB - faceA - 1));
+}
+
+/**
+* @brief Get the level of detail to mesh a chunk at.
+* @param[in]	distance	Distance in chunks from the camera chunk.
+*/
+inline uint8_t ChunkLodForDistance( float distance ) {
+	uint8_t lod = 0;
+	while( lod < CHUNK_LOD_COUNT-1 && distance >= (float)(CHUNK_LOD_DISTANCE << lod) )
+		lod++;
+	return lod;
+}
+
+/**
+* @brief A chunk mesh vertex, packed into two 32-bit words that the vertex shader unpacks.
+* @details The first word holds the chunk-local corner position, 6 bits per axis from 0 to #CHUNK_SIZE inclusive,
+*	the face (see BlockFaces) in 3 bits and the ambient occlusion level in 2 bits. The second word holds the
+*	texture layer in 16 bits and the texture coordinates, in blocks across the quad, in 6 bits each.
+*	Both words are read as unsigned integer attributes, see the shifts and masks above.
+*/
+struct ChunkVertex
+{
+	uint32_t position;
+	uint32_t texture;
+
+	static inline ChunkVertex Pack( uint32_t x, uint32_t y, uint32_t z, uint32_t face, uint32_t ao, uint32_t layer, uint32_t u, uint32_t v ) {
+		ChunkVertex vertex;
+		vertex.position = (x << CHUNK_VERTEX_X_SHIFT) | (y << CHUNK_VERTEX_Y_SHIFT) | (z << CHUNK_VERTEX_Z_SHIFT)
+			| (face << CHUNK_VERTEX_FACE_SHIFT) | (ao << CHUNK_VERTEX_AO_SHIFT);
+		vertex.texture = (layer << CHUNK_VERTEX_LAYER_SHIFT) | (u << CHUNK_VERTEX_U_SHIFT) | (v << CHUNK_VERTEX_V_SHIFT);
+		return vertex;
+	}
+
+	inline uint32_t getX() const { return (position >> CHUNK_VERTEX_X_SHIFT) & CHUNK_VERTEX_COORD_MASK; }
+	inline uint32_t getY() const { return (position >> CHUNK_VERTEX_Y_SHIFT) & CHUNK_VERTEX_COORD_MASK; }
+	inline uint32_t getZ() const { return (position >> CHUNK_VERTEX_Z_SHIFT) & CHUNK_VERTEX_COORD_MASK; }
+	inline uint32_t getFace() const { return (position >> CHUNK_VERTEX_FACE_SHIFT) & CHUNK_VERTEX_FACE_MASK; }
+	inline uint32_t getAO() const { return (position >> CHUNK_VERTEX_AO_SHIFT) & CHUNK_VERTEX_AO_MASK; }
+	inline uint32_t getLayer() const { return (texture >> CHUNK_VERTEX_LAYER_SHIFT) & CHUNK_VERTEX_LAYER_MASK; }
+	inline uint32_t getU() const { return (texture >> CHUNK_VERTEX_U_SHIFT) & CHUNK_VERTEX_COORD_MASK; }
+	inline uint32_t getV() const { return (texture >> CHUNK_VERTEX_V_SHIFT) & CHUNK_VERTEX_COORD_MASK; }
+};
+static_assert(sizeof( ChunkVertex ) == 8, "Chunk vertices should stay compact");
+
+/** Converts padded coordinates, 0 to #MESHER_PADDED_SIZE exclusive, to an index into a padded chunk copy. Laid out like ChunkBlockIndex. */
+inline uint32_t PaddedBlockIndex( uint32_t x, uint32_t y, uint32_t z ) {
+	return (y*MESHER_PADDED_SIZE + z)*MESHER_PADDED_SIZE + x;
+}
+
+/**
+* @brief A copy of a chunk and a one block border from the 26 chunks around it, everything needed to mesh it.
+* @details The border includes the edges and corners of the diagonal neighbours, which ambient occlusion reads.
+*	Any block next to a chunk block is a fixed index offset away, so meshing never checks for the chunk edge.
+*	The copy lets the mesh be built away from the thread that owns the chunk store.
+*/
+struct ChunkMeshInput
+{
+	ChunkPos position;
+	/** Version of the chunk when it was copied */
+	uint32_t version;
+
+	/** The chunk and its border, see PaddedBlockIndex */
+	BlockId blocks[MESHER_PADDED_VOLUME];
+
+	/**
+	* @brief Copy a chunk and its neighbour borders from a chunk store.
+	* @details Missing neighbours are filled with #MESHER_UNLOADED_BLOCK, except above the top of the world, which is air.
+	* @returns True if the chunk was copied, false if it is not loaded.
+	*/
+	bool gather( CChunkStore *pChunkStore, const ChunkPos &chunkPosition );
+
+	/**
+	* @brief Get a block in chunk-local coordinates, one block past each side of the chunk reads from the border.
+	*/
+	inline BlockId getBlock( int32_t x, int32_t y, int32_t z ) const {
+		return blocks[PaddedBlockIndex( x + 1, y + 1, z + 1 )];
+	}
+};
+
+/**
+* @brief A large opaque quad of a chunk mesh, in chunk-local blocks.
+*/
+struct ChunkOccluder
+{
+	/** Face direction, see BlockFaces */
+	uint8_t face;
+	/** Position of the quad along the face axis */
+	uint8_t plane;
+	/** Corners of the quad along the two other axes, in the order of the axes after the face axis */
+	uint8_t minU, minV, maxU, maxV;
+
+	inline uint32_t getArea() const { return (uint32_t)(maxU - minU) * (maxV - minV); }
+};
+
+/**
+* @brief The output of the mesher for one chunk.
+* @details Every four vertices are one quad, see CChunkMesher::BuildQuadIndices.
+*/
+struct ChunkMesh
+{
+	ChunkPos position;
+	/** Version of the chunk the mesh was built from */
+	uint32_t version;
+	/** Level of detail the mesh was built at */
+	uint8_t lod;
+	/** Pairs of faces that can see each other through the chunk, see ChunkFacePairBit */
+	uint16_t faceConnections;
+	/** The largest opaque quads, at most #CHUNK_OCCLUDER_MAX_COUNT */
+	std::vector<ChunkOccluder> occluders;
+
+	std::vector<ChunkVertex> vertices;
+	/** Number of visible faces before merging */
+	uint32_t faceCount;
+
+	inline uint32_t getQuadCount() const { return (uint32_t)(vertices.size() / 4); }
+};
+
+/**
+* @brief Time spent meshing, kept by each mesher.
+*/
+struct ChunkMeshStats
+{
+	uint64_t chunkCount;
+	uint64_t faceCount;
+	uint64_t quadCount;
+	/** Total time in buildMesh */
+	double seconds;
+	/** Part of the total spent finding ambient occlusion levels */
+	double aoSeconds;
+	/** Chunks meshed at each level of detail */
+	uint64_t lodChunkCount[CHUNK_LOD_COUNT];
+
+	inline double getMicrosecondsPerChunk() const { return chunkCount ? seconds * 1000000.0 / (double)chunkCount : 0.0; }
+	/** Fraction of the mesh time spent on ambient occlusion */
+	inline double getAOFraction() const { return seconds > 0.0 ? aoSeconds / seconds : 0.0; }
+
+	void add( const ChunkMeshStats &other );
+};
+
+/**
+* @brief Builds greedy meshes from chunk copies.
+* @details Keeps a scratch mask between calls. A mesher is not thread-safe, but separate meshers can run concurrently.
+*
+* @author Timothy Volpe
+* @date 5/14/2020
+*/
+class CChunkMesher
+{
+private:
+	/** The block and corner ambient occlusion levels of every visible face in a slice, 0 where there is no face */
+	std::vector<uint32_t> m_faceMask;
+	/** Padded block grids of each level of detail above 0, laid out like the chunk copy */
+	std::vector<BlockId> m_lodBlocks[CHUNK_LOD_COUNT];
+	/** Flood fill state, one bit per block along x for every row of y and z */
+	std::vector<uint32_t> m_openRows, m_filledRows;
+	/** Blocks a fill has stepped into from a neighbouring row, but not spread from yet */
+	std::vector<uint32_t> m_pendingRows;
+	/** Rows with pending blocks */
+	std::vector<uint16_t> m_fillStack;
+
+	ChunkMeshStats m_stats;
+
+	/** Build a padded grid at half the resolution of another, size is the side length without the border */
+	static void DownsampleBlocks( const BlockId *pSource, uint32_t sourceSize, BlockId *pDest );
+
+	/**
+	* @brief Face culling and greedy merging for one face direction.
+	* @param[in]	pBlocks		A padded block grid.
+	* @param[in]	size		Side length of the grid without the border.
+	* @param[in]	lod			Level of detail of the grid, cells are 2^lod blocks wide.
+	*/
+	void meshFaceDirection( const BlockId *pBlocks, uint32_t size, uint8_t lod, uint8_t face, ChunkMesh &mesh );
+	/** Flood fill the blocks that are not opaque from every face, and return the pairs of faces the fills reach */
+	uint16_t findFaceConnections( const ChunkMeshInput &input );
+public:
+	/**
+	* @brief Fill an index buffer for drawing quads as triangles, two per quad.
+	* @param[out]	indices		Cleared and filled with six indices per quad.
+	* @param[in]	quadCount	The number of quads.
+	*/
+	static void BuildQuadIndices( std::vector<uint32_t> &indices, uint32_t quadCount );
+
+	CChunkMesher();
+	~CChunkMesher();
+
+	/**
+	* @brief Build the mesh of a chunk.
+	* @param[in]	input	The chunk copy to mesh.
+	* @param[in]	lod		The level of detail, see ChunkLodForDistance.
+	* @param[out]	mesh	Receives the quads. Its vertex storage is reused.
+	*/
+	void buildMesh( const ChunkMeshInput &input, uint8_t lod, ChunkMesh &mesh );
+
+	inline const ChunkMeshStats& getStats() const { return m_stats; }
+	inline void resetStats() { m_stats = ChunkMeshStats(); }
+};
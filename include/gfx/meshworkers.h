@@ -0,0 +1,173 @@
+/**
+* @file meshworkers.h
+* @brief Contains the CMeshWorkerPool class, which builds chunk meshes on background threads.
+* @details The server thread copies dirty chunks into pooled ChunkMeshInput buffers and submits them. Worker threads
+*	mesh the closest chunks to the camera first, and push finished meshes onto a lock-free list that the render
+*	thread collects once per frame. Every submission is tagged with a serial, a mesh is only current if no newer
+*	submission was made for the same chunk, so out-of-date meshes are dropped instead of uploaded.
+*
+*	A chunk is meshed at the level of detail for its distance to the camera when a worker takes it. When the camera
+*	moves, the render thread asks for chunks to be meshed again, and the server thread submits fresh copies of them.
+*
+* @author Timothy Volpe
+* @date 5/15/2020
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <unordered_map>
+#include "gfx/mesher.h"
+
+/** Upper bound on the number of pooled buffers of each kind kept for reuse, extras are freed */
+#define MESH_WORKER_POOL_LIMIT 64
+
+/**
+* @brief A finished mesh waiting to be collected by the render thread.
+*/
+struct MeshResult
+{
+	ChunkMesh mesh;
+	/** The submission this mesh was built from, or 0 if the chunk was cancelled and the mesh is empty */
+	uint32_t serial;
+
+	MeshResult *pNext;
+};
+
+/**
+* @brief A pool of threads that build chunk meshes in order of distance to the camera.
+* @details Submitting a chunk that is already queued replaces the queued copy, so a chunk edited several times before
+*	a worker gets to it is only meshed once. Input and result buffers are recycled, so steady-state meshing does not
+*	allocate. Submitting is thread-safe, collecting results must only be done from one thread at a time.
+*
+* @author Timothy Volpe
+* @date 5/15/2020
+*/
+class CMeshWorkerPool
+{
+private:
+	struct QueuedChunk
+	{
+		int64_t distance;
+		ChunkPos position;
+
+		/** Orders the heap so the closest chunk is on top */
+		inline bool operator<( const QueuedChunk& other ) const { return distance > other.distance; }
+	};
+	struct PendingJob
+	{
+		ChunkMeshInput *pInput;
+		uint32_t serial;
+	};
+
+	std::vector<std::thread> m_workerThreads;
+
+	std::mutex m_jobMutex;
+	std::condition_variable m_jobAvailable;
+	std::vector<QueuedChunk> m_jobHeap;
+	std::unordered_map<ChunkPos, PendingJob, ChunkPosHash> m_pendingJobs;
+	/** Serial of the newest submission of every chunk that has been submitted */
+	std::unordered_map<ChunkPos, uint32_t, ChunkPosHash> m_latestSerials;
+	uint32_t m_nextSerial;
+	ChunkPos m_cameraChunk;
+	bool m_shuttingDown;
+	/** Chunks the render thread wants meshed again at another level of detail */
+	std::vector<ChunkPos> m_remeshRequests;
+
+	std::mutex m_poolMutex;
+	std::vector<ChunkMeshInput*> m_freeInputs;
+	std::vector<MeshResult*> m_freeResults;
+	/** Stats of every worker's mesher, guarded by the pool mutex */
+	ChunkMeshStats m_stats;
+
+	/** Finished meshes, pushed by the workers and taken all at once by the collecting thread */
+	std::atomic<MeshResult*> m_resultHead;
+	std::atomic<uint32_t> m_jobsInFlight;
+
+	void workerMain();
+
+	MeshResult* acquireResult();
+	void pushResult( MeshResult *pResult );
+
+	static int64_t ChunkDistance( const ChunkPos &a, const ChunkPos &b );
+public:
+	CMeshWorkerPool();
+	~CMeshWorkerPool();
+
+	/**
+	* @brief Start the worker threads.
+	* @param[in]	threadCount		The number of workers. If 0, half the number of hardware threads is used, with a minimum of one.
+	* @returns True if the threads were started, false if otherwise.
+	*/
+	bool initialize( unsigned int threadCount );
+	/**
+	* @brief Stop the worker threads and free every buffer. Queued chunks are discarded.
+	*/
+	void shutdown();
+
+	/**
+	* @brief Get an input buffer to copy a chunk into.
+	* @details The buffer must be passed to submit or releaseInput.
+	*/
+	ChunkMeshInput* acquireInput();
+	/**
+	* @brief Return an input buffer that was not submitted.
+	*/
+	void releaseInput( ChunkMeshInput *pInput );
+
+	/**
+	* @brief Queue a chunk copy to be meshed, the pool takes ownership of the buffer.
+	* @details Any queued copy of the same chunk is replaced, and meshes of earlier copies become stale.
+	*/
+	void submit( ChunkMeshInput *pInput );
+	/**
+	* @brief Stop meshing a chunk, because it was unloaded.
+	* @details Any queued copy is dropped, and any mesh still being built becomes stale. If the chunk was ever
+	*	submitted, an empty result is posted so the collecting thread drops its mesh.
+	*/
+	void cancel( const ChunkPos &position );
+
+	/**
+	* @brief Set the chunk the camera is in, queued chunks are meshed closest first.
+	*/
+	void setCameraChunk( const ChunkPos &position );
+
+	/**
+	* @brief Ask for a chunk to be copied and submitted again, because its mesh is at the wrong level of detail.
+	*/
+	void requestRemesh( const ChunkPos &position );
+	/**
+	* @brief Take the chunks asked for with requestRemesh since the last call, by the thread that submits chunks.
+	* @param[out]	positions	The chunks are appended.
+	*/
+	void takeRemeshRequests( std::vector<ChunkPos> &positions );
+
+	/**
+	* @brief Take every mesh finished since the last call.
+	* @returns A list linked through MeshResult::pNext in the order the meshes finished, or a null pointer if there are none.
+	*	Every result must be passed to releaseResult.
+	*/
+	MeshResult* takeResults();
+	/**
+	* @brief Check if a result is from the newest submission of its chunk, or is a removal not followed by a submission.
+	*/
+	bool isCurrent( const MeshResult *pResult );
+	/**
+	* @brief Return a result buffer to the pool.
+	*/
+	void releaseResult( MeshResult *pResult );
+
+	/**
+	* @brief Get the combined mesh timings of every worker.
+	*/
+	ChunkMeshStats getStats();
+
+	/** The number of chunks queued or being meshed */
+	inline uint32_t getJobsInFlight() const { return m_jobsInFlight.load( std::memory_order_relaxed ); }
+	inline unsigned int getThreadCount() const { return (unsigned int)m_workerThreads.size(); }
+};
@@ -0,0 +1,200 @@
+/**
+* @file nullbackend.h
+* @brief Contains the CNullRenderBackend class, a render backend that needs no GPU.
+* @details Commands are checked against the rules OpenGL would apply, and counted, but nothing is drawn. With it the
+*	whole client runs on machines without a display or driver, for benchmarks and automated runs.
+*
+* @author Timothy Volpe
+* @date 5/17/2020
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <unordered_set>
+#include "gfx/backend.h"
+
+/** Vertex attributes every OpenGL implementation supports */
+#define NULL_BACKEND_MAX_VERTEX_ATTRIBS 16
+/** The largest uniform buffer offset alignment OpenGL allows, so ranges that pass here pass everywhere */
+#define NULL_BACKEND_UNIFORM_BUFFER_OFFSET_ALIGNMENT 256
+/** The only program binary format, a binary is the source the program was linked with */
+#define NULL_BACKEND_PROGRAM_BINARY_FORMAT 0x4E554C4C
+
+/**
+* @brief Records render commands without a context.
+* @details Keeps the objects created and the state bound, so it can report a command OpenGL would reject with the
+*	error OpenGL would give. Each error is logged as a warning with the command that caused it, and returned by the
+*	next getError. Draws are also checked against the element buffer size, which OpenGL does not report.
+*
+*	Shaders compile if they have source, and programs link if every attached shader compiled and one of them is a
+*	vertex shader. A uniform or uniform block exists if its name appears in the source of the program. The binary
+*	of a program is that source, so a program loaded from its binary behaves the same as the one it came from.
+*
+*	Mapped buffers get memory of their own that nothing reads, and fences are signaled as soon as they are made.
+*
+*	Claims the highest support level and every extension, so the same paths run as on the newest hardware.
+*
+* @author Timothy Volpe
+* @date 5/17/2020
+*/
+class CNullRenderBackend : public IRenderBackend
+{
+private:
+	struct NullBuffer
+	{
+		GLsizeiptr size;
+		/** Set by bufferStorage, the size can no longer change */
+		bool immutable;
+		/** Flags passed to bufferStorage */
+		GLbitfield storageFlags;
+		bool mapped;
+		/** Memory handed out by mapBufferRange, kept until the buffer is unmapped */
+		std::vector<uint8_t> mapping;
+	};
+	struct NullVertexArray
+	{
+		GLuint elementBuffer;
+		/** A bit for every attribute enabled */
+		uint32_t enabledAttribs;
+	};
+	struct NullShader
+	{
+		GLenum type;
+		std::string source;
+		bool compiled;
+	};
+	struct NullProgram
+	{
+		std::vector<GLuint> shaders;
+		bool linked;
+		/** Sources of the shaders it was last linked with */
+		std::string linkedSource;
+		std::map<std::string, GLint> uniformLocations;
+		std::map<std::string, GLuint> blockIndices;
+	};
+
+	CGame *m_pGameHandle;
+
+	RenderBackendStats m_stats;
+	/** The first error since getError was called */
+	GLenum m_error;
+	GLuint m_nextName;
+
+	std::unordered_map<GLuint, NullBuffer> m_buffers;
+	std::unordered_map<GLuint, NullVertexArray> m_vertexArrays;
+	std::unordered_map<GLuint, NullShader> m_shaders;
+	std::unordered_map<GLuint, NullProgram> m_programs;
+	std::unordered_set<uintptr_t> m_syncs;
+
+	/** The buffer bound to each target, the element buffer is kept by the vertex array */
+	std::unordered_map<GLenum, GLuint> m_boundBuffers;
+	GLuint m_boundVertexArray;
+	GLuint m_boundProgram;
+	std::unordered_map<GLenum, bool> m_capabilities;
+	GLenum m_depthFunction, m_cullFace, m_frontFace;
+
+	/** Record an error for getError and log the command that caused it */
+	void setError( GLenum error, const char *pCommand, const char *pReason );
+	/** Count a state change, and whether it changed anything */
+	inline void changeState( bool redundant ) {
+		m_stats.stateChangeCount++;
+		m_stats.redundantStateCount += redundant;
+	}
+	/** The buffer bound to a target, or 0 */
+	GLuint getBoundBuffer( GLenum target ) const;
+	/** The buffer bound to a target, or null after setting an error if there is none */
+	NullBuffer* getTargetBuffer( GLenum target, const char *pCommand );
+	/** Check the program and vertex array before a draw */
+	bool validateDraw( const char *pCommand );
+	/** Check an indexed draw, including that the indices are inside the element buffer */
+	bool validateElementDraw( GLsizei count, GLenum type, const void *pIndices, const char *pCommand );
+	/** Check a vertex attribute can be set up */
+	bool validateAttrib( GLuint index, bool needsBuffer, const char *pCommand );
+	/** Check a uniform location belongs to the bound program */
+	bool validateUniform( GLint location, const char *pCommand );
+public:
+	CNullRenderBackend( CGame *pGameHandle );
+	~CNullRenderBackend();
+
+	bool initialize();
+	void shutdown();
+
+	inline const char* getName() const { return "Null"; }
+	inline char getSupportLevel() const { return GLSupportLevel::GL_SUPPORT_MAX; }
+	inline bool isExtensionSupported( const char *pExtension ) { return true; }
+	void endFrame();
+
+	inline const RenderBackendStats& getStats() const { return m_stats; }
+	inline void resetStats() { m_stats = RenderBackendStats(); }
+
+	GLenum getError();
+	void getIntegerv( GLenum name, GLint *pValue );
+	const char* getString( GLenum name );
+
+	void enable( GLenum capability );
+	void disable( GLenum capability );
+	void depthFunc( GLenum function );
+	void cullFace( GLenum face );
+	void frontFace( GLenum winding );
+	void pointSize( GLfloat size );
+	void clearColor( GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha );
+	void clear( GLbitfield mask );
+
+	void genBuffers( GLsizei count, GLuint *pBuffers );
+	void deleteBuffers( GLsizei count, const GLuint *pBuffers );
+	void bindBuffer( GLenum target, GLuint buffer );
+	void bindBufferRange( GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size );
+	void bufferData( GLenum target, GLsizeiptr size, const void *pData, GLenum usage );
+	void bufferStorage( GLenum target, GLsizeiptr size, const void *pData, GLbitfield flags );
+	void bufferSubData( GLenum target, GLintptr offset, GLsizeiptr size, const void *pData );
+	void* mapBufferRange( GLenum target, GLintptr offset, GLsizeiptr length, GLbitfield access );
+	GLboolean unmapBuffer( GLenum target );
+
+	GLsync fenceSync( GLenum condition, GLbitfield flags );
+	GLenum clientWaitSync( GLsync sync, GLbitfield flags, GLuint64 timeout );
+	void deleteSync( GLsync sync );
+
+	void genVertexArrays( GLsizei count, GLuint *pArrays );
+	void deleteVertexArrays( GLsizei count, const GLuint *pArrays );
+	void bindVertexArray( GLuint array );
+	void vertexAttribPointer( GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride, const void *pPointer );
+	void vertexAttribIPointer( GLuint index, GLint size, GLenum type, GLsizei stride, const void *pPointer );
+	void vertexAttribLPointer( GLuint index, GLint size, GLenum type, GLsizei stride, const void *pPointer );
+	void enableVertexAttribArray( GLuint index );
+	void vertexAttribDivisor( GLuint index, GLuint divisor );
+	void vertexAttrib3f( GLuint index, GLfloat x, GLfloat y, GLfloat z );
+
+	GLuint createShader( GLenum type );
+	void deleteShader( GLuint shader );
+	void shaderSource( GLuint shader, const GLchar *pSource );
+	void compileShader( GLuint shader );
+	void getShaderiv( GLuint shader, GLenum name, GLint *pValue );
+	void getShaderInfoLog( GLuint shader, GLsizei maxLength, GLsizei *pLength, GLchar *pLog );
+	GLuint createProgram();
+	void deleteProgram( GLuint program );
+	void attachShader( GLuint program, GLuint shader );
+	void detachShader( GLuint program, GLuint shader );
+	void linkProgram( GLuint program );
+	void getProgramiv( GLuint program, GLenum name, GLint *pValue );
+	void getProgramInfoLog( GLuint program, GLsizei maxLength, GLsizei *pLength, GLchar *pLog );
+	void useProgram( GLuint program );
+	void programParameteri( GLuint program, GLenum name, GLint value );
+	void getProgramBinary( GLuint program, GLsizei bufferSize, GLsizei *pLength, GLenum *pFormat, void *pBinary );
+	void programBinary( GLuint program, GLenum format, const void *pBinary, GLsizei length );
+
+	GLint getUniformLocation( GLuint program, const GLchar *pName );
+	GLuint getUniformBlockIndex( GLuint program, const GLchar *pName );
+	void uniformBlockBinding( GLuint program, GLuint blockIndex, GLuint binding );
+	void uniform3fv( GLint location, GLsizei count, const GLfloat *pValue );
+	void uniformMatrix4fv( GLint location, GLsizei count, GLboolean transpose, const GLfloat *pValue );
+
+	void drawArrays( GLenum mode, GLint first, GLsizei count );
+	void drawElements( GLenum mode, GLsizei count, GLenum type, const void *pIndices );
+	void drawElementsBaseVertex( GLenum mode, GLsizei count, GLenum type, const void *pIndices, GLint baseVertex );
+	void drawElementsInstanced( GLenum mode, GLsizei count, GLenum type, const void *pIndices, GLsizei instanceCount );
+	void multiDrawElementsIndirect( GLenum mode, GLenum type, const void *pIndirect, GLsizei drawCount, GLsizei stride );
+};
@@ -0,0 +1,154 @@
+/**
+* @file occlusion.h
+* @brief Contains the COcclusionCuller class, which tests boxes against a small depth buffer drawn on the CPU.
+* @details Each frame, large occluder quads are drawn into a low resolution depth buffer. Boxes whose nearest point is
+*	behind everything in their part of the buffer are hidden. A pixel is only written where an occluder covers all of
+*	it, with the farthest depth the occluder has inside the pixel. So a box is never hidden by the low resolution.
+*
+*	The buffer is split into horizontal bands drawn in parallel. Once a band is drawn, it is reduced into a
+*	hierarchy where each level holds the farthest depth of the 2x2 texels below it. A box is tested against the
+*	level where its screen rectangle covers at most 2x2 texels. Edge functions are evaluated four pixels at a time
+*	with SSE when it is available.
+*
+*	Depths are normalized device depths, -1 at the near plane and 1 at the far plane.
+*
+* @author Timothy Volpe
+* @date 5/17/2020
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+#include "threadpool.h"
+
+#define OCCLUSION_BUFFER_WIDTH 256
+#define OCCLUSION_BUFFER_HEIGHT 128
+/** Rows in each band drawn in parallel */
+#define OCCLUSION_BAND_HEIGHT 16
+/** Levels of the depth hierarchy, level 0 is the full buffer */
+#define OCCLUSION_LEVEL_COUNT 5
+/** Most occluder quads drawn in a frame, the rest are ignored */
+#define OCCLUSION_MAX_OCCLUDERS 4096
+/** Edges tested per occluder, each quad is drawn whole so no pixels are lost along a split */
+#define OCCLUSION_POLYGON_EDGES 4
+/** Worker threads drawing bands, the thread calling rasterize helps */
+#define OCCLUSION_THREAD_COUNT 3
+/** Time a frame of drawing occluders and testing boxes should stay under */
+#define OCCLUSION_FRAME_BUDGET_MS 1.0
+
+/**
+* @brief Counts of occlusion tests.
+*/
+struct OcclusionStats
+{
+	uint64_t frameCount;
+	/** Occluder quads drawn */
+	uint64_t occluderCount;
+	uint64_t testCount;
+	/** Boxes found hidden */
+	uint64_t occludedCount;
+	/** Time spent drawing occluders and building the hierarchy */
+	double rasterSeconds;
+	double testSeconds;
+	/** Longest frame, and frames longer than #OCCLUSION_FRAME_BUDGET_MS */
+	double maxFrameSeconds;
+	uint64_t overBudgetCount;
+
+	inline double getOccludedFraction() const { return testCount ? (double)occludedCount / (double)testCount : 0.0; }
+	inline double getMillisecondsPerFrame() const { return frameCount ? (rasterSeconds + testSeconds) * 1000.0 / (double)frameCount : 0.0; }
+	inline double getRasterMillisecondsPerFrame() const { return frameCount ? rasterSeconds * 1000.0 / (double)frameCount : 0.0; }
+};
+
+/**
+* @brief Draws occluders into a CPU depth buffer and tests boxes against it.
+* @details Does not touch OpenGL. Use from one thread, beginFrame, then addOccluder, then rasterize, then isBoxVisible.
+*
+* @author Timothy Volpe
+* @date 5/17/2020
+*/
+class COcclusionCuller
+{
+private:
+	/** A convex polygon in buffer pixels, with edge functions that are positive where a whole pixel is inside */
+	struct OccluderPolygon
+	{
+		float edgeA[OCCLUSION_POLYGON_EDGES], edgeB[OCCLUSION_POLYGON_EDGES], edgeC[OCCLUSION_POLYGON_EDGES];
+		/** Depth at a pixel center, plus how much it can grow inside the pixel */
+		float depthA, depthB, depthC, depthSlope;
+		/** Farthest corner depth */
+		float maxDepth;
+		int32_t minX, minY, maxX, maxY;
+	};
+
+	CThreadPool m_threadPool;
+
+	glm::mat4 m_viewProjection;
+	std::vector<OccluderPolygon> m_polygons;
+	uint32_t m_occluderCount;
+	/** Depth of every texel of each level, rows top to bottom */
+	std::vector<float> m_levels[OCCLUSION_LEVEL_COUNT];
+
+	OcclusionStats m_stats;
+	/** Time spent on the current frame so far */
+	double m_frameSeconds;
+
+	/** Add the time of the current frame to the stats */
+	void finishFrameStats();
+	/** Clip a quad to the near plane and set it up, corners are in clip space */
+	void addClipQuad( const glm::vec4 *pCorners );
+	/** Set up a convex polygon of three or four buffer space vertices */
+	void setupPolygon( const glm::vec3 *pVertices, uint32_t count );
+	/** Draw every polygon into one band and reduce it into the higher levels */
+	void rasterizeBand( uint32_t band );
+public:
+	COcclusionCuller();
+	~COcclusionCuller();
+
+	/**
+	* @brief Start the band threads.
+	* @returns True if successful, false if otherwise.
+	*/
+	bool initialize();
+	void shutdown();
+
+	/**
+	* @brief Clear the buffer and start collecting occluders.
+	* @param[in]	viewProjection	The projection matrix times the view matrix.
+	*/
+	void beginFrame( const glm::mat4 &viewProjection );
+	/**
+	* @brief Add an occluder quad.
+	* @param[in]	pCorners	Four world space corners in order around the quad, either way around. The quad must be flat and convex.
+	* @returns False if the frame already has #OCCLUSION_MAX_OCCLUDERS occluders, the quad is not added.
+	*/
+	bool addOccluder( const glm::vec3 *pCorners );
+	/**
+	* @brief Draw the occluders and build the depth hierarchy.
+	*/
+	void rasterize();
+
+	/**
+	* @brief Check if any part of a box may be visible past the occluders.
+	* @details Boxes crossing the near plane are always visible.
+	*/
+	bool isBoxVisible( const glm::vec3 &minimum, const glm::vec3 &maximum );
+
+	/**
+	* @brief Draw a known occluder and check the boxes behind and beside it are tested correctly.
+	* @details Needs no GPU, the headless client runs it on startup. Uses the buffer like a frame does, and resets the stats.
+	* @returns True if every box was found hidden or visible as expected.
+	*/
+	bool runSelfCheck();
+
+	/**
+	* @brief Get the depth of a texel of a level of the hierarchy, 1 where nothing was drawn.
+	*/
+	inline float getDepth( uint32_t level, uint32_t x, uint32_t y ) const {
+		return m_levels[level][y*(OCCLUSION_BUFFER_WIDTH >> level) + x];
+	}
+
+	inline const OcclusionStats& getStats() const { return m_stats; }
+	inline void resetStats() { m_stats = OcclusionStats(); m_frameSeconds = 0.0; }
+};
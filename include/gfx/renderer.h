@@ -6,6 +6,7 @@ class CGame;
 class CECSCoordinator;
 
 class CRenderSystem;
+class CChunkRenderer;
 
 /**
 * @brief The client-sided renderer, which renders 3D world objects.
@@ -23,6 +24,8 @@ private:
 	CECSCoordinator* m_pClientEntCoordinator;
 
 	std::shared_ptr<CRenderSystem> m_renderSystem;
+
+	CChunkRenderer *m_pChunkRenderer;
 public:
 	CWorldRenderer( CGame* pGameHandle );
 	~CWorldRenderer();
@@ -70,4 +73,9 @@ public:
 	* @brief Update the render system
 	*/
 	void render();
+
+	/**
+	* @brief Returns the renderer for the world terrain.
+	*/
+	inline CChunkRenderer* getChunkRenderer() { return m_pChunkRenderer; }
 };
\ No newline at end of file
@@ -5,13 +5,17 @@
 #include <map>
 #include <memory>
 #include <vector>
-#include <functional>
 #include <glm/glm.hpp>
+#include "gfx/streambuffer.h"
+#include "gfx/shadercache.h"
 
 #define SHADER_DEF_FILE "shaders.json"
 #define SHADER_COMPILE_LOG "compile.log"
 #define SHADER_LINK_LOG "link.log"
 
+/** Bytes of uniform blocks that can be written each frame */
+#define UNIFORM_ARENA_SIZE (512 * 1024)
+
 /** If this is defined, missing uniforms will be a fatal error */
 //#define STRICT_UNIFORMS
 
@@ -30,6 +34,7 @@ struct ShaderProgramDefinition
 enum UniformBlockIDs
 {
 	UNIFORM_BLOCK_MATRIX = 0,
+	UNIFORM_BLOCK_DRAW,
 	UNIFORM_BLOCK_COUNT
 };
 
@@ -39,13 +44,20 @@ struct UniformBlockData
 	const char*		blockName;
 	size_t			blockSize;
 
-	GLuint			uboId;
 	GLuint			uboBindingPoint;
 };
 
+/** The DrawBlock of a single draw, laid out as std140 */
+struct DrawUniforms
+{
+	glm::mat4 modelMatrix;
+	glm::vec4 color;
+};
+
 /** Uniform block data, index corresponds to UniformBlockIDs value */
 static const UniformBlockData UniformBlocknames[] ={
 	{ "MatrixBlock", sizeof( glm::mat4 ) * 3 },
+	{ "DrawBlock", sizeof( DrawUniforms ) },
 };
 
 /**
@@ -65,14 +77,20 @@ private:
 
 	std::vector<UniformBlockData> m_uniformBlocks;
 	GLuint m_uboIndexCounter;
+	/** Every uniform block written this frame, bound to its binding point by range */
+	CStreamBuffer m_uniformArena;
+	/** Offsets of bound ranges must be a multiple of this */
+	GLint m_uniformAlignment;
+
+	CShaderCache m_shaderCache;
 
 	unsigned int m_boundProgramIndex;
 
-	/** Compiles the shader stages passed and stores them in temporary map m_shaderStageObjects */
-	bool compileShaderStages( const std::unordered_set<std::string> &shaderStages, std::map<std::string, std::shared_ptr<CShaderStage>> &compiledStages );
+	/** Loads the code of the shader stages passed and stores them in the temporary map loadedStages */
+	bool loadShaderStages( const std::unordered_set<std::string> &shaderStages, std::map<std::string, std::shared_ptr<CShaderStage>> &loadedStages );
 
-	/** Takes the compiled stages and program definitions and links the programs, then stores them in m_shaderPrograms */
-	bool linkPrograms( const std::map<std::string, std::shared_ptr<CShaderStage>> &compiledStages, const std::vector<ShaderProgramDefinition> &programDefs );
+	/** Loads each program from the shader cache, or compiles its stages and links it, then stores them in m_shaderPrograms */
+	bool linkPrograms( const std::map<std::string, std::shared_ptr<CShaderStage>> &loadedStages, const std::vector<ShaderProgramDefinition> &programDefs );
 
 	/** Setup the global uniform blocks */
 	bool createUniformBlocks();
@@ -88,8 +106,8 @@ public:
 	/**
 	* @brief Load the shader programs defined in the shaders.json file
 	* @details Attempts to load each defined shader program. If a shader stage or program fails to load, it will be treated as a fatal error.
-	*	The shader stages are aggregated and compiled, then each program is linked with its respective stages. Afterwards, the loaded shader stages
-	*	are cleared from memory.
+	*	The shader stages are aggregated and their code loaded. Each program is then loaded from the shader cache if its binary is current,
+	*	otherwise its stages are compiled and it is linked and saved to the cache. Afterwards, the loaded shader stages are cleared from memory.
 	* @returns True if all shader programs were loaded successfully, or false if there was a failure.
 	*/
 	bool loadPrograms();
@@ -131,6 +149,20 @@ public:
 	* @returns Reference to struct containing information on the uniform block
 	*/
 	UniformBlockData& getUniformBlock( UniformBlockIDs blockIdentifier );
+
+	/**
+	* @brief Allocate a uniform block in the uniform arena for this frame.
+	* @details The block is only valid until the frame is drawn. Blocks for a single draw are passed with the draw,
+	*	blocks for the whole frame are bound with bindUniformBlock.
+	* @param[in]	blockIdentifier		The hardcoded block identifier, decides the size of the allocation.
+	* @param[out]	pOffset				Offset of the block in the arena.
+	* @returns Where to write the block, or null if the arena is full this frame. See CStreamBuffer::allocate.
+	*/
+	void* allocateUniformBlock( UniformBlockIDs blockIdentifier, GLintptr *pOffset );
+	/**
+	* @brief Bind a block allocated this frame to the binding point of its uniform block.
+	*/
+	void bindUniformBlock( UniformBlockIDs blockIdentifier, GLintptr offset );
 };
 
 /**
@@ -151,9 +183,6 @@ private:
 
 	std::vector<GLint> m_uniformLocations;
 	std::map<std::string, size_t> m_uniformNameToIndex;
-
-	bool m_updateUniforms;
-	std::vector<std::function<void()>> m_updateCallbacks;
 public:
 	CShaderProgram( CGame* pGameHandle, std::string programName );
 	~CShaderProgram();
@@ -176,6 +205,13 @@ public:
 	* @returns True if successfully linked, or false if otherwise. Errors will be dumped to the #SHADER_LINK_LOG file.
 	*/
 	bool link( std::vector<std::string> uniformNames );
+	/**
+	* @brief Find the uniform locations and bind the global uniform blocks.
+	* @details Called by link, or after the program was loaded from a binary instead of linked.
+	* @param[in]	uniformNames	The names of the uniforms to search for.
+	* @returns True if successful, or false if otherwise.
+	*/
+	bool initializeUniforms( const std::vector<std::string> &uniformNames );
 
 	/**
 	* @brief Bind the shader object. Should only be called by shader manager.
@@ -183,12 +219,6 @@ public:
 	*/
 	void bind();
 
-	/**
-	* @brief Add to the list of functions to call when uniforms are updated.
-	* @param[in]	callback	Should be a pointer to the callback function.
-	*/
-	void subscribeToUniformUpdate( std::function<void()> callback );
-
 	/**
 	* @brief Get uniform location from name.
 	* @details Slow lookup to get the uniform index from the uniform name in the lookup table.
@@ -209,13 +239,6 @@ public:
 
 	inline std::string getProgramName() { return m_programName;  }
 	GLuint getProgramId() { return m_shaderProgramId; }
-
-	/**
-	* @brief Hint to the shader that the uniforms need to be updated.
-	* @details This will tell the shader to call the subscribing uniform update functions
-	*	after the next bind call.
-	*/
-	inline void requireUniformUpdate() { m_updateUniforms = true; }
 };
 
 /**
@@ -234,6 +257,9 @@ private:
 	GLenum m_shaderType;
 
 	GLuint m_shaderObjectId;
+	/** The GLSL code, kept until the stage is deleted */
+	std::string m_source;
+	bool m_compiled;
 
 	std::vector<GLuint> m_programsAttachedTo;
 public:
@@ -248,13 +274,19 @@ public:
 	void deleteShader();
 
 	/**
-	* @brief Load the shader stage code from a file and compile.
-	* @details This takes the shader stage code from a text file and compiles it to binary. This also creates the GL shader stage object
-	*	if it did not exist prior.
+	* @brief Load the shader stage code from a file.
+	* @details Finds the file for the highest GLSL version supported, and reads the code without compiling it. The code
+	*	is all the shader cache needs to know if a program using the stage is cached.
 	* @param[in]	relPath		The relative path to the shader in the shader directory.
-	* @return Returns true if successfully loaded the code and compiled it, false if it failed. Errors will be dumped to the #SHADER_COMPILE_LOG file.
+	* @return Returns true if successfully loaded the code, false if it failed.
+	*/
+	bool loadFromFile( std::string relPath );
+	/**
+	* @brief Compile the loaded code.
+	* @details This also creates the GL shader stage object if it did not exist prior.
+	* @return Returns true if successfully compiled, false if it failed. Errors will be dumped to the #SHADER_COMPILE_LOG file.
 	*/
-	bool createFromFile( std::string relPath );
+	bool compile();
 
 	/**
 	* @brief Attach the shader stage to a program with the given ID
@@ -280,4 +312,6 @@ public:
 	inline GLenum getShaderType() { return m_shaderType; }
 	/** Get the OpenGL shader stage ID */
 	inline GLuint getShaderId() { return m_shaderObjectId; }
+	inline const std::string& getSource() const { return m_source; }
+	inline bool isCompiled() const { return m_compiled; }
 };
\ No newline at end of file
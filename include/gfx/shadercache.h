@@ -0,0 +1,99 @@
+/**
+* @file shadercache.h
+* @brief Contains the CShaderCache class, which saves linked shader programs so they need not be compiled again.
+* @details Compiling and linking every program from GLSL takes most of the startup time on some drivers. A program
+*	binary from glGetProgramBinary loads much faster, but only on the driver that made it, and only for the same source.
+*
+* @author Timothy Volpe
+* @date 5/17/2020
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <boost/filesystem.hpp>
+#include <gl\glew.h>
+
+/** Directory in the cache location the program binaries are kept in */
+#define SHADER_CACHE_DIRECTORY "shaders"
+#define SHADER_CACHE_EXTENSION ".bin"
+/** First bytes of every cache file, "VXSB" */
+#define SHADER_CACHE_MAGIC 0x42535856
+/** Increase when the layout of the cache files changes */
+#define SHADER_CACHE_VERSION 1
+
+class CGame;
+
+/**
+* @brief Counts of programs found in the shader cache.
+*/
+struct ShaderCacheStats
+{
+	/** Programs loaded from their binary */
+	uint32_t hitCount;
+	/** Programs with no binary */
+	uint32_t missCount;
+	/** Programs with a binary made from other source or by another driver, or that the driver would not load */
+	uint32_t staleCount;
+};
+
+/**
+* @brief Saves and loads program binaries, one file per program.
+* @details Each file records a hash of the source of every stage of the program, and the vendor, renderer and
+*	version strings of the driver. A binary is only loaded if both match, so editing a shader or updating the
+*	driver invalidates it. The driver may still refuse a binary, in which case the program is left unlinked and
+*	should be compiled from source as if it was not cached. The new binary then replaces the stale one.
+*
+*	Needs GL_ARB_get_program_binary and at least one binary format, without them the cache does nothing.
+*
+* @author Timothy Volpe
+* @date 5/17/2020
+*/
+class CShaderCache
+{
+private:
+	CGame *m_pGameHandle;
+
+	bool m_enabled;
+	boost::filesystem::path m_cacheDirectory;
+	/** Vendor, renderer and version of the driver */
+	std::string m_driverString;
+
+	ShaderCacheStats m_stats;
+
+	boost::filesystem::path getProgramPath( const std::string &programName ) const;
+public:
+	/**
+	* @brief Hash a string, FNV-1a.
+	* @param[in]	hash	The hash of whatever came before, to hash several strings in a row.
+	*/
+	static uint64_t HashString( const std::string &str, uint64_t hash = 14695981039346656037ull );
+
+	CShaderCache( CGame *pGameHandle );
+	~CShaderCache();
+
+	/**
+	* @brief Check for program binary support and create the cache directory.
+	* @details The cache is disabled if binaries are not supported or the directory cannot be made, that is not an error.
+	*/
+	void initialize();
+
+	/**
+	* @brief Load a program from its binary.
+	* @param[in]	programName		Name of the program, names the file.
+	* @param[in]	sourceHash		Hash of the source of every stage of the program, see HashString.
+	* @param[in]	program			The GL program object to load into, with no shaders attached.
+	* @returns True if the program was loaded and is linked, false if it must be compiled and linked from source.
+	*/
+	bool loadProgram( const std::string &programName, uint64_t sourceHash, GLuint program );
+	/**
+	* @brief Save the binary of a program linked from source.
+	* @details The program should have been linked with GL_PROGRAM_BINARY_RETRIEVABLE_HINT set. Failing to save
+	*	only logs a warning.
+	*/
+	void saveProgram( const std::string &programName, uint64_t sourceHash, GLuint program );
+
+	inline bool isEnabled() const { return m_enabled; }
+	inline const ShaderCacheStats& getStats() const { return m_stats; }
+};
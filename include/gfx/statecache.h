@@ -0,0 +1,172 @@
+/**
+* @file statecache.h
+* @brief Contains the CRenderStateCache class, which drops state changes that would not change anything.
+* @details The cache sits between the client and the render backend, so callers can bind what they need without
+*	checking what is already bound. It keeps a copy of the state it has set, and passes a command on only if it
+*	changes that state.
+*
+* @author Timothy Volpe
+* @date 5/17/2020
+*/
+
+#pragma once
+
+#include <map>
+#include <unordered_map>
+#include "gfx/backend.h"
+
+/**
+* @brief Forwards commands to another render backend, except state changes that set what is already set.
+* @details Shadows the bound program, vertex array, buffer of each target, indexed buffer ranges, capabilities
+*	and fixed function state. Anything it cannot be sure of, like a binding to a deleted buffer, is forgotten
+*	so the next change goes through.
+*
+*	The stats are those of the backend behind it, with the state changes that were skipped added.
+*
+* @author Timothy Volpe
+* @date 5/17/2020
+*/
+class CRenderStateCache : public IRenderBackend
+{
+private:
+	struct BufferRange
+	{
+		GLuint buffer;
+		GLintptr offset;
+		GLsizeiptr size;
+	};
+
+	CGame *m_pGameHandle;
+
+	/** The backend commands are passed on to, owned by the cache */
+	IRenderBackend *m_pBackend;
+
+	uint64_t m_skippedStateCount;
+	mutable RenderBackendStats m_stats;
+
+	GLuint m_program;
+	GLuint m_vertexArray;
+	/** Buffers bound to each target, a missing target is not known */
+	std::unordered_map<GLenum, GLuint> m_buffers;
+	/** Buffer ranges bound to each target and index */
+	std::map<std::pair<GLenum, GLuint>, BufferRange> m_bufferRanges;
+	std::unordered_map<GLenum, bool> m_capabilities;
+	/** Zero until set */
+	GLenum m_depthFunction, m_cullFace, m_frontFace;
+	/** Negative until set */
+	GLfloat m_pointSize;
+	GLfloat m_clearColor[4];
+	bool m_clearColorSet;
+
+	/** Count a state change that did not need to reach the backend */
+	inline void skipState() { m_skippedStateCount++; }
+public:
+	/**
+	* @param[in]	pGameHandle		The game handle.
+	* @param[in]	pBackend		The backend to forward to, deleted with the cache.
+	*/
+	CRenderStateCache( CGame *pGameHandle, IRenderBackend *pBackend );
+	~CRenderStateCache();
+
+	bool initialize();
+	void shutdown();
+
+	inline const char* getName() const { return m_pBackend->getName(); }
+	inline char getSupportLevel() const { return m_pBackend->getSupportLevel(); }
+	inline bool isExtensionSupported( const char *pExtension ) { return m_pBackend->isExtensionSupported( pExtension ); }
+	inline void endFrame() { m_pBackend->endFrame(); }
+
+	const RenderBackendStats& getStats() const;
+	void resetStats();
+
+	inline GLenum getError() { return m_pBackend->getError(); }
+	inline void getIntegerv( GLenum name, GLint *pValue ) { m_pBackend->getIntegerv( name, pValue ); }
+	inline const char* getString( GLenum name ) { return m_pBackend->getString( name ); }
+
+	void enable( GLenum capability );
+	void disable( GLenum capability );
+	void depthFunc( GLenum function );
+	void cullFace( GLenum face );
+	void frontFace( GLenum winding );
+	void pointSize( GLfloat size );
+	void clearColor( GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha );
+	inline void clear( GLbitfield mask ) { m_pBackend->clear( mask ); }
+
+	inline void genBuffers( GLsizei count, GLuint *pBuffers ) { m_pBackend->genBuffers( count, pBuffers ); }
+	void deleteBuffers( GLsizei count, const GLuint *pBuffers );
+	void bindBuffer( GLenum target, GLuint buffer );
+	void bindBufferRange( GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size );
+	inline void bufferData( GLenum target, GLsizeiptr size, const void *pData, GLenum usage ) { m_pBackend->bufferData( target, size, pData, usage ); }
+	inline void bufferStorage( GLenum target, GLsizeiptr size, const void *pData, GLbitfield flags ) { m_pBackend->bufferStorage( target, size, pData, flags ); }
+	inline void bufferSubData( GLenum target, GLintptr offset, GLsizeiptr size, const void *pData ) { m_pBackend->bufferSubData( target, offset, size, pData ); }
+	inline void* mapBufferRange( GLenum target, GLintptr offset, GLsizeiptr length, GLbitfield access ) {
+		return m_pBackend->mapBufferRange( target, offset, length, access );
+	}
+	inline GLboolean unmapBuffer( GLenum target ) { return m_pBackend->unmapBuffer( target ); }
+
+	inline GLsync fenceSync( GLenum condition, GLbitfield flags ) { return m_pBackend->fenceSync( condition, flags ); }
+	inline GLenum clientWaitSync( GLsync sync, GLbitfield flags, GLuint64 timeout ) { return m_pBackend->clientWaitSync( sync, flags, timeout ); }
+	inline void deleteSync( GLsync sync ) { m_pBackend->deleteSync( sync ); }
+
+	inline void genVertexArrays( GLsizei count, GLuint *pArrays ) { m_pBackend->genVertexArrays( count, pArrays ); }
+	void deleteVertexArrays( GLsizei count, const GLuint *pArrays );
+	void bindVertexArray( GLuint array );
+	inline void vertexAttribPointer( GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride, const void *pPointer ) {
+		m_pBackend->vertexAttribPointer( index, size, type, normalized, stride, pPointer );
+	}
+	inline void vertexAttribIPointer( GLuint index, GLint size, GLenum type, GLsizei stride, const void *pPointer ) {
+		m_pBackend->vertexAttribIPointer( index, size, type, stride, pPointer );
+	}
+	inline void vertexAttribLPointer( GLuint index, GLint size, GLenum type, GLsizei stride, const void *pPointer ) {
+		m_pBackend->vertexAttribLPointer( index, size, type, stride, pPointer );
+	}
+	inline void enableVertexAttribArray( GLuint index ) { m_pBackend->enableVertexAttribArray( index ); }
+	inline void vertexAttribDivisor( GLuint index, GLuint divisor ) { m_pBackend->vertexAttribDivisor( index, divisor ); }
+	inline void vertexAttrib3f( GLuint index, GLfloat x, GLfloat y, GLfloat z ) { m_pBackend->vertexAttrib3f( index, x, y, z ); }
+
+	inline GLuint createShader( GLenum type ) { return m_pBackend->createShader( type ); }
+	inline void deleteShader( GLuint shader ) { m_pBackend->deleteShader( shader ); }
+	inline void shaderSource( GLuint shader, const GLchar *pSource ) { m_pBackend->shaderSource( shader, pSource ); }
+	inline void compileShader( GLuint shader ) { m_pBackend->compileShader( shader ); }
+	inline void getShaderiv( GLuint shader, GLenum name, GLint *pValue ) { m_pBackend->getShaderiv( shader, name, pValue ); }
+	inline void getShaderInfoLog( GLuint shader, GLsizei maxLength, GLsizei *pLength, GLchar *pLog ) {
+		m_pBackend->getShaderInfoLog( shader, maxLength, pLength, pLog );
+	}
+	inline GLuint createProgram() { return m_pBackend->createProgram(); }
+	void deleteProgram( GLuint program );
+	inline void attachShader( GLuint program, GLuint shader ) { m_pBackend->attachShader( program, shader ); }
+	inline void detachShader( GLuint program, GLuint shader ) { m_pBackend->detachShader( program, shader ); }
+	inline void linkProgram( GLuint program ) { m_pBackend->linkProgram( program ); }
+	inline void getProgramiv( GLuint program, GLenum name, GLint *pValue ) { m_pBackend->getProgramiv( program, name, pValue ); }
+	inline void getProgramInfoLog( GLuint program, GLsizei maxLength, GLsizei *pLength, GLchar *pLog ) {
+		m_pBackend->getProgramInfoLog( program, maxLength, pLength, pLog );
+	}
+	void useProgram( GLuint program );
+	inline void programParameteri( GLuint program, GLenum name, GLint value ) { m_pBackend->programParameteri( program, name, value ); }
+	inline void getProgramBinary( GLuint program, GLsizei bufferSize, GLsizei *pLength, GLenum *pFormat, void *pBinary ) {
+		m_pBackend->getProgramBinary( program, bufferSize, pLength, pFormat, pBinary );
+	}
+	inline void programBinary( GLuint program, GLenum format, const void *pBinary, GLsizei length ) {
+		m_pBackend->programBinary( program, format, pBinary, length );
+	}
+
+	inline GLint getUniformLocation( GLuint program, const GLchar *pName ) { return m_pBackend->getUniformLocation( program, pName ); }
+	inline GLuint getUniformBlockIndex( GLuint program, const GLchar *pName ) { return m_pBackend->getUniformBlockIndex( program, pName ); }
+	inline void uniformBlockBinding( GLuint program, GLuint blockIndex, GLuint binding ) { m_pBackend->uniformBlockBinding( program, blockIndex, binding ); }
+	inline void uniform3fv( GLint location, GLsizei count, const GLfloat *pValue ) { m_pBackend->uniform3fv( location, count, pValue ); }
+	inline void uniformMatrix4fv( GLint location, GLsizei count, GLboolean transpose, const GLfloat *pValue ) {
+		m_pBackend->uniformMatrix4fv( location, count, transpose, pValue );
+	}
+
+	inline void drawArrays( GLenum mode, GLint first, GLsizei count ) { m_pBackend->drawArrays( mode, first, count ); }
+	inline void drawElements( GLenum mode, GLsizei count, GLenum type, const void *pIndices ) { m_pBackend->drawElements( mode, count, type, pIndices ); }
+	inline void drawElementsBaseVertex( GLenum mode, GLsizei count, GLenum type, const void *pIndices, GLint baseVertex ) {
+		m_pBackend->drawElementsBaseVertex( mode, count, type, pIndices, baseVertex );
+	}
+	inline void drawElementsInstanced( GLenum mode, GLsizei count, GLenum type, const void *pIndices, GLsizei instanceCount ) {
+		m_pBackend->drawElementsInstanced( mode, count, type, pIndices, instanceCount );
+	}
+	inline void multiDrawElementsIndirect( GLenum mode, GLenum type, const void *pIndirect, GLsizei drawCount, GLsizei stride ) {
+		m_pBackend->multiDrawElementsIndirect( mode, type, pIndirect, drawCount, stride );
+	}
+};
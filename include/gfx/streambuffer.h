@@ -0,0 +1,114 @@
+/**
+* @file streambuffer.h
+* @brief Contains the CStreamBuffer class, which takes data that changes every frame to the GPU.
+* @details The buffer is split into regions, and each frame writes the next region while the GPU may still be
+*	reading the regions of the frames before. Where buffer storage is supported the whole buffer stays mapped,
+*	and data is written straight into it.
+*
+* @author Timothy Volpe
+* @date 5/17/2020
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "gfx/graphics.h"
+
+/** Regions of a stream buffer, one is written while the GPU reads up to two frames behind it */
+#define STREAM_BUFFER_REGIONS 3
+
+/**
+* @brief Counts of what was written to a stream buffer.
+*/
+struct StreamBufferStats
+{
+	uint64_t frameCount;
+	uint64_t writtenBytes;
+	/** Frames that had to wait for the GPU to finish reading their region */
+	uint64_t stallCount;
+	/** Allocations that did not fit in the region */
+	uint64_t overflowCount;
+
+	inline double getWrittenBytesPerFrame() const { return frameCount ? (double)writtenBytes / (double)frameCount : 0.0; }
+};
+
+/**
+* @brief A ring of buffer regions written once per frame.
+* @details With GL_ARB_buffer_storage the buffer is mapped persistent and coherent when it is created. Each region
+*	is fenced after the frame that wrote it is drawn, and the fence is waited on before the region is written again,
+*	which only blocks if the GPU is more than two frames behind.
+*
+*	Without buffer storage, allocations are written to a copy of the region, and flush uploads what was written since
+*	with bufferSubData. The driver still has to keep the regions in flight, but never the one being written.
+*
+*	Stream buffers add themselves to the graphics class when created, which flushes them before drawing a frame and
+*	ends their frame after. Allocations are only valid until the frame is drawn.
+*
+* @author Timothy Volpe
+* @date 5/17/2020
+*/
+class CStreamBuffer
+{
+private:
+	CGame *m_pGameHandle;
+
+	std::shared_ptr<CBufferObject> m_buffer;
+	GLsizeiptr m_regionSize;
+	/** The whole buffer while it is mapped, otherwise null */
+	uint8_t *m_pMapped;
+	/** The region being written, when the buffer is not mapped */
+	std::vector<uint8_t> m_staging;
+	/** Fence after the last frame that wrote each region, or null */
+	GLsync m_regionFences[STREAM_BUFFER_REGIONS];
+
+	uint32_t m_region;
+	/** Set once the GPU is done with the region written this frame */
+	bool m_regionReady;
+	/** Bytes allocated in the region, and bytes of those already uploaded */
+	GLsizeiptr m_head, m_flushed;
+
+	StreamBufferStats m_stats;
+
+	/** Wait for the GPU to finish reading the current region */
+	void waitForRegion();
+public:
+	CStreamBuffer( CGame *pGameHandle );
+	~CStreamBuffer();
+
+	/**
+	* @brief Create and map the buffer.
+	* @param[in]	regionSize	Bytes that can be written each frame.
+	* @returns True if successful, false if otherwise.
+	*/
+	bool create( GLsizeiptr regionSize );
+	/**
+	* @brief Unmap and free the buffer.
+	*/
+	void destroy();
+
+	/**
+	* @brief Allocate space in the region of this frame.
+	* @param[in]	size		Bytes to allocate.
+	* @param[in]	alignment	The offset is a multiple of this from the start of the buffer, need not be a power of two.
+	* @param[out]	pOffset		Offset of the allocation from the start of the buffer.
+	* @returns Where to write the data, or null if the region is full. The memory may be write combined, it should be
+	*	written in order and never read.
+	*/
+	void* allocate( GLsizeiptr size, GLsizeiptr alignment, GLintptr *pOffset );
+	/**
+	* @brief Upload what was allocated since the last flush, only needed when the buffer is not mapped.
+	*/
+	void flush();
+	/**
+	* @brief Fence the region of this frame and move on to the next one, after the frame was drawn.
+	*/
+	void endFrame();
+
+	/** The buffer to bind, it holds every region */
+	inline std::shared_ptr<CBufferObject> getBuffer() const { return m_buffer; }
+	inline GLsizeiptr getRegionSize() const { return m_regionSize; }
+	inline bool isMapped() const { return m_pMapped != 0; }
+	inline const StreamBufferStats& getStats() const { return m_stats; }
+};
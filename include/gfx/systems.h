@@ -1,11 +1,19 @@
 #pragma once
 #include <glm\glm.hpp>
 #include <memory>
+#include <vector>
 #include "components.h"
+#include "gfx/streambuffer.h"
+
+/** Initial number of entities the entity stream buffer holds each frame */
+#define ENTITY_STREAM_INSTANCES 256
+/** The shader program entities are drawn with */
+#define ENTITY_SHADER_PROGRAM "entity"
+/** Flat colour of every entity, until entities have textures */
+#define ENTITY_COLOR glm::vec3( 1.0f, 0.8f, 0.2f )
 
 class CVertexArray;
 class CBufferObject;
-class CShaderProgram;
 class CCamera;
 
 struct Vertex3D
@@ -13,21 +21,43 @@ struct Vertex3D
 	glm::vec3 position;
 };
 
+/**
+* @brief Where and how an entity is drawn, one per instance.
+* @details Must match the instance attributes of the entity shader.
+*/
+struct EntityInstance
+{
+	glm::vec3 position;
+	/** Euler angles in radians, applied in x, y, z order */
+	glm::vec3 rotation;
+	glm::vec3 scale;
+};
+
+/**
+* @brief Draws every entity with a position as an instance of one mesh.
+* @details Each frame the positions, and the rotation and scale of entities that have a transform, are packed
+*	from the dense component arrays into the instance stream buffer, and all the entities are drawn with a
+*	single instanced draw.
+*/
 class CRenderSystem : public CSystemBase
 {
 private:
-	std::shared_ptr<CVertexArray> m_vertexArray;
-	std::shared_ptr<CBufferObject> m_vertexBuffer;
+	std::shared_ptr<CBufferObject> m_quadVertexBuffer;
+	std::shared_ptr<CBufferObject> m_quadIndexBuffer;
+	/** One per stream buffer region, the instance attributes of each read from the start of its region */
+	std::vector<std::shared_ptr<CVertexArray>> m_regionArrays;
+	/** Entity instances, written every frame */
+	CStreamBuffer m_instanceStream;
+	unsigned int m_streamInstances;
+	/** The instances of this frame, packed here before they are copied to the stream buffer in order */
+	std::vector<EntityInstance> m_instances;
 
-	std::shared_ptr<CShaderProgram> m_simpleProgram;
-
-	unsigned int m_simpleShaderIndex;
-	std::vector<Vertex3D> m_vertices;
-
-	unsigned int m_modelMatUniformLoc;
-	glm::mat4 m_modelMatrix;
+	unsigned int m_shaderIndex;
 
 	std::shared_ptr<CCamera> m_testCamera;
+
+	/** Make sure the stream buffer has room for the given number of instances each frame */
+	bool reserveInstances( unsigned int instanceCount );
 public:
 	CRenderSystem( CGame *pGameHandle, CECSCoordinator *pCoordinator );
 	~CRenderSystem();
@@ -38,6 +68,4 @@ public:
 	bool onLoad();
 
 	bool update( float deltaT );
-
-	void updateShaderUniforms();
 };
\ No newline at end of file
@@ -0,0 +1,98 @@
+/**
+* @file vertexarena.h
+* @brief Contains the CVertexArena class, which packs many meshes into a few large vertex buffers.
+* @details Meshes that share a buffer can share a vertex array, and be drawn together with one multi draw.
+*
+* @author Timothy Volpe
+* @date 5/17/2020
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <map>
+#include <set>
+#include <tuple>
+
+class CBufferObject;
+
+/**
+* @brief A range of vertices allocated from a CVertexArena.
+*/
+struct VertexArenaBlock
+{
+	/** The buffer the vertices are in, see CVertexArena::getPageBuffer */
+	uint32_t page;
+	/** Index of the first vertex in the buffer, the base vertex of a draw */
+	uint32_t first;
+	uint32_t count;
+};
+
+/**
+* @brief Allocates ranges of vertices from large vertex buffers, called pages.
+* @details Free ranges are kept in a set ordered by size, and each allocation takes the smallest range it fits in.
+*	Freed ranges are merged with the free ranges on either side, so the pages do not fragment into ranges too
+*	small to use. When no range fits, another page is created. A page is never smaller than the page size, but
+*	may be larger for a single large allocation.
+*
+*	The page buffers use dynamic storage, vertices are written with bufferSubData.
+*
+* @author Timothy Volpe
+* @date 5/17/2020
+*/
+class CVertexArena
+{
+private:
+	/** A free range, ordered by size first */
+	typedef std::tuple<uint32_t, uint32_t, uint32_t> FreeRange;
+
+	uint32_t m_vertexSize;
+	uint32_t m_pageVertices;
+
+	std::vector<std::shared_ptr<CBufferObject>> m_pages;
+	/** Size, page and first vertex of every free range */
+	std::set<FreeRange> m_freeBySize;
+	/** Free ranges of each page, from their first vertex to their size */
+	std::vector<std::map<uint32_t, uint32_t>> m_freeByPage;
+
+	uint64_t m_usedVertices, m_capacityVertices;
+
+	bool addPage( uint32_t vertexCount );
+	void addFreeRange( uint32_t page, uint32_t first, uint32_t count );
+	void removeFreeRange( uint32_t page, uint32_t first, uint32_t count );
+public:
+	CVertexArena();
+	~CVertexArena();
+
+	/**
+	* @brief Set the vertex size and page size, no pages are created until the first allocation.
+	* @param[in]	vertexSize		Bytes per vertex.
+	* @param[in]	pageVertices	Vertices per page.
+	*/
+	void initialize( uint32_t vertexSize, uint32_t pageVertices );
+	/**
+	* @brief Free every page, blocks allocated before are no longer valid.
+	*/
+	void destroy();
+
+	/**
+	* @brief Allocate a range of vertices, creating a page if none has room.
+	* @returns True if successful, false if a page could not be created.
+	*/
+	bool allocate( uint32_t count, VertexArenaBlock *pBlock );
+	void free( const VertexArenaBlock &block );
+	/**
+	* @brief Write the vertices of a block.
+	* @param[in]	pVertices	The vertices to write, block.count of them.
+	*/
+	void upload( const VertexArenaBlock &block, const void *pVertices );
+
+	inline uint32_t getPageCount() const { return (uint32_t)m_pages.size(); }
+	inline std::shared_ptr<CBufferObject> getPageBuffer( uint32_t page ) const { return m_pages[page]; }
+	inline uint64_t getUsedBytes() const { return m_usedVertices * m_vertexSize; }
+	inline uint64_t getCapacityBytes() const { return m_capacityVertices * m_vertexSize; }
+	/** The number of free ranges, more than one per page means the pages are fragmented */
+	inline size_t getFreeRangeCount() const { return m_freeBySize.size(); }
+};
@@ -0,0 +1,111 @@
+/**
+* @file visibility.h
+* @brief Contains the CChunkVisibilityGraph class, which finds the chunks that can be seen from the camera chunk.
+* @details Every meshed chunk records which pairs of its faces can see each other, see ChunkMesh::faceConnections.
+*	A breadth-first search from the camera chunk only crosses a chunk from the face it entered through to faces
+*	connected to it. It never steps back against a direction it already moved in, so the search spreads away from
+*	the camera. Chunks outside the view frustum are not entered.
+*
+*	A chunk that is not reached cannot be seen, so a player underground only draws the caves around them instead of
+*	every chunk of terrain in view. A chunk that is reached is not always visible, the search is conservative.
+*
+*	Chunks above the world are open. Chunks in the world without a mesh yet are closed, so a view opens up as the
+*	chunks in it are meshed.
+*
+* @author Timothy Volpe
+* @date 5/17/2020
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <glm/glm.hpp>
+#include "chunk.h"
+#include "gfx/frustum.h"
+
+/** Furthest the search goes from the camera chunk, in chunks on each axis */
+#define CHUNK_VISIBILITY_MAX_DISTANCE 64
+
+/**
+* @brief Counts of visibility searches.
+*/
+struct VisibilityStats
+{
+	uint64_t searchCount;
+	/** Chunks reached */
+	uint64_t reachedCount;
+	double seconds;
+
+	inline double getReachedPerSearch() const { return searchCount ? (double)reachedCount / (double)searchCount : 0.0; }
+	inline double getMicrosecondsPerSearch() const { return searchCount ? seconds * 1000000.0 / (double)searchCount : 0.0; }
+};
+
+/**
+* @brief Keeps the face connections of meshed chunks, and searches them for the chunks the camera can see.
+* @details Does not touch OpenGL.
+*
+* @author Timothy Volpe
+* @date 5/17/2020
+*/
+class CChunkVisibilityGraph
+{
+private:
+	struct ChunkNode
+	{
+		uint16_t faceConnections;
+		/** Search the chunk was last reached in */
+		uint32_t reachedSearch;
+	};
+	struct SearchStep
+	{
+		ChunkPos position;
+		/** Face the search came in through, or #FACE_COUNT for the camera chunk */
+		uint8_t entryFace;
+		/** Bit of every face the search moved out through on the way here */
+		uint8_t directions;
+		uint16_t faceConnections;
+	};
+
+	std::unordered_map<ChunkPos, ChunkNode, ChunkPosHash> m_nodes;
+	/** Chunks above the world reached in the current search, they have no node */
+	std::unordered_set<ChunkPos, ChunkPosHash> m_openReached;
+	std::vector<SearchStep> m_queue;
+	uint32_t m_searchIndex;
+
+	VisibilityStats m_stats;
+
+	/** Mark a chunk reached in the current search and get its connections, returns false if it already was or it is closed */
+	bool reach( const ChunkPos &position, uint16_t *pFaceConnections );
+public:
+	CChunkVisibilityGraph();
+	~CChunkVisibilityGraph();
+
+	/**
+	* @brief Set the face connections of a chunk, see ChunkMesh::faceConnections.
+	*/
+	void setChunk( const ChunkPos &position, uint16_t faceConnections );
+	/**
+	* @brief Forget a chunk that was unloaded, it is closed until it is set again.
+	*/
+	void removeChunk( const ChunkPos &position );
+	void clear();
+
+	/**
+	* @brief Find the chunks that can be seen from a camera chunk.
+	* @param[in]	cameraChunk		The chunk the camera is in.
+	* @param[in]	pPlanes			#FRUSTUM_PLANE_COUNT frustum planes, see ExtractFrustumPlanes.
+	*/
+	void search( const ChunkPos &cameraChunk, const glm::vec4 *pPlanes );
+	/**
+	* @brief Check if a chunk was reached by the last search.
+	*/
+	bool isReached( const ChunkPos &position ) const;
+
+	inline size_t getChunkCount() const { return m_nodes.size(); }
+
+	inline const VisibilityStats& getStats() const { return m_stats; }
+	inline void resetStats() { m_stats = VisibilityStats(); }
+};
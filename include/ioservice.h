@@ -0,0 +1,187 @@
+/**
+* @file ioservice.h
+* @brief Contains the CIOService class, which performs disk reads and writes off of the calling thread.
+* @details On Linux, requests are submitted in batches to an io_uring instance owned by the I/O thread.
+*	Everywhere else, or if io_uring is not available at runtime, requests are run on a small thread pool.
+*	io_uring support is compiled in when IO_URING_SUPPORTED is defined, see CMakeLists.txt.
+*
+* @author Timothy Volpe
+* @date 5/12/2020
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <queue>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <boost/filesystem.hpp>
+
+/** Number of submission queue entries in the io_uring, also the maximum requests in flight */
+#define IO_QUEUE_DEPTH 64
+/** Milliseconds the io_uring thread waits before retrying a submit that failed without completing anything */
+#define IO_RING_RETRY_MS 1
+/** Number of workers used by the thread pool backend */
+#define IO_FALLBACK_THREADS 2
+
+class CGame;
+class CThreadPool;
+
+/** Identifies a file opened by the I/O service, 0 is invalid */
+typedef uint32_t IOFileId;
+
+enum IORequestTypes : uint8_t
+{
+	/** Read buffer.size() bytes at offset */
+	IO_REQUEST_READ,
+	/** Write the contents of buffer at offset */
+	IO_REQUEST_WRITE,
+	/** Flush the file data to disk */
+	IO_REQUEST_SYNC
+};
+
+enum IOBackends
+{
+	IO_BACKEND_NONE,
+	IO_BACKEND_THREADPOOL,
+	IO_BACKEND_IO_URING
+};
+
+struct IORequest;
+/** Called on the thread that calls CIOService::dispatchCompletions */
+typedef std::function<void( IORequest& )> IOCompletionCallback;
+
+/**
+* @brief A single read, write or sync operation.
+*/
+struct IORequest
+{
+	IORequestTypes type;
+	IOFileId file;
+	uint64_t offset;
+	/** For reads, resize to the number of bytes to read. For writes, the data to write. */
+	std::vector<uint8_t> buffer;
+	/** Bytes transferred, or a negative error code */
+	int64_t result;
+	IOCompletionCallback callback;
+};
+
+/**
+* @brief Asynchronous disk I/O service.
+* @details Requests are queued with submit from any thread, but completion callbacks are only invoked from
+*	dispatchCompletions, which should be called once per server tick. This means callbacks run on the simulation
+*	thread and can touch game state without locking, while the reads and writes themselves never block it.
+*
+* @author Timothy Volpe
+* @date 5/12/2020
+*/
+class CIOService
+{
+private:
+	struct IOFile
+	{
+		intptr_t nativeHandle;
+		bool writable;
+	};
+
+	CGame *m_pGameHandle;
+
+	IOBackends m_backend;
+
+	std::mutex m_fileMutex;
+	std::vector<IOFile> m_openFiles;
+
+	std::mutex m_submitMutex;
+	std::condition_variable m_submitAvailable;
+	std::vector<std::unique_ptr<IORequest>> m_submitQueue;
+
+	std::mutex m_completeMutex;
+	std::condition_variable m_requestsFinished;
+	std::vector<std::unique_ptr<IORequest>> m_completeQueue;
+	std::vector<std::unique_ptr<IORequest>> m_dispatchQueue;
+
+	std::atomic<bool> m_running;
+	std::atomic<uint32_t> m_requestsInFlight;
+
+	std::thread m_ioThread;
+	CThreadPool *m_pFallbackPool;
+
+#ifdef IO_URING_SUPPORTED
+	struct IOUring;
+	IOUring *m_pRing;
+
+	bool createRing();
+	void destroyRing();
+	void ringThreadMain();
+#endif
+
+	/** Performs a request synchronously on the calling thread, used by the thread pool backend */
+	void performBlocking( IORequest *pRequest );
+	void completeRequest( std::unique_ptr<IORequest> request );
+
+	intptr_t getNativeHandle( IOFileId file );
+public:
+	CIOService( CGame *pGameHandle );
+	~CIOService();
+
+	/**
+	* @brief Start the I/O service, trying io_uring first if it was compiled in.
+	* @returns True if a backend was started, false if otherwise.
+	*/
+	bool initialize();
+	/**
+	* @brief Wait for requests in flight to finish and stop the service.
+	* @details Completions that have not been dispatched are dropped, their callbacks are not called.
+	*/
+	void shutdown();
+
+	/**
+	* @brief Open a file for use with the service.
+	* @param[in]	filePath	The file to open. It must already exist.
+	* @param[in]	writable	If true the file is opened for reading and writing, otherwise only reading.
+	* @returns The file ID, or 0 if the file could not be opened.
+	*/
+	IOFileId openFile( const boost::filesystem::path &filePath, bool writable );
+	/**
+	* @brief Close a file. There must not be any requests in flight for it.
+	*/
+	void closeFile( IOFileId file );
+
+	/**
+	* @brief Queue a request.
+	* @details Thread-safe. With io_uring, everything queued while the I/O thread is busy is submitted with a single system call.
+	*/
+	void submit( std::unique_ptr<IORequest> request );
+
+	/**
+	* @brief Queue a read request.
+	* @param[in]	file		The file to read from
+	* @param[in]	offset		The byte offset to read from
+	* @param[in]	length		The number of bytes to read
+	* @param[in]	callback	Called from dispatchCompletions when the read is finished
+	*/
+	void read( IOFileId file, uint64_t offset, size_t length, IOCompletionCallback callback );
+	/**
+	* @brief Queue a write request. The data is moved into the request.
+	*/
+	void write( IOFileId file, uint64_t offset, std::vector<uint8_t> data, IOCompletionCallback callback );
+
+	/**
+	* @brief Invoke the callbacks of finished requests on the calling thread.
+	* @returns The number of callbacks invoked.
+	*/
+	unsigned int dispatchCompletions();
+
+	/**
+	* @brief Block until every submitted request has finished. Completions still need to be dispatched.
+	*/
+	void waitIdle();
+
+	inline IOBackends getBackend() { return m_backend; }
+	inline uint32_t getRequestsInFlight() { return m_requestsInFlight; }
+};
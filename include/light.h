@@ -0,0 +1,163 @@
+/**
+* @file light.h
+* @brief Contains the CLightEngine class, which spreads block light and sky light through the loaded chunks.
+* @details Light is spread with breadth-first flood fills. Every chunk has its own queues, and each round processes
+*	every chunk with queued work in parallel. A fill only touches the chunk it runs in. When it reaches the edge of
+*	the chunk, it sends a message to the neighbouring chunk instead. Messages are delivered between rounds, so
+*	neighbouring chunks never share data while they run.
+*
+*	Edits run two fills. The remove fill darkens the cells that were lit by light that is gone. It re-queues the
+*	brighter cells it meets on the way, and the add fill then spreads light from them. Only the affected cells are
+*	visited, so an edit never relights a whole chunk.
+*
+*	Sky light enters at full strength from the top of the world, and travels straight down without fading. Light
+*	in every other direction fades by one level per block. Opaque blocks stop light.
+*
+* @author Timothy Volpe
+* @date 5/16/2020
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <unordered_map>
+#include <utility>
+#include "chunk.h"
+#include "threadpool.h"
+
+/** Rounds of light propagation run per server tick, leftover work carries over to the next tick */
+#define LIGHT_MAX_ROUNDS_PER_TICK 8
+
+/** Queue entries pack the block index, light level and a flag for light travelling down */
+#define LIGHT_ENTRY_INDEX_MASK 0x7FFF
+#define LIGHT_ENTRY_LEVEL_SHIFT 15
+#define LIGHT_ENTRY_DOWN_BIT (1 << 19)
+
+class CGame;
+
+enum LightChannels : uint8_t
+{
+	LIGHT_CHANNEL_BLOCK = 0,
+	LIGHT_CHANNEL_SKY,
+	LIGHT_CHANNEL_COUNT
+};
+
+/**
+* @brief Keeps the block light and sky light of the loaded chunks up to date.
+* @details Not thread-safe, must be used from the thread that owns the chunk store. Parallel work is done internally.
+*
+* @author Timothy Volpe
+* @date 5/16/2020
+*/
+class CLightEngine
+{
+private:
+	struct LightQueues
+	{
+		/** Cells already set to their new level, to spread from */
+		std::vector<uint32_t> add[LIGHT_CHANNEL_COUNT];
+		/** Cells already darkened, with the level they had */
+		std::vector<uint32_t> remove[LIGHT_CHANNEL_COUNT];
+		/** Light arriving from neighbouring chunks, not applied yet */
+		std::vector<uint32_t> incomingAdd[LIGHT_CHANNEL_COUNT];
+		std::vector<uint32_t> incomingRemove[LIGHT_CHANNEL_COUNT];
+
+		bool empty() const;
+	};
+	struct LightMessage
+	{
+		ChunkPos target;
+		uint8_t channel;
+		bool remove;
+		uint32_t entry;
+	};
+	struct LightTask
+	{
+		CChunk *pChunk;
+		LightQueues *pQueues;
+		std::vector<LightMessage> outbox;
+	};
+
+	CGame *m_pGameHandle;
+
+	CChunkStore *m_pChunkStore;
+	CThreadPool m_threadPool;
+
+	std::unordered_map<ChunkPos, LightQueues, ChunkPosHash> m_queues;
+	std::vector<LightTask> m_tasks;
+
+	static inline uint32_t PackEntry( uint32_t index, uint32_t level, bool down = false ) {
+		return index | (level << LIGHT_ENTRY_LEVEL_SHIFT) | (down ? LIGHT_ENTRY_DOWN_BIT : 0);
+	}
+
+	/** Queue a cell that was already set to spread from, ignored if the chunk is not loaded */
+	void queueAdd( const ChunkPos &position, LightChannels channel, uint32_t index, uint8_t level );
+
+	/** Spread the queued work of one chunk, only touches that chunk */
+	void processChunk( LightTask &task );
+	void processRemoves( LightTask &task, LightChannels channel );
+	void processAdds( LightTask &task, LightChannels channel );
+
+	/** Queue fills across the face between two loaded chunks wherever one side is brighter than it allows the other to be */
+	void reconcileBorder( CChunk *pChunk, CChunk *pNeighbour, uint8_t face );
+
+	/** Reset the light of a column to its sky light and light sources, and queue the fills inside it. False if not fully loaded. */
+	bool seedColumn( int32_t columnX, int32_t columnZ );
+	/** Queue the fills across the sides of a column */
+	void reconcileColumn( int32_t columnX, int32_t columnZ );
+public:
+	CLightEngine( CGame *pGameHandle );
+	~CLightEngine();
+
+	/**
+	* @brief Start the propagation threads.
+	* @param[in]	pChunkStore		The chunks to light.
+	* @returns True if successful, false if otherwise.
+	*/
+	bool initialize( CChunkStore *pChunkStore );
+	/**
+	* @brief Stop the propagation threads and drop any queued work.
+	*/
+	void shutdown();
+
+	/**
+	* @brief Compute the light of a newly loaded chunk column.
+	* @details Sky light is filled straight down each block column and block light is set at light sources. The
+	*	fills to spread them, and the light crossing over from loaded neighbours, are queued for update.
+	*/
+	void lightColumn( int32_t columnX, int32_t columnZ );
+	/**
+	* @brief Queue the light changes caused by a block edit. The block must already be set in the chunk store.
+	* @param[in]	x, y, z		World block coordinates of the edit.
+	* @param[in]	oldBlock	The block that was replaced.
+	* @param[in]	newBlock	The block that was placed.
+	*/
+	void onBlockChanged( int32_t x, int32_t y, int32_t z, BlockId oldBlock, BlockId newBlock );
+	/**
+	* @brief Recompute the light of chunk columns from scratch, after edits too large to queue block by block.
+	* @details Queued work is finished first. Light spreads at most #LIGHT_LEVEL_MAX blocks sideways, so the light
+	*	of an edited column can only reach the columns next to it, and those must be included too.
+	* @param[in]	columns		Column X and Z chunk coordinates. Columns that are not fully loaded are skipped.
+	*/
+	void relightColumns( const std::vector<std::pair<int32_t, int32_t>> &columns );
+
+	/**
+	* @brief Run rounds of propagation over every chunk with queued work.
+	* @param[in]	maxRounds	The most rounds to run, messages between chunks are delivered once per round.
+	* @returns True if work is left over, false if the light is up to date.
+	*/
+	bool update( unsigned int maxRounds );
+	/**
+	* @brief Run propagation until the light is up to date.
+	*/
+	void finish();
+
+	inline bool hasQueuedWork() const { return !m_queues.empty(); }
+
+	/**
+	* @brief Get the block light and sky light at a world block, 0 if the chunk is not loaded.
+	*/
+	uint8_t getBlockLight( int32_t x, int32_t y, int32_t z );
+	uint8_t getSkyLight( int32_t x, int32_t y, int32_t z );
+};
@@ -0,0 +1,147 @@
+/**
+* @file physics.h
+* @brief Contains the CVoxelPhysics class, which moves boxes through the block grid, and CPhysicsSystem, which
+*	applies it to entities.
+* @details Bodies are axis-aligned boxes. Each step, gravity is applied, and the move is clipped against the solid
+*	blocks it sweeps through one axis at a time, vertical first, so bodies slide along walls and land on floors.
+*	The blocks are gathered chunk by chunk, so the chunk store is searched once per chunk the move touches
+*	instead of once per block. Chunks that are not loaded block movement, so bodies do not fall out of the world
+*	while it streams in.
+*
+* @author Timothy Volpe
+* @date 5/17/2020
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+#include "components.h"
+#include "chunk.h"
+
+/** Length of one physics step in seconds, updates run as many whole steps as fit in the elapsed time */
+#define PHYSICS_TIMESTEP (1.0f/60.0f)
+/** Most steps run in one update, time beyond this is dropped so a slow tick does not snowball */
+#define PHYSICS_MAX_STEPS_PER_UPDATE 8
+/** Downward acceleration in blocks per second squared */
+#define PHYSICS_GRAVITY 32.0f
+/** Fastest a body can fall in blocks per second */
+#define PHYSICS_TERMINAL_VELOCITY 78.4f
+/** Tolerance for touching surfaces, a body resting on a floor does not collide with it sideways */
+#define PHYSICS_EPSILON 0.0001f
+
+class CChunkStore;
+class CChunk;
+
+/**
+* @brief The state of one moving box.
+*/
+struct PhysicsBody
+{
+	/** Center of the box */
+	glm::vec3 position;
+	glm::vec3 velocity;
+	glm::vec3 halfExtents;
+	/** Set if the last step was stopped by a block below */
+	bool onGround;
+};
+
+/**
+* @brief Timing of physics steps.
+*/
+struct PhysicsStats
+{
+	/** One body moved by one step */
+	uint64_t bodySteps;
+	double seconds;
+
+	inline double getBodyStepsPerSecond() const { return seconds > 0.0 ? (double)bodySteps / seconds : 0.0; }
+};
+
+/**
+* @brief Moves batches of bodies against the blocks of a chunk store.
+* @details Keeps scratch space between calls, so steady-state stepping does not allocate.
+*	Not thread-safe, must be used from the thread that owns the chunk store.
+*
+* @author Timothy Volpe
+* @date 5/17/2020
+*/
+class CVoxelPhysics
+{
+private:
+	struct BlockCoord
+	{
+		int32_t x, y, z;
+	};
+
+	CChunkCache m_chunkCache;
+
+	/** Solid blocks near the body being moved */
+	std::vector<BlockCoord> m_candidates;
+
+	PhysicsStats m_stats;
+
+	/** Collect the solid blocks overlapping a box of world block coordinates, inclusive */
+	void gatherSolidBlocks( const int32_t *pMin, const int32_t *pMax );
+	/** Limit a move along one axis so the box does not enter any candidate block */
+	float clipAxis( const glm::vec3 &boxMin, const glm::vec3 &boxMax, uint32_t axis, float delta ) const;
+
+	void stepBody( PhysicsBody &body, float timestep );
+public:
+	CVoxelPhysics( CChunkStore *pChunkStore );
+	~CVoxelPhysics();
+
+	/**
+	* @brief Advance every body by one step.
+	* @param[in,out]	pBodies		The bodies to move. Bodies close together should be next to each other.
+	* @param[in]		count		The number of bodies.
+	* @param[in]		timestep	Length of the step in seconds.
+	*/
+	void step( PhysicsBody *pBodies, size_t count, float timestep );
+
+	inline const PhysicsStats& getStats() const { return m_stats; }
+	inline void resetStats() { m_stats = PhysicsStats(); }
+};
+
+/**
+* @brief Moves every entity with a position, a box and a velocity with fixed-length physics steps.
+* @details Components are copied into one batch per update, all the steps are run on the batch, and the results are
+*	copied back. The batch is sorted by chunk so that neighbouring bodies share cached chunk lookups.
+*
+* @author Timothy Volpe
+* @date 5/17/2020
+*/
+class CPhysicsSystem : public CSystemBase
+{
+private:
+	struct BatchEntry
+	{
+		uint64_t chunkKey;
+		Entity entity;
+	};
+
+	CVoxelPhysics *m_pPhysics;
+
+	/** Elapsed time not yet simulated */
+	float m_accumulator;
+
+	/** Entities in the order of the batch */
+	std::vector<BatchEntry> m_batchOrder;
+	std::vector<PhysicsBody> m_bodies;
+public:
+	CPhysicsSystem( CGame *pGameHandle, CECSCoordinator *pCoordinator );
+	~CPhysicsSystem();
+
+	bool initialize();
+	void shutdown();
+
+	/**
+	* @brief Set the blocks that entities collide with, must be done before the first update.
+	*/
+	void setChunkStore( CChunkStore *pChunkStore );
+
+	bool update( float deltaT );
+
+	inline CVoxelPhysics* getPhysics() { return m_pPhysics; }
+};
@@ -0,0 +1,108 @@
+/**
+* @file raycast.h
+* @brief Contains the CVoxelRaycaster class, which finds the first block along a ray.
+* @details Rays walk the block grid with the Amanatides-Woo traversal, visiting every block the ray passes through
+*	in order. Chunks that are all air, chunks that are not loaded, and empty sections of a chunk are crossed in a
+*	single step each instead of block by block.
+*
+* @author Timothy Volpe
+* @date 5/17/2020
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+#include "chunk.h"
+
+/** Which blocks stop a ray */
+enum RaycastStopTypes : uint8_t
+{
+	/** Any block that is not air, for picking blocks */
+	RAYCAST_STOP_ANY = 0,
+	/** Opaque blocks, for line of sight */
+	RAYCAST_STOP_OPAQUE,
+	/** Solid blocks, for projectiles */
+	RAYCAST_STOP_SOLID
+};
+
+/**
+* @brief A ray to cast.
+*/
+struct RaycastQuery
+{
+	glm::vec3 origin;
+	/** Does not need to be normalized */
+	glm::vec3 direction;
+	/** Distance along the ray in blocks to give up after */
+	float maxDistance;
+	RaycastStopTypes stopType;
+};
+
+/**
+* @brief The result of a raycast.
+*/
+struct RaycastHit
+{
+	bool hit;
+	/** World block coordinates of the block that was hit */
+	int32_t x, y, z;
+	BlockId block;
+	/** The face of the block the ray entered through, see BlockFaces, or #FACE_COUNT if the ray started inside it */
+	uint8_t face;
+	/** Distance from the origin to where the ray entered the block */
+	float distance;
+};
+
+/**
+* @brief Timing of batched raycasts.
+*/
+struct RaycastStats
+{
+	uint64_t rayCount;
+	/** Blocks visited, not counting the blocks skipped over in empty chunks and sections */
+	uint64_t stepCount;
+	double seconds;
+
+	inline double getRaysPerSecond() const { return seconds > 0.0 ? (double)rayCount / seconds : 0.0; }
+};
+
+/**
+* @brief Casts rays through the blocks of a chunk store.
+* @details Remembers the last chunk looked up, since consecutive steps and the rays of a batch are mostly in the same
+*	chunk. Not thread-safe, must be used from the thread that owns the chunk store.
+*
+* @author Timothy Volpe
+* @date 5/17/2020
+*/
+class CVoxelRaycaster
+{
+private:
+	CChunkCache m_chunkCache;
+
+	RaycastStats m_stats;
+
+	bool castRay( const RaycastQuery &query, RaycastHit *pHit );
+public:
+	CVoxelRaycaster( CChunkStore *pChunkStore );
+	~CVoxelRaycaster();
+
+	/**
+	* @brief Find the first block along a ray that stops it.
+	* @param[in]	query	The ray.
+	* @param[out]	pHit	Receives the hit. If nothing was hit, hit is false and the other fields are undefined.
+	* @returns True if a block was hit, false if otherwise.
+	*/
+	bool cast( const RaycastQuery &query, RaycastHit *pHit );
+	/**
+	* @brief Cast many rays, such as the sight checks of every entity in a tick.
+	* @param[in]	queries		The rays.
+	* @param[out]	hits		Resized to the number of queries, with a result for each.
+	* @returns The number of rays that hit a block.
+	*/
+	size_t castBatch( const std::vector<RaycastQuery> &queries, std::vector<RaycastHit> &hits );
+
+	inline const RaycastStats& getStats() const { return m_stats; }
+	inline void resetStats() { m_stats = RaycastStats(); }
+};
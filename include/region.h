@@ -0,0 +1,283 @@
+/**
+* @file region.h
+* @brief Contains the CRegionFile and CRegionManager classes, which persist chunk columns to disk.
+* @details A region file holds #REGION_SIZE by #REGION_SIZE chunk columns. The file is split into sectors of
+*	#REGION_SECTOR_SIZE bytes. The first sector is the location table, one 32-bit entry per column holding the
+*	sector offset in the upper 24 bits and the sector count in the lower 8 bits. The second sector holds one
+*	32-bit save timestamp per column. Column payloads follow, each starting on a sector boundary with a 32-bit
+*	length and a compression type byte. All values are little-endian.
+*
+* @author Timothy Volpe
+* @date 5/10/2020
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <map>
+#include <memory>
+#include <unordered_map>
+#include <functional>
+#include <boost/filesystem.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include "ioservice.h"
+#include "chunkcodec.h"
+
+/** Number of bits needed to address a column within a region along one axis */
+#define REGION_SIZE_BITS 5
+/** Width and depth of a region in chunk columns */
+#define REGION_SIZE (1 << REGION_SIZE_BITS)
+#define REGION_MASK (REGION_SIZE-1)
+#define REGION_COLUMN_COUNT (REGION_SIZE*REGION_SIZE)
+
+#define REGION_SECTOR_SIZE 4096
+/** The location table and the timestamp table */
+#define REGION_HEADER_SECTORS 2
+/** Column payloads can not be larger than this many sectors */
+#define REGION_MAX_COLUMN_SECTORS 255
+/** Size of the length and compression type that prefix every column payload */
+#define REGION_PAYLOAD_HEADER_SIZE 5
+/** When the file is full, it is grown by at least this many sectors to avoid remapping on every write */
+#define REGION_GROW_SECTORS 64
+/** How many times each codec sample chunk is round tripped when the region manager starts */
+#define REGION_CODEC_CHECK_REPEATS 8
+
+#define REGION_DIRECTORY "region"
+#define REGION_FILE_EXTENSION ".vxr"
+
+class CGame;
+class CChunkStore;
+
+/**
+* @brief Describes how a column payload is encoded
+*/
+enum RegionCompressionTypes : uint8_t
+{
+	/** The column is stored with CChunk::serialize */
+	REGION_COMPRESSION_NONE = 0,
+	/** The column is stored with CChunkEncoder */
+	REGION_COMPRESSION_CHUNKCODEC = 1
+};
+
+/**
+* @brief A single memory-mapped region file.
+* @details Reads return pointers directly into the mapped file, so loading a column costs a page fault
+*	and a decode. Writes are copy-on-write: new payloads are placed in free sectors and only become visible
+*	when commit is called, which flushes the payloads to disk before publishing the new location entries.
+*	An interrupted save therefore leaves the previous version of each column intact.
+*	Region files are not thread-safe.
+*
+* @author Timothy Volpe
+* @date 5/10/2020
+*/
+class CRegionFile
+{
+private:
+	CGame *m_pGameHandle;
+
+	boost::filesystem::path m_filePath;
+
+	boost::interprocess::file_mapping m_fileMapping;
+	boost::interprocess::mapped_region m_mappedRegion;
+
+	uint32_t m_fileSectors;
+	std::vector<bool> m_sectorsUsed;
+
+	/** Location entries written but not yet committed, keyed by column index */
+	std::map<uint32_t, uint32_t> m_pendingLocations;
+
+	/** Entries of both tables are stored little-endian, convert with boost::endian when reading or writing them */
+	inline uint32_t* getLocationTable() { return reinterpret_cast<uint32_t*>(m_mappedRegion.get_address()); }
+	inline uint32_t* getTimestampTable() { return reinterpret_cast<uint32_t*>(m_mappedRegion.get_address()) + REGION_COLUMN_COUNT; }
+	inline uint8_t* getSector( uint32_t sector ) { return reinterpret_cast<uint8_t*>(m_mappedRegion.get_address()) + (size_t)sector*REGION_SECTOR_SIZE; }
+
+	/** Unmap, resize and remap the file */
+	bool resize( uint32_t sectorCount );
+	/** Find a run of free sectors, growing the file if needed, and mark it used */
+	bool allocateSectors( uint32_t sectorCount, uint32_t *pSectorOffset );
+	void freeSectors( uint32_t sectorOffset, uint32_t sectorCount );
+public:
+	/** Index of a column in the location table from its region-local coordinates */
+	static inline uint32_t getColumnIndex( uint32_t localX, uint32_t localZ ) { return localX + localZ*REGION_SIZE; }
+
+	CRegionFile( CGame *pGameHandle );
+	~CRegionFile();
+
+	/**
+	* @brief Open or create a region file and map it into memory.
+	* @details If the file does not exist, it is created with an empty header. The location table is
+	*	scanned to build the free sector map. Invalid entries are ignored with a warning.
+	* @param[in]	filePath	The path to the region file
+	* @returns True if the file was opened and mapped, false if otherwise.
+	*/
+	bool open( boost::filesystem::path filePath );
+	/**
+	* @brief Commit any pending writes and unmap the file.
+	*/
+	void close();
+
+	/**
+	* @brief Check if a column has been saved to the region.
+	*/
+	bool hasColumn( uint32_t localX, uint32_t localZ );
+
+	/**
+	* @brief Get a pointer to a column payload in the mapped file, without copying it.
+	* @details Only committed columns are visible. The pointer remains valid until the next write or commit.
+	* @param[in]	localX			Region-local column X coordinate
+	* @param[in]	localZ			Region-local column Z coordinate
+	* @param[out]	ppData			The payload data is pointed to here.
+	* @param[out]	pLength			The payload length in bytes is stored here.
+	* @param[out]	pCompression	The payload compression type, see RegionCompressionTypes.
+	* @returns True if the column was found and its payload is valid, false if otherwise.
+	*/
+	bool getColumnData( uint32_t localX, uint32_t localZ, const uint8_t **ppData, uint32_t *pLength, uint8_t *pCompression );
+
+	/**
+	* @brief Get the committed location entry of a column, for reading it without the mapping.
+	* @details Payloads are never overwritten in place, so the sectors hold the payload for as long as the entry is unchanged.
+	* @returns The location entry, or 0 if the column has not been saved.
+	*/
+	uint32_t getColumnLocation( uint32_t localX, uint32_t localZ );
+	/**
+	* @brief Validate a payload read from a column's sectors and find its data.
+	* @param[in]	pSectors		The sectors of the column, as read from the file.
+	* @param[in]	sectorsLength	The number of bytes read.
+	* @param[out]	ppData			The payload data is pointed to here.
+	* @param[out]	pLength			The payload length in bytes is stored here.
+	* @param[out]	pCompression	The payload compression type, see RegionCompressionTypes.
+	* @returns True if the payload is valid, false if otherwise.
+	*/
+	static bool parsePayload( const uint8_t *pSectors, size_t sectorsLength, const uint8_t **ppData, uint32_t *pLength, uint8_t *pCompression );
+
+	/**
+	* @brief Write a column payload into free sectors.
+	* @details The new payload is not visible until commit is called.
+	* @returns True if the payload was written, false if it was too large or the file could not be grown.
+	*/
+	bool writeColumn( uint32_t localX, uint32_t localZ, const uint8_t *pData, uint32_t length, uint8_t compression );
+
+	/**
+	* @brief Flush written payloads to disk, then publish their location entries and free the sectors they replaced.
+	* @returns True if successfully flushed, false if otherwise.
+	*/
+	bool commit();
+
+	inline bool isOpen() { return m_mappedRegion.get_address() != 0; }
+	inline uint32_t getFileSectors() { return m_fileSectors; }
+	inline const boost::filesystem::path& getFilePath() { return m_filePath; }
+
+	/** Packs a sector offset and count into a location table entry */
+	static inline uint32_t packLocation( uint32_t sectorOffset, uint32_t sectorCount ) { return (sectorOffset << 8) | (sectorCount & 0xFF); }
+	static inline uint32_t getLocationOffset( uint32_t location ) { return location >> 8; }
+	static inline uint32_t getLocationCount( uint32_t location ) { return location & 0xFF; }
+};
+
+/** Called when an asynchronous column load finishes, with true if the column was loaded from disk */
+typedef std::function<void( bool )> ColumnLoadCallback;
+
+/**
+* @brief Owns the open region files for a world save.
+* @details Columns are loaded into and saved from a CChunkStore. Region files are opened on demand and kept open.
+*	If an I/O service is set, columns can also be loaded asynchronously, reading the payload with the service
+*	instead of through the mapping so the calling thread never waits on a page fault.
+*
+* @author Timothy Volpe
+* @date 5/10/2020
+*/
+class CRegionManager
+{
+private:
+	CGame *m_pGameHandle;
+
+	boost::filesystem::path m_regionDirectory;
+
+	std::unordered_map<uint64_t, std::shared_ptr<CRegionFile>> m_openRegions;
+	std::vector<uint8_t> m_encodeBuffer;
+	CChunkEncoder m_encoder;
+	CChunkDecoder m_decoder;
+
+	CIOService *m_pIOService;
+	/** Files opened with the I/O service for each open region */
+	std::unordered_map<uint64_t, IOFileId> m_regionIOFiles;
+
+	static inline uint64_t getRegionKey( int32_t regionX, int32_t regionZ ) { return ((uint64_t)(uint32_t)regionX << 32) | (uint32_t)regionZ; }
+public:
+	CRegionManager( CGame *pGameHandle );
+	~CRegionManager();
+
+	/**
+	* @brief Set the world save directory, creating the region directory if necessary.
+	* @param[in]	worldDirectory	The directory of the world save.
+	* @returns True if successful, false if the directory could not be created.
+	*/
+	bool initialize( boost::filesystem::path worldDirectory );
+	/**
+	* @brief Commit and close all open regions.
+	*/
+	void shutdown();
+
+	/**
+	* @brief Get the region file containing a chunk column, opening it if necessary.
+	* @param[in]	columnX		The column X chunk coordinate
+	* @param[in]	columnZ		The column Z chunk coordinate
+	* @param[in]	create		If the region file does not exist and this is false, a null pointer is returned.
+	* @returns The region file, or a null pointer if it could not be opened.
+	*/
+	std::shared_ptr<CRegionFile> getRegion( int32_t columnX, int32_t columnZ, bool create );
+
+	/**
+	* @brief Load a chunk column from disk into the chunk store.
+	* @returns True if the column was found and loaded, false if it was not saved or was invalid.
+	*/
+	bool loadColumn( CChunkStore *pChunkStore, int32_t columnX, int32_t columnZ );
+
+	/**
+	* @brief Set the I/O service used by loadColumnAsync. Must be called before any regions are opened.
+	*/
+	inline void setIOService( CIOService *pIOService ) { m_pIOService = pIOService; }
+
+	/**
+	* @brief Start loading a chunk column from disk without blocking.
+	* @details The callback is invoked when the I/O service dispatches completions, on that thread. If the column
+	*	is not saved, or there is no I/O service, it is invoked immediately. If the column is saved again while
+	*	the read is in flight, the column is reloaded synchronously from the mapping when the read completes.
+	* @param[in]	pChunkStore		The chunk store to load into. It must outlive the request.
+	* @param[in]	columnX			The column X chunk coordinate
+	* @param[in]	columnZ			The column Z chunk coordinate
+	* @param[in]	callback		Called with true if the column was loaded, false if it was not saved or was invalid.
+	*/
+	void loadColumnAsync( CChunkStore *pChunkStore, int32_t columnX, int32_t columnZ, ColumnLoadCallback callback );
+
+	/**
+	* @brief Save a chunk column from the chunk store to disk.
+	* @details The column is not visible to loads until commitAll is called. Chunks saved are marked unmodified.
+	* @returns True if the column was written, false if otherwise.
+	*/
+	bool saveColumn( CChunkStore *pChunkStore, int32_t columnX, int32_t columnZ );
+
+	/**
+	* @brief Commit the pending writes of all open regions.
+	*/
+	bool commitAll();
+
+	/**
+	* @brief Decode a column payload into the chunk store.
+	* @details Used by both synchronous and asynchronous loads. Existing chunks in the column are overwritten.
+	*/
+	bool decodeColumn( CChunkStore *pChunkStore, int32_t columnX, int32_t columnZ, const uint8_t *pData, uint32_t length, uint8_t compression );
+	/**
+	* @brief Encode the loaded chunks of a column into a payload.
+	* @param[out]	payload			The encoded payload, not including the region payload header.
+	* @param[out]	pCompression	The compression type used.
+	*/
+	void encodeColumn( CChunkStore *pChunkStore, int32_t columnX, int32_t columnZ, std::vector<uint8_t> &payload, uint8_t *pCompression );
+
+	/** Throughput and ratio of the chunk codec for saves since the last reset */
+	inline const ChunkCodecStats& getEncodeStats() const { return m_encoder.getStats(); }
+	/** Throughput and ratio of the chunk codec for loads since the last reset */
+	inline const ChunkCodecStats& getDecodeStats() const { return m_decoder.getStats(); }
+	inline void resetCodecStats() { m_encoder.resetStats(); m_decoder.resetStats(); }
+};
@@ -13,6 +13,7 @@
 class CGame;
 class CEntityManager;
 class CWorld;
+class CMeshWorkerPool;
 
 /**
 * @brief The server-sided handler.
@@ -38,6 +39,8 @@ private:
 	float m_lastUpdateTimeSeconds;
 
 	CWorld *m_pWorld;
+	/** Handed to the world when it is created */
+	CMeshWorkerPool *m_pMeshWorkers;
 
 	Entity testEntity;
 
@@ -60,6 +63,11 @@ public:
 	*/
 	bool initialize();
 
+	/**
+	* @brief Set the workers that the world submits dirty chunks to, must be done before startServer.
+	*/
+	inline void setMeshWorkers( CMeshWorkerPool *pMeshWorkers ) { m_pMeshWorkers = pMeshWorkers; }
+
 	/**
 	* @brief Start the server thread and block until successfully started.
 	* @details This is usually when the world is loaded, as the UI does not need the server to operate.
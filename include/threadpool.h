@@ -0,0 +1,68 @@
+/**
+* @file threadpool.h
+* @brief Contains the CThreadPool class, a fixed set of worker threads that run queued tasks.
+*
+* @author Timothy Volpe
+* @date 5/12/2020
+*/
+
+#pragma once
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <vector>
+#include <queue>
+
+/**
+* @brief A fixed-size pool of worker threads.
+* @details Tasks are run in the order they are submitted, but may complete in any order. The pool must be
+*	shut down before it is destroyed, any tasks still queued at that point are run first.
+*
+* @author Timothy Volpe
+* @date 5/12/2020
+*/
+class CThreadPool
+{
+private:
+	std::vector<std::thread> m_workerThreads;
+
+	std::mutex m_taskMutex;
+	std::condition_variable m_taskAvailable;
+	std::queue<std::function<void()>> m_tasks;
+	bool m_shuttingDown;
+
+	void workerMain();
+public:
+	CThreadPool();
+	~CThreadPool();
+
+	/**
+	* @brief Start the worker threads.
+	* @param[in]	threadCount		The number of workers. If 0, one less than the number of hardware threads is used, with a minimum of one.
+	* @returns True if the threads were started, false if otherwise.
+	*/
+	bool initialize( unsigned int threadCount );
+	/**
+	* @brief Finish the queued tasks and join the worker threads.
+	*/
+	void shutdown();
+
+	/**
+	* @brief Queue a task to be run on a worker thread.
+	*/
+	void submit( std::function<void()> task );
+
+	/**
+	* @brief Run a function for every index in [0, count) across the workers and the calling thread, and wait for them to finish.
+	* @details Indices are handed out dynamically, so uneven workloads balance themselves. The function must be safe to
+	*	call concurrently for different indices. Must not be called from a task running on the same pool.
+	* @param[in]	count		The number of indices.
+	* @param[in]	function	Called once for every index.
+	*/
+	void parallelFor( size_t count, const std::function<void( size_t )> &function );
+
+	inline unsigned int getThreadCount() { return (unsigned int)m_workerThreads.size(); }
+};
@@ -1,12 +1,64 @@
 #pragma once
 #include <memory>
+#include <cstdint>
+#include <set>
+#include <vector>
+#include <functional>
 #include "componentdef.h"
+#include "chunk.h"
+#include "raycast.h"
+
+/** The name of the world save directory in the saves folder */
+#define WORLD_DEFAULT_NAME "world"
+/** Radius in chunk columns around the origin that is loaded when the world is created */
+#define WORLD_SPAWN_RADIUS 4
+/** World ticks per second, block updates are scheduled in ticks */
+#define WORLD_TICK_RATE 20
+/** Most world ticks run in one update, time beyond this is dropped after a stall */
+#define WORLD_MAX_TICKS_PER_UPDATE 4
+/** Ticks between a falling block losing its support and moving down a block */
+#define WORLD_FALL_DELAY_TICKS 2
+/** Region edits that change more blocks than this relight whole columns instead of queueing every block */
+#define WORLD_REGION_EDIT_BLOCK_LIMIT 65536
 
 class CGame;
 
 class CECSCoordinator;
 
 class CRenderSystem;
+class CPhysicsSystem;
+
+class CChunkStore;
+class CRegionManager;
+class CIOService;
+class CMeshWorkerPool;
+class CLightEngine;
+class CBlockTickScheduler;
+class CFluidSimulator;
+
+/**
+* @brief A box of world blocks, inclusive on both ends.
+*/
+struct BlockBox
+{
+	int32_t minX, minY, minZ;
+	int32_t maxX, maxY, maxZ;
+};
+
+/**
+* @brief Blocks copied out of the world by CWorld::copyRegion.
+* @details Laid out Y-major, then Z, then X, like chunk blocks.
+*/
+struct BlockClipboard
+{
+	int32_t sizeX, sizeY, sizeZ;
+	std::vector<BlockId> blocks;
+
+	inline BlockId getBlock( int32_t x, int32_t y, int32_t z ) const { return blocks[((size_t)y*sizeZ + z)*sizeX + x]; }
+};
+
+/** Called for every block of CWorld::applyRegion with its world coordinates and current block, returns the new block */
+typedef std::function<BlockId( int32_t x, int32_t y, int32_t z, BlockId block )> BlockEditFunction;
 
 /**
 * @brief The world class which handles the 3D game world beyond the UI.
@@ -20,6 +72,58 @@ private:
 	CGame* m_pGameHandle;
 
 	CECSCoordinator* m_pWorldEntCoordinator;
+	std::shared_ptr<CPhysicsSystem> m_physicsSystem;
+
+	CChunkStore *m_pChunkStore;
+	CRegionManager *m_pRegionManager;
+	CIOService *m_pIOService;
+	CLightEngine *m_pLightEngine;
+	CVoxelRaycaster *m_pRaycaster;
+	CBlockTickScheduler *m_pBlockTicks;
+	CFluidSimulator *m_pFluids;
+
+	/** Elapsed time not yet run as world ticks */
+	float m_tickAccumulator;
+
+	/** Columns with an asynchronous load in flight */
+	std::set<std::pair<int32_t, int32_t>> m_pendingColumns;
+
+	/** The client's mesh workers, or a null pointer if there is no client to render chunks */
+	CMeshWorkerPool *m_pMeshWorkers;
+	std::vector<ChunkPos> m_dirtyChunks;
+
+	/** Copy every chunk whose mesh is out of date and submit it to the mesh workers */
+	void publishDirtyChunks();
+
+	/** Fill a chunk column with generated terrain */
+	void generateColumn( int32_t columnX, int32_t columnZ );
+	/** Called once a column is loaded or generated */
+	void onColumnReady( int32_t columnX, int32_t columnZ );
+
+	/** Run one world tick */
+	void tickWorld();
+	/** Run a scheduled block update */
+	void runBlockUpdate( int32_t x, int32_t y, int32_t z );
+
+	/** Set a block and update the light and block updates around it, without waking water */
+	bool changeBlock( int32_t x, int32_t y, int32_t z, BlockId block );
+	/** Update the light and block updates around a block that was changed */
+	void onBlockChanged( int32_t x, int32_t y, int32_t z, BlockId oldBlock, BlockId newBlock );
+
+	struct RegionEdit;
+	struct RegionChange
+	{
+		int32_t x, y, z;
+		BlockId oldBlock, newBlock;
+	};
+	/** Blocks of the chunk being edited */
+	std::vector<BlockId> m_editBlocks;
+	/** Blocks changed by the current region edit, until there are too many to handle one by one */
+	std::vector<RegionChange> m_regionChanges;
+	std::vector<ChunkPos> m_editedChunks;
+
+	/** Run a region edit chunk by chunk, returns the number of blocks changed */
+	size_t editRegion( const BlockBox &box, const RegionEdit &edit );
 public:
 	CWorld( CGame* pGameHandle );
 	~CWorld();
@@ -34,6 +138,12 @@ public:
 	*/
 	void destroyWorld();
 
+	/**
+	* @brief Set the workers that dirty chunks are submitted to, must be done before createWorld.
+	* @details Without mesh workers, chunks are simulated but never meshed.
+	*/
+	inline void setMeshWorkers( CMeshWorkerPool *pMeshWorkers ) { m_pMeshWorkers = pMeshWorkers; }
+
 	/**
 	* @brief Creates an entity in the world identified by an ID
 	* @details This will register an entity with the entity manager and create its necessary components.
@@ -53,4 +163,110 @@ public:
 	* @brief Update all the entities in the world
 	*/
 	bool updateWorld( float deltaT );
+
+	/**
+	* @brief Load a chunk column from the world save, or generate it if it has never been saved.
+	* @param[in]	columnX		The column X chunk coordinate
+	* @param[in]	columnZ		The column Z chunk coordinate
+	* @returns True if the column was loaded from disk, false if it was generated.
+	*/
+	bool loadColumn( int32_t columnX, int32_t columnZ );
+
+	/**
+	* @brief Start loading a chunk column without blocking the server thread.
+	* @details The column is read on the I/O service and decoded when completions are dispatched in updateWorld.
+	*	If it has never been saved, it is generated immediately instead. Requests for columns that are
+	*	already loaded or pending are ignored.
+	* @param[in]	columnX		The column X chunk coordinate
+	* @param[in]	columnZ		The column Z chunk coordinate
+	*/
+	void requestColumn( int32_t columnX, int32_t columnZ );
+	/**
+	* @brief Block until every requested column has been loaded or generated.
+	*/
+	void finishColumnRequests();
+	inline bool isColumnPending( int32_t columnX, int32_t columnZ ) { return m_pendingColumns.count( std::pair<int32_t, int32_t>( columnX, columnZ ) ) != 0; }
+
+	/**
+	* @brief Save every modified chunk to the world save.
+	* @returns True if all the modified chunks were saved, false if otherwise.
+	*/
+	bool saveWorld();
+
+	/**
+	* @brief Set a block by world block coordinates, and update the light and water around it.
+	* @returns True if the block was set, false if the chunk containing it is not loaded.
+	*/
+	bool setBlock( int32_t x, int32_t y, int32_t z, BlockId block );
+	/**
+	* @brief Schedule a block to be updated on a later world tick. A block has at most one update waiting.
+	* @param[in]	x, y, z		World block coordinates.
+	* @param[in]	delay		World ticks from now, at least 1.
+	*/
+	void scheduleBlockUpdate( int32_t x, int32_t y, int32_t z, uint32_t delay );
+
+	/**
+	* @brief Set every block in a box. Chunks that are not loaded are skipped.
+	* @details Region edits work a chunk at a time. Each edited chunk is remeshed once, and edits of more than
+	*	#WORLD_REGION_EDIT_BLOCK_LIMIT blocks relight the edited columns once instead of every block. Blocks placed by
+	*	large edits do not fall, and water in the edited chunks ends up full.
+	* @returns The number of blocks changed.
+	*/
+	size_t fillRegion( const BlockBox &box, BlockId block );
+	/**
+	* @brief Replace one block type with another in a box, see fillRegion.
+	* @returns The number of blocks changed.
+	*/
+	size_t replaceRegion( const BlockBox &box, BlockId oldBlock, BlockId newBlock );
+	/**
+	* @brief Set every block in a box to the result of a function, see fillRegion.
+	* @returns The number of blocks changed.
+	*/
+	size_t applyRegion( const BlockBox &box, const BlockEditFunction &function );
+	/**
+	* @brief Copy the blocks in a box.
+	* @param[in]	box				The blocks to copy.
+	* @param[out]	clipboard		Receives the blocks. Blocks in chunks that are not loaded are air.
+	* @returns True if every chunk in the box was loaded, false if otherwise.
+	*/
+	bool copyRegion( const BlockBox &box, BlockClipboard &clipboard );
+	/**
+	* @brief Paste copied blocks with their lowest corner at a world block, see fillRegion.
+	* @param[in]	clipboard		The blocks to paste.
+	* @param[in]	x, y, z			World block coordinates of the lowest corner.
+	* @param[in]	pasteAir		If false, air in the clipboard leaves the world block unchanged.
+	* @returns The number of blocks changed.
+	*/
+	size_t pasteRegion( const BlockClipboard &clipboard, int32_t x, int32_t y, int32_t z, bool pasteAir = true );
+
+	/**
+	* @brief Find the first block along a ray through the loaded chunks.
+	* @param[in]	origin			The start of the ray, in world block coordinates.
+	* @param[in]	direction		The direction of the ray, does not need to be normalized.
+	* @param[in]	maxDistance		Distance in blocks to give up after.
+	* @param[out]	pHit			Receives the block, the face the ray entered through and the distance to it.
+	* @param[in]	stopType		Which blocks stop the ray.
+	* @returns True if a block was hit, false if otherwise.
+	*/
+	bool raycast( const glm::vec3 &origin, const glm::vec3 &direction, float maxDistance, RaycastHit *pHit, RaycastStopTypes stopType = RAYCAST_STOP_ANY );
+	/**
+	* @brief Cast many rays at once, such as every entity's sight checks in a tick.
+	* @param[in]	queries		The rays.
+	* @param[out]	hits		Resized to the number of queries, with a result for each.
+	* @returns The number of rays that hit a block.
+	*/
+	size_t raycastBatch( const std::vector<RaycastQuery> &queries, std::vector<RaycastHit> &hits );
+
+	/**
+	* @brief Get the loaded chunks of the world.
+	*/
+	inline CChunkStore* getChunkStore() { return m_pChunkStore; }
+	/**
+	* @brief Get the light of the loaded chunks.
+	*/
+	inline CLightEngine* getLightEngine() { return m_pLightEngine; }
+	/**
+	* @brief Get the water of the loaded chunks.
+	*/
+	inline CFluidSimulator* getFluids() { return m_pFluids; }
 };
\ No newline at end of file
@@ -0,0 +1,179 @@
+#include <assert.h>
+#include <algorithm>
+#include "blockticks.h"
+
+#define NODE_NONE 0xFFFFFFFF
+
+static_assert(WORLD_HEIGHT <= 256, "Block keys hold 8 bits of height");
+
+/** The lowest tick bit covered by a level of the wheel */
+static inline uint32_t LevelShift( uint32_t level ) {
+	return level == 0 ? 0 : BLOCK_TICK_WHEEL_BITS + BLOCK_TICK_LEVEL_BITS*(level - 1);
+}
+static inline uint32_t LevelSlotMask( uint32_t level ) {
+	return level == 0 ? (1 << BLOCK_TICK_WHEEL_BITS) - 1 : (1 << BLOCK_TICK_LEVEL_BITS) - 1;
+}
+
+CBlockTickScheduler::CBlockTickScheduler( CChunkStore *pChunkStore ) : m_pChunkStore( pChunkStore )
+{
+	assert( pChunkStore );
+
+	m_currentTick = 0;
+	for( uint32_t level = 0; level < BLOCK_TICK_LEVEL_COUNT; level++ )
+		std::fill( m_slots[level], m_slots[level] + (1 << BLOCK_TICK_WHEEL_BITS), NODE_NONE );
+	m_freeNodes = NODE_NONE;
+	m_parkedCount = 0;
+}
+CBlockTickScheduler::~CBlockTickScheduler() {
+}
+
+uint32_t CBlockTickScheduler::allocateNode()
+{
+	if( m_freeNodes != NODE_NONE ) {
+		uint32_t node = m_freeNodes;
+		m_freeNodes = m_nodes[node].next;
+		return node;
+	}
+	m_nodes.push_back( TickNode() );
+	return (uint32_t)m_nodes.size() - 1;
+}
+void CBlockTickScheduler::freeNode( uint32_t node )
+{
+	m_nodes[node].next = m_freeNodes;
+	m_freeNodes = node;
+}
+
+void CBlockTickScheduler::insertNode( uint32_t node )
+{
+	TickNode &tickNode = m_nodes[node];
+	assert( tickNode.tick >= m_currentTick );
+
+	// The lowest level that reaches the tick
+	uint64_t delta = tickNode.tick - m_currentTick;
+	uint32_t level = 0;
+	while( level < BLOCK_TICK_LEVEL_COUNT-1 && delta >= ((uint64_t)1 << LevelShift( level + 1 )) )
+		level++;
+
+	uint32_t slot = (uint32_t)(tickNode.tick >> LevelShift( level )) & LevelSlotMask( level );
+	tickNode.next = m_slots[level][slot];
+	m_slots[level][slot] = node;
+}
+
+void CBlockTickScheduler::cascade( uint32_t level, uint32_t slot )
+{
+	uint32_t node = m_slots[level][slot];
+	m_slots[level][slot] = NODE_NONE;
+	while( node != NODE_NONE ) {
+		uint32_t next = m_nodes[node].next;
+		if( m_nodes[node].live )
+			this->insertNode( node );
+		else
+			this->freeNode( node );
+		node = next;
+	}
+}
+
+bool CBlockTickScheduler::schedule( int32_t x, int32_t y, int32_t z, uint32_t delay )
+{
+	delay = std::min( std::max( delay, 1u ), (uint32_t)BLOCK_TICK_MAX_DELAY );
+	uint64_t tick = m_currentTick + delay;
+
+	uint64_t key = PackBlockKey( x, y, z );
+	auto it = m_scheduled.find( key );
+	if( it != m_scheduled.end() ) {
+		if( m_nodes[it->second].tick <= tick )
+			return false;
+		// Sooner than the waiting update, which is left in its slot to be freed when reached
+		m_nodes[it->second].live = false;
+	}
+
+	uint32_t node = this->allocateNode();
+	TickNode &tickNode = m_nodes[node];
+	tickNode.x = x;
+	tickNode.y = y;
+	tickNode.z = z;
+	tickNode.tick = tick;
+	tickNode.live = true;
+	this->insertNode( node );
+	m_scheduled[key] = node;
+
+	return true;
+}
+
+void CBlockTickScheduler::advance( const UpdateCallback &callback )
+{
+	m_currentTick++;
+
+	// Higher levels first, their updates may land in the slots emptied below
+	for( uint32_t level = BLOCK_TICK_LEVEL_COUNT-1; level > 0; level-- ) {
+		uint64_t levelMask = ((uint64_t)1 << LevelShift( level )) - 1;
+		if( (m_currentTick & levelMask) == 0 )
+			this->cascade( level, (uint32_t)(m_currentTick >> LevelShift( level )) & LevelSlotMask( level ) );
+	}
+
+	// Take the due updates out of the wheel before running any, callbacks schedule more
+	m_due.clear();
+	ChunkPos cachedPosition = { 0, 0, 0 };
+	bool cachedLoaded = false, cacheValid = false;
+	uint32_t slot = (uint32_t)m_currentTick & LevelSlotMask( 0 );
+	uint32_t node = m_slots[0][slot];
+	m_slots[0][slot] = NODE_NONE;
+	while( node != NODE_NONE )
+	{
+		TickNode &tickNode = m_nodes[node];
+		uint32_t next = tickNode.next;
+		if( tickNode.live )
+		{
+			assert( tickNode.tick == m_currentTick );
+			m_scheduled.erase( PackBlockKey( tickNode.x, tickNode.y, tickNode.z ) );
+
+			ChunkPos chunkPosition = { BlockToChunkCoord( tickNode.x ), BlockToChunkCoord( tickNode.y ), BlockToChunkCoord( tickNode.z ) };
+			if( !cacheValid || !(chunkPosition == cachedPosition) ) {
+				cachedPosition = chunkPosition;
+				cachedLoaded = m_pChunkStore->getChunk( chunkPosition ) != 0;
+				cacheValid = true;
+			}
+			if( cachedLoaded )
+				m_due.push_back( { tickNode.x, tickNode.y, tickNode.z } );
+			else {
+				m_parked[chunkPosition].push_back( { tickNode.x, tickNode.y, tickNode.z } );
+				m_parkedCount++;
+			}
+		}
+		this->freeNode( node );
+		node = next;
+	}
+
+	// Anything over the limit waits for the next tick
+	size_t runCount = std::min( m_due.size(), (size_t)BLOCK_TICK_MAX_UPDATES_PER_TICK );
+	for( size_t i = runCount; i < m_due.size(); i++ )
+		this->schedule( m_due[i].x, m_due[i].y, m_due[i].z, 1 );
+	m_due.resize( runCount );
+
+	for( auto &it: m_due )
+		callback( it.x, it.y, it.z );
+}
+
+void CBlockTickScheduler::resumeChunk( const ChunkPos &position )
+{
+	auto it = m_parked.find( position );
+	if( it == m_parked.end() )
+		return;
+
+	m_parkedCount -= it->second.size();
+	for( auto &parked: it->second )
+		this->schedule( parked.x, parked.y, parked.z, 1 );
+	m_parked.erase( it );
+}
+
+void CBlockTickScheduler::clear()
+{
+	for( uint32_t level = 0; level < BLOCK_TICK_LEVEL_COUNT; level++ )
+		std::fill( m_slots[level], m_slots[level] + (1 << BLOCK_TICK_WHEEL_BITS), NODE_NONE );
+	m_nodes.clear();
+	m_freeNodes = NODE_NONE;
+	m_scheduled.clear();
+	m_parked.clear();
+	m_parkedCount = 0;
+	m_due.clear();
+}
@@ -0,0 +1,335 @@
+#include <assert.h>
+#include <algorithm>
+#include <cstring>
+#include <boost/endian/conversion.hpp>
+#include "chunk.h"
+
+static_assert(CHUNK_SECTIONS_PER_AXIS*CHUNK_SECTIONS_PER_AXIS*CHUNK_SECTIONS_PER_AXIS <= 64, "Chunk sections must fit in a 64-bit mask");
+
+/////////////////
+// CLightArray //
+/////////////////
+
+CLightArray::CLightArray() {
+	m_uniformLevel = 0;
+}
+CLightArray::~CLightArray() {
+}
+
+void CLightArray::set( uint32_t index, uint8_t level )
+{
+	assert( index < CHUNK_VOLUME && level <= LIGHT_LEVEL_MAX );
+
+	if( m_levels.empty() )
+	{
+		if( level == m_uniformLevel )
+			return;
+		// Expand, with the uniform level in both halves of every byte
+		m_levels.assign( CHUNK_VOLUME / 2, (uint8_t)(m_uniformLevel | (m_uniformLevel << 4)) );
+	}
+
+	uint8_t &pair = m_levels[index >> 1];
+	uint32_t shift = (index & 1) << 2;
+	pair = (uint8_t)((pair & ~(0xF << shift)) | (level << shift));
+}
+
+void CLightArray::fill( uint8_t level )
+{
+	assert( level <= LIGHT_LEVEL_MAX );
+
+	m_levels.clear();
+	m_levels.shrink_to_fit();
+	m_uniformLevel = level;
+}
+
+////////////
+// CChunk //
+////////////
+
+CChunk::CChunk( ChunkPos position ) : m_position( position )
+{
+	m_uniformBlock = BLOCK_AIR;
+	m_nonAirCount = 0;
+	m_version = 0;
+	m_modified = false;
+
+	m_sectionMask = 0;
+	m_sectionMaskVersion = m_version - 1;
+}
+CChunk::~CChunk() {
+}
+
+void CChunk::setBlock( uint32_t x, uint32_t y, uint32_t z, BlockId block )
+{
+	assert( x < CHUNK_SIZE && y < CHUNK_SIZE && z < CHUNK_SIZE );
+
+	BlockId oldBlock;
+
+	if( m_blocks.empty() )
+	{
+		if( block == m_uniformBlock )
+			return;
+		// Expand to a dense chunk
+		m_blocks.assign( CHUNK_VOLUME, m_uniformBlock );
+	}
+
+	BlockId &blockRef = m_blocks[ChunkBlockIndex( x, y, z )];
+	oldBlock = blockRef;
+	if( oldBlock == block )
+		return;
+	blockRef = block;
+
+	if( oldBlock == BLOCK_AIR )
+		m_nonAirCount++;
+	else if( block == BLOCK_AIR )
+		m_nonAirCount--;
+
+	m_version++;
+	m_modified = true;
+}
+
+uint64_t CChunk::getSectionMask() const
+{
+	if( m_sectionMaskVersion == m_version )
+		return m_sectionMask;
+	m_sectionMaskVersion = m_version;
+
+	if( m_blocks.empty() ) {
+		m_sectionMask = (m_uniformBlock == BLOCK_AIR) ? 0 : ~(uint64_t)0;
+		return m_sectionMask;
+	}
+	m_sectionMask = 0;
+	for( uint32_t y = 0; y < CHUNK_SIZE; y++ ) {
+		for( uint32_t z = 0; z < CHUNK_SIZE; z++ ) {
+			const BlockId *pRow = &m_blocks[ChunkBlockIndex( 0, y, z )];
+			for( uint32_t x = 0; x < CHUNK_SIZE; x++ ) {
+				if( pRow[x] != BLOCK_AIR )
+					m_sectionMask |= (uint64_t)1 << ChunkSectionIndex( x, y, z );
+			}
+		}
+	}
+	return m_sectionMask;
+}
+
+void CChunk::fill( BlockId block )
+{
+	m_blocks.clear();
+	m_blocks.shrink_to_fit();
+	m_uniformBlock = block;
+	m_nonAirCount = (block == BLOCK_AIR) ? 0 : CHUNK_VOLUME;
+
+	m_version++;
+	m_modified = true;
+}
+
+void CChunk::setBlockData( const BlockId *pBlocks )
+{
+	assert( pBlocks );
+
+	m_blocks.assign( pBlocks, pBlocks + CHUNK_VOLUME );
+	m_nonAirCount = CHUNK_VOLUME - (uint32_t)std::count( m_blocks.begin(), m_blocks.end(), (BlockId)BLOCK_AIR );
+	this->tryCompact();
+
+	m_version++;
+	m_modified = true;
+}
+
+bool CChunk::tryCompact()
+{
+	if( m_blocks.empty() )
+		return true;
+
+	BlockId first = m_blocks[0];
+	for( auto it: m_blocks ) {
+		if( it != first )
+			return false;
+	}
+	m_blocks.clear();
+	m_blocks.shrink_to_fit();
+	m_uniformBlock = first;
+
+	return true;
+}
+
+void CChunk::serialize( std::vector<uint8_t> &output ) const
+{
+	size_t start = output.size();
+
+	if( m_blocks.empty() ) {
+		output.resize( start + 1 + sizeof( BlockId ) );
+		output[start] = CHUNK_STORAGE_UNIFORM;
+		BlockId block = boost::endian::native_to_little( m_uniformBlock );
+		memcpy( &output[start+1], &block, sizeof( BlockId ) );
+	}
+	else {
+		output.resize( start + 1 + sizeof( BlockId )*CHUNK_VOLUME );
+		output[start] = CHUNK_STORAGE_DENSE;
+		for( uint32_t i = 0; i < CHUNK_VOLUME; i++ ) {
+			BlockId block = boost::endian::native_to_little( m_blocks[i] );
+			memcpy( &output[start+1+i*sizeof( BlockId )], &block, sizeof( BlockId ) );
+		}
+	}
+}
+
+bool CChunk::deserialize( const uint8_t *pData, size_t length, size_t *pBytesRead )
+{
+	assert( pData && pBytesRead );
+
+	if( length < 1 )
+		return false;
+
+	switch( pData[0] )
+	{
+	case CHUNK_STORAGE_UNIFORM:
+		if( length < 1 + sizeof( BlockId ) )
+			return false;
+		BlockId block;
+		memcpy( &block, pData+1, sizeof( BlockId ) );
+		this->fill( boost::endian::little_to_native( block ) );
+		(*pBytesRead) = 1 + sizeof( BlockId );
+		break;
+	case CHUNK_STORAGE_DENSE:
+		if( length < 1 + sizeof( BlockId )*CHUNK_VOLUME )
+			return false;
+		// Copy straight out of the source, it may not be aligned
+		m_blocks.resize( CHUNK_VOLUME );
+		memcpy( &m_blocks[0], pData+1, sizeof( BlockId )*CHUNK_VOLUME );
+		for( auto &it: m_blocks )
+			boost::endian::little_to_native_inplace( it );
+		m_nonAirCount = CHUNK_VOLUME - (uint32_t)std::count( m_blocks.begin(), m_blocks.end(), (BlockId)BLOCK_AIR );
+		this->tryCompact();
+		m_version++;
+		m_modified = true;
+		(*pBytesRead) = 1 + sizeof( BlockId )*CHUNK_VOLUME;
+		break;
+	default:
+		return false;
+	}
+
+	return true;
+}
+
+/////////////////
+// CChunkStore //
+/////////////////
+
+CChunkStore::CChunkStore() {
+}
+CChunkStore::~CChunkStore() {
+	this->clear();
+}
+
+CChunk* CChunkStore::getChunk( const ChunkPos& position )
+{
+	auto it = m_chunks.find( position );
+	if( it == m_chunks.end() )
+		return 0;
+	return it->second.get();
+}
+
+CChunk* CChunkStore::createChunk( const ChunkPos& position )
+{
+	auto it = m_chunks.find( position );
+	if( it != m_chunks.end() )
+		return it->second.get();
+
+	std::shared_ptr<CChunk> chunk = std::make_shared<CChunk>( position );
+	m_chunks.insert( std::pair<ChunkPos, std::shared_ptr<CChunk>>( position, chunk ) );
+	// Neighbours were meshed against an unloaded border
+	this->markNeighboursDirty( position );
+	return chunk.get();
+}
+
+void CChunkStore::removeChunk( const ChunkPos& position )
+{
+	if( m_chunks.erase( position ) )
+		this->markNeighboursDirty( position );
+}
+
+void CChunkStore::markNeighboursDirty( const ChunkPos& position )
+{
+	// Meshes read the edges and corners of every surrounding chunk
+	for( int32_t dy = -1; dy <= 1; dy++ ) {
+		for( int32_t dz = -1; dz <= 1; dz++ ) {
+			for( int32_t dx = -1; dx <= 1; dx++ )
+				m_dirtyChunks.insert( { position.x + dx, position.y + dy, position.z + dz } );
+		}
+	}
+}
+
+void CChunkStore::takeDirtyChunks( std::vector<ChunkPos> &chunks )
+{
+	chunks.insert( chunks.end(), m_dirtyChunks.begin(), m_dirtyChunks.end() );
+	m_dirtyChunks.clear();
+}
+
+void CChunkStore::clear()
+{
+	for( auto &it: m_chunks )
+		m_dirtyChunks.insert( it.first );
+	m_chunks.clear();
+}
+
+void CChunkStore::forEachChunk( const std::function<void( CChunk* )> &callback )
+{
+	for( auto &it: m_chunks )
+		callback( it.second.get() );
+}
+
+BlockId CChunkStore::getBlock( int32_t x, int32_t y, int32_t z )
+{
+	CChunk *pChunk = this->getChunk( { BlockToChunkCoord( x ), BlockToChunkCoord( y ), BlockToChunkCoord( z ) } );
+	if( !pChunk )
+		return BLOCK_AIR;
+	return pChunk->getBlock( x & CHUNK_MASK, y & CHUNK_MASK, z & CHUNK_MASK );
+}
+
+bool CChunkStore::setBlock( int32_t x, int32_t y, int32_t z, BlockId block )
+{
+	CChunk *pChunk = this->getChunk( { BlockToChunkCoord( x ), BlockToChunkCoord( y ), BlockToChunkCoord( z ) } );
+	if( !pChunk )
+		return false;
+	uint32_t oldVersion = pChunk->getVersion();
+	pChunk->setBlock( x & CHUNK_MASK, y & CHUNK_MASK, z & CHUNK_MASK, block );
+	if( pChunk->getVersion() == oldVersion )
+		return true;
+
+	// Blocks on the edge of a chunk are part of the border of every neighbour they touch, including diagonals
+	const ChunkPos &position = pChunk->getPosition();
+	int32_t minOffset[3], maxOffset[3];
+	const int32_t local[3] = { x & CHUNK_MASK, y & CHUNK_MASK, z & CHUNK_MASK };
+	for( uint32_t i = 0; i < 3; i++ ) {
+		minOffset[i] = (local[i] == 0) ? -1 : 0;
+		maxOffset[i] = (local[i] == CHUNK_MASK) ? 1 : 0;
+	}
+	for( int32_t dy = minOffset[1]; dy <= maxOffset[1]; dy++ ) {
+		for( int32_t dz = minOffset[2]; dz <= maxOffset[2]; dz++ ) {
+			for( int32_t dx = minOffset[0]; dx <= maxOffset[0]; dx++ )
+				m_dirtyChunks.insert( { position.x + dx, position.y + dy, position.z + dz } );
+		}
+	}
+	return true;
+}
+
+/////////////////
+// CChunkCache //
+/////////////////
+
+CChunkCache::CChunkCache( CChunkStore *pChunkStore ) : m_pChunkStore( pChunkStore )
+{
+	assert( pChunkStore );
+
+	m_cachedPosition = { 0, 0, 0 };
+	m_pCachedChunk = 0;
+	m_cacheValid = false;
+}
+CChunkCache::~CChunkCache() {
+}
+
+CChunk* CChunkCache::lookupChunk( const ChunkPos& position )
+{
+	m_pCachedChunk = m_pChunkStore->getChunk( position );
+	m_cachedPosition = position;
+	m_cacheValid = true;
+	return m_pCachedChunk;
+}
@@ -0,0 +1,582 @@
+#include <assert.h>
+#include <cstring>
+#include <chrono>
+#include <algorithm>
+#include "chunkcodec.h"
+#include "chunk.h"
+
+/** Marks block IDs that are not in the palette being built */
+#define PALETTE_LOOKUP_UNUSED 0xFFFF
+/** Size of one bit plane, one bit per block */
+#define BITPLANE_SIZE (CHUNK_VOLUME / 8)
+/** Size of one horizontal layer of a bit plane */
+#define BITPLANE_LAYER_SIZE (CHUNK_AREA / 8)
+/** Largest possible transformed chunk, a palette of every block followed by a run for every block */
+#define TRANSFORMED_MAX_SIZE (sizeof( uint16_t ) + sizeof( BlockId )*CHUNK_VOLUME + (sizeof( uint16_t ) + 3)*CHUNK_VOLUME)
+
+static inline void WriteUInt16( std::vector<uint8_t> &output, uint16_t value ) {
+	output.push_back( (uint8_t)(value & 0xFF) );
+	output.push_back( (uint8_t)(value >> 8) );
+}
+static inline void WriteUInt32( uint8_t *pDest, uint32_t value ) {
+	pDest[0] = (uint8_t)(value & 0xFF);
+	pDest[1] = (uint8_t)((value >> 8) & 0xFF);
+	pDest[2] = (uint8_t)((value >> 16) & 0xFF);
+	pDest[3] = (uint8_t)(value >> 24);
+}
+static inline uint16_t ReadUInt16( const uint8_t *pSource ) {
+	return (uint16_t)(pSource[0] | (pSource[1] << 8));
+}
+static inline uint32_t ReadUInt32( const uint8_t *pSource ) {
+	return (uint32_t)pSource[0] | ((uint32_t)pSource[1] << 8) | ((uint32_t)pSource[2] << 16) | ((uint32_t)pSource[3] << 24);
+}
+
+/** Number of bits needed to store palette indices */
+static inline uint32_t PaletteIndexBits( uint32_t paletteSize ) {
+	uint32_t bits = 1;
+	while( (1u << bits) < paletteSize )
+		bits++;
+	return bits;
+}
+
+////////
+// LZ //
+////////
+
+static inline uint32_t LZHash( uint32_t sequence ) {
+	return (sequence * 2654435761u) >> (32 - CODEC_LZ_HASH_BITS);
+}
+static inline void LZWriteLength( std::vector<uint8_t> &output, size_t length ) {
+	while( length >= 255 ) {
+		output.push_back( 255 );
+		length -= 255;
+	}
+	output.push_back( (uint8_t)length );
+}
+static void LZWriteSequence( std::vector<uint8_t> &output, const uint8_t *pLiterals, size_t literalLength, size_t offset, size_t matchLength )
+{
+	size_t matchCode = matchLength ? matchLength - CODEC_LZ_MIN_MATCH : 0;
+	output.push_back( (uint8_t)((std::min<size_t>( literalLength, 15 ) << 4) | std::min<size_t>( matchCode, 15 )) );
+	if( literalLength >= 15 )
+		LZWriteLength( output, literalLength - 15 );
+	output.insert( output.end(), pLiterals, pLiterals + literalLength );
+	// The final sequence is only literals
+	if( !matchLength )
+		return;
+	WriteUInt16( output, (uint16_t)offset );
+	if( matchCode >= 15 )
+		LZWriteLength( output, matchCode - 15 );
+}
+
+void LZCompress( const uint8_t *pSource, size_t length, std::vector<uint8_t> &output, uint32_t *pHashTable )
+{
+	size_t anchor = 0, position = 0;
+
+	output.reserve( output.size() + length + length / 255 + 16 );
+	memset( pHashTable, 0, sizeof( uint32_t )*(1 << CODEC_LZ_HASH_BITS) );
+
+	while( position + CODEC_LZ_MIN_MATCH <= length )
+	{
+		uint32_t sequence, candidateSequence;
+		memcpy( &sequence, pSource + position, sizeof( uint32_t ) );
+		uint32_t hash = LZHash( sequence );
+		size_t candidate = pHashTable[hash];
+		pHashTable[hash] = (uint32_t)position;
+
+		if( candidate < position && position - candidate <= CODEC_LZ_MAX_OFFSET ) {
+			memcpy( &candidateSequence, pSource + candidate, sizeof( uint32_t ) );
+			if( candidateSequence == sequence )
+			{
+				size_t matchLength = CODEC_LZ_MIN_MATCH;
+				while( position + matchLength < length && pSource[candidate + matchLength] == pSource[position + matchLength] )
+					matchLength++;
+				LZWriteSequence( output, pSource + anchor, position - anchor, position - candidate, matchLength );
+				position += matchLength;
+				anchor = position;
+				continue;
+			}
+		}
+		// Skip ahead faster through data that is not compressing
+		position += 1 + ((position - anchor) >> 6);
+	}
+
+	LZWriteSequence( output, pSource + anchor, length - anchor, 0, 0 );
+}
+
+bool LZDecompress( const uint8_t *pSource, size_t length, uint8_t *pDest, size_t decompressedLength )
+{
+	size_t readOffset = 0, writeOffset = 0;
+
+	while( true )
+	{
+		if( readOffset >= length )
+			return false;
+		uint8_t token = pSource[readOffset++];
+
+		size_t literalLength = token >> 4;
+		if( literalLength == 15 ) {
+			uint8_t byte;
+			do {
+				if( readOffset >= length )
+					return false;
+				byte = pSource[readOffset++];
+				literalLength += byte;
+			} while( byte == 255 );
+		}
+		if( literalLength > length - readOffset || literalLength > decompressedLength - writeOffset )
+			return false;
+		memcpy( pDest + writeOffset, pSource + readOffset, literalLength );
+		readOffset += literalLength;
+		writeOffset += literalLength;
+
+		if( readOffset == length )
+			break;
+
+		if( readOffset + 2 > length )
+			return false;
+		size_t offset = ReadUInt16( pSource + readOffset );
+		readOffset += 2;
+		if( offset == 0 || offset > writeOffset )
+			return false;
+
+		size_t matchLength = (token & 15);
+		if( matchLength == 15 ) {
+			uint8_t byte;
+			do {
+				if( readOffset >= length )
+					return false;
+				byte = pSource[readOffset++];
+				matchLength += byte;
+			} while( byte == 255 );
+		}
+		matchLength += CODEC_LZ_MIN_MATCH;
+		if( matchLength > decompressedLength - writeOffset )
+			return false;
+
+		uint8_t *pMatch = pDest + writeOffset - offset;
+		if( offset >= matchLength )
+			memcpy( pDest + writeOffset, pMatch, matchLength );
+		else {
+			// Overlapping match, repeats the last offset bytes
+			for( size_t i = 0; i < matchLength; i++ )
+				pDest[writeOffset + i] = pMatch[i];
+		}
+		writeOffset += matchLength;
+	}
+
+	return writeOffset == decompressedLength;
+}
+
+///////////////////
+// CChunkEncoder //
+///////////////////
+
+CChunkEncoder::CChunkEncoder()
+{
+	m_pOutput = 0;
+	m_paletteLookup.assign( 1 << (sizeof( BlockId )*8), PALETTE_LOOKUP_UNUSED );
+	m_indices.resize( CHUNK_VOLUME );
+	m_hashTable.resize( 1 << CODEC_LZ_HASH_BITS );
+	m_stats = ChunkCodecStats();
+}
+CChunkEncoder::~CChunkEncoder() {
+}
+
+void CChunkEncoder::begin( std::vector<uint8_t> *pOutput )
+{
+	assert( pOutput );
+	m_pOutput = pOutput;
+}
+void CChunkEncoder::finish() {
+	m_pOutput = 0;
+}
+
+uint32_t CChunkEncoder::buildPalette( const BlockId *pBlocks )
+{
+	uint32_t runCount = 0;
+	uint16_t lastIndex = PALETTE_LOOKUP_UNUSED;
+
+	m_palette.clear();
+	for( uint32_t i = 0; i < CHUNK_VOLUME; i++ )
+	{
+		uint16_t &lookup = m_paletteLookup[pBlocks[i]];
+		if( lookup == PALETTE_LOOKUP_UNUSED ) {
+			lookup = (uint16_t)m_palette.size();
+			m_palette.push_back( pBlocks[i] );
+		}
+		m_indices[i] = lookup;
+		if( lookup != lastIndex ) {
+			runCount++;
+			lastIndex = lookup;
+		}
+	}
+	// Only the entries that were used need resetting
+	for( auto it: m_palette )
+		m_paletteLookup[it] = PALETTE_LOOKUP_UNUSED;
+
+	return runCount;
+}
+
+void CChunkEncoder::transformRuns()
+{
+	bool wideIndices = m_palette.size() > 256;
+
+	for( uint32_t i = 0; i < CHUNK_VOLUME; )
+	{
+		uint16_t index = m_indices[i];
+		uint32_t runEnd = i + 1;
+		while( runEnd < CHUNK_VOLUME && m_indices[runEnd] == index )
+			runEnd++;
+
+		if( wideIndices )
+			WriteUInt16( m_transformed, index );
+		else
+			m_transformed.push_back( (uint8_t)index );
+		// Run length minus one as a varint, 7 bits per byte
+		uint32_t run = runEnd - i - 1;
+		while( run >= 0x80 ) {
+			m_transformed.push_back( (uint8_t)(run | 0x80) );
+			run >>= 7;
+		}
+		m_transformed.push_back( (uint8_t)run );
+
+		i = runEnd;
+	}
+}
+
+void CChunkEncoder::transformBitPlanes()
+{
+	uint32_t bitCount = PaletteIndexBits( (uint32_t)m_palette.size() );
+	size_t planesStart = m_transformed.size();
+
+	m_transformed.resize( planesStart + (size_t)bitCount*BITPLANE_SIZE, 0 );
+	for( uint32_t bit = 0; bit < bitCount; bit++ )
+	{
+		uint8_t *pPlane = &m_transformed[planesStart + (size_t)bit*BITPLANE_SIZE];
+		for( uint32_t i = 0; i < CHUNK_VOLUME; i++ )
+			pPlane[i >> 3] |= (uint8_t)(((m_indices[i] >> bit) & 1) << (i & 7));
+		// Delta against the layer below, top down so every layer is XORed with its original neighbour
+		for( uint32_t layer = CHUNK_SIZE-1; layer > 0; layer-- ) {
+			for( uint32_t i = 0; i < BITPLANE_LAYER_SIZE; i++ )
+				pPlane[layer*BITPLANE_LAYER_SIZE + i] ^= pPlane[(layer-1)*BITPLANE_LAYER_SIZE + i];
+		}
+	}
+}
+
+void CChunkEncoder::writeChunk( const CChunk *pChunk )
+{
+	assert( m_pOutput );
+	assert( pChunk );
+
+	auto encodeStart = std::chrono::high_resolution_clock::now();
+	size_t recordStart = m_pOutput->size();
+
+	if( pChunk->isUniform() ) {
+		m_pOutput->push_back( CODEC_MODE_UNIFORM );
+		WriteUInt16( *m_pOutput, pChunk->getUniformBlock() );
+	}
+	else
+	{
+		uint32_t runCount = this->buildPalette( pChunk->getBlockData() );
+		size_t indexBytes = m_palette.size() > 256 ? 2 : 1;
+		size_t planeBytes = (size_t)PaletteIndexBits( (uint32_t)m_palette.size() )*BITPLANE_SIZE;
+		// Runs cost an index and usually a one or two byte length each
+		ChunkCodecModes mode = ((size_t)runCount*(indexBytes + 2) <= planeBytes) ? CODEC_MODE_RUNS : CODEC_MODE_BITPLANES;
+
+		m_transformed.clear();
+		WriteUInt16( m_transformed, (uint16_t)m_palette.size() );
+		for( auto it: m_palette )
+			WriteUInt16( m_transformed, it );
+		if( mode == CODEC_MODE_RUNS )
+			this->transformRuns();
+		else
+			this->transformBitPlanes();
+
+		m_pOutput->resize( recordStart + CODEC_RECORD_HEADER_SIZE );
+		LZCompress( &m_transformed[0], m_transformed.size(), *m_pOutput, &m_hashTable[0] );
+
+		uint8_t *pHeader = &(*m_pOutput)[recordStart];
+		pHeader[0] = mode;
+		WriteUInt32( pHeader + 1, (uint32_t)m_transformed.size() );
+		WriteUInt32( pHeader + 5, (uint32_t)(m_pOutput->size() - recordStart - CODEC_RECORD_HEADER_SIZE) );
+	}
+
+	m_stats.chunkCount++;
+	m_stats.rawBytes += sizeof( BlockId )*CHUNK_VOLUME;
+	m_stats.encodedBytes += m_pOutput->size() - recordStart;
+	m_stats.seconds += std::chrono::duration<double>( std::chrono::high_resolution_clock::now() - encodeStart ).count();
+}
+
+///////////////////
+// CChunkDecoder //
+///////////////////
+
+CChunkDecoder::CChunkDecoder()
+{
+	m_pData = 0;
+	m_length = 0;
+	m_readOffset = 0;
+	m_indices.resize( CHUNK_VOLUME );
+	m_blocks.resize( CHUNK_VOLUME );
+	m_stats = ChunkCodecStats();
+}
+CChunkDecoder::~CChunkDecoder() {
+}
+
+void CChunkDecoder::begin( const uint8_t *pData, size_t length )
+{
+	m_pData = pData;
+	m_length = length;
+	m_readOffset = 0;
+}
+
+bool CChunkDecoder::untransformRuns( const uint8_t *pBody, size_t length, uint32_t paletteSize )
+{
+	size_t indexBytes = paletteSize > 256 ? 2 : 1;
+	size_t readOffset = 0;
+	uint32_t blockIndex = 0;
+
+	while( blockIndex < CHUNK_VOLUME )
+	{
+		if( readOffset + indexBytes > length )
+			return false;
+		uint16_t index = (indexBytes == 2) ? ReadUInt16( pBody + readOffset ) : pBody[readOffset];
+		readOffset += indexBytes;
+		if( index >= paletteSize )
+			return false;
+
+		uint32_t run = 0, shift = 0;
+		uint8_t byte;
+		do {
+			if( readOffset >= length || shift > 14 )
+				return false;
+			byte = pBody[readOffset++];
+			run |= (uint32_t)(byte & 0x7F) << shift;
+			shift += 7;
+		} while( byte & 0x80 );
+		run++;
+
+		if( run > CHUNK_VOLUME - blockIndex )
+			return false;
+		std::fill( m_indices.begin() + blockIndex, m_indices.begin() + blockIndex + run, index );
+		blockIndex += run;
+	}
+
+	return readOffset == length;
+}
+
+bool CChunkDecoder::untransformBitPlanes( const uint8_t *pBody, size_t length, uint32_t paletteSize )
+{
+	uint32_t bitCount = PaletteIndexBits( paletteSize );
+	uint8_t plane[BITPLANE_SIZE];
+
+	if( length != (size_t)bitCount*BITPLANE_SIZE )
+		return false;
+
+	std::fill( m_indices.begin(), m_indices.end(), (uint16_t)0 );
+	for( uint32_t bit = 0; bit < bitCount; bit++ )
+	{
+		memcpy( plane, pBody + (size_t)bit*BITPLANE_SIZE, BITPLANE_SIZE );
+		// Undo the delta bottom up, each layer below is already restored
+		for( uint32_t layer = 1; layer < CHUNK_SIZE; layer++ ) {
+			for( uint32_t i = 0; i < BITPLANE_LAYER_SIZE; i++ )
+				plane[layer*BITPLANE_LAYER_SIZE + i] ^= plane[(layer-1)*BITPLANE_LAYER_SIZE + i];
+		}
+		for( uint32_t i = 0; i < CHUNK_VOLUME; i++ )
+			m_indices[i] |= (uint16_t)(((plane[i >> 3] >> (i & 7)) & 1) << bit);
+	}
+	for( uint32_t i = 0; i < CHUNK_VOLUME; i++ ) {
+		if( m_indices[i] >= paletteSize )
+			return false;
+	}
+
+	return true;
+}
+
+bool CChunkDecoder::readChunk( CChunk *pChunk )
+{
+	assert( pChunk );
+
+	auto decodeStart = std::chrono::high_resolution_clock::now();
+	const uint8_t *pRecord = m_pData + m_readOffset;
+	size_t remaining = m_length - m_readOffset;
+	size_t recordLength;
+
+	if( remaining < 1 )
+		return false;
+
+	if( pRecord[0] == CODEC_MODE_UNIFORM ) {
+		if( remaining < 1 + sizeof( BlockId ) )
+			return false;
+		pChunk->fill( ReadUInt16( pRecord + 1 ) );
+		recordLength = 1 + sizeof( BlockId );
+	}
+	else if( pRecord[0] == CODEC_MODE_RUNS || pRecord[0] == CODEC_MODE_BITPLANES )
+	{
+		if( remaining < CODEC_RECORD_HEADER_SIZE )
+			return false;
+		uint32_t transformedLength = ReadUInt32( pRecord + 1 );
+		uint32_t compressedLength = ReadUInt32( pRecord + 5 );
+		if( compressedLength > remaining - CODEC_RECORD_HEADER_SIZE || transformedLength > TRANSFORMED_MAX_SIZE || transformedLength < sizeof( uint16_t ) )
+			return false;
+
+		m_transformed.resize( transformedLength );
+		if( !LZDecompress( pRecord + CODEC_RECORD_HEADER_SIZE, compressedLength, &m_transformed[0], transformedLength ) )
+			return false;
+
+		uint32_t paletteSize = ReadUInt16( &m_transformed[0] );
+		size_t paletteEnd = sizeof( uint16_t ) + (size_t)paletteSize*sizeof( BlockId );
+		if( paletteSize == 0 || paletteEnd > transformedLength )
+			return false;
+
+		const uint8_t *pBody = &m_transformed[0] + paletteEnd;
+		bool valid;
+		if( pRecord[0] == CODEC_MODE_RUNS )
+			valid = this->untransformRuns( pBody, transformedLength - paletteEnd, paletteSize );
+		else
+			valid = this->untransformBitPlanes( pBody, transformedLength - paletteEnd, paletteSize );
+		if( !valid )
+			return false;
+
+		m_palette.resize( paletteSize );
+		for( uint32_t i = 0; i < paletteSize; i++ )
+			m_palette[i] = ReadUInt16( &m_transformed[sizeof( uint16_t ) + (size_t)i*sizeof( BlockId )] );
+		for( uint32_t i = 0; i < CHUNK_VOLUME; i++ )
+			m_blocks[i] = m_palette[m_indices[i]];
+		pChunk->setBlockData( &m_blocks[0] );
+		recordLength = CODEC_RECORD_HEADER_SIZE + compressedLength;
+	}
+	else
+		return false;
+
+	m_readOffset += recordLength;
+
+	m_stats.chunkCount++;
+	m_stats.rawBytes += sizeof( BlockId )*CHUNK_VOLUME;
+	m_stats.encodedBytes += recordLength;
+	m_stats.seconds += std::chrono::duration<double>( std::chrono::high_resolution_clock::now() - decodeStart ).count();
+
+	return true;
+}
+
+///////////////
+// Benchmark //
+///////////////
+
+static void BuildSampleBlocks( ChunkCodecSamples sample, std::vector<BlockId> &blocks )
+{
+	// Fixed seed so every run measures the same chunks
+	uint32_t random = 0x9E3779B9;
+	auto nextRandom = [&random]() {
+		random ^= random << 13;
+		random ^= random >> 17;
+		random ^= random << 5;
+		return random;
+	};
+
+	blocks.resize( CHUNK_VOLUME );
+	switch( sample )
+	{
+	case CODEC_SAMPLE_UNIFORM:
+		std::fill( blocks.begin(), blocks.end(), (BlockId)BLOCK_STONE );
+		break;
+	case CODEC_SAMPLE_LAYERED:
+		for( uint32_t i = 0; i < CHUNK_VOLUME; i++ )
+		{
+			uint32_t y = i / CHUNK_AREA;
+			if( y < CHUNK_SIZE / 2 )
+				blocks[i] = BLOCK_STONE;
+			else if( y < CHUNK_SIZE / 2 + 3 )
+				blocks[i] = BLOCK_DIRT;
+			else if( y == CHUNK_SIZE / 2 + 3 )
+				blocks[i] = BLOCK_GRASS;
+			else
+				blocks[i] = BLOCK_AIR;
+		}
+		break;
+	case CODEC_SAMPLE_PALETTE:
+		for( uint32_t i = 0; i < CHUNK_VOLUME; i++ )
+			blocks[i] = (BlockId)(nextRandom() % BLOCK_COUNT);
+		break;
+	case CODEC_SAMPLE_FULL:
+		for( uint32_t i = 0; i < CHUNK_VOLUME; i++ )
+			blocks[i] = (BlockId)i;
+		for( uint32_t i = CHUNK_VOLUME-1; i > 0; i-- )
+			std::swap( blocks[i], blocks[nextRandom() % (i + 1)] );
+		break;
+	default:
+		assert( false );
+		break;
+	}
+}
+
+const char* GetChunkCodecSampleName( ChunkCodecSamples sample )
+{
+	switch( sample )
+	{
+	case CODEC_SAMPLE_UNIFORM:
+		return "uniform";
+	case CODEC_SAMPLE_LAYERED:
+		return "layered";
+	case CODEC_SAMPLE_PALETTE:
+		return "palette";
+	case CODEC_SAMPLE_FULL:
+		return "full";
+	default:
+		return "unknown";
+	}
+}
+
+bool BenchmarkChunkCodec( uint32_t repeatCount, ChunkCodecBenchmark *pResults )
+{
+	assert( pResults );
+
+	ChunkPos samplePosition = { 0, 0, 0 };
+	CChunkEncoder encoder;
+	CChunkDecoder decoder;
+	CChunk sourceChunk( samplePosition );
+	CChunk decodedChunk( samplePosition );
+	std::vector<BlockId> blocks;
+	std::vector<uint8_t> encoded;
+	bool allPassed = true;
+
+	for( uint8_t s = 0; s < CODEC_SAMPLE_COUNT; s++ )
+	{
+		BuildSampleBlocks( (ChunkCodecSamples)s, blocks );
+		sourceChunk.setBlockData( &blocks[0] );
+
+		encoded.clear();
+		encoder.resetStats();
+		encoder.begin( &encoded );
+		for( uint32_t r = 0; r < repeatCount; r++ )
+			encoder.writeChunk( &sourceChunk );
+		encoder.finish();
+
+		bool passed = !encoded.empty();
+		decoder.resetStats();
+		decoder.begin( encoded.empty() ? 0 : &encoded[0], encoded.size() );
+		for( uint32_t r = 0; r < repeatCount && passed; r++ )
+		{
+			if( !decoder.readChunk( &decodedChunk ) ) {
+				passed = false;
+				break;
+			}
+			for( uint32_t i = 0; i < CHUNK_VOLUME; i++ ) {
+				if( decodedChunk.getBlockByIndex( i ) != blocks[i] ) {
+					passed = false;
+					break;
+				}
+			}
+		}
+		if( decoder.getBytesRead() != encoded.size() )
+			passed = false;
+
+		pResults->modes[s] = encoded.empty() ? CODEC_MODE_UNIFORM : (ChunkCodecModes)encoded[0];
+		pResults->roundTrip[s] = passed;
+		pResults->encodeStats[s] = encoder.getStats();
+		pResults->decodeStats[s] = decoder.getStats();
+		allPassed = allPassed && passed;
+	}
+
+	return allPassed;
+}
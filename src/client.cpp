@@ -6,7 +6,9 @@
 #include "input.h"
 #include "logger.h"
 #include "gfx\graphics.h"
+#include "gfx\backend.h"
 #include "gfx\renderer.h"
+#include "gfx\chunkrenderer.h"
 
 CClient::CClient( CGame *pGameHandle )
 {
@@ -16,6 +18,9 @@ CClient::CClient( CGame *pGameHandle )
 	m_pUserInput = 0;
 	m_pWorldRenderer = 0;
 
+	m_headlessFrameCount = 0;
+	m_headlessFrameLimit = 0;
+
 	testEntity = 0;
 }
 CClient::~CClient() {
@@ -30,6 +35,8 @@ bool CClient::initialize()
 	m_pGraphics = new CGraphics( m_pGameHandle );
 	if( !m_pGraphics->initialize() )
 		return false;
+	if( m_pGraphics->isHeadless() && !m_pClientConfig->getPropertyFromConfig<unsigned int>( CONFIG_STR_HEADLESS_FRAME_LIMIT, &m_headlessFrameLimit ) )
+		m_headlessFrameLimit = 0;
 
 	m_pWorldRenderer = new CWorldRenderer( m_pGameHandle );
 	if( !m_pWorldRenderer->initialize() )
@@ -89,6 +96,9 @@ bool CClient::loadConfig()
 	clientConfig.put<unsigned int>( CONFIG_STR_REFRESH_RATE, DEFAULT_REFRESH_RATE );
 	clientConfig.put<float>( CONFIG_STR_FOV, DEFAULT_FOV );
 	clientConfig.put<int>( CONFIG_STR_WINDOW_MODE, DEFAULT_WINDOW_MODE );
+	clientConfig.put<int>( CONFIG_STR_RENDER_BACKEND, DEFAULT_RENDER_BACKEND );
+	clientConfig.put<unsigned int>( CONFIG_STR_HEADLESS_FRAME_LIMIT, 0 );
+	clientConfig.put<bool>( CONFIG_STR_RENDER_STATE_CACHE, true );
 
 	clientConfig.put<int>( CONFIG_STR_KEYBOARD_FORWARD, DEFAULT_KEYBIND_FORWARD );
 	clientConfig.put<int>( CONFIG_STR_KEYBOARD_BACKWARD, DEFAULT_KEYBIND_BACKWARD );
@@ -136,8 +146,13 @@ bool CClient::update()
 {
 	// Update user input
 	m_pUserInput->update();
-	// SDL events
-	this->handleSDLEvents();
+	// SDL events, without a window the frame limit stands in for closing it
+	if( m_pGraphics->isHeadless() ) {
+		if( m_headlessFrameLimit && ++m_headlessFrameCount >= m_headlessFrameLimit )
+			m_pGameHandle->quitGame();
+	}
+	else
+		this->handleSDLEvents();
 
 	// Escape key quit for early testing
 	if( m_pUserInput->isKeyPressed( SDL_SCANCODE_ESCAPE ) )
@@ -160,4 +175,10 @@ bool CClient::render()
 	m_pGraphics->draw();
 
 	return true;
-}
\ No newline at end of file
+}
+CMeshWorkerPool* CClient::getMeshWorkers()
+{
+	if( !m_pWorldRenderer || !m_pWorldRenderer->getChunkRenderer() )
+		return 0;
+	return m_pWorldRenderer->getChunkRenderer()->getMeshWorkers();
+}
@@ -0,0 +1,493 @@
+#include <assert.h>
+#include <algorithm>
+#include <chrono>
+#include "fluid.h"
+#include "game.h"
+#include "logger.h"
+
+static_assert(CHUNK_VOLUME <= 65536, "Active cells are stored as 16-bit indices");
+static_assert(CHUNK_VOLUME % 64 == 0, "Active bits are stored 64 to a word");
+
+/** Sideways faces, visited in a different order each update so water does not favour one direction */
+static const uint8_t SideFaces[4] = { FACE_NEG_X, FACE_POS_Z, FACE_POS_X, FACE_NEG_Z };
+
+/** True if any block of the chunk is water */
+static inline bool HasWater( const CChunk *pChunk ) {
+	if( pChunk->isUniform() )
+		return pChunk->getUniformBlock() == BLOCK_WATER;
+	const BlockId *pBlocks = pChunk->getBlockData();
+	return std::find( pBlocks, pBlocks + CHUNK_VOLUME, (BlockId)BLOCK_WATER ) != pBlocks + CHUNK_VOLUME;
+}
+
+/** The pass a chunk is updated in, neighbours always differ in parity on one axis */
+static inline uint32_t ChunkPass( const ChunkPos &position ) {
+	return (uint32_t)(position.x & 1) | ((uint32_t)(position.y & 1) << 1) | ((uint32_t)(position.z & 1) << 2);
+}
+
+/////////////////////
+// CFluidSimulator //
+/////////////////////
+
+CFluidSimulator::CFluidSimulator( CGame *pGameHandle ) : m_pGameHandle( pGameHandle )
+{
+	m_pChunkStore = 0;
+	m_updateCount = 0;
+	m_stats = FluidStats();
+}
+CFluidSimulator::~CFluidSimulator() {
+}
+
+bool CFluidSimulator::initialize( CChunkStore *pChunkStore )
+{
+	assert( pChunkStore );
+
+	m_pChunkStore = pChunkStore;
+	if( !m_threadPool.initialize( 0 ) ) {
+		m_pGameHandle->getLogger()->printError( "Failed to start fluid simulation threads" );
+		return false;
+	}
+
+	return true;
+}
+void CFluidSimulator::shutdown()
+{
+	m_threadPool.shutdown();
+	m_chunks.clear();
+	m_tasks.clear();
+	m_taskOrder.clear();
+	for( uint32_t pass = 0; pass < FLUID_PASS_COUNT; pass++ )
+		m_passTasks[pass].clear();
+	m_pChunkStore = 0;
+}
+
+CFluidSimulator::FluidChunk* CFluidSimulator::getFluidChunk( const ChunkPos &position )
+{
+	auto it = m_chunks.find( position );
+	if( it != m_chunks.end() )
+		return &it->second;
+
+	CChunk *pChunk = m_pChunkStore->getChunk( position );
+	if( !pChunk )
+		return 0;
+
+	FluidChunk &fluid = m_chunks[position];
+	fluid.levels.assign( CHUNK_VOLUME, 0 );
+	fluid.activeBits.assign( CHUNK_VOLUME / 64, 0 );
+	fluid.idle = false;
+	// Water without a level yet is full
+	if( pChunk->isUniform() ) {
+		if( pChunk->getUniformBlock() == BLOCK_WATER )
+			std::fill( fluid.levels.begin(), fluid.levels.end(), (uint8_t)FLUID_LEVEL_MAX );
+	}
+	else if( !pChunk->isEmpty() ) {
+		const BlockId *pBlocks = pChunk->getBlockData();
+		for( uint32_t i = 0; i < CHUNK_VOLUME; i++ ) {
+			if( pBlocks[i] == BLOCK_WATER )
+				fluid.levels[i] = FLUID_LEVEL_MAX;
+		}
+	}
+
+	return &fluid;
+}
+
+void CFluidSimulator::activate( int32_t x, int32_t y, int32_t z )
+{
+	if( y < 0 || y >= WORLD_HEIGHT )
+		return;
+
+	ChunkPos position = { BlockToChunkCoord( x ), BlockToChunkCoord( y ), BlockToChunkCoord( z ) };
+	FluidChunk *pFluid;
+	auto it = m_chunks.find( position );
+	if( it != m_chunks.end() )
+		pFluid = &it->second;
+	else {
+		// Only build the state of a chunk when there is water to wake
+		if( m_pChunkStore->getBlock( x, y, z ) != BLOCK_WATER )
+			return;
+		pFluid = this->getFluidChunk( position );
+	}
+	ActivateCell( *pFluid, ChunkBlockIndex( x & CHUNK_MASK, y & CHUNK_MASK, z & CHUNK_MASK ) );
+}
+
+void CFluidSimulator::activateAround( int32_t x, int32_t y, int32_t z )
+{
+	// Water only flows down and sideways, so the cell below never gains a move
+	this->activate( x, y, z );
+	this->activate( x, y+1, z );
+	for( uint32_t i = 0; i < 4; i++ )
+		this->activate( x + FaceNormals[SideFaces[i]][0], y, z + FaceNormals[SideFaces[i]][2] );
+}
+
+void CFluidSimulator::onBlockChanged( int32_t x, int32_t y, int32_t z, BlockId oldBlock, BlockId newBlock )
+{
+	if( oldBlock == newBlock )
+		return;
+
+	ChunkPos position = { BlockToChunkCoord( x ), BlockToChunkCoord( y ), BlockToChunkCoord( z ) };
+	uint32_t index = ChunkBlockIndex( x & CHUNK_MASK, y & CHUNK_MASK, z & CHUNK_MASK );
+	if( newBlock == BLOCK_WATER ) {
+		FluidChunk *pFluid = this->getFluidChunk( position );
+		if( pFluid )
+			pFluid->levels[index] = FLUID_LEVEL_MAX;
+	}
+	else if( oldBlock == BLOCK_WATER ) {
+		auto it = m_chunks.find( position );
+		if( it != m_chunks.end() )
+			it->second.levels[index] = 0;
+	}
+
+	this->activateAround( x, y, z );
+}
+
+void CFluidSimulator::activateBorder( FluidChunk &fluid, uint8_t face )
+{
+	const uint32_t axis = face / 2;
+	uint32_t coords[3];
+	coords[axis] = (face & 1) ? CHUNK_MASK : 0;
+	for( uint32_t v = 0; v < CHUNK_SIZE; v++ ) {
+		coords[(axis + 2) % 3] = v;
+		for( uint32_t u = 0; u < CHUNK_SIZE; u++ ) {
+			coords[(axis + 1) % 3] = u;
+			ActivateCell( fluid, ChunkBlockIndex( coords[0], coords[1], coords[2] ) );
+		}
+	}
+}
+
+void CFluidSimulator::onColumnLoaded( int32_t columnX, int32_t columnZ )
+{
+	// Water in chunks that are not loaded does not move, so only the chunks with water state can be held back
+	for( uint32_t i = 0; i < 4; i++ )
+	{
+		uint8_t face = SideFaces[i];
+		for( int32_t chunkY = 0; chunkY < WORLD_HEIGHT_CHUNKS; chunkY++ ) {
+			auto it = m_chunks.find( { columnX + FaceNormals[face][0], chunkY, columnZ + FaceNormals[face][2] } );
+			if( it != m_chunks.end() )
+				this->activateBorder( it->second, face ^ 1 );
+		}
+	}
+}
+
+void CFluidSimulator::onChunksEdited( const std::vector<ChunkPos> &positions )
+{
+	for( auto &position: positions )
+	{
+		CChunk *pChunk = m_pChunkStore->getChunk( position );
+		auto it = m_chunks.find( position );
+		if( !pChunk ) {
+			if( it != m_chunks.end() )
+				m_chunks.erase( it );
+			continue;
+		}
+
+		// Bring the levels in line with the blocks the same way single block edits do, water the edit left alone keeps its level
+		bool water;
+		if( it != m_chunks.end() ) {
+			FluidChunk &fluid = it->second;
+			water = false;
+			for( uint32_t i = 0; i < CHUNK_VOLUME; i++ ) {
+				if( pChunk->getBlockByIndex( i ) != BLOCK_WATER )
+					fluid.levels[i] = 0;
+				else {
+					if( fluid.levels[i] == 0 )
+						fluid.levels[i] = FLUID_LEVEL_MAX;
+					water = true;
+				}
+			}
+		}
+		else
+			water = HasWater( pChunk );
+		if( water ) {
+			FluidChunk *pFluid = this->getFluidChunk( position );
+			for( uint32_t i = 0; i < CHUNK_VOLUME; i++ )
+				ActivateCell( *pFluid, i );
+		}
+
+		// Water beside the chunk may have somewhere to go now
+		for( uint8_t face = 0; face < FACE_COUNT; face++ )
+		{
+			ChunkPos neighbour = { position.x + FaceNormals[face][0], position.y + FaceNormals[face][1], position.z + FaceNormals[face][2] };
+			FluidChunk *pFluid;
+			auto it = m_chunks.find( neighbour );
+			if( it != m_chunks.end() )
+				pFluid = &it->second;
+			else {
+				CChunk *pNeighbour = m_pChunkStore->getChunk( neighbour );
+				if( !pNeighbour || !HasWater( pNeighbour ) )
+					continue;
+				pFluid = this->getFluidChunk( neighbour );
+			}
+			this->activateBorder( *pFluid, face ^ 1 );
+		}
+	}
+}
+
+bool CFluidSimulator::processCell( FluidTask &task, uint32_t index )
+{
+	FluidChunk &fluid = *task.pFluid;
+	uint32_t level = fluid.levels[index];
+	if( level == 0 )
+		return false;
+
+	const int32_t local[3] = { (int32_t)(index & CHUNK_MASK), (int32_t)(index >> (CHUNK_SIZE_BITS*2)), (int32_t)((index >> CHUNK_SIZE_BITS) & CHUNK_MASK) };
+	uint32_t sideStart = (uint32_t)(m_updateCount & 3);
+	bool moved = false;
+
+	// Down first, then even out with the sides
+	for( uint32_t i = 0; i < 5 && level > 0; i++ )
+	{
+		uint8_t face = (i == 0) ? (uint8_t)FACE_NEG_Y : SideFaces[(sideStart + i - 1) & 3];
+		int32_t neighbour[3] = { local[0] + FaceNormals[face][0], local[1] + FaceNormals[face][1], local[2] + FaceNormals[face][2] };
+		bool inside = (uint32_t)neighbour[0] < CHUNK_SIZE && (uint32_t)neighbour[1] < CHUNK_SIZE && (uint32_t)neighbour[2] < CHUNK_SIZE;
+
+		CChunk *pNeighbourChunk = inside ? task.pChunk : task.pNeighbourChunks[face];
+		// Chunks that are not loaded, and the bottom of the world, hold the water back
+		if( !pNeighbourChunk )
+			continue;
+		uint32_t neighbourIndex = ChunkBlockIndex( neighbour[0] & CHUNK_MASK, neighbour[1] & CHUNK_MASK, neighbour[2] & CHUNK_MASK );
+		BlockId neighbourBlock = pNeighbourChunk->getBlockByIndex( neighbourIndex );
+		if( !IsCellOpen( neighbourBlock ) )
+			continue;
+
+		FluidChunk *pNeighbourFluid = inside ? &fluid : task.pNeighbourFluids[face];
+		uint32_t neighbourLevel = pNeighbourFluid ? pNeighbourFluid->levels[neighbourIndex] : (neighbourBlock == BLOCK_WATER ? FLUID_LEVEL_MAX : 0);
+		uint32_t amount;
+		if( face == FACE_NEG_Y )
+			amount = std::min( level, FLUID_LEVEL_MAX - neighbourLevel );
+		else
+			amount = (level > neighbourLevel + 1) ? (level - neighbourLevel) / 2 : 0;
+		if( amount == 0 )
+			continue;
+
+		level -= amount;
+		moved = true;
+		if( inside ) {
+			if( fluid.levels[neighbourIndex] == 0 )
+				fluid.changed.push_back( (uint16_t)neighbourIndex );
+			fluid.levels[neighbourIndex] += (uint8_t)amount;
+			ActivateCell( fluid, neighbourIndex );
+		}
+		else {
+			ChunkPos target = { task.position.x + FaceNormals[face][0], task.position.y + FaceNormals[face][1], task.position.z + FaceNormals[face][2] };
+			task.outbox.push_back( { target, (uint16_t)neighbourIndex, (uint8_t)amount } );
+		}
+	}
+	if( !moved )
+		return false;
+
+	fluid.levels[index] = (uint8_t)level;
+	if( level == 0 )
+		fluid.changed.push_back( (uint16_t)index );
+
+	// The cell may have more to give, and the cells above and beside it may now flow into it
+	ActivateCell( fluid, index );
+	for( uint32_t i = 0; i < 5; i++ )
+	{
+		uint8_t face = (i == 4) ? (uint8_t)FACE_POS_Y : SideFaces[i];
+		int32_t neighbour[3] = { local[0] + FaceNormals[face][0], local[1] + FaceNormals[face][1], local[2] + FaceNormals[face][2] };
+		uint32_t neighbourIndex = ChunkBlockIndex( neighbour[0] & CHUNK_MASK, neighbour[1] & CHUNK_MASK, neighbour[2] & CHUNK_MASK );
+		if( (uint32_t)neighbour[0] < CHUNK_SIZE && (uint32_t)neighbour[1] < CHUNK_SIZE && (uint32_t)neighbour[2] < CHUNK_SIZE )
+			ActivateCell( fluid, neighbourIndex );
+		else if( task.pNeighbourChunks[face] ) {
+			ChunkPos target = { task.position.x + FaceNormals[face][0], task.position.y + FaceNormals[face][1], task.position.z + FaceNormals[face][2] };
+			task.outbox.push_back( { target, (uint16_t)neighbourIndex, 0 } );
+		}
+	}
+
+	return true;
+}
+
+void CFluidSimulator::processChunk( FluidTask &task )
+{
+	FluidChunk &fluid = *task.pFluid;
+
+	size_t visitCount = std::min( fluid.active.size(), task.cellBudget );
+	for( size_t i = 0; i < visitCount; i++ ) {
+		uint32_t index = fluid.active[i];
+		fluid.activeBits[index >> 6] &= ~((uint64_t)1 << (index & 63));
+		this->processCell( task, index );
+	}
+
+	// Cells over the budget stay at the front for next time
+	fluid.active.erase( fluid.active.begin(), fluid.active.begin() + visitCount );
+	task.cellCount = visitCount;
+}
+
+void CFluidSimulator::deliverMessages( FluidTask &task )
+{
+	ChunkPos lastTarget = { 0, 0, 0 };
+	FluidChunk *pTarget = 0;
+	bool targetValid = false;
+	for( auto &message: task.outbox )
+	{
+		if( !targetValid || message.target != lastTarget ) {
+			lastTarget = message.target;
+			targetValid = true;
+			auto it = m_chunks.find( message.target );
+			pTarget = (it != m_chunks.end()) ? &it->second : 0;
+		}
+		if( !pTarget ) {
+			// Waking dry cells does nothing, do not build state for them
+			CChunk *pChunk = m_pChunkStore->getChunk( message.target );
+			if( message.amount == 0 && (!pChunk || pChunk->getBlockByIndex( message.index ) != BLOCK_WATER) )
+				continue;
+			pTarget = this->getFluidChunk( message.target );
+			if( !pTarget )
+				continue;
+		}
+
+		if( message.amount > 0 ) {
+			uint8_t &level = pTarget->levels[message.index];
+			assert( level + message.amount <= FLUID_LEVEL_MAX );
+			if( level == 0 )
+				pTarget->changed.push_back( message.index );
+			level = (uint8_t)std::min( level + message.amount, FLUID_LEVEL_MAX );
+		}
+		ActivateCell( *pTarget, message.index );
+	}
+	task.outbox.clear();
+}
+
+void CFluidSimulator::applyChanges( const BlockChangeCallback &callback )
+{
+	for( auto it = m_chunks.begin(); it != m_chunks.end(); )
+	{
+		FluidChunk &fluid = it->second;
+		const ChunkPos &position = it->first;
+		CChunk *pChunk = m_pChunkStore->getChunk( position );
+		if( !pChunk ) {
+			it = m_chunks.erase( it );
+			continue;
+		}
+
+		// A cell may have filled and emptied again, only the final level matters
+		for( auto index: fluid.changed )
+		{
+			BlockId block = fluid.levels[index] > 0 ? (BlockId)BLOCK_WATER : (BlockId)BLOCK_AIR;
+			BlockId currentBlock = pChunk->getBlockByIndex( index );
+			if( currentBlock == block )
+				continue;
+			// Only a block changed without telling the simulator can be here, its water is lost
+			if( !IsCellOpen( currentBlock ) ) {
+				fluid.levels[index] = 0;
+				continue;
+			}
+			callback( position.x*CHUNK_SIZE + (int32_t)(index & CHUNK_MASK),
+				position.y*CHUNK_SIZE + (int32_t)(index >> (CHUNK_SIZE_BITS*2)),
+				position.z*CHUNK_SIZE + (int32_t)((index >> CHUNK_SIZE_BITS) & CHUNK_MASK), block );
+		}
+		fluid.changed.clear();
+
+		// Settled chunks whose cells are all full or empty can be rebuilt from their blocks when woken
+		bool idle = fluid.active.empty() && fluid.pending.empty();
+		if( idle && !fluid.idle ) {
+			bool partial = std::any_of( fluid.levels.begin(), fluid.levels.end(), []( uint8_t level ) { return level != 0 && level != FLUID_LEVEL_MAX; } );
+			if( !partial ) {
+				it = m_chunks.erase( it );
+				continue;
+			}
+		}
+		fluid.idle = idle;
+		++it;
+	}
+}
+
+void CFluidSimulator::update( const BlockChangeCallback &callback )
+{
+	auto updateStart = std::chrono::high_resolution_clock::now();
+
+	// Every chunk with cells to visit is a task
+	size_t taskCount = 0;
+	for( auto &it: m_chunks )
+	{
+		FluidChunk &fluid = it.second;
+		if( !fluid.pending.empty() ) {
+			fluid.active.insert( fluid.active.end(), fluid.pending.begin(), fluid.pending.end() );
+			fluid.pending.clear();
+		}
+		if( fluid.active.empty() )
+			continue;
+		CChunk *pChunk = m_pChunkStore->getChunk( it.first );
+		if( !pChunk )
+			continue;
+
+		if( taskCount == m_tasks.size() )
+			m_tasks.push_back( FluidTask() );
+		FluidTask &task = m_tasks[taskCount++];
+		task.position = it.first;
+		task.pChunk = pChunk;
+		task.pFluid = &fluid;
+		task.cellCount = 0;
+		task.outbox.clear();
+	}
+
+	if( taskCount > 0 )
+	{
+		// Share the cell limit, chunks that need less than an even share leave the rest to the others
+		m_taskOrder.resize( taskCount );
+		for( size_t i = 0; i < taskCount; i++ )
+			m_taskOrder[i] = i;
+		std::sort( m_taskOrder.begin(), m_taskOrder.end(), [this]( size_t a, size_t b ) { return m_tasks[a].pFluid->active.size() < m_tasks[b].pFluid->active.size(); } );
+		size_t remainingCells = FLUID_MAX_CELLS_PER_UPDATE;
+		for( size_t i = 0; i < taskCount; i++ ) {
+			FluidTask &task = m_tasks[m_taskOrder[i]];
+			size_t share = std::max<size_t>( remainingCells / (taskCount - i), 1 );
+			task.cellBudget = std::min( task.pFluid->active.size(), share );
+			remainingCells -= std::min( remainingCells, task.cellBudget );
+		}
+
+		for( uint32_t pass = 0; pass < FLUID_PASS_COUNT; pass++ )
+			m_passTasks[pass].clear();
+		for( size_t i = 0; i < taskCount; i++ )
+			m_passTasks[ChunkPass( m_tasks[i].position )].push_back( i );
+
+		for( uint32_t pass = 0; pass < FLUID_PASS_COUNT; pass++ )
+		{
+			std::vector<size_t> &passTasks = m_passTasks[pass];
+			if( passTasks.empty() )
+				continue;
+
+			// Look the neighbours up now, earlier passes may have given them water state
+			for( auto i: passTasks )
+			{
+				FluidTask &task = m_tasks[i];
+				for( uint8_t face = 0; face < FACE_COUNT; face++ )
+				{
+					ChunkPos neighbour = { task.position.x + FaceNormals[face][0], task.position.y + FaceNormals[face][1], task.position.z + FaceNormals[face][2] };
+					task.pNeighbourChunks[face] = (neighbour.y >= 0 && neighbour.y < WORLD_HEIGHT_CHUNKS) ? m_pChunkStore->getChunk( neighbour ) : 0;
+					auto it = task.pNeighbourChunks[face] ? m_chunks.find( neighbour ) : m_chunks.end();
+					task.pNeighbourFluids[face] = (it != m_chunks.end()) ? &it->second : 0;
+				}
+			}
+
+			// No two chunks in a pass are neighbours, so every chunk reads cells nobody is writing
+			m_threadPool.parallelFor( passTasks.size(), [this, &passTasks]( size_t i ) {
+				this->processChunk( m_tasks[passTasks[i]] );
+			} );
+
+			for( auto i: passTasks )
+				this->deliverMessages( m_tasks[i] );
+		}
+
+		for( size_t i = 0; i < taskCount; i++ ) {
+			m_stats.cellCount += m_tasks[i].cellCount;
+			m_stats.deferredCount += m_tasks[i].pFluid->active.size();
+		}
+	}
+
+	this->applyChanges( callback );
+	m_updateCount++;
+
+	m_stats.updateCount++;
+	m_stats.seconds += std::chrono::duration<double>( std::chrono::high_resolution_clock::now() - updateStart ).count();
+}
+
+uint8_t CFluidSimulator::getLevel( int32_t x, int32_t y, int32_t z )
+{
+	if( y < 0 || y >= WORLD_HEIGHT )
+		return 0;
+
+	auto it = m_chunks.find( { BlockToChunkCoord( x ), BlockToChunkCoord( y ), BlockToChunkCoord( z ) } );
+	if( it != m_chunks.end() )
+		return it->second.levels[ChunkBlockIndex( x & CHUNK_MASK, y & CHUNK_MASK, z & CHUNK_MASK )];
+	return m_pChunkStore->getBlock( x, y, z ) == BLOCK_WATER ? FLUID_LEVEL_MAX : 0;
+}
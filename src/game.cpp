@@ -38,6 +38,8 @@ bool CGame::initialize()
 		return false;
 
 	m_pServer = new CServer( this );
+	// Chunks are meshed on the client's workers
+	m_pServer->setMeshWorkers( m_pClient->getMeshWorkers() );
 	// Start server thread
 	if( !m_pServer->initialize() )
 		return false;
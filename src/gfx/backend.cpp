@@ -0,0 +1,458 @@
+#include <string>
+#include "gfx/backend.h"
+#include "game.h"
+#include "logger.h"
+
+bool CGLRenderBackend::GLEWInitialized = false;
+
+#ifdef _DEBUG
+void CGLRenderBackend::MasterDebugCallback( GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length, const GLchar* message, const void* userParam )
+{
+	CGLRenderBackend *pBackend = const_cast<CGLRenderBackend*>(reinterpret_cast<const CGLRenderBackend*>(userParam));
+	pBackend->debugCallback( source, type, id, severity, length, message );
+}
+#endif
+
+CGLRenderBackend::CGLRenderBackend( CGame *pGameHandle ) : m_pGameHandle( pGameHandle )
+{
+	m_glSupportLevel = GLSupportLevel::GL_SUPPORT_NONE;
+	m_stats = RenderBackendStats();
+}
+CGLRenderBackend::~CGLRenderBackend() {
+}
+
+bool CGLRenderBackend::initialize()
+{
+	GLenum glewErr;
+
+	// Initialize GLEW
+	m_pGameHandle->getLogger()->print( "Initializing GLEW..." );
+	if( !CGLRenderBackend::GLEWInitialized )
+	{
+		glewErr = glewInit();
+		if( glewErr != GLEW_OK ) {
+			m_pGameHandle->getLogger()->printError( "Failed it initialize GLEW: %s", glewGetErrorString( glewErr ) );
+			return false;
+		}
+		CGLRenderBackend::GLEWInitialized = true;
+	}
+	m_pGameHandle->getLogger()->print( "Successfully initialize GLEW %s", glewGetString( GLEW_VERSION ) );
+	// Check for open GL support
+	if( glewIsSupported( "GL_VERSION_3_2" ) )
+		m_glSupportLevel = GLSupportLevel::GL_SUPPORT_MIN;
+	if( glewIsSupported( "GL_VERSION_4_1" ) )
+		m_glSupportLevel = GLSupportLevel::GL_SUPPORT_STD;
+	if( glewIsSupported( "GL_VERSION_4_6" ) )
+		m_glSupportLevel = GLSupportLevel::GL_SUPPORT_MAX;
+	if( m_glSupportLevel == GLSupportLevel::GL_SUPPORT_NONE ) {
+		m_pGameHandle->getLogger()->printError( "The minimum OpenGL supported version is 3.2, which this computer does not support!" );
+		return false;
+	}
+
+	// Set up debug output if supported
+#ifdef _DEBUG
+	if( glewIsSupported( "GL_ARB_debug_output" ) ) {
+		glEnable( GL_DEBUG_OUTPUT_SYNCHRONOUS );
+		glEnable( GL_DEBUG_OUTPUT );
+		glDebugMessageCallback( CGLRenderBackend::MasterDebugCallback, this );
+		GLuint unusedIds = 0;
+		glDebugMessageControl( GL_DONT_CARE, GL_DONT_CARE, GL_DONT_CARE, 0, &unusedIds, GL_TRUE );
+	}
+#endif
+
+	// Print GL info
+	m_pGameHandle->getLogger()->print( "OpenGL Context Info:" );
+	m_pGameHandle->getLogger()->print( "\tVersion: %s", glGetString( GL_VERSION ) );
+	m_pGameHandle->getLogger()->print( "\tVendor: %s", glGetString( GL_VENDOR ) );
+	m_pGameHandle->getLogger()->print( "\tRenderer: %s", glGetString( GL_RENDERER ) );
+	m_pGameHandle->getLogger()->print( "\tGLSL: %s", glGetString( GL_SHADING_LANGUAGE_VERSION ) );
+
+	return true;
+}
+void CGLRenderBackend::shutdown() {
+}
+
+#ifdef _DEBUG
+void CGLRenderBackend::debugCallback( GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length, const GLchar* message )
+{
+	// Determine severity
+	std::string severityStr;
+	switch( severity )
+	{
+	case GL_DEBUG_SEVERITY_LOW:
+		severityStr = "LOW";
+		break;
+	case GL_DEBUG_SEVERITY_MEDIUM:
+		severityStr = "MEDIUM";
+		break;
+	case GL_DEBUG_SEVERITY_HIGH:
+		severityStr = "HIGH";
+		break;
+	default:
+		severityStr = "UNKNOWN";
+		break;
+	}
+	// Determine message type
+	switch( type )
+	{
+	case GL_DEBUG_TYPE_UNDEFINED_BEHAVIOR:
+		m_pGameHandle->getLogger()->printError( "OPENGL UNDEFINED (id: %u, s: %s): %s", id, severityStr.c_str(), message );
+		break;
+	case GL_DEBUG_TYPE_ERROR:
+		m_pGameHandle->getLogger()->printError( "OPENGL ERROR (id: %u, s: %s): %s", id, severityStr.c_str(), message );
+		break;
+	case GL_DEBUG_TYPE_PORTABILITY:
+	case GL_DEBUG_TYPE_PERFORMANCE:
+	case GL_DEBUG_TYPE_DEPRECATED_BEHAVIOR:
+		m_pGameHandle->getLogger()->printWarn( "OPENGL WARNING (id: %u, s: %s): %s", id, severityStr.c_str(), message );
+		break;
+	case GL_DEBUG_TYPE_OTHER:
+		m_pGameHandle->getLogger()->print( "OPENGL (id: %u, s: %s): %s", id, severityStr.c_str(), message );
+		break;
+	}
+
+}
+#endif
+
+bool CGLRenderBackend::isExtensionSupported( const char *pExtension ) {
+	return glewIsSupported( pExtension ) == GL_TRUE;
+}
+void CGLRenderBackend::endFrame() {
+	m_stats.frameCount++;
+}
+
+GLenum CGLRenderBackend::getError() {
+	return glGetError();
+}
+void CGLRenderBackend::getIntegerv( GLenum name, GLint *pValue )
+{
+	m_stats.commandCount++;
+	glGetIntegerv( name, pValue );
+}
+const char* CGLRenderBackend::getString( GLenum name )
+{
+	m_stats.commandCount++;
+	return (const char*)glGetString( name );
+}
+
+void CGLRenderBackend::enable( GLenum capability )
+{
+	m_stats.commandCount++;
+	m_stats.stateChangeCount++;
+	glEnable( capability );
+}
+void CGLRenderBackend::disable( GLenum capability )
+{
+	m_stats.commandCount++;
+	m_stats.stateChangeCount++;
+	glDisable( capability );
+}
+void CGLRenderBackend::depthFunc( GLenum function )
+{
+	m_stats.commandCount++;
+	m_stats.stateChangeCount++;
+	glDepthFunc( function );
+}
+void CGLRenderBackend::cullFace( GLenum face )
+{
+	m_stats.commandCount++;
+	m_stats.stateChangeCount++;
+	glCullFace( face );
+}
+void CGLRenderBackend::frontFace( GLenum winding )
+{
+	m_stats.commandCount++;
+	m_stats.stateChangeCount++;
+	glFrontFace( winding );
+}
+void CGLRenderBackend::pointSize( GLfloat size )
+{
+	m_stats.commandCount++;
+	m_stats.stateChangeCount++;
+	glPointSize( size );
+}
+void CGLRenderBackend::clearColor( GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha )
+{
+	m_stats.commandCount++;
+	m_stats.stateChangeCount++;
+	glClearColor( red, green, blue, alpha );
+}
+void CGLRenderBackend::clear( GLbitfield mask )
+{
+	m_stats.commandCount++;
+	glClear( mask );
+}
+
+void CGLRenderBackend::genBuffers( GLsizei count, GLuint *pBuffers )
+{
+	m_stats.commandCount++;
+	glGenBuffers( count, pBuffers );
+}
+void CGLRenderBackend::deleteBuffers( GLsizei count, const GLuint *pBuffers )
+{
+	m_stats.commandCount++;
+	glDeleteBuffers( count, pBuffers );
+}
+void CGLRenderBackend::bindBuffer( GLenum target, GLuint buffer )
+{
+	m_stats.commandCount++;
+	m_stats.stateChangeCount++;
+	glBindBuffer( target, buffer );
+}
+void CGLRenderBackend::bindBufferRange( GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size )
+{
+	m_stats.commandCount++;
+	m_stats.stateChangeCount++;
+	glBindBufferRange( target, index, buffer, offset, size );
+}
+void CGLRenderBackend::bufferData( GLenum target, GLsizeiptr size, const void *pData, GLenum usage )
+{
+	m_stats.commandCount++;
+	if( pData )
+		m_stats.uploadedBytes += size;
+	glBufferData( target, size, pData, usage );
+}
+void CGLRenderBackend::bufferStorage( GLenum target, GLsizeiptr size, const void *pData, GLbitfield flags )
+{
+	m_stats.commandCount++;
+	if( pData )
+		m_stats.uploadedBytes += size;
+	glBufferStorage( target, size, pData, flags );
+}
+void CGLRenderBackend::bufferSubData( GLenum target, GLintptr offset, GLsizeiptr size, const void *pData )
+{
+	m_stats.commandCount++;
+	m_stats.uploadedBytes += size;
+	glBufferSubData( target, offset, size, pData );
+}
+void* CGLRenderBackend::mapBufferRange( GLenum target, GLintptr offset, GLsizeiptr length, GLbitfield access )
+{
+	m_stats.commandCount++;
+	return glMapBufferRange( target, offset, length, access );
+}
+GLboolean CGLRenderBackend::unmapBuffer( GLenum target )
+{
+	m_stats.commandCount++;
+	return glUnmapBuffer( target );
+}
+
+GLsync CGLRenderBackend::fenceSync( GLenum condition, GLbitfield flags )
+{
+	m_stats.commandCount++;
+	return glFenceSync( condition, flags );
+}
+GLenum CGLRenderBackend::clientWaitSync( GLsync sync, GLbitfield flags, GLuint64 timeout )
+{
+	m_stats.commandCount++;
+	return glClientWaitSync( sync, flags, timeout );
+}
+void CGLRenderBackend::deleteSync( GLsync sync )
+{
+	m_stats.commandCount++;
+	glDeleteSync( sync );
+}
+
+void CGLRenderBackend::genVertexArrays( GLsizei count, GLuint *pArrays )
+{
+	m_stats.commandCount++;
+	glGenVertexArrays( count, pArrays );
+}
+void CGLRenderBackend::deleteVertexArrays( GLsizei count, const GLuint *pArrays )
+{
+	m_stats.commandCount++;
+	glDeleteVertexArrays( count, pArrays );
+}
+void CGLRenderBackend::bindVertexArray( GLuint array )
+{
+	m_stats.commandCount++;
+	m_stats.stateChangeCount++;
+	glBindVertexArray( array );
+}
+void CGLRenderBackend::vertexAttribPointer( GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride, const void *pPointer )
+{
+	m_stats.commandCount++;
+	m_stats.stateChangeCount++;
+	glVertexAttribPointer( index, size, type, normalized, stride, pPointer );
+}
+void CGLRenderBackend::vertexAttribIPointer( GLuint index, GLint size, GLenum type, GLsizei stride, const void *pPointer )
+{
+	m_stats.commandCount++;
+	m_stats.stateChangeCount++;
+	glVertexAttribIPointer( index, size, type, stride, pPointer );
+}
+void CGLRenderBackend::vertexAttribLPointer( GLuint index, GLint size, GLenum type, GLsizei stride, const void *pPointer )
+{
+	m_stats.commandCount++;
+	m_stats.stateChangeCount++;
+	glVertexAttribLPointer( index, size, type, stride, pPointer );
+}
+void CGLRenderBackend::enableVertexAttribArray( GLuint index )
+{
+	m_stats.commandCount++;
+	m_stats.stateChangeCount++;
+	glEnableVertexAttribArray( index );
+}
+void CGLRenderBackend::vertexAttribDivisor( GLuint index, GLuint divisor )
+{
+	m_stats.commandCount++;
+	m_stats.stateChangeCount++;
+	glVertexAttribDivisor( index, divisor );
+}
+void CGLRenderBackend::vertexAttrib3f( GLuint index, GLfloat x, GLfloat y, GLfloat z )
+{
+	m_stats.commandCount++;
+	m_stats.stateChangeCount++;
+	glVertexAttrib3f( index, x, y, z );
+}
+
+GLuint CGLRenderBackend::createShader( GLenum type )
+{
+	m_stats.commandCount++;
+	return glCreateShader( type );
+}
+void CGLRenderBackend::deleteShader( GLuint shader )
+{
+	m_stats.commandCount++;
+	glDeleteShader( shader );
+}
+void CGLRenderBackend::shaderSource( GLuint shader, const GLchar *pSource )
+{
+	m_stats.commandCount++;
+	glShaderSource( shader, 1, &pSource, 0 );
+}
+void CGLRenderBackend::compileShader( GLuint shader )
+{
+	m_stats.commandCount++;
+	glCompileShader( shader );
+}
+void CGLRenderBackend::getShaderiv( GLuint shader, GLenum name, GLint *pValue )
+{
+	m_stats.commandCount++;
+	glGetShaderiv( shader, name, pValue );
+}
+void CGLRenderBackend::getShaderInfoLog( GLuint shader, GLsizei maxLength, GLsizei *pLength, GLchar *pLog )
+{
+	m_stats.commandCount++;
+	glGetShaderInfoLog( shader, maxLength, pLength, pLog );
+}
+GLuint CGLRenderBackend::createProgram()
+{
+	m_stats.commandCount++;
+	return glCreateProgram();
+}
+void CGLRenderBackend::deleteProgram( GLuint program )
+{
+	m_stats.commandCount++;
+	glDeleteProgram( program );
+}
+void CGLRenderBackend::attachShader( GLuint program, GLuint shader )
+{
+	m_stats.commandCount++;
+	glAttachShader( program, shader );
+}
+void CGLRenderBackend::detachShader( GLuint program, GLuint shader )
+{
+	m_stats.commandCount++;
+	glDetachShader( program, shader );
+}
+void CGLRenderBackend::linkProgram( GLuint program )
+{
+	m_stats.commandCount++;
+	glLinkProgram( program );
+}
+void CGLRenderBackend::getProgramiv( GLuint program, GLenum name, GLint *pValue )
+{
+	m_stats.commandCount++;
+	glGetProgramiv( program, name, pValue );
+}
+void CGLRenderBackend::getProgramInfoLog( GLuint program, GLsizei maxLength, GLsizei *pLength, GLchar *pLog )
+{
+	m_stats.commandCount++;
+	glGetProgramInfoLog( program, maxLength, pLength, pLog );
+}
+void CGLRenderBackend::programParameteri( GLuint program, GLenum name, GLint value )
+{
+	m_stats.commandCount++;
+	glProgramParameteri( program, name, value );
+}
+void CGLRenderBackend::getProgramBinary( GLuint program, GLsizei bufferSize, GLsizei *pLength, GLenum *pFormat, void *pBinary )
+{
+	m_stats.commandCount++;
+	glGetProgramBinary( program, bufferSize, pLength, pFormat, pBinary );
+}
+void CGLRenderBackend::programBinary( GLuint program, GLenum format, const void *pBinary, GLsizei length )
+{
+	m_stats.commandCount++;
+	glProgramBinary( program, format, pBinary, length );
+}
+void CGLRenderBackend::useProgram( GLuint program )
+{
+	m_stats.commandCount++;
+	m_stats.stateChangeCount++;
+	glUseProgram( program );
+}
+
+GLint CGLRenderBackend::getUniformLocation( GLuint program, const GLchar *pName )
+{
+	m_stats.commandCount++;
+	return glGetUniformLocation( program, pName );
+}
+GLuint CGLRenderBackend::getUniformBlockIndex( GLuint program, const GLchar *pName )
+{
+	m_stats.commandCount++;
+	return glGetUniformBlockIndex( program, pName );
+}
+void CGLRenderBackend::uniformBlockBinding( GLuint program, GLuint blockIndex, GLuint binding )
+{
+	m_stats.commandCount++;
+	m_stats.stateChangeCount++;
+	glUniformBlockBinding( program, blockIndex, binding );
+}
+void CGLRenderBackend::uniform3fv( GLint location, GLsizei count, const GLfloat *pValue )
+{
+	m_stats.commandCount++;
+	m_stats.stateChangeCount++;
+	glUniform3fv( location, count, pValue );
+}
+void CGLRenderBackend::uniformMatrix4fv( GLint location, GLsizei count, GLboolean transpose, const GLfloat *pValue )
+{
+	m_stats.commandCount++;
+	m_stats.stateChangeCount++;
+	glUniformMatrix4fv( location, count, transpose, pValue );
+}
+
+void CGLRenderBackend::drawArrays( GLenum mode, GLint first, GLsizei count )
+{
+	m_stats.commandCount++;
+	m_stats.drawCount++;
+	m_stats.vertexCount += count;
+	glDrawArrays( mode, first, count );
+}
+void CGLRenderBackend::drawElements( GLenum mode, GLsizei count, GLenum type, const void *pIndices )
+{
+	m_stats.commandCount++;
+	m_stats.drawCount++;
+	m_stats.vertexCount += count;
+	glDrawElements( mode, count, type, pIndices );
+}
+void CGLRenderBackend::drawElementsBaseVertex( GLenum mode, GLsizei count, GLenum type, const void *pIndices, GLint baseVertex )
+{
+	m_stats.commandCount++;
+	m_stats.drawCount++;
+	m_stats.vertexCount += count;
+	glDrawElementsBaseVertex( mode, count, type, const_cast<void*>(pIndices), baseVertex );
+}
+void CGLRenderBackend::drawElementsInstanced( GLenum mode, GLsizei count, GLenum type, const void *pIndices, GLsizei instanceCount )
+{
+	m_stats.commandCount++;
+	m_stats.drawCount++;
+	m_stats.vertexCount += (uint64_t)count * instanceCount;
+	glDrawElementsInstanced( mode, count, type, pIndices, instanceCount );
+}
+void CGLRenderBackend::multiDrawElementsIndirect( GLenum mode, GLenum type, const void *pIndirect, GLsizei drawCount, GLsizei stride )
+{
+	// The indices drawn are in the buffer, they are not counted
+	m_stats.commandCount++;
+	m_stats.drawCount++;
+	glMultiDrawElementsIndirect( mode, type, pIndirect, drawCount, stride );
+}
@@ -0,0 +1,460 @@
+#include <algorithm>
+#include <cmath>
+#include <glm/ext.hpp>
+#include "gfx/chunkrenderer.h"
+#include "gfx/meshworkers.h"
+#include "gfx/graphics.h"
+#include "gfx/backend.h"
+#include "gfx/shader.h"
+#include "game.h"
+#include "logger.h"
+#include "client.h"
+
+CChunkRenderer::CChunkRenderer( CGame *pGameHandle ) : m_pGameHandle( pGameHandle ), m_drawStream( pGameHandle )
+{
+	m_pMeshWorkers = 0;
+
+	m_shaderIndex = 0;
+
+	m_cameraChunk = { 0, 0, 0 };
+	m_lodCameraChunk = { 0, 0, 0 };
+
+	m_indexBufferQuads = 0;
+
+	m_multiDrawIndirect = false;
+	m_drawStreamDraws = 0;
+}
+CChunkRenderer::~CChunkRenderer() {
+}
+
+bool CChunkRenderer::initialize()
+{
+	m_pMeshWorkers = new CMeshWorkerPool();
+	if( !m_pMeshWorkers->initialize( 0 ) ) {
+		m_pGameHandle->getLogger()->printError( "Failed to start mesh worker threads" );
+		return false;
+	}
+	m_pGameHandle->getLogger()->print( "Started %u mesh worker threads", m_pMeshWorkers->getThreadCount() );
+	if( !m_occlusion.initialize() ) {
+		m_pGameHandle->getLogger()->printError( "Failed to start occlusion culling threads" );
+		return false;
+	}
+	// Nothing is drawn without a window, check the culler against known boxes instead
+	if( m_pGameHandle->getClient()->getGraphics()->isHeadless() ) {
+		if( !m_occlusion.runSelfCheck() ) {
+			m_pGameHandle->getLogger()->printError( "Occlusion culling self check failed" );
+			return false;
+		}
+		m_pGameHandle->getLogger()->print( "Occlusion culling self check passed" );
+	}
+
+	m_vertexArena.initialize( sizeof( ChunkVertex ), CHUNK_ARENA_PAGE_VERTICES );
+	IRenderBackend *pBackend = CGraphics::GetActiveBackend();
+	m_multiDrawIndirect = pBackend->isExtensionSupported( "GL_ARB_multi_draw_indirect" ) && pBackend->isExtensionSupported( "GL_ARB_base_instance" );
+	if( m_multiDrawIndirect ) {
+		if( !this->reserveDrawStream( CHUNK_DRAW_BUFFER_DRAWS ) )
+			return false;
+	}
+	else
+		m_pGameHandle->getLogger()->printWarn( "Multi draw indirect is not supported, chunks will be drawn one at a time" );
+
+	// Find the chunk shader
+	CShaderManager *pShaderManager = m_pGameHandle->getClient()->getGraphics()->getShaderManager();
+	if( !pShaderManager->getProgramIndex( CHUNK_SHADER_PROGRAM, &m_shaderIndex ) ) {
+		m_pGameHandle->getLogger()->printWarn( "Failed to get %s shader program, chunks will not be drawn", CHUNK_SHADER_PROGRAM );
+		m_shaderIndex = 0;
+		return true;
+	}
+
+	return true;
+}
+void CChunkRenderer::destroy()
+{
+	if( m_pMeshWorkers ) {
+		ChunkMeshStats meshStats = m_pMeshWorkers->getStats();
+		if( meshStats.chunkCount > 0 )
+			m_pGameHandle->getLogger()->print( "Meshed %llu chunks at %.1f us per chunk, ambient occlusion took %.1f%% of mesh time",
+				(unsigned long long)meshStats.chunkCount, meshStats.getMicrosecondsPerChunk(), meshStats.getAOFraction() * 100.0 );
+		if( meshStats.chunkCount > 0 )
+			m_pGameHandle->getLogger()->print( "Chunks meshed at each level of detail: %llu, %llu, %llu, %llu",
+				(unsigned long long)meshStats.lodChunkCount[0], (unsigned long long)meshStats.lodChunkCount[1],
+				(unsigned long long)meshStats.lodChunkCount[2], (unsigned long long)meshStats.lodChunkCount[3] );
+		const CullStats &cullStats = m_culler.getStats();
+		if( cullStats.cullCount > 0 )
+			m_pGameHandle->getLogger()->print( "Culled chunks %llu times, %.1f%% of chunk meshes were in view, tested %.0f per second%s",
+				(unsigned long long)cullStats.cullCount, cullStats.getVisibleFraction() * 100.0, cullStats.getBoxesPerSecond(), m_culler.isUsingAVX() ? " with AVX" : "" );
+		const VisibilityStats &visibilityStats = m_visibility.getStats();
+		if( visibilityStats.searchCount > 0 )
+			m_pGameHandle->getLogger()->print( "Visibility searches reached %.0f chunks on average in %.1f us",
+				visibilityStats.getReachedPerSearch(), visibilityStats.getMicrosecondsPerSearch() );
+		const OcclusionStats &occlusionStats = m_occlusion.getStats();
+		if( occlusionStats.frameCount > 0 )
+		{
+			m_pGameHandle->getLogger()->print( "Occlusion culling hid %.1f%% of tested chunk meshes, took %.3f ms per frame (%.3f ms drawing occluders), at most %.3f ms",
+				occlusionStats.getOccludedFraction() * 100.0, occlusionStats.getMillisecondsPerFrame(), occlusionStats.getRasterMillisecondsPerFrame(), occlusionStats.maxFrameSeconds * 1000.0 );
+			if( occlusionStats.overBudgetCount > 0 )
+				m_pGameHandle->getLogger()->printWarn( "Occlusion culling went over its %.1f ms budget in %llu of %llu frames",
+					OCCLUSION_FRAME_BUDGET_MS, (unsigned long long)occlusionStats.overBudgetCount, (unsigned long long)occlusionStats.frameCount );
+		}
+		if( m_vertexArena.getPageCount() > 0 )
+			m_pGameHandle->getLogger()->print( "Chunk vertex arena used %.1f of %.1f MB in %u buffers, with %u free ranges",
+				m_vertexArena.getUsedBytes() / (1024.0*1024.0), m_vertexArena.getCapacityBytes() / (1024.0*1024.0),
+				m_vertexArena.getPageCount(), (unsigned int)m_vertexArena.getFreeRangeCount() );
+		const StreamBufferStats &streamStats = m_drawStream.getStats();
+		if( streamStats.frameCount > 0 )
+			m_pGameHandle->getLogger()->print( "Streamed %.1f KB of chunk draws per frame, waited for the GPU %llu times and ran out of room %llu times",
+				streamStats.getWrittenBytesPerFrame() / 1024.0, (unsigned long long)streamStats.stallCount, (unsigned long long)streamStats.overflowCount );
+		for( auto it: m_readyMeshes )
+			m_pMeshWorkers->releaseResult( it );
+		m_readyMeshes.clear();
+		m_pMeshWorkers->shutdown();
+		delete m_pMeshWorkers;
+		m_pMeshWorkers = 0;
+	}
+
+	m_chunkMeshes.clear();
+	m_culler.clear();
+	m_cullEntries.clear();
+	m_visibleChunks.clear();
+	m_visibility.clear();
+	m_occlusion.shutdown();
+	m_pageArrays.clear();
+	m_vertexArena.destroy();
+	m_indexBuffer.reset();
+	m_quadIndices.clear();
+	m_indexBufferQuads = 0;
+	m_drawStream.destroy();
+	m_drawStreamDraws = 0;
+	m_pageDrawOffsets.clear();
+}
+
+void CChunkRenderer::reserveIndexBuffer( uint32_t quadCount )
+{
+	if( m_indexBuffer && quadCount <= m_indexBufferQuads )
+		return;
+
+	m_indexBufferQuads = std::max( m_indexBufferQuads, (uint32_t)CHUNK_INDEX_BUFFER_QUADS );
+	while( m_indexBufferQuads < quadCount )
+		m_indexBufferQuads *= 2;
+	CChunkMesher::BuildQuadIndices( m_quadIndices, m_indexBufferQuads );
+
+	m_indexBuffer = std::make_shared<CBufferObject>();
+	m_indexBuffer->create( sizeof( uint32_t ) * m_quadIndices.size(), &m_quadIndices[0], 0, GL_STATIC_DRAW );
+	// Every vertex array is made again with the new buffer
+	m_pageArrays.clear();
+}
+bool CChunkRenderer::reserveDrawStream( uint32_t drawCount )
+{
+	if( m_drawStream.getBuffer() && drawCount <= m_drawStreamDraws )
+		return true;
+
+	m_drawStreamDraws = std::max( m_drawStreamDraws, (uint32_t)CHUNK_DRAW_BUFFER_DRAWS );
+	while( m_drawStreamDraws < drawCount )
+		m_drawStreamDraws *= 2;
+
+	// Room to align the origins after the commands
+	m_drawStream.destroy();
+	if( !m_drawStream.create( (sizeof( DrawElementsIndirectCommand ) + sizeof( glm::vec3 )) * m_drawStreamDraws + sizeof( glm::vec3 ) ) ) {
+		m_pGameHandle->getLogger()->printError( "Failed to create chunk draw stream buffer" );
+		return false;
+	}
+	// Every vertex array is made again with the new buffer
+	m_pageArrays.clear();
+	return true;
+}
+
+bool CChunkRenderer::createPageArrays()
+{
+	while( m_pageArrays.size() < m_vertexArena.getPageCount() )
+	{
+		std::shared_ptr<CVertexArray> vertexArray = std::make_shared<CVertexArray>( m_pGameHandle );
+		if( !vertexArray->create() )
+			return false;
+		vertexArray->addBuffer( m_vertexArena.getPageBuffer( (uint32_t)m_pageArrays.size() ), GL_ARRAY_BUFFER );
+		vertexArray->addBuffer( m_indexBuffer, GL_ELEMENT_ARRAY_BUFFER );
+		vertexArray->addVertexIAttrib( 1, GL_UNSIGNED_INT, sizeof( ChunkVertex ), (GLvoid*)offsetof( ChunkVertex, position ) );
+		vertexArray->addVertexIAttrib( 1, GL_UNSIGNED_INT, sizeof( ChunkVertex ), (GLvoid*)offsetof( ChunkVertex, texture ) );
+		if( !vertexArray->flushBindsAndAttribs() )
+			return false;
+		if( m_multiDrawIndirect ) {
+			// Each draw is one instance, its base instance picks its origin from the start of the buffer
+			vertexArray->addBuffer( m_drawStream.getBuffer(), GL_ARRAY_BUFFER );
+			GLuint originAttrib = vertexArray->addInstancedVertexAttrib( 3, GL_FLOAT, sizeof( glm::vec3 ), 0, 1 );
+			assert( originAttrib == CHUNK_ORIGIN_ATTRIB );
+			if( !vertexArray->flushBindsAndAttribs() )
+				return false;
+		}
+		m_pageArrays.push_back( vertexArray );
+	}
+	CGraphics::GetActiveBackend()->bindVertexArray( 0 );
+	return true;
+}
+
+size_t CChunkRenderer::uploadMesh( const MeshResult *pResult )
+{
+	const ChunkMesh &mesh = pResult->mesh;
+
+	// Empty meshes still connect the chunks around them
+	if( pResult->serial == 0 )
+		m_visibility.removeChunk( mesh.position );
+	else
+		m_visibility.setChunk( mesh.position, mesh.faceConnections );
+
+	// Replaced meshes give their vertices back to the arena
+	this->removeMesh( mesh.position );
+	if( mesh.vertices.empty() )
+		return 0;
+
+	this->reserveIndexBuffer( mesh.getQuadCount() );
+
+	ChunkRenderData renderData;
+	size_t vertexBytes = sizeof( ChunkVertex ) * mesh.vertices.size();
+	if( !m_vertexArena.allocate( (uint32_t)mesh.vertices.size(), &renderData.vertices ) ) {
+		m_pGameHandle->getLogger()->printError( "Failed to allocate vertices for mesh of chunk (%d, %d, %d)", mesh.position.x, mesh.position.y, mesh.position.z );
+		return 0;
+	}
+	// The vertices are copied here, the mesh can be released after
+	m_vertexArena.upload( renderData.vertices, &mesh.vertices[0] );
+	if( !this->createPageArrays() ) {
+		m_pGameHandle->getLogger()->printError( "Failed to create vertex array for mesh of chunk (%d, %d, %d)", mesh.position.x, mesh.position.y, mesh.position.z );
+		m_vertexArena.free( renderData.vertices );
+		return 0;
+	}
+
+	renderData.indexCount = mesh.getQuadCount() * 6;
+	renderData.version = mesh.version;
+	renderData.lod = mesh.lod;
+	renderData.remeshRequested = false;
+
+	// Culled by the bounds of the quads, which are often much smaller than the chunk
+	uint32_t boundsMin[3] = { CHUNK_SIZE, CHUNK_SIZE, CHUNK_SIZE }, boundsMax[3] = { 0, 0, 0 };
+	for( auto &it: mesh.vertices ) {
+		const uint32_t coords[3] = { it.getX(), it.getY(), it.getZ() };
+		for( uint32_t a = 0; a < 3; a++ ) {
+			boundsMin[a] = std::min( boundsMin[a], coords[a] );
+			boundsMax[a] = std::max( boundsMax[a], coords[a] );
+		}
+	}
+	glm::vec3 origin( (float)(mesh.position.x*CHUNK_SIZE), (float)(mesh.position.y*CHUNK_SIZE), (float)(mesh.position.z*CHUNK_SIZE) );
+	renderData.boundsMin = origin + glm::vec3( boundsMin[0], boundsMin[1], boundsMin[2] );
+	renderData.boundsMax = origin + glm::vec3( boundsMax[0], boundsMax[1], boundsMax[2] );
+	renderData.cullIndex = m_culler.addBox( renderData.boundsMin, renderData.boundsMax );
+	renderData.occluders = mesh.occluders;
+
+	auto inserted = m_chunkMeshes.insert( std::pair<ChunkPos, ChunkRenderData>( mesh.position, renderData ) );
+	m_cullEntries.push_back( { mesh.position, &inserted.first->second } );
+
+	return vertexBytes;
+}
+
+void CChunkRenderer::removeMesh( const ChunkPos &position )
+{
+	auto it = m_chunkMeshes.find( position );
+	if( it == m_chunkMeshes.end() )
+		return;
+
+	// The last box moves into the freed index
+	uint32_t index = it->second.cullIndex;
+	m_culler.removeBox( index );
+	m_cullEntries[index] = m_cullEntries.back();
+	m_cullEntries.pop_back();
+	if( index < m_cullEntries.size() )
+		m_cullEntries[index].pRenderData->cullIndex = index;
+
+	m_vertexArena.free( it->second.vertices );
+	m_chunkMeshes.erase( it );
+}
+
+void CChunkRenderer::update()
+{
+	// Mesh the chunks around the camera first
+	glm::vec3 cameraPos = glm::vec3( glm::inverse( *m_pGameHandle->getClient()->getGraphics()->getViewMatrixPtr() )[3] );
+	m_cameraChunk = {
+		BlockToChunkCoord( (int32_t)std::floor( cameraPos.x ) ),
+		BlockToChunkCoord( (int32_t)std::floor( cameraPos.y ) ),
+		BlockToChunkCoord( (int32_t)std::floor( cameraPos.z ) ) };
+	m_pMeshWorkers->setCameraChunk( m_cameraChunk );
+	if( !(m_cameraChunk == m_lodCameraChunk) ) {
+		m_lodCameraChunk = m_cameraChunk;
+		this->selectLevelsOfDetail();
+	}
+
+	for( MeshResult *pResult = m_pMeshWorkers->takeResults(); pResult; ) {
+		MeshResult *pNext = pResult->pNext;
+		m_readyMeshes.push_back( pResult );
+		pResult = pNext;
+	}
+	if( m_readyMeshes.empty() )
+		return;
+
+	// Drop meshes that were resubmitted or cancelled, even if they waited a few frames
+	auto readyEnd = std::remove_if( m_readyMeshes.begin(), m_readyMeshes.end(), [this]( MeshResult *pResult ) {
+		if( m_pMeshWorkers->isCurrent( pResult ) )
+			return false;
+		m_pMeshWorkers->releaseResult( pResult );
+		return true;
+	} );
+	m_readyMeshes.erase( readyEnd, m_readyMeshes.end() );
+
+	// Closest last, so uploaded meshes pop off the back
+	const ChunkPos cameraChunk = m_cameraChunk;
+	auto distance = [cameraChunk]( const MeshResult *pResult ) {
+		int64_t dx = (int64_t)pResult->mesh.position.x - cameraChunk.x;
+		int64_t dy = (int64_t)pResult->mesh.position.y - cameraChunk.y;
+		int64_t dz = (int64_t)pResult->mesh.position.z - cameraChunk.z;
+		return dx*dx + dy*dy + dz*dz;
+	};
+	std::sort( m_readyMeshes.begin(), m_readyMeshes.end(), [&distance]( const MeshResult *pA, const MeshResult *pB ) {
+		return distance( pA ) > distance( pB );
+	} );
+
+	size_t uploadedBytes = 0;
+	while( !m_readyMeshes.empty() && uploadedBytes < CHUNK_UPLOAD_BUDGET_BYTES ) {
+		MeshResult *pResult = m_readyMeshes.back();
+		m_readyMeshes.pop_back();
+		uploadedBytes += this->uploadMesh( pResult );
+		m_pMeshWorkers->releaseResult( pResult );
+	}
+}
+
+void CChunkRenderer::selectLevelsOfDetail()
+{
+	for( auto &it: m_chunkMeshes )
+	{
+		if( it.second.remeshRequested )
+			continue;
+
+		float dx = (float)(it.first.x - m_cameraChunk.x);
+		float dy = (float)(it.first.y - m_cameraChunk.y);
+		float dz = (float)(it.first.z - m_cameraChunk.z);
+		float distance = std::sqrt( dx*dx + dy*dy + dz*dz );
+
+		// Any level that fits within the hysteresis is kept
+		uint8_t finestLod = ChunkLodForDistance( std::max( distance - CHUNK_LOD_HYSTERESIS, 0.0f ) );
+		uint8_t coarsestLod = ChunkLodForDistance( distance + CHUNK_LOD_HYSTERESIS );
+		if( it.second.lod < finestLod || it.second.lod > coarsestLod ) {
+			m_pMeshWorkers->requestRemesh( it.first );
+			it.second.remeshRequested = true;
+		}
+	}
+}
+
+void CChunkRenderer::render()
+{
+	if( !m_shaderIndex )
+		return;
+
+	CGraphics *pGraphics = m_pGameHandle->getClient()->getGraphics();
+	m_culler.cull( pGraphics->getFrustumPlanes(), m_visibleChunks );
+	m_visibility.search( m_cameraChunk, pGraphics->getFrustumPlanes() );
+	auto visibleEnd = std::remove_if( m_visibleChunks.begin(), m_visibleChunks.end(), [this]( uint32_t index ) {
+		return !m_visibility.isReached( m_cullEntries[index].position );
+	} );
+	m_visibleChunks.erase( visibleEnd, m_visibleChunks.end() );
+
+	// Nearest first, they cover the most of the screen if the occluder limit is reached
+	const ChunkPos cameraChunk = m_cameraChunk;
+	auto distance = [this, cameraChunk]( uint32_t index ) {
+		const ChunkPos &position = m_cullEntries[index].position;
+		int64_t dx = (int64_t)position.x - cameraChunk.x;
+		int64_t dy = (int64_t)position.y - cameraChunk.y;
+		int64_t dz = (int64_t)position.z - cameraChunk.z;
+		return dx*dx + dy*dy + dz*dz;
+	};
+	std::sort( m_visibleChunks.begin(), m_visibleChunks.end(), [&distance]( uint32_t a, uint32_t b ) {
+		return distance( a ) < distance( b );
+	} );
+
+	m_occlusion.beginFrame( pGraphics->getViewProjectionMatrix() );
+	bool occluderRoom = true;
+	for( size_t i = 0; i < m_visibleChunks.size() && occluderRoom; i++ )
+	{
+		const CullEntry &entry = m_cullEntries[m_visibleChunks[i]];
+		const int32_t origin[3] = { entry.position.x*CHUNK_SIZE, entry.position.y*CHUNK_SIZE, entry.position.z*CHUNK_SIZE };
+		for( auto &occluder: entry.pRenderData->occluders )
+		{
+			const uint32_t axis = occluder.face / 2, axisU = (axis + 1) % 3, axisV = (axis + 2) % 3;
+			const uint8_t cornerU[4] = { occluder.minU, occluder.maxU, occluder.maxU, occluder.minU };
+			const uint8_t cornerV[4] = { occluder.minV, occluder.minV, occluder.maxV, occluder.maxV };
+			glm::vec3 corners[4];
+			for( uint32_t c = 0; c < 4; c++ ) {
+				corners[c][axis] = (float)(origin[axis] + occluder.plane);
+				corners[c][axisU] = (float)(origin[axisU] + cornerU[c]);
+				corners[c][axisV] = (float)(origin[axisV] + cornerV[c]);
+			}
+			if( !m_occlusion.addOccluder( corners ) ) {
+				occluderRoom = false;
+				break;
+			}
+		}
+	}
+	m_occlusion.rasterize();
+	visibleEnd = std::remove_if( m_visibleChunks.begin(), m_visibleChunks.end(), [this]( uint32_t index ) {
+		const ChunkRenderData *pRenderData = m_cullEntries[index].pRenderData;
+		return !m_occlusion.isBoxVisible( pRenderData->boundsMin, pRenderData->boundsMax );
+	} );
+	m_visibleChunks.erase( visibleEnd, m_visibleChunks.end() );
+
+	if( m_multiDrawIndirect ) {
+		this->submitMultiDraws( m_visibleChunks );
+		return;
+	}
+	for( auto index: m_visibleChunks ) {
+		const CullEntry &entry = m_cullEntries[index];
+		const VertexArenaBlock &vertices = entry.pRenderData->vertices;
+		glm::vec3 origin( (float)(entry.position.x*CHUNK_SIZE), (float)(entry.position.y*CHUNK_SIZE), (float)(entry.position.z*CHUNK_SIZE) );
+		pGraphics->submitIndexedForDraw( m_pageArrays[vertices.page], m_shaderIndex, entry.pRenderData->indexCount, GL_UNSIGNED_INT,
+			(GLint)vertices.first, CHUNK_ORIGIN_ATTRIB, origin );
+	}
+}
+
+void CChunkRenderer::submitMultiDraws( const std::vector<uint32_t> &drawChunks )
+{
+	if( drawChunks.empty() )
+		return;
+
+	if( !this->reserveDrawStream( (uint32_t)drawChunks.size() ) )
+		return;
+	if( !this->createPageArrays() ) {
+		m_pGameHandle->getLogger()->printError( "Failed to create chunk vertex arrays" );
+		return;
+	}
+	// Sized for the draws, these only fail if the buffer could not be made bigger
+	GLintptr commandOffset, originOffset;
+	DrawElementsIndirectCommand *pCommands = (DrawElementsIndirectCommand*)m_drawStream.allocate(
+		sizeof( DrawElementsIndirectCommand ) * drawChunks.size(), 4, &commandOffset );
+	glm::vec3 *pOrigins = (glm::vec3*)m_drawStream.allocate( sizeof( glm::vec3 ) * drawChunks.size(), sizeof( glm::vec3 ), &originOffset );
+	if( !pCommands || !pOrigins ) {
+		m_pGameHandle->getLogger()->printWarn( "Chunk draw stream buffer is full" );
+		return;
+	}
+	const GLuint firstOrigin = (GLuint)(originOffset / sizeof( glm::vec3 ));
+
+	// Group the draws by arena buffer, they stay nearest first within each
+	const uint32_t pageCount = m_vertexArena.getPageCount();
+	m_pageDrawOffsets.assign( pageCount + 1, 0 );
+	for( auto index: drawChunks )
+		m_pageDrawOffsets[m_cullEntries[index].pRenderData->vertices.page + 1]++;
+	for( uint32_t p = 0; p < pageCount; p++ )
+		m_pageDrawOffsets[p + 1] += m_pageDrawOffsets[p];
+	// Written straight into the stream buffer
+	for( auto index: drawChunks )
+	{
+		const CullEntry &entry = m_cullEntries[index];
+		const VertexArenaBlock &vertices = entry.pRenderData->vertices;
+		uint32_t draw = m_pageDrawOffsets[vertices.page]++;
+		pCommands[draw] = { entry.pRenderData->indexCount, 1, 0, (GLint)vertices.first, firstOrigin + draw };
+		pOrigins[draw] = glm::vec3( (float)(entry.position.x*CHUNK_SIZE), (float)(entry.position.y*CHUNK_SIZE), (float)(entry.position.z*CHUNK_SIZE) );
+	}
+
+	// Each offset is now the end of the draws of its buffer
+	CGraphics *pGraphics = m_pGameHandle->getClient()->getGraphics();
+	uint32_t firstDraw = 0;
+	for( uint32_t p = 0; p < pageCount; p++ ) {
+		uint32_t endDraw = m_pageDrawOffsets[p];
+		if( endDraw > firstDraw )
+			pGraphics->submitIndirectForDraw( m_pageArrays[p], m_shaderIndex, m_drawStream.getBuffer()->getBufferId(),
+				commandOffset + (GLintptr)(sizeof( DrawElementsIndirectCommand ) * firstDraw), endDraw - firstDraw, GL_UNSIGNED_INT );
+		firstDraw = endDraw;
+	}
+}
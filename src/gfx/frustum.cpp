@@ -0,0 +1,184 @@
+#include <assert.h>
+#include <cmath>
+#include <chrono>
+#include "gfx/frustum.h"
+
+#if defined( __SSE__ ) || defined( _M_X64 ) || (defined( _M_IX86_FP ) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define FRUSTUM_SIMD_WIDTH 4
+#else
+#define FRUSTUM_SIMD_WIDTH 1
+#endif
+#if defined( FRUSTUM_AVX_SUPPORTED ) && defined( _MSC_VER )
+#include <intrin.h>
+#endif
+
+#ifdef FRUSTUM_AVX_SUPPORTED
+/** True if the CPU has AVX and the OS saves the upper halves of its registers */
+static bool IsAVXSupported()
+{
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid( info, 1 );
+	if( !(info[2] & (1 << 28)) || !(info[2] & (1 << 27)) )
+		return false;
+	return (_xgetbv( 0 ) & 0x6) == 0x6;
+#else
+	return __builtin_cpu_supports( "avx" ) != 0;
+#endif
+}
+#endif
+
+void ExtractFrustumPlanes( const glm::mat4 &viewProjection, glm::vec4 *pPlanes )
+{
+	assert( pPlanes );
+
+	// Clip space x, y and z lie between -w and w, each bound is a row of the matrix added to or taken from the last row.
+	// glm matrices are indexed by column first.
+	glm::vec4 rows[4];
+	for( int i = 0; i < 4; i++ )
+		rows[i] = glm::vec4( viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i] );
+
+	for( int axis = 0; axis < 3; axis++ ) {
+		pPlanes[axis*2] = rows[3] + rows[axis];
+		pPlanes[axis*2 + 1] = rows[3] - rows[axis];
+	}
+}
+
+bool IsBoxInFrustum( const glm::vec4 *pPlanes, const glm::vec3 &minimum, const glm::vec3 &maximum )
+{
+	assert( pPlanes );
+
+	// Only the corner furthest along the normal needs to be in front
+	for( uint32_t p = 0; p < FRUSTUM_PLANE_COUNT; p++ ) {
+		float distance = pPlanes[p].w;
+		for( uint32_t a = 0; a < 3; a++ )
+			distance += pPlanes[p][a] * (pPlanes[p][a] >= 0.0f ? maximum[a] : minimum[a]);
+		if( distance < 0.0f )
+			return false;
+	}
+	return true;
+}
+
+////////////////////
+// CFrustumCuller //
+////////////////////
+
+CFrustumCuller::CFrustumCuller()
+{
+#ifdef FRUSTUM_AVX_SUPPORTED
+	m_useAVX = IsAVXSupported();
+#else
+	m_useAVX = false;
+#endif
+	m_stats = CullStats();
+}
+CFrustumCuller::~CFrustumCuller() {
+}
+
+uint32_t CFrustumCuller::addBox( const glm::vec3 &minimum, const glm::vec3 &maximum )
+{
+	glm::vec3 center = (minimum + maximum) * 0.5f;
+	glm::vec3 extent = (maximum - minimum) * 0.5f;
+
+	m_centerX.push_back( center.x );
+	m_centerY.push_back( center.y );
+	m_centerZ.push_back( center.z );
+	m_extentX.push_back( extent.x );
+	m_extentY.push_back( extent.y );
+	m_extentZ.push_back( extent.z );
+
+	return (uint32_t)m_centerX.size() - 1;
+}
+
+void CFrustumCuller::removeBox( uint32_t index )
+{
+	assert( index < m_centerX.size() );
+
+	std::vector<float> *pArrays[6] = { &m_centerX, &m_centerY, &m_centerZ, &m_extentX, &m_extentY, &m_extentZ };
+	for( auto pArray: pArrays ) {
+		(*pArray)[index] = pArray->back();
+		pArray->pop_back();
+	}
+}
+
+void CFrustumCuller::clear()
+{
+	m_centerX.clear();
+	m_centerY.clear();
+	m_centerZ.clear();
+	m_extentX.clear();
+	m_extentY.clear();
+	m_extentZ.clear();
+}
+
+void CFrustumCuller::cull( const glm::vec4 *pPlanes, std::vector<uint32_t> &visible )
+{
+	assert( pPlanes );
+
+	auto cullStart = std::chrono::high_resolution_clock::now();
+
+	// The distance of the corner furthest along the plane normal is the center distance plus the extents
+	// weighted by the size of the normal on each axis
+	float absNormals[FRUSTUM_PLANE_COUNT][3];
+	for( uint32_t p = 0; p < FRUSTUM_PLANE_COUNT; p++ ) {
+		for( uint32_t a = 0; a < 3; a++ )
+			absNormals[p][a] = std::fabs( pPlanes[p][a] );
+	}
+
+	const uint32_t boxCount = this->getBoxCount();
+	// Room for every box, cut down to the visible ones at the end
+	visible.resize( boxCount );
+	uint32_t visibleCount = 0;
+	uint32_t i = 0;
+
+#ifdef FRUSTUM_AVX_SUPPORTED
+	if( m_useAVX ) {
+		const float *pBoxArrays[6] = { m_centerX.data(), m_centerY.data(), m_centerZ.data(), m_extentX.data(), m_extentY.data(), m_extentZ.data() };
+		i = CullBoxesAVX( &pPlanes[0].x, &absNormals[0][0], pBoxArrays, boxCount, visible.data(), &visibleCount );
+	}
+#endif
+#if FRUSTUM_SIMD_WIDTH == 4
+	for( ; i + 4 <= boxCount; i += 4 )
+	{
+		__m128 centerX = _mm_loadu_ps( &m_centerX[i] ), centerY = _mm_loadu_ps( &m_centerY[i] ), centerZ = _mm_loadu_ps( &m_centerZ[i] );
+		__m128 extentX = _mm_loadu_ps( &m_extentX[i] ), extentY = _mm_loadu_ps( &m_extentY[i] ), extentZ = _mm_loadu_ps( &m_extentZ[i] );
+
+		int inside = 0xF;
+		for( uint32_t p = 0; p < FRUSTUM_PLANE_COUNT && inside; p++ )
+		{
+			__m128 distance = _mm_set1_ps( pPlanes[p].w );
+			distance = _mm_add_ps( distance, _mm_mul_ps( centerX, _mm_set1_ps( pPlanes[p].x ) ) );
+			distance = _mm_add_ps( distance, _mm_mul_ps( centerY, _mm_set1_ps( pPlanes[p].y ) ) );
+			distance = _mm_add_ps( distance, _mm_mul_ps( centerZ, _mm_set1_ps( pPlanes[p].z ) ) );
+			distance = _mm_add_ps( distance, _mm_mul_ps( extentX, _mm_set1_ps( absNormals[p][0] ) ) );
+			distance = _mm_add_ps( distance, _mm_mul_ps( extentY, _mm_set1_ps( absNormals[p][1] ) ) );
+			distance = _mm_add_ps( distance, _mm_mul_ps( extentZ, _mm_set1_ps( absNormals[p][2] ) ) );
+			inside &= _mm_movemask_ps( _mm_cmpge_ps( distance, _mm_setzero_ps() ) );
+		}
+		for( uint32_t bit = 0; inside; bit++, inside >>= 1 ) {
+			if( inside & 1 )
+				visible[visibleCount++] = i + bit;
+		}
+	}
+#endif
+
+	// Whatever does not fill a whole vector
+	for( ; i < boxCount; i++ )
+	{
+		bool inside = true;
+		for( uint32_t p = 0; p < FRUSTUM_PLANE_COUNT && inside; p++ ) {
+			float distance = pPlanes[p].w + m_centerX[i]*pPlanes[p].x + m_centerY[i]*pPlanes[p].y + m_centerZ[i]*pPlanes[p].z
+				+ m_extentX[i]*absNormals[p][0] + m_extentY[i]*absNormals[p][1] + m_extentZ[i]*absNormals[p][2];
+			inside = distance >= 0.0f;
+		}
+		if( inside )
+			visible[visibleCount++] = i;
+	}
+	visible.resize( visibleCount );
+
+	m_stats.cullCount++;
+	m_stats.boxCount += boxCount;
+	m_stats.visibleCount += visible.size();
+	m_stats.seconds += std::chrono::duration<double>( std::chrono::high_resolution_clock::now() - cullStart ).count();
+}
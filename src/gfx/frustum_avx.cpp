@@ -0,0 +1,44 @@
+#include "gfx/frustum.h"
+
+#ifdef FRUSTUM_AVX_SUPPORTED
+#include <immintrin.h>
+
+// Built with AVX enabled. Only intrinsics and plain arrays are used here, an inline function shared with the rest of
+// the program could have its AVX copy kept by the linker and run on CPUs without it.
+uint32_t CullBoxesAVX( const float *pPlanes, const float *pAbsNormals, const float *const *ppBoxArrays, uint32_t boxCount, uint32_t *pVisible, uint32_t *pVisibleCount )
+{
+	const float *pCenterX = ppBoxArrays[0], *pCenterY = ppBoxArrays[1], *pCenterZ = ppBoxArrays[2];
+	const float *pExtentX = ppBoxArrays[3], *pExtentY = ppBoxArrays[4], *pExtentZ = ppBoxArrays[5];
+	uint32_t visibleCount = *pVisibleCount;
+
+	uint32_t i = 0;
+	for( ; i + 8 <= boxCount; i += 8 )
+	{
+		__m256 centerX = _mm256_loadu_ps( pCenterX + i ), centerY = _mm256_loadu_ps( pCenterY + i ), centerZ = _mm256_loadu_ps( pCenterZ + i );
+		__m256 extentX = _mm256_loadu_ps( pExtentX + i ), extentY = _mm256_loadu_ps( pExtentY + i ), extentZ = _mm256_loadu_ps( pExtentZ + i );
+
+		int inside = 0xFF;
+		for( uint32_t p = 0; p < FRUSTUM_PLANE_COUNT && inside; p++ )
+		{
+			const float *pPlane = pPlanes + p*4, *pAbsNormal = pAbsNormals + p*3;
+			__m256 distance = _mm256_set1_ps( pPlane[3] );
+			distance = _mm256_add_ps( distance, _mm256_mul_ps( centerX, _mm256_set1_ps( pPlane[0] ) ) );
+			distance = _mm256_add_ps( distance, _mm256_mul_ps( centerY, _mm256_set1_ps( pPlane[1] ) ) );
+			distance = _mm256_add_ps( distance, _mm256_mul_ps( centerZ, _mm256_set1_ps( pPlane[2] ) ) );
+			distance = _mm256_add_ps( distance, _mm256_mul_ps( extentX, _mm256_set1_ps( pAbsNormal[0] ) ) );
+			distance = _mm256_add_ps( distance, _mm256_mul_ps( extentY, _mm256_set1_ps( pAbsNormal[1] ) ) );
+			distance = _mm256_add_ps( distance, _mm256_mul_ps( extentZ, _mm256_set1_ps( pAbsNormal[2] ) ) );
+			inside &= _mm256_movemask_ps( _mm256_cmp_ps( distance, _mm256_setzero_ps(), _CMP_GE_OQ ) );
+		}
+		for( uint32_t bit = 0; inside; bit++, inside >>= 1 ) {
+			if( inside & 1 )
+				pVisible[visibleCount++] = i + bit;
+		}
+	}
+	// Clear the upper halves of the registers before returning to code built without AVX
+	_mm256_zeroupper();
+
+	*pVisibleCount = visibleCount;
+	return i;
+}
+#endif
@@ -1,6 +1,10 @@
 #include <algorithm>
 #include <glm/ext.hpp>
 #include "gfx\graphics.h"
+#include "gfx\backend.h"
+#include "gfx\nullbackend.h"
+#include "gfx\statecache.h"
+#include "gfx\streambuffer.h"
 #include "gfx\shader.h"
 #include "gfx\camera.h"
 #include "game.h"
@@ -9,36 +13,74 @@
 #include "client.h"
 
 int CGraphics::SDLReferenceCount = 0;
-bool CGraphics::GLEWInitialized = false;
+IRenderBackend* CGraphics::ActiveBackend = 0;
 
-bool RenderJobSort( RenderJob& a, RenderJob& b ) {
-	return a.shaderIndex < b.shaderIndex;
+uint64_t MakeRenderJobKey( unsigned int shaderIndex, float viewDepth, GLuint vertexArrayId )
+{
+	const uint64_t shaderMax = (1ull << RENDER_KEY_SHADER_BITS) - 1;
+	const uint64_t depthMax = (1ull << RENDER_KEY_DEPTH_BITS) - 1;
+	const uint64_t vertexArrayMax = (1ull << RENDER_KEY_VERTEX_ARRAY_BITS) - 1;
+
+	// Behind the camera sorts first, it is either culled or close enough to matter
+	float depthBucket = viewDepth * RENDER_KEY_DEPTH_SCALE;
+	uint64_t depth = depthBucket <= 0.0f ? 0 : (depthBucket >= (float)depthMax ? depthMax : (uint64_t)depthBucket);
+
+	return (std::min<uint64_t>( shaderIndex, shaderMax ) << (RENDER_KEY_VERTEX_ARRAY_BITS + RENDER_KEY_DEPTH_BITS))
+		| (std::min<uint64_t>( vertexArrayId, vertexArrayMax ) << RENDER_KEY_DEPTH_BITS)
+		| depth;
+}
+
+void RadixSortRenderJobKeys( std::vector<RenderJobKey> &keys, std::vector<RenderJobKey> &scratch )
+{
+	if( keys.size() < 2 )
+		return;
+	scratch.resize( keys.size() );
+
+	// Bytes every key has in common would not move anything
+	uint64_t differing = 0;
+	for( auto &key: keys )
+		differing |= key.first ^ keys[0].first;
+
+	size_t counts[256];
+	for( unsigned int shift = 0; shift < 64; shift += 8 )
+	{
+		if( !((differing >> shift) & 0xFF) )
+			continue;
+		std::fill( counts, counts + 256, 0 );
+		for( auto &key: keys )
+			counts[(key.first >> shift) & 0xFF]++;
+		size_t offset = 0;
+		for( size_t &count: counts ) {
+			size_t bucketSize = count;
+			count = offset;
+			offset += bucketSize;
+		}
+		for( auto &key: keys )
+			scratch[counts[(key.first >> shift) & 0xFF]++] = key;
+		keys.swap( scratch );
+	}
 }
 
 ///////////////
 // CGraphics //
 ///////////////
 
-#ifdef _DEBUG
-void CGraphics::MasterDebugCallback( GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length, const GLchar* message, const void* userParam )
-{
-	CGraphics *pGraphics = const_cast<CGraphics*>(reinterpret_cast<const CGraphics*>(userParam));
-	pGraphics->debugCallback( source, type, id, severity, length, message );
-}
-#endif
-
 CGraphics::CGraphics( CGame *pGameHandle )
 {
 	m_pGameHandle = pGameHandle;
 	m_glSupportLevel = GLSupportLevel::GL_SUPPORT_NONE;
+	m_headless = false;
 	m_pSDLWindow = 0;
 	m_sdlContext = 0;
+	m_pBackend = 0;
 
 	m_pShaderManager = 0;
 
 	m_projectionPerspMat = glm::mat4( 1.0f );
 	m_projectionOrthoMat = glm::mat4( 1.0f );
 	m_viewMat = std::make_shared<glm::mat4>( 1.0f );
+	m_viewProjectionMat = m_projectionPerspMat * (*m_viewMat);
+	ExtractFrustumPlanes( m_viewProjectionMat, m_frustumPlanes );
 
 	m_activeCamera = 0;
 
@@ -49,13 +91,66 @@ CGraphics::~CGraphics() {
 
 bool CGraphics::initialize()
 {
-	SDL_version sdlVersion;
-	unsigned int resX, resY;
-	GLenum glewErr;
+	int backendType;
+	bool cacheState;
 	GLenum glError;
 
 	m_pGameHandle->getLogger()->print( "Initializing graphics..." );
 
+	// Without a window nothing needs a GPU
+	if( !m_pGameHandle->getClient()->getClientConfig()->getPropertyFromConfig<int>( CONFIG_STR_RENDER_BACKEND, &backendType ) ) {
+		backendType = DEFAULT_RENDER_BACKEND;
+		m_pGameHandle->getLogger()->printWarn( "Failed to get render backend from config, using default" );
+	}
+	m_headless = backendType == RenderBackendType::RENDER_BACKEND_NULL;
+	if( m_headless )
+		m_pBackend = new CNullRenderBackend( m_pGameHandle );
+	else {
+		if( !this->createWindow() )
+			return false;
+		m_pBackend = new CGLRenderBackend( m_pGameHandle );
+	}
+	if( !m_pGameHandle->getClient()->getClientConfig()->getPropertyFromConfig<bool>( CONFIG_STR_RENDER_STATE_CACHE, &cacheState ) )
+		cacheState = true;
+	if( cacheState )
+		m_pBackend = new CRenderStateCache( m_pGameHandle, m_pBackend );
+	if( !m_pBackend->initialize() )
+		return false;
+	m_glSupportLevel = m_pBackend->getSupportLevel();
+	CGraphics::ActiveBackend = m_pBackend;
+
+	// GL Setup
+	m_pBackend->enable( GL_DEPTH_TEST );
+	m_pBackend->depthFunc( GL_LESS );
+
+	m_pBackend->enable( GL_CULL_FACE );
+	m_pBackend->cullFace( GL_FRONT );
+	m_pBackend->frontFace( GL_CCW );
+
+	m_pBackend->pointSize( 2.0f );
+
+	m_pBackend->clearColor( 0, 0, 0.25f, 1.0f );
+
+	// Check for error, however if we have gotten this far it is probably fine
+	if( (glError = m_pBackend->getError()) != GL_NO_ERROR )
+		m_pGameHandle->getLogger()->printError( "There was a GL error during the initialization process, GL error code %u", glError );
+
+	// Create shader manager
+	m_pShaderManager = new CShaderManager( m_pGameHandle );
+	if( !m_pShaderManager->initialize() )
+		return false;
+	// Load the shader files
+	if( !m_pShaderManager->loadPrograms() )
+		return false;
+
+	return true;
+}
+
+bool CGraphics::createWindow()
+{
+	SDL_version sdlVersion;
+	unsigned int resX, resY;
+
 	// Initialize SDL2
 	if( CGraphics::SDLReferenceCount <= 0 ) {
 		m_pGameHandle->getLogger()->print( "Initializing SDL2 library..." );
@@ -128,72 +223,6 @@ bool CGraphics::initialize()
 	// Trap the mouse
 	SDL_SetRelativeMouseMode( SDL_TRUE );
 
-	// Initialize GLEW
-	m_pGameHandle->getLogger()->print( "Initializing GLEW..." );
-	if( !CGraphics::GLEWInitialized )
-	{
-		glewErr = glewInit();
-		if( glewErr != GLEW_OK ) {
-			m_pGameHandle->getLogger()->printError( "Failed it initialize GLEW: %s", glewGetErrorString( glewErr ) );
-			return false;
-		}
-		CGraphics::GLEWInitialized = true;
-	}
-	m_pGameHandle->getLogger()->print( "Successfully initialize GLEW %s", glewGetString( GLEW_VERSION ) );
-	// Check for open GL support
-	if( glewIsSupported( "GL_VERSION_3_2" ) )
-		m_glSupportLevel = GLSupportLevel::GL_SUPPORT_MIN;
-	if( glewIsSupported( "GL_VERSION_4_1" ) )
-		m_glSupportLevel = GLSupportLevel::GL_SUPPORT_STD;
-	if( glewIsSupported( "GL_VERSION_4_6" ) )
-		m_glSupportLevel = GLSupportLevel::GL_SUPPORT_MAX;
-	if( m_glSupportLevel == GLSupportLevel::GL_SUPPORT_NONE ) {
-		m_pGameHandle->getLogger()->printError( "The minimum OpenGL supported version is 3.2, which this computer does not support!" );
-		return false;
-	}
-
-	// Set up debug output if supported
-#ifdef _DEBUG
-	if( glewIsSupported( "GL_ARB_debug_output" ) ) {
-		glEnable( GL_DEBUG_OUTPUT_SYNCHRONOUS );
-		glEnable( GL_DEBUG_OUTPUT );
-		glDebugMessageCallback( CGraphics::MasterDebugCallback, this );
-		GLuint unusedIds = 0;
-		glDebugMessageControl( GL_DONT_CARE, GL_DONT_CARE, GL_DONT_CARE, 0, &unusedIds, GL_TRUE );
-	}
-#endif
-
-	// Print GL info
-	m_pGameHandle->getLogger()->print( "OpenGL Context Info:" );
-	m_pGameHandle->getLogger()->print( "\tVersion: %s", glGetString( GL_VERSION ) );
-	m_pGameHandle->getLogger()->print( "\tVendor: %s", glGetString( GL_VENDOR ) );
-	m_pGameHandle->getLogger()->print( "\tRenderer: %s", glGetString( GL_RENDERER ) );
-	m_pGameHandle->getLogger()->print( "\tGLSL: %s", glGetString( GL_SHADING_LANGUAGE_VERSION ) );
-
-	// GL Setup
-	glEnable( GL_DEPTH_TEST );
-	glDepthFunc( GL_LESS );
-
-	glEnable( GL_CULL_FACE );
-	glCullFace( GL_FRONT );
-	glFrontFace( GL_CCW );
-
-	glPointSize( 2.0f );
-
-	glClearColor( 0, 0, 0.25f, 1.0f );
-
-	// Check for error, however if we have gotten this far it is probably fine
-	if( (glError = glGetError()) != GL_NO_ERROR )
-		m_pGameHandle->getLogger()->printError( "There was a GL error during the initialization process, GL error code %u", glError );
-
-	// Create shader manager
-	m_pShaderManager = new CShaderManager( m_pGameHandle );
-	if( !m_pShaderManager->initialize() )
-		return false;
-	// Load the shader files
-	if( !m_pShaderManager->loadPrograms() )
-		return false;
-
 	return true;
 }
 
@@ -211,42 +240,74 @@ bool CGraphics::update( float deltaT )
 			return false;
 	}
 
-	// Update matrix block
-	glm::mat4 matrixBlock[3];
-	UniformBlockData uboData = m_pShaderManager->getUniformBlock( UniformBlockIDs::UNIFORM_BLOCK_MATRIX );
-
-	matrixBlock[0] = m_projectionPerspMat;
-	matrixBlock[1] = m_projectionOrthoMat;
-	matrixBlock[2] = (*m_viewMat);
-	glBindBuffer( GL_UNIFORM_BUFFER, uboData.uboId );
-	glBufferSubData( GL_UNIFORM_BUFFER, 0, sizeof( matrixBlock ), &matrixBlock[0] );
-	glBindBuffer( GL_UNIFORM_BUFFER, 0 );
+	// For culling against what the shaders will draw
+	m_viewProjectionMat = m_projectionPerspMat * (*m_viewMat);
+	ExtractFrustumPlanes( m_viewProjectionMat, m_frustumPlanes );
 
 	return true;
 }
 bool CGraphics::draw()
 {
 	// Clear screen
-	glClear( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT );
+	m_pBackend->clear( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT );
+
+	// Sort the keys rather than the jobs, they are a quarter of the size
+	m_renderJobKeys.clear();
+	for( uint32_t i = 0; i < (uint32_t)m_renderJobs.size(); i++ )
+		m_renderJobKeys.push_back( RenderJobKey( m_renderJobs[i].sortKey, i ) );
+	RadixSortRenderJobKeys( m_renderJobKeys, m_renderJobKeyScratch );
+
+	// The matrix block of this frame goes in the uniform arena with the blocks of each draw
+	GLintptr matrixOffset;
+	glm::mat4 *pMatrixBlock = (glm::mat4*)m_pShaderManager->allocateUniformBlock( UniformBlockIDs::UNIFORM_BLOCK_MATRIX, &matrixOffset );
+	if( pMatrixBlock ) {
+		pMatrixBlock[0] = m_projectionPerspMat;
+		pMatrixBlock[1] = m_projectionOrthoMat;
+		pMatrixBlock[2] = (*m_viewMat);
+		m_pShaderManager->bindUniformBlock( UniformBlockIDs::UNIFORM_BLOCK_MATRIX, matrixOffset );
+	}
 
-	// Sort submitted vertex arrays by shader id
-	std::sort( m_renderJobs.begin(), m_renderJobs.end(), RenderJobSort );
+	// Everything written to the stream buffers this frame must reach the GPU first
+	for( auto it: m_streamBuffers )
+		it->flush();
 
 	// Draw vertices
-	for( auto it: m_renderJobs )
+	GLuint boundVertexArray = 0;
+	for( auto &key: m_renderJobKeys )
 	{
-		m_pShaderManager->bindProgram( it.shaderIndex );
-		it.vertexArray->bind();
-		glDrawArrays( GL_POINTS, 0, it.vertexCount );
+		const RenderJob &job = m_renderJobs[key.second];
+		m_pShaderManager->bindProgram( job.shaderIndex );
+		if( job.vertexArrayId != boundVertexArray ) {
+			m_pBackend->bindVertexArray( job.vertexArrayId );
+			boundVertexArray = job.vertexArrayId;
+		}
+		if( job.offsetAttrib != -1 )
+			m_pBackend->vertexAttrib3f( job.offsetAttrib, job.offset.x, job.offset.y, job.offset.z );
+		if( job.drawUniformOffset != -1 )
+			m_pShaderManager->bindUniformBlock( UniformBlockIDs::UNIFORM_BLOCK_DRAW, job.drawUniformOffset );
+		if( job.indirectBuffer ) {
+			m_pBackend->bindBuffer( GL_DRAW_INDIRECT_BUFFER, job.indirectBuffer );
+			m_pBackend->multiDrawElementsIndirect( job.primitiveType, job.indexType, (const void*)job.indirectOffset, job.vertexCount, 0 );
+		}
+		else if( job.instanceCount )
+			m_pBackend->drawElementsInstanced( job.primitiveType, job.vertexCount, job.indexType, 0, job.instanceCount );
+		else if( job.indexType && job.baseVertex )
+			m_pBackend->drawElementsBaseVertex( job.primitiveType, job.vertexCount, job.indexType, 0, job.baseVertex );
+		else if( job.indexType )
+			m_pBackend->drawElements( job.primitiveType, job.vertexCount, job.indexType, 0 );
+		else
+			m_pBackend->drawArrays( job.primitiveType, job.baseVertex, job.vertexCount );
 	}
+	for( auto it: m_streamBuffers )
+		it->endFrame();
 
-	// Reset to old size to maybe save some time
-	size_t pastSize = m_renderJobs.size();
+	// Clearing keeps the capacity for the next frame
 	m_renderJobs.clear();
-	m_renderJobs.reserve( pastSize );
 
 	// Swap buffers
-	SDL_GL_SwapWindow( m_pSDLWindow );
+	if( m_pSDLWindow )
+		SDL_GL_SwapWindow( m_pSDLWindow );
+	m_pBackend->endFrame();
 
 	return true;
 }
@@ -258,6 +319,24 @@ void CGraphics::destroy()
 		delete m_pShaderManager;
 		m_pShaderManager = 0;
 	}
+	if( m_pBackend ) {
+		const RenderBackendStats &backendStats = m_pBackend->getStats();
+		if( backendStats.frameCount > 0 )
+			m_pGameHandle->getLogger()->print( "%s render backend drew %llu frames, %.0f commands, %.1f draws and %.1f KB uploaded per frame",
+				m_pBackend->getName(), (unsigned long long)backendStats.frameCount, backendStats.getCommandsPerFrame(),
+				backendStats.getDrawsPerFrame(), backendStats.getUploadedBytesPerFrame() / 1024.0 );
+		if( backendStats.skippedStateCount > 0 || backendStats.redundantStateCount > 0 )
+			m_pGameHandle->getLogger()->print( "%.1f redundant state changes skipped and %.1f sent per frame",
+				backendStats.getSkippedStatePerFrame(), backendStats.getRedundantStatePerFrame() );
+		if( backendStats.errorCount > 0 )
+			m_pGameHandle->getLogger()->printWarn( "%s render backend found %llu invalid commands",
+				m_pBackend->getName(), (unsigned long long)backendStats.errorCount );
+		m_pBackend->shutdown();
+		if( CGraphics::ActiveBackend == m_pBackend )
+			CGraphics::ActiveBackend = 0;
+		delete m_pBackend;
+		m_pBackend = 0;
+	}
 	if( m_sdlContext ) {
 		SDL_GL_DeleteContext( SDL_GL_DeleteContext );
 		m_sdlContext = 0;
@@ -267,17 +346,17 @@ void CGraphics::destroy()
 		m_pSDLWindow = 0;
 	}
 
-	SDLReferenceCount--;
-	if( SDLReferenceCount <= 0 ) {
-		SDL_Quit();
+	if( !m_headless ) {
+		SDLReferenceCount--;
+		if( SDLReferenceCount <= 0 ) {
+			SDL_Quit();
+		}
 	}
 	m_pGameHandle = 0;
 }
 
 bool CGraphics::setupViewport()
 {
-	assert( m_pSDLWindow );
-
 	unsigned int resolutionX, resolutionY;
 	unsigned int refreshRate;
 	float fov;
@@ -295,32 +374,35 @@ bool CGraphics::setupViewport()
 		&& windowMode != WindowModes::WindowModeBorderless
 		&& windowMode != WindowModes::WindowModeFullscreen )
 		windowMode = WindowModes::WindowModeBordered;
-	// Handle switching between window modes
-	switch( windowMode )
+	// Handle switching between window modes, a headless client has no window
+	if( m_pSDLWindow )
 	{
-	case WindowModes::WindowModeBordered:
-		if( SDL_SetWindowFullscreen( m_pSDLWindow, 0 ) < 0 ) {
-			m_pGameHandle->getLogger()->printError( "Failed to exit fullscreen: %s", SDL_GetError() );
-			return false;
-		}
-		SDL_SetWindowBordered( m_pSDLWindow, SDL_TRUE );
-		break;
-	case WindowModes::WindowModeBorderless:
-		if( SDL_SetWindowFullscreen( m_pSDLWindow, 0 ) < 0 ) {
-			m_pGameHandle->getLogger()->printError( "Failed to exit fullscreen: %s", SDL_GetError() );
-			return false;
-		}
-		SDL_SetWindowBordered( m_pSDLWindow, SDL_FALSE );
-		break;
-	case WindowModes::WindowModeFullscreen:
-		if( SDL_SetWindowFullscreen( m_pSDLWindow, SDL_WINDOW_FULLSCREEN ) < 0 ) {
-			m_pGameHandle->getLogger()->printError( "Failed to enter fullscreen: %s", SDL_GetError() );
-			return false;
+		switch( windowMode )
+		{
+		case WindowModes::WindowModeBordered:
+			if( SDL_SetWindowFullscreen( m_pSDLWindow, 0 ) < 0 ) {
+				m_pGameHandle->getLogger()->printError( "Failed to exit fullscreen: %s", SDL_GetError() );
+				return false;
+			}
+			SDL_SetWindowBordered( m_pSDLWindow, SDL_TRUE );
+			break;
+		case WindowModes::WindowModeBorderless:
+			if( SDL_SetWindowFullscreen( m_pSDLWindow, 0 ) < 0 ) {
+				m_pGameHandle->getLogger()->printError( "Failed to exit fullscreen: %s", SDL_GetError() );
+				return false;
+			}
+			SDL_SetWindowBordered( m_pSDLWindow, SDL_FALSE );
+			break;
+		case WindowModes::WindowModeFullscreen:
+			if( SDL_SetWindowFullscreen( m_pSDLWindow, SDL_WINDOW_FULLSCREEN ) < 0 ) {
+				m_pGameHandle->getLogger()->printError( "Failed to enter fullscreen: %s", SDL_GetError() );
+				return false;
+			}
+			break;
+		default:
+			assert( false );
+			break;
 		}
-		break;
-	default:
-		assert( false );
-		break;
 	}
 
 	// Get user config resolutions
@@ -338,7 +420,7 @@ bool CGraphics::setupViewport()
 	}
 
 	// If fullscreen mode, try to find a video mode matching the user config
-	if( WindowModes::WindowModeFullscreen )
+	if( m_pSDLWindow && WindowModes::WindowModeFullscreen )
 	{
 		// Get which window the display is in
 		int displayIndex = SDL_GetWindowDisplayIndex( m_pSDLWindow );
@@ -384,7 +466,7 @@ bool CGraphics::setupViewport()
 		m_pGameHandle->getClient()->getClientConfig()->updateProperty<unsigned int>( CONFIG_STR_REFRESH_RATE, refreshRate );
 	}
 	// If window mode, set resolution
-	else
+	else if( m_pSDLWindow )
 		SDL_SetWindowSize( m_pSDLWindow, resolutionX, resolutionY );
 
 	if( !m_pGameHandle->getClient()->getClientConfig()->getPropertyFromConfig<float>( CONFIG_STR_FOV, &fov ) ) {
@@ -400,55 +482,67 @@ bool CGraphics::setupViewport()
 	return true;
 }
 
-#ifdef _DEBUG
-void CGraphics::debugCallback( GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length, const GLchar* message )
+void CGraphics::submitForDraw( const std::shared_ptr<CVertexArray> &vertexArray, unsigned int shaderIndex, unsigned int vertexCount, GLint firstVertex )
 {
-	// Determine severity
-	std::string severityStr;
-	switch( severity )
-	{
-	case GL_DEBUG_SEVERITY_LOW:
-		severityStr = "LOW";
-		break;
-	case GL_DEBUG_SEVERITY_MEDIUM:
-		severityStr = "MEDIUM";
-		break;
-	case GL_DEBUG_SEVERITY_HIGH:
-		severityStr = "HIGH";
-		break;
-	default:
-		severityStr = "UNKNOWN";
-		break;
-	}
-	// Determine message type
-	switch( type )
-	{
-	case GL_DEBUG_TYPE_UNDEFINED_BEHAVIOR:
-		m_pGameHandle->getLogger()->printError( "OPENGL UNDEFINED (id: %u, s: %s): %s", id, severityStr.c_str(), message );
-		break;
-	case GL_DEBUG_TYPE_ERROR:
-		m_pGameHandle->getLogger()->printError( "OPENGL ERROR (id: %u, s: %s): %s", id, severityStr.c_str(), message );
-		break;
-	case GL_DEBUG_TYPE_PORTABILITY:
-	case GL_DEBUG_TYPE_PERFORMANCE:
-	case GL_DEBUG_TYPE_DEPRECATED_BEHAVIOR:
-		m_pGameHandle->getLogger()->printWarn( "OPENGL WARNING (id: %u, s: %s): %s", id, severityStr.c_str(), message );
-		break;
-	case GL_DEBUG_TYPE_OTHER:
-		m_pGameHandle->getLogger()->print( "OPENGL (id: %u, s: %s): %s", id, severityStr.c_str(), message );
-		break;
-	}
-	
+	assert( vertexArray );
+	assert( vertexArray->getVertexArrayId() );
+	assert( shaderIndex );
+
+	GLuint vertexArrayId = vertexArray->getVertexArrayId();
+	uint64_t sortKey = MakeRenderJobKey( shaderIndex, 0.0f, vertexArrayId );
+	m_renderJobs.push_back( { sortKey, vertexArrayId, shaderIndex, vertexCount, GL_POINTS, 0, firstVertex, 0, 0, 0, -1, glm::vec3( 0.0f ), -1 } );
+}
+void CGraphics::submitIndexedForDraw( const std::shared_ptr<CVertexArray> &vertexArray, unsigned int shaderIndex, unsigned int indexCount, GLenum indexType,
+	GLint baseVertex, GLint offsetAttrib, const glm::vec3 &offset )
+{
+	assert( vertexArray );
+	assert( vertexArray->getVertexArrayId() );
+	assert( shaderIndex );
+	assert( indexType == GL_UNSIGNED_SHORT || indexType == GL_UNSIGNED_INT );
+
+	// The view looks down -z
+	float viewDepth = -((*m_viewMat) * glm::vec4( offset, 1.0f )).z;
+
+	GLuint vertexArrayId = vertexArray->getVertexArrayId();
+	uint64_t sortKey = MakeRenderJobKey( shaderIndex, viewDepth, vertexArrayId );
+	m_renderJobs.push_back( { sortKey, vertexArrayId, shaderIndex, indexCount, GL_TRIANGLES, indexType, baseVertex, 0, 0, 0, offsetAttrib, offset, -1 } );
 }
-#endif
+void CGraphics::submitIndirectForDraw( const std::shared_ptr<CVertexArray> &vertexArray, unsigned int shaderIndex, GLuint indirectBuffer, GLintptr indirectOffset,
+	unsigned int drawCount, GLenum indexType )
+{
+	assert( vertexArray );
+	assert( vertexArray->getVertexArrayId() );
+	assert( shaderIndex );
+	assert( indirectBuffer );
+	assert( indexType == GL_UNSIGNED_SHORT || indexType == GL_UNSIGNED_INT );
 
-void CGraphics::submitForDraw( std::shared_ptr<CVertexArray> vertexArray, unsigned int shaderIndex, unsigned int vertexCount )
+	GLuint vertexArrayId = vertexArray->getVertexArrayId();
+	uint64_t sortKey = MakeRenderJobKey( shaderIndex, 0.0f, vertexArrayId );
+	m_renderJobs.push_back( { sortKey, vertexArrayId, shaderIndex, drawCount, GL_TRIANGLES, indexType, 0, indirectBuffer, indirectOffset, 0, -1, glm::vec3( 0.0f ), -1 } );
+}
+void CGraphics::submitInstancedForDraw( const std::shared_ptr<CVertexArray> &vertexArray, unsigned int shaderIndex, unsigned int indexCount, GLenum indexType,
+	unsigned int instanceCount, GLintptr drawUniformOffset )
 {
 	assert( vertexArray );
 	assert( vertexArray->getVertexArrayId() );
 	assert( shaderIndex );
+	assert( indexType == GL_UNSIGNED_SHORT || indexType == GL_UNSIGNED_INT );
+
+	if( !instanceCount )
+		return;
 
-	m_renderJobs.push_back( { vertexArray, shaderIndex, vertexCount } );
+	GLuint vertexArrayId = vertexArray->getVertexArrayId();
+	uint64_t sortKey = MakeRenderJobKey( shaderIndex, 0.0f, vertexArrayId );
+	m_renderJobs.push_back( { sortKey, vertexArrayId, shaderIndex, indexCount, GL_TRIANGLES, indexType, 0, 0, 0, instanceCount, -1, glm::vec3( 0.0f ), drawUniformOffset } );
+}
+
+void CGraphics::addStreamBuffer( CStreamBuffer *pStreamBuffer )
+{
+	assert( std::find( m_streamBuffers.begin(), m_streamBuffers.end(), pStreamBuffer ) == m_streamBuffers.end() );
+	m_streamBuffers.push_back( pStreamBuffer );
+}
+void CGraphics::removeStreamBuffer( CStreamBuffer *pStreamBuffer ) {
+	m_streamBuffers.erase( std::remove( m_streamBuffers.begin(), m_streamBuffers.end(), pStreamBuffer ), m_streamBuffers.end() );
 }
 
 ///////////////////
@@ -481,31 +575,34 @@ void CBufferObject::create( GLsizeiptr size, void* data, GLbitfield flags, GLenu
 void CBufferObject::destroy()
 {
 	if( m_bufferId ) {
-		glDeleteBuffers( 1, &m_bufferId );
+		// The backend is gone if the buffer outlived the graphics
+		if( CGraphics::GetActiveBackend() )
+			CGraphics::GetActiveBackend()->deleteBuffers( 1, &m_bufferId );
 		m_bufferId = 0;
 	}
 }
 
 bool CBufferObject::bind( GLenum target )
 {
+	IRenderBackend *pBackend = CGraphics::GetActiveBackend();
 	GLenum glError;
 
 	// if the buffer hasnt actually been created
 	if( !m_bufferId )
 	{
-		glGenBuffers( 1, &m_bufferId );
-		glBindBuffer( target, m_bufferId );
-		if( glewIsSupported( "GL_ARB_buffer_storage" ) )
-			glBufferStorage( target, m_bufferSize, m_bufferData, m_bufferFlags );
+		pBackend->genBuffers( 1, &m_bufferId );
+		pBackend->bindBuffer( target, m_bufferId );
+		if( pBackend->isExtensionSupported( "GL_ARB_buffer_storage" ) )
+			pBackend->bufferStorage( target, m_bufferSize, m_bufferData, m_bufferFlags );
 		else 
-			glBufferData( target, m_bufferSize, m_bufferData, m_bufferUsage );
-		if( (glError = glGetError()) != GL_NO_ERROR ) {
+			pBackend->bufferData( target, m_bufferSize, m_bufferData, m_bufferUsage );
+		if( (glError = pBackend->getError()) != GL_NO_ERROR ) {
 			m_bufferId = 0;
 			return false;
 		}
 	}
 	else
-		glBindBuffer( target, m_bufferId );
+		pBackend->bindBuffer( target, m_bufferId );
 
 	return true;
 }
@@ -530,8 +627,8 @@ bool CVertexArray::create()
 
 	GLenum glError;
 
-	glGenVertexArrays( 1, &m_vaoId );
-	if( (glError = glGetError()) != GL_NO_ERROR ) {
+	CGraphics::GetActiveBackend()->genVertexArrays( 1, &m_vaoId );
+	if( (glError = CGraphics::GetActiveBackend()->getError()) != GL_NO_ERROR ) {
 		m_vaoId = 0;
 		m_pGameHandle->getLogger()->printError( "Failed to generate vertex array, GL error code %u", glError );
 		return false;
@@ -541,7 +638,8 @@ bool CVertexArray::create()
 void CVertexArray::destroy()
 {
 	if( m_vaoId ) {
-		glDeleteVertexArrays( 1, &m_vaoId );
+		if( CGraphics::GetActiveBackend() )
+			CGraphics::GetActiveBackend()->deleteVertexArrays( 1, &m_vaoId );
 		m_vaoId = 0;
 	}
 	m_vertexAttribsActive = 0;
@@ -553,7 +651,7 @@ void CVertexArray::bind()
 {
 	assert( m_vaoId );
 
-	glBindVertexArray( m_vaoId );
+	CGraphics::GetActiveBackend()->bindVertexArray( m_vaoId );
 }
 
 void CVertexArray::addBuffer( std::shared_ptr<CBufferObject> bufferObject, GLenum target )
@@ -563,7 +661,7 @@ void CVertexArray::addBuffer( std::shared_ptr<CBufferObject> bufferObject, GLenu
 	m_buffersToBind.push_back( BufferPair( target, bufferObject ) );
 }
 
-GLuint CVertexArray::addVertexAttribInternal( unsigned char internalType, GLint size, GLenum type, GLsizei stride, const void *pointer, GLboolean normalized )
+GLuint CVertexArray::addVertexAttribInternal( unsigned char internalType, GLint size, GLenum type, GLsizei stride, const void *pointer, GLboolean normalized, GLuint divisor )
 {
 	assert( m_vaoId );
 	assert( m_vertexAttribsActive < GL_MAX_VERTEX_ATTRIBS );
@@ -574,20 +672,23 @@ GLuint CVertexArray::addVertexAttribInternal( unsigned char internalType, GLint
 	// Determine index
 	index = m_vertexAttribsActive++;
 	// Populate attrib struct
-	attrib = { index, size, type, stride, pointer, normalized, internalType };
+	attrib = { index, size, type, stride, pointer, normalized, internalType, divisor };
 
 	m_vertexAttribQueue.push( attrib );
 
 	return index;
 }
 GLuint CVertexArray::addVertexAttrib( GLint size, GLenum type, GLsizei stride, const void *pointer, GLboolean normalized ) {
-	return this->addVertexAttribInternal( CVertexArray::VertexAttribType::VAT_Special, size, type, stride, pointer, GL_FALSE );
+	return this->addVertexAttribInternal( CVertexArray::VertexAttribType::VAT_Special, size, type, stride, pointer, GL_FALSE, 0 );
 }
 GLuint CVertexArray::addVertexIAttrib( GLint size, GLenum type, GLsizei stride, const void *pointer ) {
-	return this->addVertexAttribInternal( CVertexArray::VertexAttribType::VAT_Integer, size, type, stride, pointer, GL_FALSE );
+	return this->addVertexAttribInternal( CVertexArray::VertexAttribType::VAT_Integer, size, type, stride, pointer, GL_FALSE, 0 );
 }
 GLuint CVertexArray::addVertexLAttrib( GLint size, GLenum type, GLsizei stride, const void *pointer ) {
-	return this->addVertexAttribInternal( CVertexArray::VertexAttribType::VAT_Long, size, type, stride, pointer, GL_FALSE );
+	return this->addVertexAttribInternal( CVertexArray::VertexAttribType::VAT_Long, size, type, stride, pointer, GL_FALSE, 0 );
+}
+GLuint CVertexArray::addInstancedVertexAttrib( GLint size, GLenum type, GLsizei stride, const void *pointer, GLuint divisor ) {
+	return this->addVertexAttribInternal( CVertexArray::VertexAttribType::VAT_Special, size, type, stride, pointer, GL_FALSE, divisor );
 }
 
 bool CVertexArray::flushBindsAndAttribs()
@@ -595,10 +696,11 @@ bool CVertexArray::flushBindsAndAttribs()
 	assert( m_vaoId );
 	assert( !m_buffersToBind.empty() );
 
+	IRenderBackend *pBackend = CGraphics::GetActiveBackend();
 	GLenum glError;
 
 	this->bind();
-	if( (glError = glGetError()) != GL_NO_ERROR ) {
+	if( (glError = pBackend->getError()) != GL_NO_ERROR ) {
 		m_pGameHandle->getLogger()->printError( "Failed to bind vertex array, GL error code %u", glError );
 		return false;
 	}
@@ -620,28 +722,35 @@ bool CVertexArray::flushBindsAndAttribs()
 		switch( attrib.internalType )
 		{
 		case CVertexArray::VertexAttribType::VAT_Special:
-			glVertexAttribPointer( attrib.index, attrib.size, attrib.type, attrib.normalized, attrib.stride, attrib.pointer );
+			pBackend->vertexAttribPointer( attrib.index, attrib.size, attrib.type, attrib.normalized, attrib.stride, attrib.pointer );
 			break;
 		case CVertexArray::VertexAttribType::VAT_Integer:
-			glVertexAttribIPointer( attrib.index, attrib.size, attrib.type, attrib.stride, attrib.pointer );
+			pBackend->vertexAttribIPointer( attrib.index, attrib.size, attrib.type, attrib.stride, attrib.pointer );
 			break;
 		case CVertexArray::VertexAttribType::VAT_Long:
-			glVertexAttribLPointer( attrib.index, attrib.size, attrib.type, attrib.stride, attrib.pointer );
+			pBackend->vertexAttribLPointer( attrib.index, attrib.size, attrib.type, attrib.stride, attrib.pointer );
 			break;
 		default:
 			assert( false );
 			return false;
 		}
-		if( (glError = glGetError()) != GL_NO_ERROR ) {
+		if( (glError = pBackend->getError()) != GL_NO_ERROR ) {
 			m_pGameHandle->getLogger()->printError( "Failed to call glVertexAttribPointer, GL error code %u", glError );
 			return false;
 		}
 		// Enable vertex attrib
-		glEnableVertexAttribArray( attrib.index );
-		if( (glError = glGetError()) != GL_NO_ERROR ) {
+		pBackend->enableVertexAttribArray( attrib.index );
+		if( (glError = pBackend->getError()) != GL_NO_ERROR ) {
 			m_pGameHandle->getLogger()->printError( "Failed to call glEnableVertexArrayAttrib, GL error code %u", glError );
 			return false;
 		}
+		if( attrib.divisor ) {
+			pBackend->vertexAttribDivisor( attrib.index, attrib.divisor );
+			if( (glError = pBackend->getError()) != GL_NO_ERROR ) {
+				m_pGameHandle->getLogger()->printError( "Failed to call glVertexAttribDivisor, GL error code %u", glError );
+				return false;
+			}
+		}
 	}
 
 	return true;
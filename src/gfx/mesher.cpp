@@ -0,0 +1,475 @@
+#include <assert.h>
+#include <algorithm>
+#include <chrono>
+#include "gfx/mesher.h"
+
+/** Mask entries hold the block in the low bits and the four corner occlusion levels above it */
+#define FACE_MASK_AO_SHIFT 16
+#define FACE_MASK_BLOCK_MASK 0xFFFF
+
+/** True if the face of block between it and neighbour can be seen */
+static inline bool IsFaceVisible( BlockId block, BlockId neighbour ) {
+	if( block == BLOCK_AIR )
+		return false;
+	// Transparent blocks of the same type, like glass, merge into one volume
+	return neighbour == BLOCK_AIR || (!IsBlockOpaque( neighbour ) && neighbour != block);
+}
+/** True if the block darkens the corners next to it. Unloaded blocks do not, so borders are not dark before neighbours load. */
+static inline uint32_t IsOccluder( BlockId block ) {
+	return (block < BLOCK_COUNT && (BlockDefinitions[block].flags & BLOCK_FLAG_OPAQUE)) ? 1 : 0;
+}
+/** The occlusion level of a corner from its two side blocks and the diagonal block between them */
+static inline uint32_t CornerOcclusion( uint32_t side1, uint32_t side2, uint32_t corner ) {
+	// Two sides hide the corner block completely
+	return (side1 & side2) ? 0 : CHUNK_VERTEX_AO_NONE - (side1 + side2 + corner);
+}
+
+/** Index into a padded grid with a side length of size plus the border */
+static inline uint32_t PaddedGridIndex( uint32_t size, uint32_t x, uint32_t y, uint32_t z ) {
+	return (y*(size + 2) + z)*(size + 2) + x;
+}
+
+/** Copy range along one axis for a neighbour offset of -1, 0 or 1: the first source block, the first padded block and the count */
+static inline void GetPaddedRange( int32_t offset, uint32_t &source, uint32_t &dest, uint32_t &count )
+{
+	source = (offset < 0) ? CHUNK_SIZE-1 : 0;
+	dest = (offset < 0) ? 0 : (offset > 0 ? CHUNK_SIZE+1 : 1);
+	count = (offset == 0) ? CHUNK_SIZE : 1;
+}
+
+////////////////////
+// ChunkMeshInput //
+////////////////////
+
+bool ChunkMeshInput::gather( CChunkStore *pChunkStore, const ChunkPos &chunkPosition )
+{
+	assert( pChunkStore );
+
+	CChunk *pChunk = pChunkStore->getChunk( chunkPosition );
+	if( !pChunk )
+		return false;
+
+	position = chunkPosition;
+	version = pChunk->getVersion();
+
+	// The chunk itself and its 26 neighbours, each copies the part of it that lands inside the padded box
+	for( int32_t dy = -1; dy <= 1; dy++ ) {
+		for( int32_t dz = -1; dz <= 1; dz++ ) {
+			for( int32_t dx = -1; dx <= 1; dx++ )
+			{
+				ChunkPos neighbourPos = { chunkPosition.x + dx, chunkPosition.y + dy, chunkPosition.z + dz };
+				CChunk *pNeighbour = (dx || dy || dz) ? pChunkStore->getChunk( neighbourPos ) : pChunk;
+
+				uint32_t sourceX, sourceY, sourceZ, destX, destY, destZ, countX, countY, countZ;
+				GetPaddedRange( dx, sourceX, destX, countX );
+				GetPaddedRange( dy, sourceY, destY, countY );
+				GetPaddedRange( dz, sourceZ, destZ, countZ );
+
+				const BlockId *pSource = 0;
+				BlockId fillBlock = BLOCK_AIR;
+				if( !pNeighbour )
+					fillBlock = (neighbourPos.y >= WORLD_HEIGHT_CHUNKS) ? (BlockId)BLOCK_AIR : (BlockId)MESHER_UNLOADED_BLOCK;
+				else if( pNeighbour->isUniform() )
+					fillBlock = pNeighbour->getUniformBlock();
+				else
+					pSource = pNeighbour->getBlockData();
+
+				for( uint32_t y = 0; y < countY; y++ ) {
+					for( uint32_t z = 0; z < countZ; z++ ) {
+						BlockId *pDest = &blocks[PaddedBlockIndex( destX, destY + y, destZ + z )];
+						if( pSource ) {
+							const BlockId *pRow = pSource + ChunkBlockIndex( sourceX, sourceY + y, sourceZ + z );
+							std::copy( pRow, pRow + countX, pDest );
+						}
+						else
+							std::fill( pDest, pDest + countX, fillBlock );
+					}
+				}
+			}
+		}
+	}
+
+	return true;
+}
+
+//////////////////
+// CChunkMesher //
+//////////////////
+
+void ChunkMeshStats::add( const ChunkMeshStats &other )
+{
+	chunkCount += other.chunkCount;
+	faceCount += other.faceCount;
+	quadCount += other.quadCount;
+	seconds += other.seconds;
+	aoSeconds += other.aoSeconds;
+	for( uint32_t lod = 0; lod < CHUNK_LOD_COUNT; lod++ )
+		lodChunkCount[lod] += other.lodChunkCount[lod];
+}
+
+CChunkMesher::CChunkMesher()
+{
+	m_faceMask.resize( CHUNK_AREA );
+	for( uint32_t lod = 1; lod < CHUNK_LOD_COUNT; lod++ ) {
+		uint32_t paddedSize = (CHUNK_SIZE >> lod) + 2;
+		m_lodBlocks[lod].resize( paddedSize*paddedSize*paddedSize );
+	}
+	m_openRows.resize( CHUNK_AREA );
+	m_filledRows.resize( CHUNK_AREA );
+	m_pendingRows.resize( CHUNK_AREA );
+	m_fillStack.reserve( CHUNK_AREA );
+	m_stats = ChunkMeshStats();
+}
+CChunkMesher::~CChunkMesher() {
+}
+
+void CChunkMesher::BuildQuadIndices( std::vector<uint32_t> &indices, uint32_t quadCount )
+{
+	indices.resize( (size_t)quadCount * 6 );
+	for( uint32_t i = 0; i < quadCount; i++ ) {
+		uint32_t base = i * 4;
+		uint32_t *pQuad = &indices[(size_t)i * 6];
+		pQuad[0] = base;
+		pQuad[1] = base + 1;
+		pQuad[2] = base + 2;
+		pQuad[3] = base;
+		pQuad[4] = base + 2;
+		pQuad[5] = base + 3;
+	}
+}
+
+void CChunkMesher::DownsampleBlocks( const BlockId *pSource, uint32_t sourceSize, BlockId *pDest )
+{
+	const uint32_t destSize = sourceSize / 2;
+
+	// Interior cells cover two source cells on each axis. The border is one source cell thick, so a border cell
+	// only covers the source border cell below it.
+	auto getChildRange = [sourceSize, destSize]( uint32_t dest, uint32_t &first, uint32_t &count ) {
+		if( dest == 0 ) {
+			first = 0;
+			count = 1;
+		}
+		else if( dest == destSize + 1 ) {
+			first = sourceSize + 1;
+			count = 1;
+		}
+		else {
+			first = dest*2 - 1;
+			count = 2;
+		}
+	};
+
+	for( uint32_t y = 0; y < destSize + 2; y++ )
+	{
+		uint32_t firstY, countY;
+		getChildRange( y, firstY, countY );
+		for( uint32_t z = 0; z < destSize + 2; z++ )
+		{
+			uint32_t firstZ, countZ;
+			getChildRange( z, firstZ, countZ );
+			for( uint32_t x = 0; x < destSize + 2; x++ )
+			{
+				uint32_t firstX, countX;
+				getChildRange( x, firstX, countX );
+
+				BlockId children[8];
+				uint32_t childCount = 0, solidCount = 0;
+				for( uint32_t cy = firstY; cy < firstY + countY; cy++ ) {
+					for( uint32_t cz = firstZ; cz < firstZ + countZ; cz++ ) {
+						for( uint32_t cx = firstX; cx < firstX + countX; cx++ ) {
+							BlockId child = pSource[PaddedGridIndex( sourceSize, cx, cy, cz )];
+							childCount++;
+							if( child != BLOCK_AIR )
+								children[solidCount++] = child;
+						}
+					}
+				}
+
+				// Ties go to the blocks, so thin floors and walls survive
+				BlockId block = BLOCK_AIR;
+				if( solidCount*2 >= childCount ) {
+					uint32_t bestCount = 0;
+					for( uint32_t i = 0; i < solidCount; i++ ) {
+						uint32_t count = (uint32_t)std::count( children, children + solidCount, children[i] );
+						if( count > bestCount ) {
+							bestCount = count;
+							block = children[i];
+						}
+					}
+				}
+				pDest[PaddedGridIndex( destSize, x, y, z )] = block;
+			}
+		}
+	}
+}
+
+void CChunkMesher::buildMesh( const ChunkMeshInput &input, uint8_t lod, ChunkMesh &mesh )
+{
+	assert( lod < CHUNK_LOD_COUNT );
+
+	mesh.position = input.position;
+	mesh.version = input.version;
+	mesh.lod = lod;
+	mesh.faceConnections = CHUNK_FACE_CONNECTIONS_ALL;
+	mesh.vertices.clear();
+	mesh.occluders.clear();
+	mesh.faceCount = 0;
+
+	auto meshStart = std::chrono::high_resolution_clock::now();
+	m_stats.chunkCount++;
+	m_stats.lodChunkCount[lod]++;
+
+	// Nothing to see in an empty chunk
+	bool empty = true;
+	for( uint32_t y = 0; y < CHUNK_SIZE && empty; y++ ) {
+		for( uint32_t z = 0; z < CHUNK_SIZE && empty; z++ ) {
+			const BlockId *pRow = &input.blocks[PaddedBlockIndex( 1, y + 1, z + 1 )];
+			empty = std::all_of( pRow, pRow + CHUNK_SIZE, []( BlockId b ) { return b == BLOCK_AIR; } );
+		}
+	}
+	if( !empty )
+	{
+		// Only the levels up to the one asked for are built
+		const BlockId *pBlocks = input.blocks;
+		uint32_t size = CHUNK_SIZE;
+		for( uint32_t level = 1; level <= lod; level++ ) {
+			DownsampleBlocks( pBlocks, size, &m_lodBlocks[level][0] );
+			pBlocks = &m_lodBlocks[level][0];
+			size /= 2;
+		}
+
+		for( uint8_t face = 0; face < FACE_COUNT; face++ )
+			this->meshFaceDirection( pBlocks, size, lod, face, mesh );
+
+		// From the full chunk, whatever the level of detail, so no gap closes up
+		mesh.faceConnections = this->findFaceConnections( input );
+
+		if( mesh.occluders.size() > CHUNK_OCCLUDER_MAX_COUNT ) {
+			std::nth_element( mesh.occluders.begin(), mesh.occluders.begin() + (CHUNK_OCCLUDER_MAX_COUNT - 1), mesh.occluders.end(),
+				[]( const ChunkOccluder &a, const ChunkOccluder &b ) { return a.getArea() > b.getArea(); } );
+			mesh.occluders.resize( CHUNK_OCCLUDER_MAX_COUNT );
+		}
+	}
+
+	m_stats.faceCount += mesh.faceCount;
+	m_stats.quadCount += mesh.getQuadCount();
+	m_stats.seconds += std::chrono::duration<double>( std::chrono::high_resolution_clock::now() - meshStart ).count();
+}
+
+uint16_t CChunkMesher::findFaceConnections( const ChunkMeshInput &input )
+{
+	static_assert(CHUNK_SIZE == 32, "Flood fill rows are 32-bit masks");
+
+	// One bit per block along x for every row of y and z
+	for( uint32_t y = 0; y < CHUNK_SIZE; y++ ) {
+		for( uint32_t z = 0; z < CHUNK_SIZE; z++ ) {
+			const BlockId *pRow = &input.blocks[PaddedBlockIndex( 1, y + 1, z + 1 )];
+			uint32_t open = 0;
+			for( uint32_t x = 0; x < CHUNK_SIZE; x++ )
+				open |= (uint32_t)!IsBlockOpaque( pRow[x] ) << x;
+			m_openRows[y*CHUNK_SIZE + z] = open;
+		}
+	}
+	std::fill( m_filledRows.begin(), m_filledRows.end(), 0u );
+	std::fill( m_pendingRows.begin(), m_pendingRows.end(), 0u );
+
+	// Only fills that start on a face can connect faces, so every seed is on the edge of the chunk
+	uint16_t connections = 0;
+	for( uint32_t seedRow = 0; seedRow < CHUNK_AREA && connections != CHUNK_FACE_CONNECTIONS_ALL; seedRow++ )
+	{
+		uint32_t seedY = seedRow / CHUNK_SIZE, seedZ = seedRow % CHUNK_SIZE;
+		bool edgeRow = seedY == 0 || seedY == CHUNK_MASK || seedZ == 0 || seedZ == CHUNK_MASK;
+		uint32_t edgeMask = edgeRow ? 0xFFFFFFFF : (1u | (1u << CHUNK_MASK));
+
+		uint32_t seeds;
+		while( (seeds = m_openRows[seedRow] & ~m_filledRows[seedRow] & edgeMask) != 0 )
+		{
+			uint32_t reachedFaces = 0;
+			m_pendingRows[seedRow] = seeds & (~seeds + 1);
+			m_fillStack.clear();
+			m_fillStack.push_back( (uint16_t)seedRow );
+			while( !m_fillStack.empty() )
+			{
+				uint32_t row = m_fillStack.back();
+				m_fillStack.pop_back();
+				uint32_t open = m_openRows[row];
+				uint32_t span = m_pendingRows[row] & ~m_filledRows[row];
+				m_pendingRows[row] = 0;
+				if( !span )
+					continue;
+
+				// Spread along the row both ways through open blocks, doubling the reach each step
+				uint32_t up = span, down = span, upOpen = open, downOpen = open;
+				for( uint32_t shift = 1; shift < CHUNK_SIZE; shift *= 2 ) {
+					up |= upOpen & (up << shift);
+					upOpen &= upOpen << shift;
+					down |= downOpen & (down >> shift);
+					downOpen &= downOpen >> shift;
+				}
+				span = (up | down) & ~m_filledRows[row];
+				m_filledRows[row] |= span;
+
+				uint32_t y = row / CHUNK_SIZE, z = row % CHUNK_SIZE;
+				reachedFaces |= ((span & 1) ? 1 << FACE_NEG_X : 0) | ((span >> CHUNK_MASK) ? 1 << FACE_POS_X : 0)
+					| (y == 0 ? 1 << FACE_NEG_Y : 0) | (y == CHUNK_MASK ? 1 << FACE_POS_Y : 0)
+					| (z == 0 ? 1 << FACE_NEG_Z : 0) | (z == CHUNK_MASK ? 1 << FACE_POS_Z : 0);
+
+				const int32_t neighbourRows[4] = {
+					y > 0 ? (int32_t)(row - CHUNK_SIZE) : -1, y < CHUNK_MASK ? (int32_t)(row + CHUNK_SIZE) : -1,
+					z > 0 ? (int32_t)(row - 1) : -1, z < CHUNK_MASK ? (int32_t)(row + 1) : -1 };
+				for( auto neighbour: neighbourRows ) {
+					if( neighbour < 0 )
+						continue;
+					uint32_t entering = span & m_openRows[neighbour] & ~m_filledRows[neighbour];
+					if( !entering )
+						continue;
+					if( !m_pendingRows[neighbour] )
+						m_fillStack.push_back( (uint16_t)neighbour );
+					m_pendingRows[neighbour] |= entering;
+				}
+			}
+
+			for( uint32_t faceA = 0; faceA < FACE_COUNT; faceA++ ) {
+				for( uint32_t faceB = faceA + 1; faceB < FACE_COUNT; faceB++ ) {
+					if( (reachedFaces >> faceA) & (reachedFaces >> faceB) & 1 )
+						connections |= ChunkFacePairBit( faceA, faceB );
+				}
+			}
+		}
+	}
+
+	return connections;
+}
+
+void CChunkMesher::meshFaceDirection( const BlockId *pBlocks, uint32_t size, uint8_t lod, uint8_t face, ChunkMesh &mesh )
+{
+	// The slice axis and the two axes across the slice, u cross v points along the positive slice axis
+	const uint32_t axis = face / 2;
+	const uint32_t axisU = (axis + 1) % 3;
+	const uint32_t axisV = (axis + 2) % 3;
+	const bool positive = (face & 1) != 0;
+	const int32_t *pNormal = FaceNormals[face];
+	uint32_t *pMask = &m_faceMask[0];
+	const uint32_t scale = 1u << lod;
+	// Skirts go on the last slice, where the faces point out of the chunk
+	const uint32_t edgeSlice = positive ? size - 1 : 0;
+
+	// Index offsets in the padded grid along each axis
+	const int32_t paddedSize = (int32_t)size + 2;
+	const int32_t axisStrides[3] = { 1, paddedSize*paddedSize, paddedSize };
+	const int32_t normalStride = pNormal[0]*axisStrides[0] + pNormal[1]*axisStrides[1] + pNormal[2]*axisStrides[2];
+	const int32_t strideU = axisStrides[axisU];
+	const int32_t strideV = axisStrides[axisV];
+	// Corner order matches the quad corners below
+	const int32_t cornerU[4] = { -strideU, strideU, strideU, -strideU };
+	const int32_t cornerV[4] = { -strideV, -strideV, strideV, strideV };
+
+	for( uint32_t slice = 0; slice < size; slice++ )
+	{
+		uint32_t coords[3];
+		uint32_t visibleFaces = 0;
+		const bool skirts = lod > 0 && slice == edgeSlice;
+
+		// Find the visible faces in this slice
+		coords[axis] = slice;
+		for( uint32_t v = 0; v < size; v++ ) {
+			coords[axisV] = v;
+			for( uint32_t u = 0; u < size; u++ ) {
+				coords[axisU] = u;
+				uint32_t index = PaddedGridIndex( size, coords[0] + 1, coords[1] + 1, coords[2] + 1 );
+				BlockId block = pBlocks[index];
+				BlockId neighbour = pBlocks[index + normalStride];
+				bool visible = IsFaceVisible( block, neighbour );
+				// A skirt for a block with any other face showing, so the wall reaches down to where the surface is
+				if( skirts && !visible && block != BLOCK_AIR && neighbour != MESHER_UNLOADED_BLOCK ) {
+					visible = IsFaceVisible( block, pBlocks[index - normalStride] ) ||
+						IsFaceVisible( block, pBlocks[index + strideU] ) || IsFaceVisible( block, pBlocks[index - strideU] ) ||
+						IsFaceVisible( block, pBlocks[index + strideV] ) || IsFaceVisible( block, pBlocks[index - strideV] );
+				}
+				pMask[v*size + u] = visible ? block : (uint32_t)BLOCK_AIR;
+				visibleFaces += visible;
+			}
+		}
+		if( !visibleFaces )
+			continue;
+		mesh.faceCount += visibleFaces;
+
+		// Occlusion of each corner from the blocks in front of the face, faces only merge if every corner matches
+		auto aoStart = std::chrono::high_resolution_clock::now();
+		for( uint32_t v = 0; v < size; v++ ) {
+			coords[axisV] = v;
+			for( uint32_t u = 0; u < size; u++ ) {
+				uint32_t &maskEntry = pMask[v*size + u];
+				if( !maskEntry )
+					continue;
+				coords[axisU] = u;
+				const BlockId *pFront = &pBlocks[PaddedGridIndex( size, coords[0] + 1, coords[1] + 1, coords[2] + 1 ) + normalStride];
+				uint32_t occlusion = 0;
+				for( uint32_t i = 0; i < 4; i++ ) {
+					uint32_t level = CornerOcclusion( IsOccluder( pFront[cornerU[i]] ), IsOccluder( pFront[cornerV[i]] ),
+						IsOccluder( pFront[cornerU[i] + cornerV[i]] ) );
+					occlusion |= level << (i*2);
+				}
+				maskEntry |= occlusion << FACE_MASK_AO_SHIFT;
+			}
+		}
+		m_stats.aoSeconds += std::chrono::duration<double>( std::chrono::high_resolution_clock::now() - aoStart ).count();
+
+		// Merge into rectangles, widest first, then as tall as the whole row matches
+		uint32_t plane = slice + (positive ? 1 : 0);
+		for( uint32_t v = 0; v < size; v++ )
+		{
+			for( uint32_t u = 0; u < size; )
+			{
+				uint32_t maskEntry = pMask[v*size + u];
+				if( !maskEntry ) {
+					u++;
+					continue;
+				}
+
+				uint32_t width = 1;
+				while( u + width < size && pMask[v*size + u + width] == maskEntry )
+					width++;
+				uint32_t height = 1;
+				for( ; v + height < size; height++ ) {
+					const uint32_t *pRow = &pMask[(v + height)*size + u];
+					if( std::find_if( pRow, pRow + width, [maskEntry]( uint32_t m ) { return m != maskEntry; } ) != pRow + width )
+						break;
+				}
+				for( uint32_t h = 0; h < height; h++ )
+					std::fill( &pMask[(v + h)*size + u], &pMask[(v + h)*size + u] + width, 0u );
+
+				BlockId block = (BlockId)(maskEntry & FACE_MASK_BLOCK_MASK);
+				uint32_t layer = GetBlockTextureLayer( block );
+				// Downsampled blocks can be solid where the chunk is not, so only full detail quads occlude
+				if( lod == 0 && width*height >= CHUNK_OCCLUDER_MIN_AREA && IsBlockOpaque( block ) )
+					mesh.occluders.push_back( { face, (uint8_t)plane, (uint8_t)u, (uint8_t)v, (uint8_t)(u + width), (uint8_t)(v + height) } );
+
+				// Counter-clockwise seen from outside the block, in blocks
+				const uint32_t corners[4][2] ={ { 0, 0 }, { width*scale, 0 }, { width*scale, height*scale }, { 0, height*scale } };
+				uint32_t order[4], occlusion[4];
+				for( uint32_t i = 0; i < 4; i++ ) {
+					order[i] = positive ? i : 3 - i;
+					occlusion[i] = (maskEntry >> (FACE_MASK_AO_SHIFT + order[i]*2)) & CHUNK_VERTEX_AO_MASK;
+				}
+				// Quads are split along the first and third vertex, start one corner later to split along the
+				// brighter diagonal, otherwise a single dark corner smears across the whole quad
+				uint32_t first = (occlusion[0] + occlusion[2] < occlusion[1] + occlusion[3]) ? 1 : 0;
+				for( uint32_t n = 0; n < 4; n++ )
+				{
+					uint32_t i = (first + n) & 3;
+					const uint32_t *pCorner = corners[order[i]];
+					uint32_t position[3];
+					position[axis] = plane*scale;
+					position[axisU] = u*scale + pCorner[0];
+					position[axisV] = v*scale + pCorner[1];
+
+					mesh.vertices.push_back( ChunkVertex::Pack( position[0], position[1], position[2], face, occlusion[i],
+						layer, pCorner[0], pCorner[1] ) );
+				}
+
+				u += width;
+			}
+		}
+	}
+}
@@ -0,0 +1,304 @@
+#include <assert.h>
+#include <algorithm>
+#include <cmath>
+#include "gfx/meshworkers.h"
+
+CMeshWorkerPool::CMeshWorkerPool()
+{
+	// Serial 0 marks removals
+	m_nextSerial = 1;
+	m_cameraChunk = { 0, 0, 0 };
+	m_shuttingDown = false;
+
+	m_resultHead = 0;
+	m_jobsInFlight = 0;
+
+	m_stats = ChunkMeshStats();
+}
+CMeshWorkerPool::~CMeshWorkerPool() {
+	this->shutdown();
+}
+
+int64_t CMeshWorkerPool::ChunkDistance( const ChunkPos &a, const ChunkPos &b )
+{
+	int64_t dx = (int64_t)a.x - b.x;
+	int64_t dy = (int64_t)a.y - b.y;
+	int64_t dz = (int64_t)a.z - b.z;
+	return dx*dx + dy*dy + dz*dz;
+}
+
+bool CMeshWorkerPool::initialize( unsigned int threadCount )
+{
+	assert( m_workerThreads.empty() );
+
+	// Leave room for the main, render and server threads
+	if( threadCount == 0 )
+		threadCount = std::max( std::thread::hardware_concurrency() / 2, 1u );
+
+	m_shuttingDown = false;
+	try {
+		for( unsigned int i = 0; i < threadCount; i++ )
+			m_workerThreads.push_back( std::thread( &CMeshWorkerPool::workerMain, this ) );
+	}
+	catch( const std::system_error& ) {
+		this->shutdown();
+		return false;
+	}
+
+	return true;
+}
+void CMeshWorkerPool::shutdown()
+{
+	{
+		std::lock_guard<std::mutex> lock( m_jobMutex );
+		m_shuttingDown = true;
+	}
+	m_jobAvailable.notify_all();
+
+	for( auto &it: m_workerThreads ) {
+		if( it.joinable() )
+			it.join();
+	}
+	m_workerThreads.clear();
+
+	// Nothing else can touch the pool now
+	for( auto &it: m_pendingJobs )
+		delete it.second.pInput;
+	m_pendingJobs.clear();
+	m_jobHeap.clear();
+	m_latestSerials.clear();
+	m_remeshRequests.clear();
+	m_jobsInFlight = 0;
+
+	MeshResult *pResult = m_resultHead.exchange( 0 );
+	while( pResult ) {
+		MeshResult *pNext = pResult->pNext;
+		delete pResult;
+		pResult = pNext;
+	}
+	for( auto it: m_freeInputs )
+		delete it;
+	m_freeInputs.clear();
+	for( auto it: m_freeResults )
+		delete it;
+	m_freeResults.clear();
+}
+
+void CMeshWorkerPool::workerMain()
+{
+	CChunkMesher mesher;
+	PendingJob job;
+	uint8_t lod;
+
+	while( true )
+	{
+		{
+			std::unique_lock<std::mutex> lock( m_jobMutex );
+			m_jobAvailable.wait( lock, [this] { return m_shuttingDown || !m_jobHeap.empty(); } );
+			if( m_shuttingDown )
+				return;
+
+			std::pop_heap( m_jobHeap.begin(), m_jobHeap.end() );
+			ChunkPos position = m_jobHeap.back().position;
+			m_jobHeap.pop_back();
+			// Cancelled since it was queued
+			auto it = m_pendingJobs.find( position );
+			if( it == m_pendingJobs.end() )
+				continue;
+			job = it->second;
+			m_pendingJobs.erase( it );
+			lod = ChunkLodForDistance( std::sqrt( (float)ChunkDistance( position, m_cameraChunk ) ) );
+		}
+
+		MeshResult *pResult = this->acquireResult();
+		mesher.buildMesh( *job.pInput, lod, pResult->mesh );
+		pResult->serial = job.serial;
+		{
+			std::lock_guard<std::mutex> lock( m_poolMutex );
+			m_stats.add( mesher.getStats() );
+		}
+		mesher.resetStats();
+		this->releaseInput( job.pInput );
+		this->pushResult( pResult );
+		m_jobsInFlight.fetch_sub( 1, std::memory_order_relaxed );
+	}
+}
+
+ChunkMeshInput* CMeshWorkerPool::acquireInput()
+{
+	{
+		std::lock_guard<std::mutex> lock( m_poolMutex );
+		if( !m_freeInputs.empty() ) {
+			ChunkMeshInput *pInput = m_freeInputs.back();
+			m_freeInputs.pop_back();
+			return pInput;
+		}
+	}
+	return new ChunkMeshInput();
+}
+void CMeshWorkerPool::releaseInput( ChunkMeshInput *pInput )
+{
+	assert( pInput );
+	{
+		std::lock_guard<std::mutex> lock( m_poolMutex );
+		if( m_freeInputs.size() < MESH_WORKER_POOL_LIMIT ) {
+			m_freeInputs.push_back( pInput );
+			return;
+		}
+	}
+	delete pInput;
+}
+
+ChunkMeshStats CMeshWorkerPool::getStats()
+{
+	std::lock_guard<std::mutex> lock( m_poolMutex );
+	return m_stats;
+}
+
+MeshResult* CMeshWorkerPool::acquireResult()
+{
+	{
+		std::lock_guard<std::mutex> lock( m_poolMutex );
+		if( !m_freeResults.empty() ) {
+			MeshResult *pResult = m_freeResults.back();
+			m_freeResults.pop_back();
+			return pResult;
+		}
+	}
+	return new MeshResult();
+}
+void CMeshWorkerPool::releaseResult( MeshResult *pResult )
+{
+	assert( pResult );
+	{
+		std::lock_guard<std::mutex> lock( m_poolMutex );
+		// The vertex storage is kept, which is the point of pooling results
+		if( m_freeResults.size() < MESH_WORKER_POOL_LIMIT ) {
+			m_freeResults.push_back( pResult );
+			return;
+		}
+	}
+	delete pResult;
+}
+
+void CMeshWorkerPool::pushResult( MeshResult *pResult )
+{
+	pResult->pNext = m_resultHead.load( std::memory_order_relaxed );
+	while( !m_resultHead.compare_exchange_weak( pResult->pNext, pResult, std::memory_order_release, std::memory_order_relaxed ) );
+}
+
+MeshResult* CMeshWorkerPool::takeResults()
+{
+	MeshResult *pResult = m_resultHead.exchange( 0, std::memory_order_acquire );
+
+	// The list is newest first, reverse it
+	MeshResult *pOrdered = 0;
+	while( pResult ) {
+		MeshResult *pNext = pResult->pNext;
+		pResult->pNext = pOrdered;
+		pOrdered = pResult;
+		pResult = pNext;
+	}
+	return pOrdered;
+}
+
+bool CMeshWorkerPool::isCurrent( const MeshResult *pResult )
+{
+	std::lock_guard<std::mutex> lock( m_jobMutex );
+
+	auto it = m_latestSerials.find( pResult->mesh.position );
+	// Removals stay current until the chunk is submitted again
+	if( pResult->serial == 0 )
+		return it == m_latestSerials.end();
+	return it != m_latestSerials.end() && it->second == pResult->serial;
+}
+
+void CMeshWorkerPool::submit( ChunkMeshInput *pInput )
+{
+	assert( pInput );
+
+	ChunkMeshInput *pReplaced = 0;
+	{
+		std::lock_guard<std::mutex> lock( m_jobMutex );
+
+		uint32_t serial = m_nextSerial++;
+		m_latestSerials[pInput->position] = serial;
+
+		auto it = m_pendingJobs.find( pInput->position );
+		if( it != m_pendingJobs.end() ) {
+			// Keep its place in the queue, only the newest copy is worth meshing
+			pReplaced = it->second.pInput;
+			it->second = { pInput, serial };
+		}
+		else {
+			m_pendingJobs.insert( std::pair<ChunkPos, PendingJob>( pInput->position, { pInput, serial } ) );
+			m_jobHeap.push_back( { ChunkDistance( pInput->position, m_cameraChunk ), pInput->position } );
+			std::push_heap( m_jobHeap.begin(), m_jobHeap.end() );
+			m_jobsInFlight.fetch_add( 1, std::memory_order_relaxed );
+		}
+	}
+	if( pReplaced )
+		this->releaseInput( pReplaced );
+	else
+		m_jobAvailable.notify_one();
+}
+
+void CMeshWorkerPool::cancel( const ChunkPos &position )
+{
+	ChunkMeshInput *pDropped = 0;
+	bool submitted;
+	{
+		std::lock_guard<std::mutex> lock( m_jobMutex );
+
+		submitted = m_latestSerials.erase( position ) != 0;
+		// The heap entry is skipped when a worker pops it
+		auto it = m_pendingJobs.find( position );
+		if( it != m_pendingJobs.end() ) {
+			pDropped = it->second.pInput;
+			m_pendingJobs.erase( it );
+			m_jobsInFlight.fetch_sub( 1, std::memory_order_relaxed );
+		}
+	}
+	if( pDropped )
+		this->releaseInput( pDropped );
+
+	// An empty mesh tells the collecting thread to drop its copy, chunks never submitted have none
+	if( submitted ) {
+		MeshResult *pRemoval = this->acquireResult();
+		pRemoval->mesh.position = position;
+		pRemoval->mesh.version = 0;
+		pRemoval->mesh.lod = 0;
+		pRemoval->mesh.faceConnections = 0;
+		pRemoval->mesh.vertices.clear();
+		pRemoval->mesh.occluders.clear();
+		pRemoval->mesh.faceCount = 0;
+		pRemoval->serial = 0;
+		this->pushResult( pRemoval );
+	}
+}
+
+void CMeshWorkerPool::setCameraChunk( const ChunkPos &position )
+{
+	std::lock_guard<std::mutex> lock( m_jobMutex );
+
+	if( position == m_cameraChunk )
+		return;
+	m_cameraChunk = position;
+
+	for( auto &it: m_jobHeap )
+		it.distance = ChunkDistance( it.position, m_cameraChunk );
+	std::make_heap( m_jobHeap.begin(), m_jobHeap.end() );
+}
+
+void CMeshWorkerPool::requestRemesh( const ChunkPos &position )
+{
+	std::lock_guard<std::mutex> lock( m_jobMutex );
+	m_remeshRequests.push_back( position );
+}
+
+void CMeshWorkerPool::takeRemeshRequests( std::vector<ChunkPos> &positions )
+{
+	std::lock_guard<std::mutex> lock( m_jobMutex );
+	positions.insert( positions.end(), m_remeshRequests.begin(), m_remeshRequests.end() );
+	m_remeshRequests.clear();
+}
@@ -0,0 +1,876 @@
+#include <algorithm>
+#include <cstring>
+#include "gfx/nullbackend.h"
+#include "game.h"
+#include "logger.h"
+
+CNullRenderBackend::CNullRenderBackend( CGame *pGameHandle ) : m_pGameHandle( pGameHandle )
+{
+	m_stats = RenderBackendStats();
+	m_error = GL_NO_ERROR;
+	m_nextName = 1;
+
+	m_boundVertexArray = 0;
+	m_boundProgram = 0;
+	m_depthFunction = GL_LESS;
+	m_cullFace = GL_BACK;
+	m_frontFace = GL_CCW;
+}
+CNullRenderBackend::~CNullRenderBackend() {
+}
+
+bool CNullRenderBackend::initialize()
+{
+	m_pGameHandle->getLogger()->print( "Using the null render backend, nothing will be drawn" );
+	return true;
+}
+void CNullRenderBackend::shutdown()
+{
+	if( !m_buffers.empty() || !m_vertexArrays.empty() || !m_programs.empty() )
+		m_pGameHandle->getLogger()->printWarn( "Null render backend shut down with %u buffers, %u vertex arrays and %u programs not deleted",
+			(unsigned int)m_buffers.size(), (unsigned int)m_vertexArrays.size(), (unsigned int)m_programs.size() );
+
+	m_buffers.clear();
+	m_vertexArrays.clear();
+	m_shaders.clear();
+	m_programs.clear();
+	m_syncs.clear();
+	m_boundBuffers.clear();
+	m_boundVertexArray = 0;
+	m_boundProgram = 0;
+	m_capabilities.clear();
+}
+
+void CNullRenderBackend::endFrame() {
+	m_stats.frameCount++;
+}
+
+void CNullRenderBackend::setError( GLenum error, const char *pCommand, const char *pReason )
+{
+	m_stats.errorCount++;
+	if( m_error == GL_NO_ERROR )
+		m_error = error;
+	m_pGameHandle->getLogger()->printWarn( "Null render backend: %s gives GL error 0x%04X, %s", pCommand, error, pReason );
+}
+GLenum CNullRenderBackend::getError()
+{
+	GLenum error = m_error;
+	m_error = GL_NO_ERROR;
+	return error;
+}
+void CNullRenderBackend::getIntegerv( GLenum name, GLint *pValue )
+{
+	m_stats.commandCount++;
+	switch( name )
+	{
+	case GL_MAX_VERTEX_ATTRIBS:
+		*pValue = NULL_BACKEND_MAX_VERTEX_ATTRIBS;
+		break;
+	case GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT:
+		*pValue = NULL_BACKEND_UNIFORM_BUFFER_OFFSET_ALIGNMENT;
+		break;
+	case GL_NUM_PROGRAM_BINARY_FORMATS:
+		*pValue = 1;
+		break;
+	default:
+		this->setError( GL_INVALID_ENUM, "glGetIntegerv", "the parameter name is not supported" );
+		break;
+	}
+}
+const char* CNullRenderBackend::getString( GLenum name )
+{
+	m_stats.commandCount++;
+	switch( name )
+	{
+	case GL_VENDOR:
+		return "None";
+	case GL_RENDERER:
+		return "Null";
+	case GL_VERSION:
+		return "4.6 Null";
+	default:
+		this->setError( GL_INVALID_ENUM, "glGetString", "the parameter name is not supported" );
+		return 0;
+	}
+}
+
+GLuint CNullRenderBackend::getBoundBuffer( GLenum target ) const
+{
+	if( target == GL_ELEMENT_ARRAY_BUFFER ) {
+		auto it = m_vertexArrays.find( m_boundVertexArray );
+		return it == m_vertexArrays.end() ? 0 : it->second.elementBuffer;
+	}
+	auto it = m_boundBuffers.find( target );
+	return it == m_boundBuffers.end() ? 0 : it->second;
+}
+CNullRenderBackend::NullBuffer* CNullRenderBackend::getTargetBuffer( GLenum target, const char *pCommand )
+{
+	auto it = m_buffers.find( this->getBoundBuffer( target ) );
+	if( it == m_buffers.end() ) {
+		this->setError( GL_INVALID_OPERATION, pCommand, "no buffer is bound to the target" );
+		return 0;
+	}
+	return &it->second;
+}
+
+bool CNullRenderBackend::validateDraw( const char *pCommand )
+{
+	if( !m_boundProgram ) {
+		this->setError( GL_INVALID_OPERATION, pCommand, "no program is in use" );
+		return false;
+	}
+	if( !m_boundVertexArray ) {
+		this->setError( GL_INVALID_OPERATION, pCommand, "no vertex array is bound" );
+		return false;
+	}
+	return true;
+}
+bool CNullRenderBackend::validateElementDraw( GLsizei count, GLenum type, const void *pIndices, const char *pCommand )
+{
+	if( count < 0 ) {
+		this->setError( GL_INVALID_VALUE, pCommand, "the count is negative" );
+		return false;
+	}
+	GLsizeiptr indexSize;
+	switch( type )
+	{
+	case GL_UNSIGNED_BYTE:
+		indexSize = 1;
+		break;
+	case GL_UNSIGNED_SHORT:
+		indexSize = 2;
+		break;
+	case GL_UNSIGNED_INT:
+		indexSize = 4;
+		break;
+	default:
+		this->setError( GL_INVALID_ENUM, pCommand, "the index type is not valid" );
+		return false;
+	}
+	if( !this->validateDraw( pCommand ) )
+		return false;
+
+	auto it = m_buffers.find( this->getBoundBuffer( GL_ELEMENT_ARRAY_BUFFER ) );
+	if( it == m_buffers.end() ) {
+		this->setError( GL_INVALID_OPERATION, pCommand, "the vertex array has no element buffer" );
+		return false;
+	}
+	// OpenGL does not check this, but it reads past the end of the buffer
+	if( (GLsizeiptr)(size_t)pIndices + count*indexSize > it->second.size ) {
+		this->setError( GL_INVALID_OPERATION, pCommand, "the indices run past the end of the element buffer" );
+		return false;
+	}
+	return true;
+}
+bool CNullRenderBackend::validateAttrib( GLuint index, bool needsBuffer, const char *pCommand )
+{
+	if( index >= NULL_BACKEND_MAX_VERTEX_ATTRIBS ) {
+		this->setError( GL_INVALID_VALUE, pCommand, "the attribute index is too large" );
+		return false;
+	}
+	if( !m_boundVertexArray ) {
+		this->setError( GL_INVALID_OPERATION, pCommand, "no vertex array is bound" );
+		return false;
+	}
+	if( needsBuffer && !this->getBoundBuffer( GL_ARRAY_BUFFER ) ) {
+		this->setError( GL_INVALID_OPERATION, pCommand, "no array buffer is bound" );
+		return false;
+	}
+	return true;
+}
+bool CNullRenderBackend::validateUniform( GLint location, const char *pCommand )
+{
+	// Location -1 is silently ignored
+	if( location == -1 )
+		return false;
+	auto it = m_programs.find( m_boundProgram );
+	if( it == m_programs.end() ) {
+		this->setError( GL_INVALID_OPERATION, pCommand, "no program is in use" );
+		return false;
+	}
+	for( auto &uniform: it->second.uniformLocations ) {
+		if( uniform.second == location )
+			return true;
+	}
+	this->setError( GL_INVALID_OPERATION, pCommand, "the location is not a uniform of the program in use" );
+	return false;
+}
+
+void CNullRenderBackend::enable( GLenum capability )
+{
+	m_stats.commandCount++;
+	bool &enabled = m_capabilities[capability];
+	this->changeState( enabled );
+	enabled = true;
+}
+void CNullRenderBackend::disable( GLenum capability )
+{
+	m_stats.commandCount++;
+	bool &enabled = m_capabilities[capability];
+	this->changeState( !enabled );
+	enabled = false;
+}
+void CNullRenderBackend::depthFunc( GLenum function )
+{
+	m_stats.commandCount++;
+	this->changeState( function == m_depthFunction );
+	m_depthFunction = function;
+}
+void CNullRenderBackend::cullFace( GLenum face )
+{
+	m_stats.commandCount++;
+	this->changeState( face == m_cullFace );
+	m_cullFace = face;
+}
+void CNullRenderBackend::frontFace( GLenum winding )
+{
+	m_stats.commandCount++;
+	this->changeState( winding == m_frontFace );
+	m_frontFace = winding;
+}
+void CNullRenderBackend::pointSize( GLfloat size )
+{
+	m_stats.commandCount++;
+	if( size <= 0.0f )
+		this->setError( GL_INVALID_VALUE, "glPointSize", "the size is not positive" );
+	else
+		this->changeState( false );
+}
+void CNullRenderBackend::clearColor( GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha )
+{
+	m_stats.commandCount++;
+	this->changeState( false );
+}
+void CNullRenderBackend::clear( GLbitfield mask ) {
+	m_stats.commandCount++;
+}
+
+void CNullRenderBackend::genBuffers( GLsizei count, GLuint *pBuffers )
+{
+	m_stats.commandCount++;
+	for( GLsizei i = 0; i < count; i++ ) {
+		pBuffers[i] = m_nextName++;
+		m_buffers[pBuffers[i]] = { 0, false, 0, false };
+	}
+}
+void CNullRenderBackend::deleteBuffers( GLsizei count, const GLuint *pBuffers )
+{
+	m_stats.commandCount++;
+	for( GLsizei i = 0; i < count; i++ )
+	{
+		// Unused names are ignored, deleted buffers are unbound from everywhere
+		if( !m_buffers.erase( pBuffers[i] ) )
+			continue;
+		for( auto &it: m_boundBuffers ) {
+			if( it.second == pBuffers[i] )
+				it.second = 0;
+		}
+		for( auto &it: m_vertexArrays ) {
+			if( it.second.elementBuffer == pBuffers[i] )
+				it.second.elementBuffer = 0;
+		}
+	}
+}
+void CNullRenderBackend::bindBuffer( GLenum target, GLuint buffer )
+{
+	m_stats.commandCount++;
+	if( buffer && !m_buffers.count( buffer ) ) {
+		this->setError( GL_INVALID_OPERATION, "glBindBuffer", "the buffer was not generated" );
+		return;
+	}
+	this->changeState( this->getBoundBuffer( target ) == buffer );
+	if( target == GL_ELEMENT_ARRAY_BUFFER && m_boundVertexArray )
+		m_vertexArrays[m_boundVertexArray].elementBuffer = buffer;
+	else
+		m_boundBuffers[target] = buffer;
+}
+void CNullRenderBackend::bindBufferRange( GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size )
+{
+	m_stats.commandCount++;
+	auto it = m_buffers.find( buffer );
+	if( it == m_buffers.end() ) {
+		this->setError( GL_INVALID_OPERATION, "glBindBufferRange", "the buffer was not generated" );
+		return;
+	}
+	if( offset < 0 || size <= 0 || offset + size > it->second.size ) {
+		this->setError( GL_INVALID_VALUE, "glBindBufferRange", "the range is outside the buffer" );
+		return;
+	}
+	if( target == GL_UNIFORM_BUFFER && offset % NULL_BACKEND_UNIFORM_BUFFER_OFFSET_ALIGNMENT != 0 ) {
+		this->setError( GL_INVALID_VALUE, "glBindBufferRange", "the offset is not a multiple of the uniform buffer offset alignment" );
+		return;
+	}
+	// Binds the generic target too
+	this->changeState( false );
+	m_boundBuffers[target] = buffer;
+}
+void CNullRenderBackend::bufferData( GLenum target, GLsizeiptr size, const void *pData, GLenum usage )
+{
+	m_stats.commandCount++;
+	NullBuffer *pBuffer = this->getTargetBuffer( target, "glBufferData" );
+	if( !pBuffer )
+		return;
+	if( pBuffer->immutable ) {
+		this->setError( GL_INVALID_OPERATION, "glBufferData", "the buffer has immutable storage" );
+		return;
+	}
+	if( size < 0 ) {
+		this->setError( GL_INVALID_VALUE, "glBufferData", "the size is negative" );
+		return;
+	}
+	pBuffer->size = size;
+	if( pData )
+		m_stats.uploadedBytes += size;
+}
+void CNullRenderBackend::bufferStorage( GLenum target, GLsizeiptr size, const void *pData, GLbitfield flags )
+{
+	m_stats.commandCount++;
+	NullBuffer *pBuffer = this->getTargetBuffer( target, "glBufferStorage" );
+	if( !pBuffer )
+		return;
+	if( pBuffer->immutable ) {
+		this->setError( GL_INVALID_OPERATION, "glBufferStorage", "the buffer has immutable storage" );
+		return;
+	}
+	if( size <= 0 ) {
+		this->setError( GL_INVALID_VALUE, "glBufferStorage", "the size is not positive" );
+		return;
+	}
+	pBuffer->size = size;
+	pBuffer->immutable = true;
+	pBuffer->storageFlags = flags;
+	if( pData )
+		m_stats.uploadedBytes += size;
+}
+void CNullRenderBackend::bufferSubData( GLenum target, GLintptr offset, GLsizeiptr size, const void *pData )
+{
+	m_stats.commandCount++;
+	NullBuffer *pBuffer = this->getTargetBuffer( target, "glBufferSubData" );
+	if( !pBuffer )
+		return;
+	if( offset < 0 || size < 0 || offset + size > pBuffer->size ) {
+		this->setError( GL_INVALID_VALUE, "glBufferSubData", "the range is outside the buffer" );
+		return;
+	}
+	if( pBuffer->immutable && !(pBuffer->storageFlags & GL_DYNAMIC_STORAGE_BIT) ) {
+		this->setError( GL_INVALID_OPERATION, "glBufferSubData", "the buffer storage is not dynamic" );
+		return;
+	}
+	if( pBuffer->mapped && !(pBuffer->storageFlags & GL_MAP_PERSISTENT_BIT) ) {
+		this->setError( GL_INVALID_OPERATION, "glBufferSubData", "the buffer is mapped" );
+		return;
+	}
+	m_stats.uploadedBytes += size;
+}
+void* CNullRenderBackend::mapBufferRange( GLenum target, GLintptr offset, GLsizeiptr length, GLbitfield access )
+{
+	m_stats.commandCount++;
+	NullBuffer *pBuffer = this->getTargetBuffer( target, "glMapBufferRange" );
+	if( !pBuffer )
+		return 0;
+	if( offset < 0 || length <= 0 || offset + length > pBuffer->size ) {
+		this->setError( GL_INVALID_VALUE, "glMapBufferRange", "the range is outside the buffer" );
+		return 0;
+	}
+	if( pBuffer->mapped ) {
+		this->setError( GL_INVALID_OPERATION, "glMapBufferRange", "the buffer is already mapped" );
+		return 0;
+	}
+	// Immutable storage must have been made with every map bit asked for
+	const GLbitfield storageBits = GL_MAP_READ_BIT | GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	if( pBuffer->immutable && (access & storageBits & ~pBuffer->storageFlags) ) {
+		this->setError( GL_INVALID_OPERATION, "glMapBufferRange", "the buffer storage is missing map flags" );
+		return 0;
+	}
+	if( !(access & (GL_MAP_READ_BIT | GL_MAP_WRITE_BIT)) ) {
+		this->setError( GL_INVALID_OPERATION, "glMapBufferRange", "neither read nor write access was asked for" );
+		return 0;
+	}
+	pBuffer->mapped = true;
+	pBuffer->mapping.assign( (size_t)length, 0 );
+	return &pBuffer->mapping[0];
+}
+GLboolean CNullRenderBackend::unmapBuffer( GLenum target )
+{
+	m_stats.commandCount++;
+	NullBuffer *pBuffer = this->getTargetBuffer( target, "glUnmapBuffer" );
+	if( !pBuffer )
+		return GL_FALSE;
+	if( !pBuffer->mapped ) {
+		this->setError( GL_INVALID_OPERATION, "glUnmapBuffer", "the buffer is not mapped" );
+		return GL_FALSE;
+	}
+	pBuffer->mapped = false;
+	pBuffer->mapping = std::vector<uint8_t>();
+	return GL_TRUE;
+}
+
+GLsync CNullRenderBackend::fenceSync( GLenum condition, GLbitfield flags )
+{
+	m_stats.commandCount++;
+	if( condition != GL_SYNC_GPU_COMMANDS_COMPLETE || flags != 0 ) {
+		this->setError( GL_INVALID_ENUM, "glFenceSync", "the condition or flags are not valid" );
+		return 0;
+	}
+	uintptr_t sync = m_nextName++;
+	m_syncs.insert( sync );
+	return (GLsync)sync;
+}
+GLenum CNullRenderBackend::clientWaitSync( GLsync sync, GLbitfield flags, GLuint64 timeout )
+{
+	m_stats.commandCount++;
+	if( !m_syncs.count( (uintptr_t)sync ) ) {
+		this->setError( GL_INVALID_VALUE, "glClientWaitSync", "the sync object does not exist" );
+		return GL_WAIT_FAILED;
+	}
+	// Nothing is ever pending
+	return GL_ALREADY_SIGNALED;
+}
+void CNullRenderBackend::deleteSync( GLsync sync )
+{
+	m_stats.commandCount++;
+	if( sync && !m_syncs.erase( (uintptr_t)sync ) )
+		this->setError( GL_INVALID_VALUE, "glDeleteSync", "the sync object does not exist" );
+}
+
+void CNullRenderBackend::genVertexArrays( GLsizei count, GLuint *pArrays )
+{
+	m_stats.commandCount++;
+	for( GLsizei i = 0; i < count; i++ ) {
+		pArrays[i] = m_nextName++;
+		m_vertexArrays[pArrays[i]] = { 0, 0 };
+	}
+}
+void CNullRenderBackend::deleteVertexArrays( GLsizei count, const GLuint *pArrays )
+{
+	m_stats.commandCount++;
+	for( GLsizei i = 0; i < count; i++ ) {
+		if( m_vertexArrays.erase( pArrays[i] ) && m_boundVertexArray == pArrays[i] )
+			m_boundVertexArray = 0;
+	}
+}
+void CNullRenderBackend::bindVertexArray( GLuint array )
+{
+	m_stats.commandCount++;
+	if( array && !m_vertexArrays.count( array ) ) {
+		this->setError( GL_INVALID_OPERATION, "glBindVertexArray", "the vertex array was not generated" );
+		return;
+	}
+	this->changeState( array == m_boundVertexArray );
+	m_boundVertexArray = array;
+}
+void CNullRenderBackend::vertexAttribPointer( GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride, const void *pPointer )
+{
+	m_stats.commandCount++;
+	if( this->validateAttrib( index, true, "glVertexAttribPointer" ) )
+		this->changeState( false );
+}
+void CNullRenderBackend::vertexAttribIPointer( GLuint index, GLint size, GLenum type, GLsizei stride, const void *pPointer )
+{
+	m_stats.commandCount++;
+	if( this->validateAttrib( index, true, "glVertexAttribIPointer" ) )
+		this->changeState( false );
+}
+void CNullRenderBackend::vertexAttribLPointer( GLuint index, GLint size, GLenum type, GLsizei stride, const void *pPointer )
+{
+	m_stats.commandCount++;
+	if( this->validateAttrib( index, true, "glVertexAttribLPointer" ) )
+		this->changeState( false );
+}
+void CNullRenderBackend::enableVertexAttribArray( GLuint index )
+{
+	m_stats.commandCount++;
+	if( !this->validateAttrib( index, false, "glEnableVertexAttribArray" ) )
+		return;
+	uint32_t &enabled = m_vertexArrays[m_boundVertexArray].enabledAttribs;
+	this->changeState( (enabled & (1u << index)) != 0 );
+	enabled |= 1u << index;
+}
+void CNullRenderBackend::vertexAttribDivisor( GLuint index, GLuint divisor )
+{
+	m_stats.commandCount++;
+	if( this->validateAttrib( index, false, "glVertexAttribDivisor" ) )
+		this->changeState( false );
+}
+void CNullRenderBackend::vertexAttrib3f( GLuint index, GLfloat x, GLfloat y, GLfloat z )
+{
+	m_stats.commandCount++;
+	if( index >= NULL_BACKEND_MAX_VERTEX_ATTRIBS ) {
+		this->setError( GL_INVALID_VALUE, "glVertexAttrib3f", "the attribute index is too large" );
+		return;
+	}
+	this->changeState( false );
+}
+
+GLuint CNullRenderBackend::createShader( GLenum type )
+{
+	m_stats.commandCount++;
+	switch( type )
+	{
+	case GL_VERTEX_SHADER:
+	case GL_TESS_CONTROL_SHADER:
+	case GL_TESS_EVALUATION_SHADER:
+	case GL_GEOMETRY_SHADER:
+	case GL_FRAGMENT_SHADER:
+	case GL_COMPUTE_SHADER:
+		break;
+	default:
+		this->setError( GL_INVALID_ENUM, "glCreateShader", "the shader type is not valid" );
+		return 0;
+	}
+	GLuint shader = m_nextName++;
+	m_shaders[shader] = { type, std::string(), false };
+	return shader;
+}
+void CNullRenderBackend::deleteShader( GLuint shader )
+{
+	m_stats.commandCount++;
+	m_shaders.erase( shader );
+	for( auto &it: m_programs )
+		it.second.shaders.erase( std::remove( it.second.shaders.begin(), it.second.shaders.end(), shader ), it.second.shaders.end() );
+}
+void CNullRenderBackend::shaderSource( GLuint shader, const GLchar *pSource )
+{
+	m_stats.commandCount++;
+	auto it = m_shaders.find( shader );
+	if( it == m_shaders.end() ) {
+		this->setError( GL_INVALID_VALUE, "glShaderSource", "the shader was not created" );
+		return;
+	}
+	it->second.source = pSource ? pSource : "";
+}
+void CNullRenderBackend::compileShader( GLuint shader )
+{
+	m_stats.commandCount++;
+	auto it = m_shaders.find( shader );
+	if( it == m_shaders.end() ) {
+		this->setError( GL_INVALID_VALUE, "glCompileShader", "the shader was not created" );
+		return;
+	}
+	it->second.compiled = !it->second.source.empty();
+}
+void CNullRenderBackend::getShaderiv( GLuint shader, GLenum name, GLint *pValue )
+{
+	m_stats.commandCount++;
+	auto it = m_shaders.find( shader );
+	if( it == m_shaders.end() ) {
+		this->setError( GL_INVALID_VALUE, "glGetShaderiv", "the shader was not created" );
+		return;
+	}
+	switch( name )
+	{
+	case GL_SHADER_TYPE:
+		*pValue = (GLint)it->second.type;
+		break;
+	case GL_COMPILE_STATUS:
+		*pValue = it->second.compiled ? GL_TRUE : GL_FALSE;
+		break;
+	case GL_SHADER_SOURCE_LENGTH:
+		*pValue = it->second.source.empty() ? 0 : (GLint)it->second.source.size() + 1;
+		break;
+	case GL_INFO_LOG_LENGTH:
+		*pValue = 0;
+		break;
+	default:
+		this->setError( GL_INVALID_ENUM, "glGetShaderiv", "the parameter name is not supported" );
+		break;
+	}
+}
+void CNullRenderBackend::getShaderInfoLog( GLuint shader, GLsizei maxLength, GLsizei *pLength, GLchar *pLog )
+{
+	m_stats.commandCount++;
+	if( pLength )
+		*pLength = 0;
+	if( maxLength > 0 )
+		pLog[0] = 0;
+}
+GLuint CNullRenderBackend::createProgram()
+{
+	m_stats.commandCount++;
+	GLuint program = m_nextName++;
+	m_programs[program] = NullProgram();
+	return program;
+}
+void CNullRenderBackend::deleteProgram( GLuint program )
+{
+	m_stats.commandCount++;
+	if( m_programs.erase( program ) && m_boundProgram == program )
+		m_boundProgram = 0;
+}
+void CNullRenderBackend::attachShader( GLuint program, GLuint shader )
+{
+	m_stats.commandCount++;
+	auto it = m_programs.find( program );
+	if( it == m_programs.end() || !m_shaders.count( shader ) ) {
+		this->setError( GL_INVALID_VALUE, "glAttachShader", "the program or shader was not created" );
+		return;
+	}
+	if( std::find( it->second.shaders.begin(), it->second.shaders.end(), shader ) != it->second.shaders.end() ) {
+		this->setError( GL_INVALID_OPERATION, "glAttachShader", "the shader is already attached" );
+		return;
+	}
+	it->second.shaders.push_back( shader );
+}
+void CNullRenderBackend::detachShader( GLuint program, GLuint shader )
+{
+	m_stats.commandCount++;
+	auto it = m_programs.find( program );
+	if( it == m_programs.end() ) {
+		this->setError( GL_INVALID_VALUE, "glDetachShader", "the program was not created" );
+		return;
+	}
+	auto shaderIt = std::find( it->second.shaders.begin(), it->second.shaders.end(), shader );
+	if( shaderIt == it->second.shaders.end() ) {
+		this->setError( GL_INVALID_OPERATION, "glDetachShader", "the shader is not attached" );
+		return;
+	}
+	it->second.shaders.erase( shaderIt );
+}
+void CNullRenderBackend::linkProgram( GLuint program )
+{
+	m_stats.commandCount++;
+	auto it = m_programs.find( program );
+	if( it == m_programs.end() ) {
+		this->setError( GL_INVALID_VALUE, "glLinkProgram", "the program was not created" );
+		return;
+	}
+
+	NullProgram &nullProgram = it->second;
+	bool hasVertexShader = false;
+	nullProgram.linked = true;
+	nullProgram.linkedSource.clear();
+	nullProgram.uniformLocations.clear();
+	nullProgram.blockIndices.clear();
+	for( auto shader: nullProgram.shaders ) {
+		const NullShader &nullShader = m_shaders[shader];
+		hasVertexShader |= nullShader.type == GL_VERTEX_SHADER;
+		nullProgram.linked &= nullShader.compiled;
+		nullProgram.linkedSource += nullShader.source;
+	}
+	nullProgram.linked &= hasVertexShader;
+}
+void CNullRenderBackend::getProgramiv( GLuint program, GLenum name, GLint *pValue )
+{
+	m_stats.commandCount++;
+	auto it = m_programs.find( program );
+	if( it == m_programs.end() ) {
+		this->setError( GL_INVALID_VALUE, "glGetProgramiv", "the program was not created" );
+		return;
+	}
+	switch( name )
+	{
+	case GL_LINK_STATUS:
+		*pValue = it->second.linked ? GL_TRUE : GL_FALSE;
+		break;
+	case GL_ATTACHED_SHADERS:
+		*pValue = (GLint)it->second.shaders.size();
+		break;
+	case GL_INFO_LOG_LENGTH:
+		*pValue = 0;
+		break;
+	case GL_PROGRAM_BINARY_LENGTH:
+		*pValue = it->second.linked ? (GLint)it->second.linkedSource.size() : 0;
+		break;
+	default:
+		this->setError( GL_INVALID_ENUM, "glGetProgramiv", "the parameter name is not supported" );
+		break;
+	}
+}
+void CNullRenderBackend::getProgramInfoLog( GLuint program, GLsizei maxLength, GLsizei *pLength, GLchar *pLog )
+{
+	m_stats.commandCount++;
+	if( pLength )
+		*pLength = 0;
+	if( maxLength > 0 )
+		pLog[0] = 0;
+}
+void CNullRenderBackend::useProgram( GLuint program )
+{
+	m_stats.commandCount++;
+	if( program ) {
+		auto it = m_programs.find( program );
+		if( it == m_programs.end() || !it->second.linked ) {
+			this->setError( GL_INVALID_OPERATION, "glUseProgram", "the program is not linked" );
+			return;
+		}
+	}
+	this->changeState( program == m_boundProgram );
+	m_boundProgram = program;
+}
+void CNullRenderBackend::programParameteri( GLuint program, GLenum name, GLint value )
+{
+	m_stats.commandCount++;
+	if( !m_programs.count( program ) ) {
+		this->setError( GL_INVALID_VALUE, "glProgramParameteri", "the program was not created" );
+		return;
+	}
+	if( name != GL_PROGRAM_BINARY_RETRIEVABLE_HINT ) {
+		this->setError( GL_INVALID_ENUM, "glProgramParameteri", "the parameter name is not supported" );
+		return;
+	}
+	if( value != GL_FALSE && value != GL_TRUE )
+		this->setError( GL_INVALID_VALUE, "glProgramParameteri", "the value is not GL_FALSE or GL_TRUE" );
+}
+void CNullRenderBackend::getProgramBinary( GLuint program, GLsizei bufferSize, GLsizei *pLength, GLenum *pFormat, void *pBinary )
+{
+	m_stats.commandCount++;
+	auto it = m_programs.find( program );
+	if( it == m_programs.end() ) {
+		this->setError( GL_INVALID_VALUE, "glGetProgramBinary", "the program was not created" );
+		return;
+	}
+	const NullProgram &nullProgram = it->second;
+	if( !nullProgram.linked ) {
+		this->setError( GL_INVALID_OPERATION, "glGetProgramBinary", "the program is not linked" );
+		return;
+	}
+	if( bufferSize < (GLsizei)nullProgram.linkedSource.size() ) {
+		this->setError( GL_INVALID_OPERATION, "glGetProgramBinary", "the buffer is smaller than the binary" );
+		return;
+	}
+	std::memcpy( pBinary, nullProgram.linkedSource.data(), nullProgram.linkedSource.size() );
+	if( pLength )
+		*pLength = (GLsizei)nullProgram.linkedSource.size();
+	*pFormat = NULL_BACKEND_PROGRAM_BINARY_FORMAT;
+}
+void CNullRenderBackend::programBinary( GLuint program, GLenum format, const void *pBinary, GLsizei length )
+{
+	m_stats.commandCount++;
+	auto it = m_programs.find( program );
+	if( it == m_programs.end() ) {
+		this->setError( GL_INVALID_VALUE, "glProgramBinary", "the program was not created" );
+		return;
+	}
+	if( format != NULL_BACKEND_PROGRAM_BINARY_FORMAT ) {
+		this->setError( GL_INVALID_ENUM, "glProgramBinary", "the binary format is not supported" );
+		return;
+	}
+	// Like a link, a binary that cannot be loaded leaves the program unlinked rather than raising an error
+	NullProgram &nullProgram = it->second;
+	nullProgram.linkedSource.assign( (const char*)pBinary, (size_t)length );
+	nullProgram.linked = !nullProgram.linkedSource.empty();
+	nullProgram.uniformLocations.clear();
+	nullProgram.blockIndices.clear();
+}
+
+GLint CNullRenderBackend::getUniformLocation( GLuint program, const GLchar *pName )
+{
+	m_stats.commandCount++;
+	auto it = m_programs.find( program );
+	if( it == m_programs.end() || !it->second.linked ) {
+		this->setError( GL_INVALID_OPERATION, "glGetUniformLocation", "the program is not linked" );
+		return -1;
+	}
+	NullProgram &nullProgram = it->second;
+	if( nullProgram.linkedSource.find( pName ) == std::string::npos )
+		return -1;
+	auto inserted = nullProgram.uniformLocations.insert( std::pair<std::string, GLint>( pName, (GLint)nullProgram.uniformLocations.size() ) );
+	return inserted.first->second;
+}
+GLuint CNullRenderBackend::getUniformBlockIndex( GLuint program, const GLchar *pName )
+{
+	m_stats.commandCount++;
+	auto it = m_programs.find( program );
+	if( it == m_programs.end() || !it->second.linked ) {
+		this->setError( GL_INVALID_OPERATION, "glGetUniformBlockIndex", "the program is not linked" );
+		return GL_INVALID_INDEX;
+	}
+	NullProgram &nullProgram = it->second;
+	if( nullProgram.linkedSource.find( pName ) == std::string::npos )
+		return GL_INVALID_INDEX;
+	auto inserted = nullProgram.blockIndices.insert( std::pair<std::string, GLuint>( pName, (GLuint)nullProgram.blockIndices.size() ) );
+	return inserted.first->second;
+}
+void CNullRenderBackend::uniformBlockBinding( GLuint program, GLuint blockIndex, GLuint binding )
+{
+	m_stats.commandCount++;
+	auto it = m_programs.find( program );
+	if( it == m_programs.end() ) {
+		this->setError( GL_INVALID_VALUE, "glUniformBlockBinding", "the program was not created" );
+		return;
+	}
+	if( blockIndex >= it->second.blockIndices.size() ) {
+		this->setError( GL_INVALID_VALUE, "glUniformBlockBinding", "the block index is not a block of the program" );
+		return;
+	}
+	this->changeState( false );
+}
+void CNullRenderBackend::uniform3fv( GLint location, GLsizei count, const GLfloat *pValue )
+{
+	m_stats.commandCount++;
+	if( this->validateUniform( location, "glUniform3fv" ) )
+		this->changeState( false );
+}
+void CNullRenderBackend::uniformMatrix4fv( GLint location, GLsizei count, GLboolean transpose, const GLfloat *pValue )
+{
+	m_stats.commandCount++;
+	if( this->validateUniform( location, "glUniformMatrix4fv" ) )
+		this->changeState( false );
+}
+
+void CNullRenderBackend::drawArrays( GLenum mode, GLint first, GLsizei count )
+{
+	m_stats.commandCount++;
+	if( first < 0 || count < 0 ) {
+		this->setError( GL_INVALID_VALUE, "glDrawArrays", "the range is negative" );
+		return;
+	}
+	if( !this->validateDraw( "glDrawArrays" ) )
+		return;
+	m_stats.drawCount++;
+	m_stats.vertexCount += count;
+}
+void CNullRenderBackend::drawElements( GLenum mode, GLsizei count, GLenum type, const void *pIndices )
+{
+	m_stats.commandCount++;
+	if( !this->validateElementDraw( count, type, pIndices, "glDrawElements" ) )
+		return;
+	m_stats.drawCount++;
+	m_stats.vertexCount += count;
+}
+void CNullRenderBackend::drawElementsBaseVertex( GLenum mode, GLsizei count, GLenum type, const void *pIndices, GLint baseVertex )
+{
+	m_stats.commandCount++;
+	if( !this->validateElementDraw( count, type, pIndices, "glDrawElementsBaseVertex" ) )
+		return;
+	m_stats.drawCount++;
+	m_stats.vertexCount += count;
+}
+void CNullRenderBackend::drawElementsInstanced( GLenum mode, GLsizei count, GLenum type, const void *pIndices, GLsizei instanceCount )
+{
+	m_stats.commandCount++;
+	if( instanceCount < 0 ) {
+		this->setError( GL_INVALID_VALUE, "glDrawElementsInstanced", "the instance count is negative" );
+		return;
+	}
+	if( !this->validateElementDraw( count, type, pIndices, "glDrawElementsInstanced" ) )
+		return;
+	m_stats.drawCount++;
+	m_stats.vertexCount += (uint64_t)count * instanceCount;
+}
+void CNullRenderBackend::multiDrawElementsIndirect( GLenum mode, GLenum type, const void *pIndirect, GLsizei drawCount, GLsizei stride )
+{
+	// The commands are not kept, so the indices they draw cannot be checked
+	const GLsizeiptr commandSize = 5*sizeof( GLuint );
+
+	m_stats.commandCount++;
+	if( drawCount < 0 || (stride != 0 && stride < commandSize) || (stride % 4) != 0 ) {
+		this->setError( GL_INVALID_VALUE, "glMultiDrawElementsIndirect", "the draw count or stride is not valid" );
+		return;
+	}
+	if( !this->validateElementDraw( 0, type, 0, "glMultiDrawElementsIndirect" ) )
+		return;
+	NullBuffer *pIndirectBuffer = this->getTargetBuffer( GL_DRAW_INDIRECT_BUFFER, "glMultiDrawElementsIndirect" );
+	if( !pIndirectBuffer )
+		return;
+	if( ((size_t)pIndirect % 4) != 0 ) {
+		this->setError( GL_INVALID_VALUE, "glMultiDrawElementsIndirect", "the command offset is not a multiple of 4" );
+		return;
+	}
+	GLsizeiptr end = drawCount ? (GLsizeiptr)(size_t)pIndirect + (drawCount - 1)*(stride ? stride : commandSize) + commandSize : 0;
+	if( end > pIndirectBuffer->size ) {
+		this->setError( GL_INVALID_OPERATION, "glMultiDrawElementsIndirect", "the commands run past the end of the draw indirect buffer" );
+		return;
+	}
+	m_stats.drawCount++;
+}
@@ -0,0 +1,347 @@
+#include <assert.h>
+#include <cmath>
+#include <algorithm>
+#include <chrono>
+#include <glm/ext.hpp>
+#include "gfx/occlusion.h"
+
+#if defined( __SSE__ ) || defined( _M_X64 ) || (defined( _M_IX86_FP ) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define OCCLUSION_SIMD
+#endif
+
+static_assert(OCCLUSION_BUFFER_HEIGHT % OCCLUSION_BAND_HEIGHT == 0, "Bands must cover the buffer");
+static_assert((OCCLUSION_BAND_HEIGHT >> (OCCLUSION_LEVEL_COUNT-1)) >= 1, "Every level needs a row in each band");
+static_assert((OCCLUSION_BUFFER_WIDTH >> (OCCLUSION_LEVEL_COUNT-1)) >= 1, "Every level needs a column");
+static_assert(OCCLUSION_POLYGON_EDGES == 4, "The rasterizer tests four edges");
+
+#define OCCLUSION_BAND_COUNT (OCCLUSION_BUFFER_HEIGHT / OCCLUSION_BAND_HEIGHT)
+
+/** Buffer pixel coordinates of a clip space point in front of the near plane, rows run top to bottom */
+static inline glm::vec3 ClipToBuffer( const glm::vec4 &clip )
+{
+	float inverseW = 1.0f / clip.w;
+	return glm::vec3( (clip.x*inverseW*0.5f + 0.5f) * OCCLUSION_BUFFER_WIDTH,
+		(0.5f - clip.y*inverseW*0.5f) * OCCLUSION_BUFFER_HEIGHT, clip.z*inverseW );
+}
+
+COcclusionCuller::COcclusionCuller()
+{
+	m_viewProjection = glm::mat4( 1.0f );
+	m_occluderCount = 0;
+	for( uint32_t level = 0; level < OCCLUSION_LEVEL_COUNT; level++ )
+		m_levels[level].resize( (OCCLUSION_BUFFER_WIDTH >> level) * (OCCLUSION_BUFFER_HEIGHT >> level), 1.0f );
+	m_stats = OcclusionStats();
+	m_frameSeconds = 0.0;
+}
+COcclusionCuller::~COcclusionCuller() {
+}
+
+bool COcclusionCuller::initialize() {
+	return m_threadPool.initialize( OCCLUSION_THREAD_COUNT );
+}
+void COcclusionCuller::shutdown()
+{
+	m_threadPool.shutdown();
+	m_polygons.clear();
+}
+
+void COcclusionCuller::finishFrameStats()
+{
+	m_stats.maxFrameSeconds = std::max( m_stats.maxFrameSeconds, m_frameSeconds );
+	if( m_frameSeconds * 1000.0 > OCCLUSION_FRAME_BUDGET_MS )
+		m_stats.overBudgetCount++;
+	m_frameSeconds = 0.0;
+}
+
+void COcclusionCuller::beginFrame( const glm::mat4 &viewProjection )
+{
+	// The previous frame ends here, its boxes are tested after it is drawn
+	if( m_stats.frameCount > 0 )
+		this->finishFrameStats();
+
+	m_viewProjection = viewProjection;
+	m_polygons.clear();
+	m_occluderCount = 0;
+	// Only the full buffer needs clearing, every higher level is rebuilt from it
+	std::fill( m_levels[0].begin(), m_levels[0].end(), 1.0f );
+}
+
+bool COcclusionCuller::addOccluder( const glm::vec3 *pCorners )
+{
+	assert( pCorners );
+
+	if( m_occluderCount >= OCCLUSION_MAX_OCCLUDERS )
+		return false;
+	m_occluderCount++;
+
+	glm::vec4 clip[4];
+	for( uint32_t i = 0; i < 4; i++ )
+		clip[i] = m_viewProjection * glm::vec4( pCorners[i].x, pCorners[i].y, pCorners[i].z, 1.0f );
+	this->addClipQuad( clip );
+
+	return true;
+}
+
+void COcclusionCuller::addClipQuad( const glm::vec4 *pCorners )
+{
+	// Keep the part in front of the near plane, where z >= -w
+	glm::vec4 clipped[5];
+	uint32_t clippedCount = 0;
+	for( uint32_t i = 0; i < 4; i++ )
+	{
+		const glm::vec4 &current = pCorners[i], &next = pCorners[(i + 1) % 4];
+		float currentDistance = current.z + current.w, nextDistance = next.z + next.w;
+		if( currentDistance >= 0.0f )
+			clipped[clippedCount++] = current;
+		if( (currentDistance >= 0.0f) != (nextDistance >= 0.0f) ) {
+			float t = currentDistance / (currentDistance - nextDistance);
+			clipped[clippedCount++] = current + (next - current) * t;
+		}
+	}
+	if( clippedCount < 3 )
+		return;
+
+	glm::vec3 screen[5];
+	for( uint32_t i = 0; i < clippedCount; i++ ) {
+		if( clipped[i].w <= 0.0f )
+			return;
+		screen[i] = ClipToBuffer( clipped[i] );
+	}
+	// Drawn whole, splitting it would leave the pixels along the split covered by neither part.
+	// Only a quad cut across one corner by the near plane has a fifth corner.
+	if( clippedCount <= OCCLUSION_POLYGON_EDGES )
+		this->setupPolygon( screen, clippedCount );
+	else {
+		this->setupPolygon( screen, 4 );
+		const glm::vec3 rest[3] = { screen[0], screen[3], screen[4] };
+		this->setupPolygon( rest, 3 );
+	}
+}
+
+void COcclusionCuller::setupPolygon( const glm::vec3 *pVertices, uint32_t count )
+{
+	assert( count >= 3 && count <= OCCLUSION_POLYGON_EDGES );
+
+	glm::vec3 v[OCCLUSION_POLYGON_EDGES];
+	float area = 0.0f;
+	for( uint32_t i = 0; i < count; i++ ) {
+		v[i] = pVertices[i];
+		area += pVertices[i].x*pVertices[(i + 1) % count].y - pVertices[(i + 1) % count].x*pVertices[i].y;
+	}
+	if( std::fabs( area ) < 1e-6f )
+		return;
+	if( area < 0.0f )
+		std::reverse( v, v + count );
+
+	// Only pixels entirely inside can be written, pixel x covers x to x + 1
+	OccluderPolygon polygon;
+	glm::vec3 screenMin = v[0], screenMax = v[0];
+	for( uint32_t i = 1; i < count; i++ ) {
+		screenMin = glm::min( screenMin, v[i] );
+		screenMax = glm::max( screenMax, v[i] );
+	}
+	polygon.minX = std::max( (int32_t)std::ceil( screenMin.x ), 0 );
+	polygon.minY = std::max( (int32_t)std::ceil( screenMin.y ), 0 );
+	polygon.maxX = std::min( (int32_t)std::floor( screenMax.x ) - 1, OCCLUSION_BUFFER_WIDTH-1 );
+	polygon.maxY = std::min( (int32_t)std::floor( screenMax.y ) - 1, OCCLUSION_BUFFER_HEIGHT-1 );
+	if( polygon.minX > polygon.maxX || polygon.minY > polygon.maxY )
+		return;
+
+	// Edge functions at pixel centers, moved in by the most a pixel corner can be further out than its center.
+	// A triangle leaves its last edge always passing.
+	for( uint32_t i = 0; i < OCCLUSION_POLYGON_EDGES; i++ )
+	{
+		if( i >= count ) {
+			polygon.edgeA[i] = 0.0f;
+			polygon.edgeB[i] = 0.0f;
+			polygon.edgeC[i] = 1.0f;
+			continue;
+		}
+		const glm::vec3 &from = v[i], &to = v[(i + 1) % count];
+		float edgeA = from.y - to.y, edgeB = to.x - from.x;
+		polygon.edgeA[i] = edgeA;
+		polygon.edgeB[i] = edgeB;
+		polygon.edgeC[i] = from.x*to.y - to.x*from.y + 0.5f*(edgeA + edgeB) - 0.5f*(std::fabs( edgeA ) + std::fabs( edgeB ));
+	}
+
+	// The depth plane of the occluder, from the corners spanning the most area so it is least affected by rounding.
+	// Then how much further the depth can be inside a pixel than at its center.
+	uint32_t third = 2;
+	if( count == 4 ) {
+		float area012 = std::fabs( (v[1].x - v[0].x)*(v[2].y - v[0].y) - (v[2].x - v[0].x)*(v[1].y - v[0].y) );
+		float area013 = std::fabs( (v[1].x - v[0].x)*(v[3].y - v[0].y) - (v[3].x - v[0].x)*(v[1].y - v[0].y) );
+		third = area013 > area012 ? 3 : 2;
+	}
+	const glm::vec3 &a = v[0], &b = v[1], &c = v[third];
+	float planeArea = (b.x - a.x)*(c.y - a.y) - (c.x - a.x)*(b.y - a.y);
+	if( std::fabs( planeArea ) < 1e-6f )
+		return;
+	float depthA = ((b.z - a.z)*(c.y - a.y) - (c.z - a.z)*(b.y - a.y)) / planeArea;
+	float depthB = ((b.x - a.x)*(c.z - a.z) - (c.x - a.x)*(b.z - a.z)) / planeArea;
+	polygon.depthA = depthA;
+	polygon.depthB = depthB;
+	polygon.depthC = a.z - depthA*a.x - depthB*a.y + 0.5f*(depthA + depthB);
+	polygon.depthSlope = 0.5f*(std::fabs( depthA ) + std::fabs( depthB ));
+	polygon.maxDepth = v[0].z;
+	for( uint32_t i = 1; i < count; i++ )
+		polygon.maxDepth = std::max( polygon.maxDepth, v[i].z );
+
+	m_polygons.push_back( polygon );
+}
+
+void COcclusionCuller::rasterizeBand( uint32_t band )
+{
+	const int32_t bandMinY = (int32_t)band * OCCLUSION_BAND_HEIGHT;
+	const int32_t bandMaxY = bandMinY + OCCLUSION_BAND_HEIGHT - 1;
+	float *pDepths = &m_levels[0][0];
+
+	for( auto &polygon: m_polygons )
+	{
+		int32_t minY = std::max( polygon.minY, bandMinY ), maxY = std::min( polygon.maxY, bandMaxY );
+		for( int32_t y = minY; y <= maxY; y++ )
+		{
+			float *pRow = pDepths + y*OCCLUSION_BUFFER_WIDTH;
+			int32_t x = polygon.minX;
+			float edges[OCCLUSION_POLYGON_EDGES];
+			for( uint32_t i = 0; i < OCCLUSION_POLYGON_EDGES; i++ )
+				edges[i] = polygon.edgeA[i]*x + polygon.edgeB[i]*y + polygon.edgeC[i];
+			float depth = polygon.depthA*x + polygon.depthB*y + polygon.depthC + polygon.depthSlope;
+
+#ifdef OCCLUSION_SIMD
+			const __m128 steps = _mm_set_ps( 3.0f, 2.0f, 1.0f, 0.0f );
+			__m128 edge0 = _mm_add_ps( _mm_set1_ps( edges[0] ), _mm_mul_ps( steps, _mm_set1_ps( polygon.edgeA[0] ) ) );
+			__m128 edge1 = _mm_add_ps( _mm_set1_ps( edges[1] ), _mm_mul_ps( steps, _mm_set1_ps( polygon.edgeA[1] ) ) );
+			__m128 edge2 = _mm_add_ps( _mm_set1_ps( edges[2] ), _mm_mul_ps( steps, _mm_set1_ps( polygon.edgeA[2] ) ) );
+			__m128 edge3 = _mm_add_ps( _mm_set1_ps( edges[3] ), _mm_mul_ps( steps, _mm_set1_ps( polygon.edgeA[3] ) ) );
+			__m128 depths = _mm_add_ps( _mm_set1_ps( depth ), _mm_mul_ps( steps, _mm_set1_ps( polygon.depthA ) ) );
+			const __m128 edgeStep0 = _mm_set1_ps( polygon.edgeA[0]*4.0f ), edgeStep1 = _mm_set1_ps( polygon.edgeA[1]*4.0f );
+			const __m128 edgeStep2 = _mm_set1_ps( polygon.edgeA[2]*4.0f ), edgeStep3 = _mm_set1_ps( polygon.edgeA[3]*4.0f );
+			const __m128 depthStep = _mm_set1_ps( polygon.depthA*4.0f );
+			const __m128 maxDepth = _mm_set1_ps( polygon.maxDepth ), zero = _mm_setzero_ps();
+			for( ; x + 3 <= polygon.maxX; x += 4 )
+			{
+				__m128 inside = _mm_and_ps( _mm_and_ps( _mm_cmpge_ps( edge0, zero ), _mm_cmpge_ps( edge1, zero ) ),
+					_mm_and_ps( _mm_cmpge_ps( edge2, zero ), _mm_cmpge_ps( edge3, zero ) ) );
+				if( _mm_movemask_ps( inside ) ) {
+					__m128 current = _mm_loadu_ps( pRow + x );
+					__m128 written = _mm_min_ps( current, _mm_min_ps( depths, maxDepth ) );
+					_mm_storeu_ps( pRow + x, _mm_or_ps( _mm_and_ps( inside, written ), _mm_andnot_ps( inside, current ) ) );
+				}
+				edge0 = _mm_add_ps( edge0, edgeStep0 );
+				edge1 = _mm_add_ps( edge1, edgeStep1 );
+				edge2 = _mm_add_ps( edge2, edgeStep2 );
+				edge3 = _mm_add_ps( edge3, edgeStep3 );
+				depths = _mm_add_ps( depths, depthStep );
+			}
+			// Back to scalar values for the rest of the row
+			float offset = (float)(x - polygon.minX);
+			for( uint32_t i = 0; i < OCCLUSION_POLYGON_EDGES; i++ )
+				edges[i] += polygon.edgeA[i]*offset;
+			depth += polygon.depthA*offset;
+#endif
+			for( ; x <= polygon.maxX; x++ ) {
+				if( edges[0] >= 0.0f && edges[1] >= 0.0f && edges[2] >= 0.0f && edges[3] >= 0.0f )
+					pRow[x] = std::min( pRow[x], std::min( depth, polygon.maxDepth ) );
+				for( uint32_t i = 0; i < OCCLUSION_POLYGON_EDGES; i++ )
+					edges[i] += polygon.edgeA[i];
+				depth += polygon.depthA;
+			}
+		}
+	}
+
+	// Each texel of a level is the farthest of the four below it
+	for( uint32_t level = 1; level < OCCLUSION_LEVEL_COUNT; level++ )
+	{
+		const uint32_t width = OCCLUSION_BUFFER_WIDTH >> level;
+		const float *pBelow = &m_levels[level - 1][0];
+		float *pLevel = &m_levels[level][0];
+		for( int32_t y = bandMinY >> level; y <= (bandMaxY >> level); y++ ) {
+			const float *pRow0 = pBelow + (y*2)*(width*2);
+			const float *pRow1 = pRow0 + width*2;
+			for( uint32_t x = 0; x < width; x++ )
+				pLevel[y*width + x] = std::max( std::max( pRow0[x*2], pRow0[x*2 + 1] ), std::max( pRow1[x*2], pRow1[x*2 + 1] ) );
+		}
+	}
+}
+
+void COcclusionCuller::rasterize()
+{
+	auto rasterStart = std::chrono::high_resolution_clock::now();
+
+	m_threadPool.parallelFor( OCCLUSION_BAND_COUNT, [this]( size_t band ) { this->rasterizeBand( (uint32_t)band ); } );
+
+	m_stats.frameCount++;
+	m_stats.occluderCount += m_occluderCount;
+	double rasterSeconds = std::chrono::duration<double>( std::chrono::high_resolution_clock::now() - rasterStart ).count();
+	m_stats.rasterSeconds += rasterSeconds;
+	m_frameSeconds += rasterSeconds;
+}
+
+bool COcclusionCuller::isBoxVisible( const glm::vec3 &minimum, const glm::vec3 &maximum )
+{
+	auto testStart = std::chrono::high_resolution_clock::now();
+	m_stats.testCount++;
+
+	// Screen rectangle and nearest depth of the corners
+	glm::vec3 screenMin( 1e30f ), screenMax( -1e30f );
+	bool visible = false, crossesNear = false;
+	for( uint32_t i = 0; i < 8 && !crossesNear; i++ ) {
+		glm::vec4 corner( (i & 1) ? maximum.x : minimum.x, (i & 2) ? maximum.y : minimum.y, (i & 4) ? maximum.z : minimum.z, 1.0f );
+		glm::vec4 clip = m_viewProjection * corner;
+		if( clip.z < -clip.w || clip.w <= 0.0f ) {
+			crossesNear = true;
+			break;
+		}
+		glm::vec3 screen = ClipToBuffer( clip );
+		screenMin = glm::min( screenMin, screen );
+		screenMax = glm::max( screenMax, screen );
+	}
+
+	if( crossesNear )
+		visible = true;
+	else if( screenMax.x >= 0.0f && screenMin.x < OCCLUSION_BUFFER_WIDTH && screenMax.y >= 0.0f && screenMin.y < OCCLUSION_BUFFER_HEIGHT )
+	{
+		int32_t minX = std::max( (int32_t)std::floor( screenMin.x ), 0 ), maxX = std::min( (int32_t)std::floor( screenMax.x ), OCCLUSION_BUFFER_WIDTH-1 );
+		int32_t minY = std::max( (int32_t)std::floor( screenMin.y ), 0 ), maxY = std::min( (int32_t)std::floor( screenMax.y ), OCCLUSION_BUFFER_HEIGHT-1 );
+
+		// The level where the rectangle covers at most 2x2 texels
+		uint32_t level = 0;
+		while( level < OCCLUSION_LEVEL_COUNT-1 && ((maxX >> level) - (minX >> level) > 1 || (maxY >> level) - (minY >> level) > 1) )
+			level++;
+		for( int32_t y = minY >> level; y <= (maxY >> level) && !visible; y++ ) {
+			for( int32_t x = minX >> level; x <= (maxX >> level) && !visible; x++ )
+				visible = screenMin.z <= this->getDepth( level, x, y );
+		}
+	}
+
+	if( !visible )
+		m_stats.occludedCount++;
+	double testSeconds = std::chrono::duration<double>( std::chrono::high_resolution_clock::now() - testStart ).count();
+	m_stats.testSeconds += testSeconds;
+	m_frameSeconds += testSeconds;
+	return visible;
+}
+
+bool COcclusionCuller::runSelfCheck()
+{
+	// Looking down -z at a wall 8 units wide, 10 units away
+	const float aspect = (float)OCCLUSION_BUFFER_WIDTH / (float)OCCLUSION_BUFFER_HEIGHT;
+	this->beginFrame( glm::perspective( glm::radians( 90.0f ), aspect, 0.1f, 100.0f ) );
+	const glm::vec3 wall[4] = { glm::vec3( -4.0f, -4.0f, -10.0f ), glm::vec3( 4.0f, -4.0f, -10.0f ), glm::vec3( 4.0f, 4.0f, -10.0f ), glm::vec3( -4.0f, 4.0f, -10.0f ) };
+	this->addOccluder( wall );
+	this->rasterize();
+
+	bool passed = true;
+	// Behind the middle of the wall
+	passed &= !this->isBoxVisible( glm::vec3( -1.0f, -1.0f, -21.0f ), glm::vec3( 1.0f, 1.0f, -20.0f ) );
+	// As far away, but beside the wall
+	passed &= this->isBoxVisible( glm::vec3( 10.0f, -1.0f, -21.0f ), glm::vec3( 12.0f, 1.0f, -20.0f ) );
+	// In front of the wall
+	passed &= this->isBoxVisible( glm::vec3( -1.0f, -1.0f, -6.0f ), glm::vec3( 1.0f, 1.0f, -5.0f ) );
+	// Behind the wall but reaching past its edge
+	passed &= this->isBoxVisible( glm::vec3( 6.0f, -1.0f, -21.0f ), glm::vec3( 10.0f, 1.0f, -20.0f ) );
+
+	this->resetStats();
+	return passed;
+}
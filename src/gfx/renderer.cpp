@@ -3,11 +3,13 @@
 #include "components.h"
 #include "gfx/renderer.h"
 #include "gfx/systems.h"
+#include "gfx/chunkrenderer.h"
 
 CWorldRenderer::CWorldRenderer( CGame* pGameHandle ) : m_pGameHandle( pGameHandle )
 {
 	m_renderSystem = 0;
 	m_pClientEntCoordinator = 0;
+	m_pChunkRenderer = 0;
 }
 CWorldRenderer::~CWorldRenderer()
 {
@@ -30,10 +32,19 @@ bool CWorldRenderer::initialize()
 		return false;
 	}
 
+	m_pChunkRenderer = new CChunkRenderer( m_pGameHandle );
+	if( !m_pChunkRenderer->initialize() )
+		return false;
+
 	return true;
 }
 void CWorldRenderer::destroy()
 {
+	if( m_pChunkRenderer ) {
+		m_pChunkRenderer->destroy();
+		delete m_pChunkRenderer;
+		m_pChunkRenderer = 0;
+	}
 	if( m_pClientEntCoordinator ) {
 		delete m_pClientEntCoordinator;
 		m_pClientEntCoordinator = 0;
@@ -60,10 +71,14 @@ bool CWorldRenderer::onLoad()
 
 bool CWorldRenderer::update( float deltaT )
 {
+	// Pick up chunk meshes the workers finished
+	m_pChunkRenderer->update();
+
 	return true;
 }
 
 void CWorldRenderer::render()
 {
+	m_pChunkRenderer->render();
 	m_renderSystem->update( 0 );
 }
\ No newline at end of file
@@ -5,7 +5,9 @@
 #include <chrono>
 #include "client.h"
 #include "gfx\graphics.h"
+#include "gfx\backend.h"
 #include "gfx\shader.h"
+#include "gfx\shadercache.h"
 #include "game.h"
 #include "filesystem.h"
 #include "logger.h"
@@ -14,10 +16,11 @@
 // CShaderManager //
 ////////////////////
 
-CShaderManager::CShaderManager( CGame *pGameHandle ) : m_pGameHandle( pGameHandle )
+CShaderManager::CShaderManager( CGame *pGameHandle ) : m_pGameHandle( pGameHandle ), m_uniformArena( pGameHandle ), m_shaderCache( pGameHandle )
 {
 	m_boundProgramIndex = 0;
 	m_uboIndexCounter = 0;
+	m_uniformAlignment = 0;
 }
 CShaderManager::~CShaderManager()
 {
@@ -27,6 +30,7 @@ bool CShaderManager::initialize()
 {
 	if( !this->createUniformBlocks() )
 		return false;
+	m_shaderCache.initialize();
 
 	return true;
 }
@@ -37,44 +41,30 @@ void CShaderManager::shutdown()
 
 bool CShaderManager::createUniformBlocks()
 {
-	std::vector<GLuint> uboIds;
+	IRenderBackend *pBackend = CGraphics::GetActiveBackend();
 	GLenum glError;
 
-	// Generate buffers
-	uboIds.resize( UniformBlockIDs::UNIFORM_BLOCK_COUNT );
+	pBackend->getIntegerv( GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &m_uniformAlignment );
+	if( (glError = pBackend->getError()) != GL_NO_ERROR || m_uniformAlignment <= 0 ) {
+		m_pGameHandle->getLogger()->printError( "Failed to get uniform buffer offset alignment, GL error code %u", glError );
+		return false;
+	}
 
-	glGenBuffers( (GLsizei)uboIds.size(), &uboIds[0] );
-	if( (glError = glGetError()) != GL_NO_ERROR ) {
-		m_pGameHandle->getLogger()->printError( "Failed to generate uniform buffer objects, GL error code %u", glError );
+	// One buffer for every block, written each frame instead of updating a buffer per block the GPU may still be reading
+	if( !m_uniformArena.create( UNIFORM_ARENA_SIZE ) ) {
+		m_pGameHandle->getLogger()->printError( "Failed to create uniform arena" );
 		return false;
 	}
 
-	// Assign buffers and data
+	// Assign binding points, the range bound to each changes as blocks are allocated
 	for( unsigned int i = 0; i < UniformBlockIDs::UNIFORM_BLOCK_COUNT; i++ )
 	{
 		UniformBlockData uniformBlockData;
 		uniformBlockData = UniformBlocknames[i];
-		uniformBlockData.uboId = uboIds[i];
 
 		assert( uniformBlockData.blockSize > 0 );
 
-		// Bind and allocate space
-		glBindBuffer( GL_UNIFORM_BUFFER, uniformBlockData.uboId );
-		if( glewIsSupported( "GL_ARB_buffer_storage" ) )
-			glBufferStorage( GL_UNIFORM_BUFFER, uniformBlockData.blockSize, 0, GL_DYNAMIC_STORAGE_BIT );
-		else
-			glBufferData( GL_UNIFORM_BUFFER, uniformBlockData.blockSize, 0, GL_DYNAMIC_DRAW );
-		glBindBuffer( GL_UNIFORM_BUFFER, 0 );
-
-		// Bind the entire buffer to a range of memory
-		glBindBufferRange( GL_UNIFORM_BUFFER, m_uboIndexCounter, uniformBlockData.uboId, 0, uniformBlockData.blockSize );
 		uniformBlockData.uboBindingPoint = m_uboIndexCounter++;
-
-		if( (glError = glGetError()) != GL_NO_ERROR ) {
-			m_pGameHandle->getLogger()->printError( "Failed to allocate uniform buffer object memory, GL error code %u", glError );
-			return false;
-		}
-
 		m_uniformBlocks.push_back( uniformBlockData );
 	}
 	
@@ -82,10 +72,14 @@ bool CShaderManager::createUniformBlocks()
 }
 void CShaderManager::destroyUniformBlocks()
 {
-	for( auto it: m_uniformBlocks ) {
-		if( it.uboId )
-			glDeleteBuffers( 1, &it.uboId );
+	const StreamBufferStats &arenaStats = m_uniformArena.getStats();
+	if( m_uniformArena.getBuffer() && arenaStats.frameCount > 0 ) {
+		m_pGameHandle->getLogger()->print( "Wrote %.1f KB of uniform blocks per frame", arenaStats.getWrittenBytesPerFrame() / 1024.0 );
+		if( arenaStats.overflowCount > 0 )
+			m_pGameHandle->getLogger()->printWarn( "Uniform arena was full %llu times, increase UNIFORM_ARENA_SIZE", (unsigned long long)arenaStats.overflowCount );
 	}
+
+	m_uniformArena.destroy();
 	m_uniformBlocks.clear();
 	m_uboIndexCounter = 0;
 }
@@ -98,7 +92,7 @@ bool CShaderManager::loadPrograms()
 	std::unordered_set<std::string> shaderStages;
 	std::vector<ShaderProgramDefinition> programDefs;
 
-	std::map<std::string, std::shared_ptr<CShaderStage>> compiledStages;
+	std::map<std::string, std::shared_ptr<CShaderStage>> loadedStages;
 
 	m_pGameHandle->getLogger()->print( "Loading shader programs from %s...", SHADER_DEF_FILE );
 
@@ -141,7 +135,7 @@ bool CShaderManager::loadPrograms()
 			shaderStages.insert( programDef.vertShader );
 		}
 		// Tessellation shader, non-required support
-		if( glewIsSupported( "GL_ARB_tessellation_shader" ) )
+		if( CGraphics::GetActiveBackend()->isExtensionSupported( "GL_ARB_tessellation_shader" ) )
 		{
 			tessCShaderStr = it.second.get<std::string>( "TessellationControlShader", "" );
 			if( !tessCShaderStr.empty() ) {
@@ -188,20 +182,24 @@ bool CShaderManager::loadPrograms()
 		programDefs.push_back( programDef );
 	}
 
-	// Load and compile the shader stages
-	if( !this->compileShaderStages( shaderStages, compiledStages ) )
+	// Load the shader stages, they are only compiled if a program using them is not cached
+	if( !this->loadShaderStages( shaderStages, loadedStages ) )
 		return false;
 	// Link programs
-	if( !this->linkPrograms( compiledStages, programDefs ) )
+	if( !this->linkPrograms( loadedStages, programDefs ) )
 		return false;
-	
+
+	const ShaderCacheStats &cacheStats = m_shaderCache.getStats();
+	if( m_shaderCache.isEnabled() )
+		m_pGameHandle->getLogger()->print( "Loaded %u shader programs from the cache, %u were missing and %u were out of date",
+			cacheStats.hitCount, cacheStats.missCount, cacheStats.staleCount );
 
 	return true;
 }
 
-bool CShaderManager::compileShaderStages( const std::unordered_set<std::string> &shaderStages, std::map<std::string, std::shared_ptr<CShaderStage>> &compiledStages )
+bool CShaderManager::loadShaderStages( const std::unordered_set<std::string> &shaderStages, std::map<std::string, std::shared_ptr<CShaderStage>> &loadedStages )
 {
-	compiledStages.clear();
+	loadedStages.clear();
 
 	for( auto it: shaderStages )
 	{
@@ -227,16 +225,16 @@ bool CShaderManager::compileShaderStages( const std::unordered_set<std::string>
 		// Create the shader stage object
 		std::shared_ptr<CShaderStage> shaderStage = std::make_shared<CShaderStage>( m_pGameHandle, shaderType );
 
-		if( !shaderStage->createFromFile( it ) )
+		if( !shaderStage->loadFromFile( it ) )
 			return false;
-		// Add to list of compiled shaders
-		compiledStages.insert( std::pair<std::string, std::shared_ptr<CShaderStage>>( it, shaderStage ) );
+		// Add to list of loaded shaders
+		loadedStages.insert( std::pair<std::string, std::shared_ptr<CShaderStage>>( it, shaderStage ) );
 	}
 
 	return true;
 }
 
-bool CShaderManager::linkPrograms( const std::map<std::string, std::shared_ptr<CShaderStage>> &compiledStages, const std::vector<ShaderProgramDefinition> &programDefs )
+bool CShaderManager::linkPrograms( const std::map<std::string, std::shared_ptr<CShaderStage>> &loadedStages, const std::vector<ShaderProgramDefinition> &programDefs )
 {
 	// Iterate and link programs
 	for( auto it: programDefs )
@@ -247,24 +245,24 @@ bool CShaderManager::linkPrograms( const std::map<std::string, std::shared_ptr<C
 
 		// Load the stages associate with the shader
 		// vert shader
-		auto it2 = compiledStages.find( it.vertShader );
-		if( it2 != compiledStages.end() )
+		auto it2 = loadedStages.find( it.vertShader );
+		if( it2 != loadedStages.end() )
 			stages.push_back( (*it2).second );
 		// tess control shader
-		it2 = compiledStages.find( it.tessControlShader );
-		if( it2 != compiledStages.end() )
+		it2 = loadedStages.find( it.tessControlShader );
+		if( it2 != loadedStages.end() )
 			stages.push_back( (*it2).second );
 		// tess eval shader
-		it2 = compiledStages.find( it.tessEvalShader );
-		if( it2 != compiledStages.end() )
+		it2 = loadedStages.find( it.tessEvalShader );
+		if( it2 != loadedStages.end() )
 			stages.push_back( (*it2).second );
 		// geom shader
-		it2 = compiledStages.find( it.geomShader );
-		if( it2 != compiledStages.end() )
+		it2 = loadedStages.find( it.geomShader );
+		if( it2 != loadedStages.end() )
 			stages.push_back( (*it2).second );
 		// frag shader
-		it2 = compiledStages.find( it.fragShader );
-		if( it2 != compiledStages.end() )
+		it2 = loadedStages.find( it.fragShader );
+		if( it2 != loadedStages.end() )
 			stages.push_back( (*it2).second );
 
 		// make sure there are stages
@@ -278,14 +276,34 @@ bool CShaderManager::linkPrograms( const std::map<std::string, std::shared_ptr<C
 		if( !shaderProgram->initialize() )
 			return false;
 
-		// Attach shaders
-		for( auto it: stages )
+		// The source of every stage, in order, decides if the cached binary is still the same program
+		uint64_t sourceHash = CShaderCache::HashString( std::to_string( m_pGameHandle->getClient()->getGraphics()->getGLSLVersion() ) );
+		for( auto stage: stages ) {
+			sourceHash = CShaderCache::HashString( CShaderStage::getShaderTypeStr( stage->getShaderType() ), sourceHash );
+			sourceHash = CShaderCache::HashString( stage->getSource(), sourceHash );
+		}
+
+		if( m_shaderCache.loadProgram( it.programName, sourceHash, shaderProgram->getProgramId() ) )
 		{
-			if( !it->attachShader( shaderProgram ) )
+			if( !shaderProgram->initializeUniforms( it.uniformNames ) )
 				return false;
 		}
-		if( !shaderProgram->link( (it).uniformNames ) )
-			return false;
+		else
+		{
+			// Compile stages the first time a program that is not cached needs them
+			for( auto stage: stages )
+			{
+				if( !stage->isCompiled() && !stage->compile() )
+					return false;
+				if( !stage->attachShader( shaderProgram ) )
+					return false;
+			}
+			if( m_shaderCache.isEnabled() )
+				CGraphics::GetActiveBackend()->programParameteri( shaderProgram->getProgramId(), GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE );
+			if( !shaderProgram->link( (it).uniformNames ) )
+				return false;
+			m_shaderCache.saveProgram( it.programName, sourceHash, shaderProgram->getProgramId() );
+		}
 
 		m_shaderPrograms.push_back( shaderProgram );
 		m_programIndexMap.insert( std::pair<std::string, unsigned int>( shaderProgram->getProgramName(), (unsigned int)m_shaderPrograms.size() ) );
@@ -323,6 +341,21 @@ UniformBlockData& CShaderManager::getUniformBlock( UniformBlockIDs blockIdentifi
 	return m_uniformBlocks[blockIdentifier];
 }
 
+void* CShaderManager::allocateUniformBlock( UniformBlockIDs blockIdentifier, GLintptr *pOffset )
+{
+	assert( blockIdentifier < UniformBlockIDs::UNIFORM_BLOCK_COUNT );
+
+	return m_uniformArena.allocate( m_uniformBlocks[blockIdentifier].blockSize, m_uniformAlignment, pOffset );
+}
+void CShaderManager::bindUniformBlock( UniformBlockIDs blockIdentifier, GLintptr offset )
+{
+	assert( blockIdentifier < UniformBlockIDs::UNIFORM_BLOCK_COUNT );
+
+	const UniformBlockData &uniformBlockData = m_uniformBlocks[blockIdentifier];
+	CGraphics::GetActiveBackend()->bindBufferRange( GL_UNIFORM_BUFFER, uniformBlockData.uboBindingPoint, m_uniformArena.getBuffer()->getBufferId(),
+		offset, uniformBlockData.blockSize );
+}
+
 ////////////////////
 // CShaderProgram //
 ////////////////////
@@ -331,7 +364,6 @@ CShaderProgram::CShaderProgram( CGame* pGameHandle, std::string programName ) :
 {
 	m_programName = programName;
 	m_shaderProgramId = 0;
-	m_updateUniforms = false;
 }
 CShaderProgram::~CShaderProgram() {
 	this->deleteProgram();
@@ -341,7 +373,7 @@ bool CShaderProgram::initialize()
 {
 	assert( m_shaderProgramId == 0 );
 
-	m_shaderProgramId = glCreateProgram();
+	m_shaderProgramId = CGraphics::GetActiveBackend()->createProgram();
 	if( m_shaderProgramId == 0 ) {
 		m_pGameHandle->getLogger()->printError( "Failed to create shader program object for shader program %s", m_programName.c_str() );
 		return false;
@@ -351,7 +383,7 @@ bool CShaderProgram::initialize()
 void CShaderProgram::deleteProgram()
 {
 	if( m_shaderProgramId ) {
-		glDeleteProgram( m_shaderProgramId );
+		CGraphics::GetActiveBackend()->deleteProgram( m_shaderProgramId );
 		m_shaderProgramId = 0;
 	}
 }
@@ -360,23 +392,23 @@ bool CShaderProgram::link( std::vector<std::string> uniformNames )
 {
 	assert( m_shaderProgramId != 0 );
 
+	IRenderBackend *pBackend = CGraphics::GetActiveBackend();
 	GLint glStatus;
-	GLenum glError;
 
-	glLinkProgram( m_shaderProgramId );
+	pBackend->linkProgram( m_shaderProgramId );
 	// Check if link was successful
-	glGetProgramiv( m_shaderProgramId, GL_LINK_STATUS, &glStatus );
+	pBackend->getProgramiv( m_shaderProgramId, GL_LINK_STATUS, &glStatus );
 	if( glStatus == GL_FALSE )
 	{
 		GLint logLength = 0;
 		std::string programLinkLog;
 
 		// Get the shader log
-		glGetProgramiv( m_shaderProgramId, GL_INFO_LOG_LENGTH, &logLength );
+		pBackend->getProgramiv( m_shaderProgramId, GL_INFO_LOG_LENGTH, &logLength );
 		if( logLength > 0 )
 		{
 			programLinkLog.resize( logLength );
-			glGetProgramInfoLog( m_shaderProgramId, logLength, &logLength, &programLinkLog[0] );
+			pBackend->getProgramInfoLog( m_shaderProgramId, logLength, &logLength, &programLinkLog[0] );
 			// Dump to a file
 			if( !programLinkLog.empty() )
 			{
@@ -401,18 +433,27 @@ bool CShaderProgram::link( std::vector<std::string> uniformNames )
 		return false;
 	}
 
+	return this->initializeUniforms( uniformNames );
+}
+bool CShaderProgram::initializeUniforms( const std::vector<std::string> &uniformNames )
+{
+	assert( m_shaderProgramId != 0 );
+
+	IRenderBackend *pBackend = CGraphics::GetActiveBackend();
+	GLenum glError;
+
 	// Find and store uniform locations
 	GLint uniformLoc = 0;
 	for( auto it = uniformNames.begin(); it != uniformNames.end(); it++ )
 	{
-		uniformLoc = glGetUniformLocation( m_shaderProgramId, (*it).c_str() );
+		uniformLoc = pBackend->getUniformLocation( m_shaderProgramId, (*it).c_str() );
 #ifdef STRICT_UNIFORMS
 		if( uniformLoc == -1 ) {
 			m_pGameHandle->getLogger()->print( "Failed to find uniform %s in shader program %s", (*it).c_str(), m_programName.c_str() );
 			return false;
 		}
 #endif
-		if( (glError = glGetError()) != GL_NO_ERROR ) {
+		if( (glError = pBackend->getError()) != GL_NO_ERROR ) {
 			m_pGameHandle->getLogger()->print( "Failed to find uniform %s in shader program %s, GL error code %u", (*it).c_str(), m_programName.c_str(), glError );
 			return false;
 		}
@@ -424,12 +465,12 @@ bool CShaderProgram::link( std::vector<std::string> uniformNames )
 	std::vector<UniformBlockData> uniformBlocks = m_pGameHandle->getClient()->getGraphics()->getShaderManager()->getUniformBlockData();
 	for( auto it: uniformBlocks )
 	{
-		GLuint uboLocalIndex = glGetUniformBlockIndex( m_shaderProgramId, it.blockName );
+		GLuint uboLocalIndex = pBackend->getUniformBlockIndex( m_shaderProgramId, it.blockName );
 		if( uboLocalIndex == GL_INVALID_INDEX )
 			continue;
 		// Bind it to the global slot
-		glUniformBlockBinding( m_shaderProgramId, uboLocalIndex, it.uboBindingPoint );
-		if( (glError = glGetError()) != GL_NO_ERROR ) {
+		pBackend->uniformBlockBinding( m_shaderProgramId, uboLocalIndex, it.uboBindingPoint );
+		if( (glError = pBackend->getError()) != GL_NO_ERROR ) {
 			m_pGameHandle->getLogger()->print( "Failed to bind global UBO %s in shader program %s, GL error code %u", it.blockName, m_programName.c_str(), glError );
 			return false;
 		}
@@ -442,17 +483,7 @@ void CShaderProgram::bind()
 {
 	assert( m_shaderProgramId );
 
-	glUseProgram( m_shaderProgramId );
-	// Call uniform update functions if necessary
-	if( m_updateUniforms )
-	{
-		m_updateUniforms = false;
-		for( auto it: m_updateCallbacks )
-			it();
-	}
-}
-void CShaderProgram::subscribeToUniformUpdate( std::function<void()> callback ) {
-	m_updateCallbacks.push_back( callback );
+	CGraphics::GetActiveBackend()->useProgram( m_shaderProgramId );
 }
 
 bool CShaderProgram::getUniformIndex( std::string name, size_t* pIndex )
@@ -497,6 +528,7 @@ CShaderStage::CShaderStage( CGame *pGameHandle, GLenum shaderType ) : m_pGameHan
 	m_shaderType = shaderType;
 
 	m_shaderObjectId = 0;
+	m_compiled = false;
 }
 CShaderStage::~CShaderStage()
 {
@@ -508,26 +540,24 @@ void CShaderStage::deleteShader()
 	if( m_shaderObjectId )
 	{
 		this->detachFromAll();
-		glDeleteShader( m_shaderObjectId );
+		CGraphics::GetActiveBackend()->deleteShader( m_shaderObjectId );
 		m_shaderObjectId = 0;
 	}
+	m_compiled = false;
 }
 
-bool CShaderStage::createFromFile( std::string relPath )
+bool CShaderStage::loadFromFile( std::string relPath )
 {
 	boost::filesystem::path absFilePath;
 	boost::filesystem::path shaderDir;
 	std::string extension;
 	std::ifstream fileIn;
-	std::string glslCodeStr;
-	GLint glStatus;
+	std::string &glslCodeStr = m_source;
 
 	assert( !relPath.empty() );
 
 	m_shaderName = relPath;
 
-	m_pGameHandle->getLogger()->print( "Compiling shader from file %s...", relPath.c_str() );
-
 	// Construct file path
 	absFilePath = m_pGameHandle->getFilesystem()->getGamePath( FilesystemLocations::LOCATION_SHADERS, relPath );
 
@@ -616,12 +646,23 @@ bool CShaderStage::createFromFile( std::string relPath )
 		m_pGameHandle->getLogger()->printError( "Failed to compile shader stage: failed to read file." );
 		return false;
 	}
+	return true;
+}
+
+bool CShaderStage::compile()
+{
+	IRenderBackend *pBackend = CGraphics::GetActiveBackend();
+	GLint glStatus;
+
+	assert( !m_source.empty() );
+
+	m_pGameHandle->getLogger()->print( "Compiling shader from file %s...", m_shaderName.c_str() );
 
 	// Create the opengl shader stage object if necessary
 	if( !m_shaderObjectId ) {
-		m_shaderObjectId = glCreateShader( m_shaderType );
+		m_shaderObjectId = pBackend->createShader( m_shaderType );
 		if( !m_shaderObjectId ) {
-			m_pGameHandle->getLogger()->printError( "Failed to create GL shader object, GL error code: %u", glGetError() );
+			m_pGameHandle->getLogger()->printError( "Failed to create GL shader object, GL error code: %u", pBackend->getError() );
 			return false;
 		}
 	}
@@ -629,22 +670,22 @@ bool CShaderStage::createFromFile( std::string relPath )
 		m_pGameHandle->getLogger()->printWarn( "Shader object was already created, it will be overwritten." );
 
 	// Compile the shader
-	const GLchar* pShaderSrc = glslCodeStr.c_str();
-	glShaderSource( m_shaderObjectId, 1, &pShaderSrc, 0 );
-	glCompileShader( m_shaderObjectId );
+	const GLchar* pShaderSrc = m_source.c_str();
+	pBackend->shaderSource( m_shaderObjectId, pShaderSrc );
+	pBackend->compileShader( m_shaderObjectId );
 	// Check if compilation was successful
-	glGetShaderiv( m_shaderObjectId, GL_COMPILE_STATUS, &glStatus );
+	pBackend->getShaderiv( m_shaderObjectId, GL_COMPILE_STATUS, &glStatus );
 	if( glStatus == GL_FALSE )
 	{
 		GLint logLength = 0;
 		std::string shaderCompileLog;
 
 		// Get the shader log
-		glGetShaderiv( m_shaderObjectId, GL_INFO_LOG_LENGTH, &logLength );
+		pBackend->getShaderiv( m_shaderObjectId, GL_INFO_LOG_LENGTH, &logLength );
 		if( logLength > 0 )
 		{
 			shaderCompileLog.resize( logLength );
-			glGetShaderInfoLog( m_shaderObjectId, logLength, &logLength, &shaderCompileLog[0] );
+			pBackend->getShaderInfoLog( m_shaderObjectId, logLength, &logLength, &shaderCompileLog[0] );
 			// Dump to a file
 			if( !shaderCompileLog.empty() )
 			{
@@ -668,6 +709,7 @@ bool CShaderStage::createFromFile( std::string relPath )
 		}
 		return false;
 	}
+	m_compiled = true;
 	return true;
 }
 
@@ -676,6 +718,7 @@ bool CShaderStage::attachShader( std::shared_ptr<CShaderProgram> shaderProgram )
 	assert( shaderProgram->getProgramId() != 0 );
 	assert( m_shaderObjectId != 0 );
 
+	IRenderBackend *pBackend = CGraphics::GetActiveBackend();
 	GLenum glError;
 
 	// Make sure it is not already attached
@@ -684,8 +727,8 @@ bool CShaderStage::attachShader( std::shared_ptr<CShaderProgram> shaderProgram )
 		return true;
 	}
 
-	glAttachShader( shaderProgram->getProgramId(), m_shaderObjectId );
-	if( (glError = glGetError()) != GL_NO_ERROR ) {
+	pBackend->attachShader( shaderProgram->getProgramId(), m_shaderObjectId );
+	if( (glError = pBackend->getError()) != GL_NO_ERROR ) {
 		m_pGameHandle->getLogger()->printError( "Failed to attach shader stage to shader program, GL error code: %u", glError );
 		return false;
 	}
@@ -698,6 +741,7 @@ void CShaderStage::detachShader( std::shared_ptr<CShaderProgram> shaderProgram )
 	assert( shaderProgram->getProgramId() != 0 );
 	assert( m_shaderObjectId != 0 );
 
+	IRenderBackend *pBackend = CGraphics::GetActiveBackend();
 	GLenum glError;
 
 	// make sure it is attached
@@ -707,8 +751,8 @@ void CShaderStage::detachShader( std::shared_ptr<CShaderProgram> shaderProgram )
 		return;
 	}
 
-	glDetachShader( shaderProgram->getProgramId(), m_shaderObjectId );
-	if( (glError = glGetError()) != GL_NO_ERROR ) {
+	pBackend->detachShader( shaderProgram->getProgramId(), m_shaderObjectId );
+	if( (glError = pBackend->getError()) != GL_NO_ERROR ) {
 		m_pGameHandle->getLogger()->printError( "Failed to deattach shader stage from shader program, GL error code: %u", glError );
 		return;
 	}
@@ -718,11 +762,12 @@ void CShaderStage::detachFromAll()
 {
 	assert( m_shaderObjectId != 0 );
 
+	IRenderBackend *pBackend = CGraphics::GetActiveBackend();
 	GLenum glError;
 
 	for( auto it: m_programsAttachedTo ) {
-		glDetachShader( (it), m_shaderObjectId );
-		if( (glError = glGetError()) != GL_NO_ERROR )
+		pBackend->detachShader( (it), m_shaderObjectId );
+		if( (glError = pBackend->getError()) != GL_NO_ERROR )
 			m_pGameHandle->getLogger()->printError( "Failed to deattach shader stage from shader program, GL error code: %u", glError );
 	}
 	m_programsAttachedTo.clear();
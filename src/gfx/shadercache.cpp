@@ -0,0 +1,183 @@
+#include <fstream>
+#include <vector>
+#include "gfx/shadercache.h"
+#include "gfx/graphics.h"
+#include "gfx/backend.h"
+#include "game.h"
+#include "logger.h"
+#include "filesystem.h"
+
+// Native byte order, the cache never leaves the machine that wrote it
+template<typename T>
+static inline void WriteValue( std::ofstream &fileOut, T value ) {
+	fileOut.write( (const char*)&value, sizeof( T ) );
+}
+template<typename T>
+static inline bool ReadValue( std::ifstream &fileIn, T *pValue ) {
+	return (bool)fileIn.read( (char*)pValue, sizeof( T ) );
+}
+
+uint64_t CShaderCache::HashString( const std::string &str, uint64_t hash )
+{
+	for( char c: str ) {
+		hash ^= (uint8_t)c;
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+CShaderCache::CShaderCache( CGame *pGameHandle ) : m_pGameHandle( pGameHandle )
+{
+	m_enabled = false;
+	m_stats = ShaderCacheStats();
+}
+CShaderCache::~CShaderCache() {
+}
+
+void CShaderCache::initialize()
+{
+	IRenderBackend *pBackend = CGraphics::GetActiveBackend();
+
+	m_enabled = false;
+	if( !pBackend->isExtensionSupported( "GL_ARB_get_program_binary" ) ) {
+		m_pGameHandle->getLogger()->print( "Program binaries are not supported, shaders will not be cached" );
+		return;
+	}
+	GLint formatCount = 0;
+	pBackend->getIntegerv( GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount );
+	if( pBackend->getError() != GL_NO_ERROR || formatCount <= 0 ) {
+		m_pGameHandle->getLogger()->print( "Driver has no program binary formats, shaders will not be cached" );
+		return;
+	}
+
+	// A binary from one driver is no use to another, or to another version of the same one
+	const char *pVendor = pBackend->getString( GL_VENDOR );
+	const char *pRenderer = pBackend->getString( GL_RENDERER );
+	const char *pVersion = pBackend->getString( GL_VERSION );
+	if( !pVendor || !pRenderer || !pVersion ) {
+		pBackend->getError();
+		m_pGameHandle->getLogger()->printWarn( "Failed to identify the driver, shaders will not be cached" );
+		return;
+	}
+	m_driverString = std::string( pVendor ) + "\n" + pRenderer + "\n" + pVersion;
+
+	m_cacheDirectory = m_pGameHandle->getFilesystem()->getGamePath( FilesystemLocations::LOCATION_CACHE, SHADER_CACHE_DIRECTORY );
+	try {
+		if( !boost::filesystem::is_directory( m_cacheDirectory ) ) {
+			m_pGameHandle->getLogger()->print( "Creating directory %s", m_cacheDirectory.string().c_str() );
+			boost::filesystem::create_directories( m_cacheDirectory );
+		}
+	}
+	catch( const boost::filesystem::filesystem_error &e ) {
+		m_pGameHandle->getLogger()->printWarn( "Failed to create shader cache directory \'%s\', shaders will not be cached: %s", m_cacheDirectory.string().c_str(), e.what() );
+		return;
+	}
+
+	m_enabled = true;
+}
+
+boost::filesystem::path CShaderCache::getProgramPath( const std::string &programName ) const {
+	return m_cacheDirectory / (programName + SHADER_CACHE_EXTENSION);
+}
+
+bool CShaderCache::loadProgram( const std::string &programName, uint64_t sourceHash, GLuint program )
+{
+	if( !m_enabled )
+		return false;
+
+	std::ifstream fileIn( this->getProgramPath( programName ).string(), std::ifstream::in | std::ifstream::binary );
+	if( !fileIn.is_open() ) {
+		m_stats.missCount++;
+		return false;
+	}
+
+	// Anything that does not match is stale, and is replaced once the program is linked from source
+	uint32_t magic, version, driverLength, binaryFormat, binaryLength;
+	uint64_t fileSourceHash;
+	if( !ReadValue( fileIn, &magic ) || !ReadValue( fileIn, &version ) || !ReadValue( fileIn, &fileSourceHash ) || !ReadValue( fileIn, &driverLength )
+		|| magic != SHADER_CACHE_MAGIC || version != SHADER_CACHE_VERSION || fileSourceHash != sourceHash || driverLength != m_driverString.length() ) {
+		m_stats.staleCount++;
+		return false;
+	}
+	std::string driverString( driverLength, '\0' );
+	if( !fileIn.read( &driverString[0], driverLength ) || driverString != m_driverString ) {
+		m_stats.staleCount++;
+		return false;
+	}
+	std::vector<uint8_t> binary;
+	if( !ReadValue( fileIn, &binaryFormat ) || !ReadValue( fileIn, &binaryLength ) || binaryLength == 0 ) {
+		m_stats.staleCount++;
+		return false;
+	}
+	// The binary must be the rest of the file, a corrupt length is not allocated
+	std::streamoff binaryOffset = fileIn.tellg();
+	fileIn.seekg( 0, std::ifstream::end );
+	std::streamoff fileLength = fileIn.tellg();
+	if( binaryOffset < 0 || fileLength < 0 || fileLength - binaryOffset != (std::streamoff)binaryLength ) {
+		m_stats.staleCount++;
+		return false;
+	}
+	fileIn.seekg( binaryOffset, std::ifstream::beg );
+	binary.resize( binaryLength );
+	if( !fileIn.read( (char*)&binary[0], binaryLength ) ) {
+		m_stats.staleCount++;
+		return false;
+	}
+
+	// The driver can still refuse it, then the program is not linked
+	IRenderBackend *pBackend = CGraphics::GetActiveBackend();
+	GLint linkStatus = GL_FALSE;
+	pBackend->programBinary( program, (GLenum)binaryFormat, &binary[0], (GLsizei)binaryLength );
+	pBackend->getProgramiv( program, GL_LINK_STATUS, &linkStatus );
+	if( pBackend->getError() != GL_NO_ERROR || linkStatus == GL_FALSE ) {
+		m_pGameHandle->getLogger()->print( "Driver refused the cached binary of shader program %s", programName.c_str() );
+		m_stats.staleCount++;
+		return false;
+	}
+
+	m_stats.hitCount++;
+	return true;
+}
+
+void CShaderCache::saveProgram( const std::string &programName, uint64_t sourceHash, GLuint program )
+{
+	if( !m_enabled )
+		return;
+
+	IRenderBackend *pBackend = CGraphics::GetActiveBackend();
+	GLint binaryLength = 0;
+	pBackend->getProgramiv( program, GL_PROGRAM_BINARY_LENGTH, &binaryLength );
+	if( pBackend->getError() != GL_NO_ERROR || binaryLength <= 0 ) {
+		m_pGameHandle->getLogger()->printWarn( "Failed to get the binary of shader program %s", programName.c_str() );
+		return;
+	}
+	std::vector<uint8_t> binary( (size_t)binaryLength );
+	GLenum binaryFormat = 0;
+	pBackend->getProgramBinary( program, binaryLength, &binaryLength, &binaryFormat, &binary[0] );
+	if( pBackend->getError() != GL_NO_ERROR ) {
+		m_pGameHandle->getLogger()->printWarn( "Failed to get the binary of shader program %s", programName.c_str() );
+		return;
+	}
+
+	boost::filesystem::path filePath = this->getProgramPath( programName );
+	std::ofstream fileOut( filePath.string(), std::ofstream::out | std::ofstream::binary | std::ofstream::trunc );
+	if( !fileOut.is_open() ) {
+		m_pGameHandle->getLogger()->printWarn( "Failed to write shader cache file \'%s\'", filePath.string().c_str() );
+		return;
+	}
+	WriteValue<uint32_t>( fileOut, SHADER_CACHE_MAGIC );
+	WriteValue<uint32_t>( fileOut, SHADER_CACHE_VERSION );
+	WriteValue<uint64_t>( fileOut, sourceHash );
+	WriteValue<uint32_t>( fileOut, (uint32_t)m_driverString.length() );
+	fileOut.write( m_driverString.data(), m_driverString.length() );
+	WriteValue<uint32_t>( fileOut, (uint32_t)binaryFormat );
+	WriteValue<uint32_t>( fileOut, (uint32_t)binaryLength );
+	fileOut.write( (const char*)&binary[0], binaryLength );
+	if( !fileOut ) {
+		// A partial file would only be found stale, but there is no reason to keep it
+		fileOut.close();
+		boost::system::error_code error;
+		boost::filesystem::remove( filePath, error );
+		m_pGameHandle->getLogger()->printWarn( "Failed to write shader cache file \'%s\'", filePath.string().c_str() );
+	}
+}
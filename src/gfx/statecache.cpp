@@ -0,0 +1,210 @@
+#include "gfx/statecache.h"
+#include "game.h"
+#include "logger.h"
+
+CRenderStateCache::CRenderStateCache( CGame *pGameHandle, IRenderBackend *pBackend ) : m_pGameHandle( pGameHandle ), m_pBackend( pBackend )
+{
+	assert( m_pBackend );
+
+	m_skippedStateCount = 0;
+	m_stats = RenderBackendStats();
+
+	// The defaults of a new context
+	m_program = 0;
+	m_vertexArray = 0;
+	m_depthFunction = 0;
+	m_cullFace = 0;
+	m_frontFace = 0;
+	m_pointSize = -1.0f;
+	m_clearColorSet = false;
+}
+CRenderStateCache::~CRenderStateCache()
+{
+	if( m_pBackend ) {
+		delete m_pBackend;
+		m_pBackend = 0;
+	}
+}
+
+bool CRenderStateCache::initialize()
+{
+	if( !m_pBackend->initialize() )
+		return false;
+	m_pGameHandle->getLogger()->print( "Caching render state in front of the %s render backend", m_pBackend->getName() );
+	return true;
+}
+void CRenderStateCache::shutdown()
+{
+	m_pBackend->shutdown();
+
+	m_program = 0;
+	m_vertexArray = 0;
+	m_buffers.clear();
+	m_bufferRanges.clear();
+	m_capabilities.clear();
+}
+
+const RenderBackendStats& CRenderStateCache::getStats() const
+{
+	m_stats = m_pBackend->getStats();
+	m_stats.skippedStateCount = m_skippedStateCount;
+	return m_stats;
+}
+void CRenderStateCache::resetStats()
+{
+	m_pBackend->resetStats();
+	m_skippedStateCount = 0;
+}
+
+void CRenderStateCache::enable( GLenum capability )
+{
+	auto it = m_capabilities.find( capability );
+	if( it != m_capabilities.end() && it->second ) {
+		this->skipState();
+		return;
+	}
+	m_capabilities[capability] = true;
+	m_pBackend->enable( capability );
+}
+void CRenderStateCache::disable( GLenum capability )
+{
+	auto it = m_capabilities.find( capability );
+	if( it != m_capabilities.end() && !it->second ) {
+		this->skipState();
+		return;
+	}
+	m_capabilities[capability] = false;
+	m_pBackend->disable( capability );
+}
+void CRenderStateCache::depthFunc( GLenum function )
+{
+	if( function == m_depthFunction ) {
+		this->skipState();
+		return;
+	}
+	m_depthFunction = function;
+	m_pBackend->depthFunc( function );
+}
+void CRenderStateCache::cullFace( GLenum face )
+{
+	if( face == m_cullFace ) {
+		this->skipState();
+		return;
+	}
+	m_cullFace = face;
+	m_pBackend->cullFace( face );
+}
+void CRenderStateCache::frontFace( GLenum winding )
+{
+	if( winding == m_frontFace ) {
+		this->skipState();
+		return;
+	}
+	m_frontFace = winding;
+	m_pBackend->frontFace( winding );
+}
+void CRenderStateCache::pointSize( GLfloat size )
+{
+	if( size == m_pointSize ) {
+		this->skipState();
+		return;
+	}
+	m_pointSize = size;
+	m_pBackend->pointSize( size );
+}
+void CRenderStateCache::clearColor( GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha )
+{
+	if( m_clearColorSet && red == m_clearColor[0] && green == m_clearColor[1] && blue == m_clearColor[2] && alpha == m_clearColor[3] ) {
+		this->skipState();
+		return;
+	}
+	m_clearColor[0] = red;
+	m_clearColor[1] = green;
+	m_clearColor[2] = blue;
+	m_clearColor[3] = alpha;
+	m_clearColorSet = true;
+	m_pBackend->clearColor( red, green, blue, alpha );
+}
+
+void CRenderStateCache::deleteBuffers( GLsizei count, const GLuint *pBuffers )
+{
+	// OpenGL unbinds deleted buffers, forget where they were bound rather than follow its rules
+	for( GLsizei i = 0; i < count; i++ )
+	{
+		for( auto it = m_buffers.begin(); it != m_buffers.end(); ) {
+			if( it->second == pBuffers[i] )
+				it = m_buffers.erase( it );
+			else
+				++it;
+		}
+		for( auto it = m_bufferRanges.begin(); it != m_bufferRanges.end(); ) {
+			if( it->second.buffer == pBuffers[i] )
+				it = m_bufferRanges.erase( it );
+			else
+				++it;
+		}
+	}
+	m_pBackend->deleteBuffers( count, pBuffers );
+}
+void CRenderStateCache::bindBuffer( GLenum target, GLuint buffer )
+{
+	auto it = m_buffers.find( target );
+	if( it != m_buffers.end() && it->second == buffer ) {
+		this->skipState();
+		return;
+	}
+	m_buffers[target] = buffer;
+	m_pBackend->bindBuffer( target, buffer );
+}
+void CRenderStateCache::bindBufferRange( GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size )
+{
+	auto it = m_bufferRanges.find( std::make_pair( target, index ) );
+	if( it != m_bufferRanges.end() && it->second.buffer == buffer && it->second.offset == offset && it->second.size == size
+		&& m_buffers.count( target ) && m_buffers[target] == buffer ) {
+		this->skipState();
+		return;
+	}
+	// Binding a range binds the whole target too
+	m_bufferRanges[std::make_pair( target, index )] = { buffer, offset, size };
+	m_buffers[target] = buffer;
+	m_pBackend->bindBufferRange( target, index, buffer, offset, size );
+}
+
+void CRenderStateCache::deleteVertexArrays( GLsizei count, const GLuint *pArrays )
+{
+	for( GLsizei i = 0; i < count; i++ ) {
+		// Deleting the bound vertex array binds the default one
+		if( pArrays[i] == m_vertexArray ) {
+			m_vertexArray = 0;
+			m_buffers.erase( GL_ELEMENT_ARRAY_BUFFER );
+		}
+	}
+	m_pBackend->deleteVertexArrays( count, pArrays );
+}
+void CRenderStateCache::bindVertexArray( GLuint array )
+{
+	if( array == m_vertexArray ) {
+		this->skipState();
+		return;
+	}
+	m_vertexArray = array;
+	// The element buffer belongs to the vertex array
+	m_buffers.erase( GL_ELEMENT_ARRAY_BUFFER );
+	m_pBackend->bindVertexArray( array );
+}
+
+void CRenderStateCache::deleteProgram( GLuint program )
+{
+	// A program in use stays in use until another is, and its name is not reused before then, so the
+	// bound program is still right
+	m_pBackend->deleteProgram( program );
+}
+void CRenderStateCache::useProgram( GLuint program )
+{
+	if( program == m_program ) {
+		this->skipState();
+		return;
+	}
+	m_program = program;
+	m_pBackend->useProgram( program );
+}
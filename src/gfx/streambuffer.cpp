@@ -0,0 +1,153 @@
+#include "gfx/streambuffer.h"
+#include "gfx/backend.h"
+#include "game.h"
+#include "logger.h"
+#include "client.h"
+
+CStreamBuffer::CStreamBuffer( CGame *pGameHandle ) : m_pGameHandle( pGameHandle )
+{
+	m_regionSize = 0;
+	m_pMapped = 0;
+	for( uint32_t i = 0; i < STREAM_BUFFER_REGIONS; i++ )
+		m_regionFences[i] = 0;
+
+	m_region = 0;
+	m_regionReady = false;
+	m_head = 0;
+	m_flushed = 0;
+
+	m_stats = StreamBufferStats();
+}
+CStreamBuffer::~CStreamBuffer() {
+	this->destroy();
+}
+
+bool CStreamBuffer::create( GLsizeiptr regionSize )
+{
+	assert( !m_buffer );
+	assert( regionSize > 0 );
+
+	IRenderBackend *pBackend = CGraphics::GetActiveBackend();
+	const GLbitfield mapFlags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+	m_regionSize = regionSize;
+	// Dynamic storage too, in case the buffer cannot be mapped
+	m_buffer = std::make_shared<CBufferObject>();
+	m_buffer->create( m_regionSize * STREAM_BUFFER_REGIONS, 0, mapFlags | GL_DYNAMIC_STORAGE_BIT, GL_STREAM_DRAW );
+	if( !m_buffer->bind( GL_COPY_WRITE_BUFFER ) ) {
+		m_pGameHandle->getLogger()->printError( "Failed to create stream buffer of %.1f KB", (m_regionSize * STREAM_BUFFER_REGIONS) / 1024.0 );
+		m_buffer.reset();
+		return false;
+	}
+	if( pBackend->isExtensionSupported( "GL_ARB_buffer_storage" ) )
+		m_pMapped = (uint8_t*)pBackend->mapBufferRange( GL_COPY_WRITE_BUFFER, 0, m_regionSize * STREAM_BUFFER_REGIONS, mapFlags );
+	if( !m_pMapped ) {
+		pBackend->getError();
+		m_staging.resize( (size_t)m_regionSize );
+	}
+
+	m_region = 0;
+	m_regionReady = false;
+	m_head = 0;
+	m_flushed = 0;
+
+	m_pGameHandle->getClient()->getGraphics()->addStreamBuffer( this );
+	return true;
+}
+void CStreamBuffer::destroy()
+{
+	if( !m_buffer )
+		return;
+
+	m_pGameHandle->getClient()->getGraphics()->removeStreamBuffer( this );
+
+	IRenderBackend *pBackend = CGraphics::GetActiveBackend();
+	if( pBackend ) {
+		for( uint32_t i = 0; i < STREAM_BUFFER_REGIONS; i++ ) {
+			if( m_regionFences[i] )
+				pBackend->deleteSync( m_regionFences[i] );
+		}
+		if( m_pMapped ) {
+			m_buffer->bind( GL_COPY_WRITE_BUFFER );
+			pBackend->unmapBuffer( GL_COPY_WRITE_BUFFER );
+		}
+	}
+	for( uint32_t i = 0; i < STREAM_BUFFER_REGIONS; i++ )
+		m_regionFences[i] = 0;
+	m_pMapped = 0;
+	m_staging.clear();
+	m_buffer.reset();
+	m_regionSize = 0;
+}
+
+void CStreamBuffer::waitForRegion()
+{
+	GLsync fence = m_regionFences[m_region];
+	if( !fence )
+		return;
+
+	IRenderBackend *pBackend = CGraphics::GetActiveBackend();
+	GLenum result = pBackend->clientWaitSync( fence, 0, 0 );
+	if( result == GL_TIMEOUT_EXPIRED ) {
+		// The GPU is more than a region behind, flush so the fence can be reached and block until it is
+		m_stats.stallCount++;
+		do {
+			result = pBackend->clientWaitSync( fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000 );
+		} while( result == GL_TIMEOUT_EXPIRED );
+	}
+	if( result == GL_WAIT_FAILED )
+		m_pGameHandle->getLogger()->printWarn( "Failed to wait for stream buffer fence" );
+	pBackend->deleteSync( fence );
+	m_regionFences[m_region] = 0;
+}
+
+void* CStreamBuffer::allocate( GLsizeiptr size, GLsizeiptr alignment, GLintptr *pOffset )
+{
+	assert( m_buffer );
+	assert( size > 0 && alignment > 0 );
+
+	if( !m_regionReady ) {
+		this->waitForRegion();
+		m_regionReady = true;
+	}
+
+	// Aligned from the start of the buffer, so attribute and command offsets can be found by dividing
+	const GLintptr regionStart = (GLintptr)m_region * m_regionSize;
+	GLintptr offset = ((regionStart + m_head + alignment - 1) / alignment) * alignment - regionStart;
+	if( offset + size > m_regionSize ) {
+		m_stats.overflowCount++;
+		return 0;
+	}
+	m_head = offset + size;
+	m_stats.writtenBytes += size;
+
+	(*pOffset) = regionStart + offset;
+	if( m_pMapped )
+		return m_pMapped + regionStart + offset;
+	return &m_staging[offset];
+}
+
+void CStreamBuffer::flush()
+{
+	// Coherent mappings need nothing
+	if( m_pMapped || m_head <= m_flushed )
+		return;
+
+	IRenderBackend *pBackend = CGraphics::GetActiveBackend();
+	m_buffer->bind( GL_COPY_WRITE_BUFFER );
+	pBackend->bufferSubData( GL_COPY_WRITE_BUFFER, (GLintptr)m_region * m_regionSize + m_flushed, m_head - m_flushed, &m_staging[m_flushed] );
+	m_flushed = m_head;
+}
+
+void CStreamBuffer::endFrame()
+{
+	// Regions nothing was written to have nothing to wait for
+	if( m_pMapped && m_head > 0 )
+		m_regionFences[m_region] = CGraphics::GetActiveBackend()->fenceSync( GL_SYNC_GPU_COMMANDS_COMPLETE, 0 );
+
+	m_region = (m_region + 1) % STREAM_BUFFER_REGIONS;
+	m_regionReady = false;
+	m_head = 0;
+	m_flushed = 0;
+	m_stats.frameCount++;
+}
@@ -1,25 +1,34 @@
-#include <glm/ext.hpp>
+#include <algorithm>
+#include <cstring>
 #include "gfx/systems.h"
 #include "gfx/graphics.h"
+#include "gfx/backend.h"
 #include "gfx/shader.h"
 #include "gfx/camera.h"
 #include "game.h"
 #include "logger.h"
 #include "client.h"
 
+// A quad facing +z, every entity is drawn as one for now
+static Vertex3D EntityQuadVertices[4] = {
+	{ glm::vec3( 1.f, -1.f, 0.0f ) },
+	{ glm::vec3( 1.f, 1.f, 0.0f ) },
+	{ glm::vec3( -1.f, 1.f, 0.0f ) },
+	{ glm::vec3( -1.f, -1.f, 0.0f ) }
+};
+static uint16_t EntityQuadIndices[6] = { 0, 1, 2, 2, 3, 0 };
+
 ///////////////////
 // CRenderSystem //
 ///////////////////
 
-CRenderSystem::CRenderSystem( CGame *pGameHandle, CECSCoordinator *pCoordinator )
+CRenderSystem::CRenderSystem( CGame *pGameHandle, CECSCoordinator *pCoordinator ) : m_instanceStream( pGameHandle )
 {
 	m_pGameHandle = pGameHandle;
 	m_pCoordinatorHandle = pCoordinator;
 
-	m_modelMatUniformLoc = -1;
-
-	m_vertexArray = 0;
-	m_vertexBuffer = 0;
+	m_streamInstances = 0;
+	m_shaderIndex = 0;
 
 	m_testCamera = std::make_shared<CCamera>();
 }
@@ -29,92 +38,146 @@ CRenderSystem::~CRenderSystem() {
 
 bool CRenderSystem::initialize()
 {
+	m_pGameHandle->getClient()->getGraphics()->setActiveCamera( m_testCamera );
+
 	// Get shader index
-	if( !m_pGameHandle->getClient()->getGraphics()->getShaderManager()->getProgramIndex( "simple", &m_simpleShaderIndex ) ) {
-		m_pGameHandle->getLogger()->printError( "Failed to get simple shader program for client renderer." );
-		return false;
+	if( !m_pGameHandle->getClient()->getGraphics()->getShaderManager()->getProgramIndex( ENTITY_SHADER_PROGRAM, &m_shaderIndex ) ) {
+		m_pGameHandle->getLogger()->printWarn( "Failed to get %s shader program, entities will not be drawn", ENTITY_SHADER_PROGRAM );
+		m_shaderIndex = 0;
+		return true;
 	}
-	m_simpleProgram = m_pGameHandle->getClient()->getGraphics()->getShaderManager()->getProgramByIndex( m_simpleShaderIndex );
-	// Get the mvpUniformLocation
-	size_t modelMatIndex;
-	if( !m_simpleProgram->getUniformIndex( "modelMatrix", &modelMatIndex ) ) {
-		m_pGameHandle->getLogger()->printError( "Failed to get modelMatrix uniform location" );
-		return false;
-	}
-	m_modelMatUniformLoc = m_simpleProgram->getUniformLocation( modelMatIndex );
-	// Subscribe to uniform updates
-	m_simpleProgram->subscribeToUniformUpdate( std::bind( &CRenderSystem::updateShaderUniforms, this ) );
 
-	// Create the vao
-	m_vertexArray = std::make_shared<CVertexArray>( m_pGameHandle );
-	m_vertexArray->create();
-
-	// Update uniforms once
-	float fovRad = glm::radians( 100.0f );
-	m_modelMatrix = glm::translate( glm::mat4( 1.0f ), glm::vec3( 0.0f, 0.0f, 0.0f ) );
-	m_simpleProgram->requireUniformUpdate();
-
-	m_pGameHandle->getClient()->getGraphics()->setActiveCamera( m_testCamera );
+	// The mesh every entity is an instance of
+	m_quadVertexBuffer = std::make_shared<CBufferObject>();
+	m_quadVertexBuffer->create( sizeof( EntityQuadVertices ), EntityQuadVertices, 0, GL_STATIC_DRAW );
+	m_quadIndexBuffer = std::make_shared<CBufferObject>();
+	m_quadIndexBuffer->create( sizeof( EntityQuadIndices ), EntityQuadIndices, 0, GL_STATIC_DRAW );
 
 	return true;
 }
 void CRenderSystem::shutdown()
 {
-	// Destroy the vao
-	if( m_vertexArray ) {
-		m_vertexArray->destroy();
-		m_vertexArray.reset();
+	const StreamBufferStats &streamStats = m_instanceStream.getStats();
+	if( m_instanceStream.getBuffer() && streamStats.frameCount > 0 )
+		m_pGameHandle->getLogger()->print( "Streamed %.1f KB of entity instances per frame, %llu stalls",
+			streamStats.getWrittenBytesPerFrame() / 1024.0, (unsigned long long)streamStats.stallCount );
+
+	m_regionArrays.clear();
+	m_instanceStream.destroy();
+	m_streamInstances = 0;
+	m_instances.clear();
+	m_quadVertexBuffer.reset();
+	m_quadIndexBuffer.reset();
+}
+
+bool CRenderSystem::reserveInstances( unsigned int instanceCount )
+{
+	if( m_instanceStream.getBuffer() && instanceCount <= m_streamInstances )
+		return true;
+
+	m_streamInstances = std::max( m_streamInstances, (unsigned int)ENTITY_STREAM_INSTANCES );
+	while( m_streamInstances < instanceCount )
+		m_streamInstances *= 2;
+
+	// A whole number of instances per region, so each region starts on an instance
+	m_regionArrays.clear();
+	m_instanceStream.destroy();
+	if( !m_instanceStream.create( sizeof( EntityInstance ) * m_streamInstances ) ) {
+		m_pGameHandle->getLogger()->printError( "Failed to create entity stream buffer" );
+		return false;
 	}
-	if( m_vertexBuffer ) {
-		m_vertexBuffer->destroy();
-		m_vertexArray.reset();
+	m_instances.reserve( m_streamInstances );
+
+	// Without a base instance the instance attributes must point at the region being drawn
+	for( uint32_t i = 0; i < STREAM_BUFFER_REGIONS; i++ )
+	{
+		size_t regionStart = (size_t)i * m_instanceStream.getRegionSize();
+
+		std::shared_ptr<CVertexArray> vertexArray = std::make_shared<CVertexArray>( m_pGameHandle );
+		if( !vertexArray->create() )
+			return false;
+		vertexArray->addBuffer( m_quadVertexBuffer, GL_ARRAY_BUFFER );
+		vertexArray->addBuffer( m_quadIndexBuffer, GL_ELEMENT_ARRAY_BUFFER );
+		vertexArray->addVertexAttrib( 3, GL_FLOAT, sizeof( Vertex3D ), (GLvoid*)offsetof( Vertex3D, position ), GL_FALSE );
+		if( !vertexArray->flushBindsAndAttribs() )
+			return false;
+		vertexArray->addBuffer( m_instanceStream.getBuffer(), GL_ARRAY_BUFFER );
+		vertexArray->addInstancedVertexAttrib( 3, GL_FLOAT, sizeof( EntityInstance ), (GLvoid*)(regionStart + offsetof( EntityInstance, position )), 1 );
+		vertexArray->addInstancedVertexAttrib( 3, GL_FLOAT, sizeof( EntityInstance ), (GLvoid*)(regionStart + offsetof( EntityInstance, rotation )), 1 );
+		vertexArray->addInstancedVertexAttrib( 3, GL_FLOAT, sizeof( EntityInstance ), (GLvoid*)(regionStart + offsetof( EntityInstance, scale )), 1 );
+		if( !vertexArray->flushBindsAndAttribs() )
+			return false;
+		m_regionArrays.push_back( vertexArray );
 	}
+	CGraphics::GetActiveBackend()->bindVertexArray( 0 );
+	return true;
 }
 
 bool CRenderSystem::onLoad()
 {
-	size_t entityCount = m_entities.size();
-
-	// Create quads for each entity
-	m_vertices.reserve( (unsigned int)entityCount * 4 );
 	for( auto it: m_entities )
 	{
 		Position3D pos = m_pCoordinatorHandle->getComponentManager()->GetComponent<Position3D>( it );
 		m_pGameHandle->getLogger()->print( "Coordinates for entity %d: (%f, %f, %f)", it, pos.x, pos.y, pos.z );
-
-		m_vertices.push_back( { glm::vec3( 1.f, -1.f, 0.0f ) + pos } );
-		m_vertices.push_back( { glm::vec3( 1.f, 1.f, 0.0f ) + pos } );
-		m_vertices.push_back( { glm::vec3( -1.f, 1.f, 0.0f ) + pos } );
-		m_vertices.push_back( { glm::vec3( -1.f, -1.f, 0.0f ) + pos } );
 	}
 
-	// Create vertex buffer objects
-	m_vertexBuffer = std::make_shared<CBufferObject>();
-	m_vertexBuffer->create( sizeof( Vertex3D ) * m_vertices.size(), &m_vertices[0], 0, GL_STATIC_DRAW );
-	m_vertexArray->addBuffer( m_vertexBuffer, GL_ARRAY_BUFFER );
-
-	m_vertexArray->addVertexAttrib( 3, GL_FLOAT, sizeof( Vertex3D ), (GLvoid*)offsetof( Vertex3D, position ), GL_FALSE );
-
-	m_vertexArray->flushBindsAndAttribs();
-
-	return true;
+	if( !m_shaderIndex )
+		return true;
+	return this->reserveInstances( (unsigned int)m_entities.size() );
 }
 
 bool CRenderSystem::update( float deltaT )
 {
-	m_vertexArray->bind();
+	if( !m_shaderIndex )
+		return true;
+
+	// Every entity with a position is an entity of this system, so the dense position array holds them all
+	CComponentManager *pComponents = m_pCoordinatorHandle->getComponentManager();
+	std::shared_ptr<CComponentArray<Position3D>> positions = pComponents->GetComponentArray<Position3D>();
+	unsigned int instanceCount = positions->GetComponentCount();
+	if( instanceCount == 0 )
+		return true;
+	if( !this->reserveInstances( instanceCount ) )
+		return false;
 
-	for( auto it: m_entities )
-	{
+	// Instances are in the order of the position array
+	const Position3D *pPositions = positions->GetComponentData();
+	m_instances.resize( instanceCount );
+	for( unsigned int i = 0; i < instanceCount; i++ )
+		m_instances[i] = { pPositions[i], glm::vec3( 0.0f ), glm::vec3( 1.0f ) };
 
+	// Then the entities with a transform are rotated and scaled
+	std::shared_ptr<CComponentArray<Transform3DComponent>> transforms = pComponents->GetComponentArray<Transform3DComponent>();
+	const Transform3DComponent *pTransforms = transforms->GetComponentData();
+	for( EntityInt i = 0; i < transforms->GetComponentCount(); i++ )
+	{
+		size_t instance;
+		if( !positions->FindComponentIndex( transforms->GetEntityAtIndex( i ), &instance ) )
+			continue;
+		m_instances[instance].rotation = pTransforms[i].rotation;
+		m_instances[instance].scale = pTransforms[i].scale;
 	}
 
-	m_pGameHandle->getClient()->getGraphics()->submitForDraw( m_vertexArray, m_simpleShaderIndex, (unsigned int)m_vertices.size() );
+	// The stream buffer may be write combined, so the instances are copied in one go
+	GLintptr offset;
+	void *pInstances = m_instanceStream.allocate( sizeof( EntityInstance ) * instanceCount, sizeof( EntityInstance ), &offset );
+	if( !pInstances )
+		return false;
+	std::memcpy( pInstances, &m_instances[0], sizeof( EntityInstance ) * instanceCount );
+
+	// Uniforms shared by every entity
+	CGraphics *pGraphics = m_pGameHandle->getClient()->getGraphics();
+	GLintptr drawUniformOffset;
+	DrawUniforms *pDrawUniforms = (DrawUniforms*)pGraphics->getShaderManager()->allocateUniformBlock( UniformBlockIDs::UNIFORM_BLOCK_DRAW, &drawUniformOffset );
+	if( !pDrawUniforms )
+		return false;
+	pDrawUniforms->modelMatrix = glm::mat4( 1.0f );
+	pDrawUniforms->color = glm::vec4( ENTITY_COLOR, 1.0f );
+
+	// The only allocation of the frame, so it starts its region
+	assert( offset % m_instanceStream.getRegionSize() == 0 );
+	const std::shared_ptr<CVertexArray> &vertexArray = m_regionArrays[(size_t)(offset / m_instanceStream.getRegionSize())];
+	pGraphics->submitInstancedForDraw( vertexArray, m_shaderIndex, 6, GL_UNSIGNED_SHORT, instanceCount, drawUniformOffset );
 
 	return true;
 }
-
-void CRenderSystem::updateShaderUniforms()
-{
-	glUniformMatrix4fv( m_modelMatUniformLoc, 1, GL_FALSE, glm::value_ptr( m_modelMatrix ) );
-}
\ No newline at end of file
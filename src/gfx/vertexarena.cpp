@@ -0,0 +1,113 @@
+#include <algorithm>
+#include "gfx/vertexarena.h"
+#include "gfx/graphics.h"
+#include "gfx/backend.h"
+
+CVertexArena::CVertexArena()
+{
+	m_vertexSize = 0;
+	m_pageVertices = 0;
+	m_usedVertices = 0;
+	m_capacityVertices = 0;
+}
+CVertexArena::~CVertexArena() {
+}
+
+void CVertexArena::initialize( uint32_t vertexSize, uint32_t pageVertices )
+{
+	assert( vertexSize > 0 && pageVertices > 0 );
+
+	m_vertexSize = vertexSize;
+	m_pageVertices = pageVertices;
+}
+void CVertexArena::destroy()
+{
+	m_pages.clear();
+	m_freeBySize.clear();
+	m_freeByPage.clear();
+	m_usedVertices = 0;
+	m_capacityVertices = 0;
+}
+
+bool CVertexArena::addPage( uint32_t vertexCount )
+{
+	std::shared_ptr<CBufferObject> page = std::make_shared<CBufferObject>();
+	page->create( (GLsizeiptr)vertexCount * m_vertexSize, 0, GL_DYNAMIC_STORAGE_BIT, GL_DYNAMIC_DRAW );
+	// Binding creates the storage
+	if( !page->bind( GL_COPY_WRITE_BUFFER ) )
+		return false;
+
+	m_pages.push_back( page );
+	m_freeByPage.push_back( std::map<uint32_t, uint32_t>() );
+	this->addFreeRange( (uint32_t)m_pages.size() - 1, 0, vertexCount );
+	m_capacityVertices += vertexCount;
+	return true;
+}
+void CVertexArena::addFreeRange( uint32_t page, uint32_t first, uint32_t count )
+{
+	m_freeBySize.insert( FreeRange( count, page, first ) );
+	m_freeByPage[page][first] = count;
+}
+void CVertexArena::removeFreeRange( uint32_t page, uint32_t first, uint32_t count )
+{
+	m_freeBySize.erase( FreeRange( count, page, first ) );
+	m_freeByPage[page].erase( first );
+}
+
+bool CVertexArena::allocate( uint32_t count, VertexArenaBlock *pBlock )
+{
+	assert( m_vertexSize > 0 );
+	assert( count > 0 );
+
+	auto it = m_freeBySize.lower_bound( FreeRange( count, 0, 0 ) );
+	if( it == m_freeBySize.end() ) {
+		if( !this->addPage( std::max( count, m_pageVertices ) ) )
+			return false;
+		it = m_freeBySize.lower_bound( FreeRange( count, 0, 0 ) );
+		assert( it != m_freeBySize.end() );
+	}
+
+	uint32_t rangeCount = std::get<0>( *it ), page = std::get<1>( *it ), first = std::get<2>( *it );
+	this->removeFreeRange( page, first, rangeCount );
+	if( rangeCount > count )
+		this->addFreeRange( page, first + count, rangeCount - count );
+
+	(*pBlock) = { page, first, count };
+	m_usedVertices += count;
+	return true;
+}
+void CVertexArena::free( const VertexArenaBlock &block )
+{
+	assert( block.page < m_pages.size() );
+
+	uint32_t first = block.first, count = block.count;
+	std::map<uint32_t, uint32_t> &pageRanges = m_freeByPage[block.page];
+
+	// Merge with the free ranges just after and just before
+	auto next = pageRanges.find( first + count );
+	if( next != pageRanges.end() ) {
+		uint32_t nextCount = next->second;
+		this->removeFreeRange( block.page, first + count, nextCount );
+		count += nextCount;
+	}
+	auto previous = pageRanges.lower_bound( first );
+	if( previous != pageRanges.begin() ) {
+		--previous;
+		if( previous->first + previous->second == first ) {
+			uint32_t previousFirst = previous->first, previousCount = previous->second;
+			this->removeFreeRange( block.page, previousFirst, previousCount );
+			first = previousFirst;
+			count += previousCount;
+		}
+	}
+	this->addFreeRange( block.page, first, count );
+	m_usedVertices -= block.count;
+}
+
+void CVertexArena::upload( const VertexArenaBlock &block, const void *pVertices )
+{
+	assert( block.page < m_pages.size() );
+
+	m_pages[block.page]->bind( GL_COPY_WRITE_BUFFER );
+	CGraphics::GetActiveBackend()->bufferSubData( GL_COPY_WRITE_BUFFER, (GLintptr)block.first * m_vertexSize, (GLsizeiptr)block.count * m_vertexSize, pVertices );
+}
@@ -0,0 +1,99 @@
+#include <assert.h>
+#include <cstdlib>
+#include <chrono>
+#include "gfx/visibility.h"
+#include "gfx/mesher.h"
+
+CChunkVisibilityGraph::CChunkVisibilityGraph()
+{
+	// Nodes start out reached in search 0, which never runs
+	m_searchIndex = 0;
+	m_stats = VisibilityStats();
+}
+CChunkVisibilityGraph::~CChunkVisibilityGraph() {
+}
+
+void CChunkVisibilityGraph::setChunk( const ChunkPos &position, uint16_t faceConnections )
+{
+	auto inserted = m_nodes.insert( std::pair<ChunkPos, ChunkNode>( position, { faceConnections, 0 } ) );
+	if( !inserted.second )
+		inserted.first->second.faceConnections = faceConnections;
+}
+void CChunkVisibilityGraph::removeChunk( const ChunkPos &position ) {
+	m_nodes.erase( position );
+}
+void CChunkVisibilityGraph::clear()
+{
+	m_nodes.clear();
+	m_openReached.clear();
+	m_queue.clear();
+}
+
+bool CChunkVisibilityGraph::reach( const ChunkPos &position, uint16_t *pFaceConnections )
+{
+	assert( pFaceConnections );
+
+	if( position.y >= WORLD_HEIGHT_CHUNKS ) {
+		*pFaceConnections = CHUNK_FACE_CONNECTIONS_ALL;
+		return m_openReached.insert( position ).second;
+	}
+
+	auto it = m_nodes.find( position );
+	if( it == m_nodes.end() || it->second.reachedSearch == m_searchIndex )
+		return false;
+	it->second.reachedSearch = m_searchIndex;
+	*pFaceConnections = it->second.faceConnections;
+	return true;
+}
+
+void CChunkVisibilityGraph::search( const ChunkPos &cameraChunk, const glm::vec4 *pPlanes )
+{
+	assert( pPlanes );
+
+	auto searchStart = std::chrono::high_resolution_clock::now();
+	m_searchIndex++;
+	m_openReached.clear();
+	m_queue.clear();
+
+	// The camera chunk is searched even without a mesh, the camera can see out of it in every direction
+	uint16_t cameraConnections;
+	this->reach( cameraChunk, &cameraConnections );
+	m_queue.push_back( { cameraChunk, FACE_COUNT, 0, CHUNK_FACE_CONNECTIONS_ALL } );
+
+	// The queue is not popped, it is cleared for the next search
+	for( size_t head = 0; head < m_queue.size(); head++ )
+	{
+		const SearchStep step = m_queue[head];
+		for( uint8_t face = 0; face < FACE_COUNT; face++ )
+		{
+			// Never back towards the camera, and only out through faces the way in can see
+			if( step.directions & (1 << (face ^ 1)) )
+				continue;
+			if( step.entryFace != FACE_COUNT && !(step.faceConnections & ChunkFacePairBit( step.entryFace, face )) )
+				continue;
+
+			ChunkPos next = { step.position.x + FaceNormals[face][0], step.position.y + FaceNormals[face][1], step.position.z + FaceNormals[face][2] };
+			if( next.y < 0 || std::abs( next.x - cameraChunk.x ) > CHUNK_VISIBILITY_MAX_DISTANCE
+				|| std::abs( next.y - cameraChunk.y ) > CHUNK_VISIBILITY_MAX_DISTANCE || std::abs( next.z - cameraChunk.z ) > CHUNK_VISIBILITY_MAX_DISTANCE )
+				continue;
+			glm::vec3 nextMin( (float)(next.x*CHUNK_SIZE), (float)(next.y*CHUNK_SIZE), (float)(next.z*CHUNK_SIZE) );
+			if( !IsBoxInFrustum( pPlanes, nextMin, nextMin + glm::vec3( (float)CHUNK_SIZE ) ) )
+				continue;
+
+			uint16_t nextConnections;
+			if( !this->reach( next, &nextConnections ) )
+				continue;
+			m_queue.push_back( { next, (uint8_t)(face ^ 1), (uint8_t)(step.directions | (1 << face)), nextConnections } );
+		}
+	}
+
+	m_stats.searchCount++;
+	m_stats.reachedCount += m_queue.size();
+	m_stats.seconds += std::chrono::duration<double>( std::chrono::high_resolution_clock::now() - searchStart ).count();
+}
+
+bool CChunkVisibilityGraph::isReached( const ChunkPos &position ) const
+{
+	auto it = m_nodes.find( position );
+	return it != m_nodes.end() && it->second.reachedSearch == m_searchIndex;
+}
@@ -0,0 +1,546 @@
+#include <assert.h>
+#include <cstring>
+#include <algorithm>
+#include <chrono>
+#include "ioservice.h"
+#include "threadpool.h"
+#include "game.h"
+#include "logger.h"
+
+#ifdef WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
+
+#ifdef IO_URING_SUPPORTED
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+#endif
+
+/** Value stored in the native handle of a closed file slot */
+#define IO_INVALID_HANDLE ((intptr_t)-1)
+
+#ifdef IO_URING_SUPPORTED
+/**
+* @brief The io_uring rings and the requests submitted to them.
+*/
+struct CIOService::IOUring
+{
+	int ringFd;
+
+	void *pSqRing, *pCqRing;
+	size_t sqRingSize, cqRingSize;
+	io_uring_sqe *pSqes;
+	size_t sqesSize;
+
+	unsigned int *pSqTail, *pSqMask, *pSqArray;
+	unsigned int *pCqHead, *pCqTail, *pCqMask;
+	io_uring_cqe *pCqes;
+
+	/** A request in the ring, the iovec must live until the request completes */
+	struct RingOp
+	{
+		std::unique_ptr<IORequest> request;
+		iovec iov;
+	};
+	/** Requests in the ring, submitted or not, until their completion is reaped */
+	uint32_t opsInRing;
+	/** Entries published to the submission queue that the kernel has not taken yet */
+	uint32_t opsUnsubmitted;
+};
+
+static int SysIOUringSetup( unsigned int entries, io_uring_params *pParams ) {
+	return (int)syscall( __NR_io_uring_setup, entries, pParams );
+}
+static int SysIOUringEnter( int ringFd, unsigned int toSubmit, unsigned int minComplete, unsigned int flags ) {
+	return (int)syscall( __NR_io_uring_enter, ringFd, toSubmit, minComplete, flags, 0, 0 );
+}
+#endif
+
+CIOService::CIOService( CGame *pGameHandle ) : m_pGameHandle( pGameHandle )
+{
+	m_backend = IO_BACKEND_NONE;
+	m_running = false;
+	m_requestsInFlight = 0;
+	m_pFallbackPool = 0;
+#ifdef IO_URING_SUPPORTED
+	m_pRing = 0;
+#endif
+}
+CIOService::~CIOService()
+{
+	this->shutdown();
+}
+
+bool CIOService::initialize()
+{
+	assert( m_backend == IO_BACKEND_NONE );
+
+	m_running = true;
+
+#ifdef IO_URING_SUPPORTED
+	if( this->createRing() ) {
+		m_backend = IO_BACKEND_IO_URING;
+		m_ioThread = std::thread( &CIOService::ringThreadMain, this );
+		m_pGameHandle->getLogger()->print( "Started I/O service with io_uring backend" );
+		return true;
+	}
+	m_pGameHandle->getLogger()->printWarn( "io_uring is not available, falling back to thread pool I/O" );
+#endif
+
+	m_pFallbackPool = new CThreadPool();
+	if( !m_pFallbackPool->initialize( IO_FALLBACK_THREADS ) ) {
+		m_pGameHandle->getLogger()->printError( "Failed to start I/O threads" );
+		delete m_pFallbackPool;
+		m_pFallbackPool = 0;
+		m_running = false;
+		return false;
+	}
+	m_backend = IO_BACKEND_THREADPOOL;
+	m_pGameHandle->getLogger()->print( "Started I/O service with %d thread pool backend", IO_FALLBACK_THREADS );
+
+	return true;
+}
+void CIOService::shutdown()
+{
+	if( m_backend == IO_BACKEND_NONE )
+		return;
+
+	this->waitIdle();
+	{
+		// Under the lock, so the ring thread cannot miss the wakeup between checking and waiting
+		std::lock_guard<std::mutex> lock( m_submitMutex );
+		m_running = false;
+	}
+
+#ifdef IO_URING_SUPPORTED
+	if( m_backend == IO_BACKEND_IO_URING ) {
+		m_submitAvailable.notify_all();
+		if( m_ioThread.joinable() )
+			m_ioThread.join();
+		this->destroyRing();
+	}
+#endif
+	if( m_pFallbackPool ) {
+		m_pFallbackPool->shutdown();
+		delete m_pFallbackPool;
+		m_pFallbackPool = 0;
+	}
+
+	// Close any files left open
+	for( IOFileId i = 1; i <= (IOFileId)m_openFiles.size(); i++ )
+		this->closeFile( i );
+	m_openFiles.clear();
+	m_completeQueue.clear();
+	m_dispatchQueue.clear();
+
+	m_backend = IO_BACKEND_NONE;
+}
+
+IOFileId CIOService::openFile( const boost::filesystem::path &filePath, bool writable )
+{
+	intptr_t handle;
+
+#ifdef WIN32
+	HANDLE fileHandle = CreateFileW( filePath.wstring().c_str(), GENERIC_READ | (writable ? GENERIC_WRITE : 0), FILE_SHARE_READ | FILE_SHARE_WRITE, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0 );
+	if( fileHandle == INVALID_HANDLE_VALUE ) {
+		m_pGameHandle->getLogger()->printError( "Failed to open \'%s\' for I/O, error code %u", filePath.string().c_str(), (unsigned int)GetLastError() );
+		return 0;
+	}
+	handle = (intptr_t)fileHandle;
+#else
+	int fd = open( filePath.c_str(), (writable ? O_RDWR : O_RDONLY) | O_CLOEXEC );
+	if( fd < 0 ) {
+		m_pGameHandle->getLogger()->printError( "Failed to open \'%s\' for I/O: %s", filePath.string().c_str(), strerror( errno ) );
+		return 0;
+	}
+	handle = (intptr_t)fd;
+#endif
+
+	// Reuse a closed slot if there is one
+	std::lock_guard<std::mutex> lock( m_fileMutex );
+	for( size_t i = 0; i < m_openFiles.size(); i++ ) {
+		if( m_openFiles[i].nativeHandle == IO_INVALID_HANDLE ) {
+			m_openFiles[i] = { handle, writable };
+			return (IOFileId)(i + 1);
+		}
+	}
+	m_openFiles.push_back( { handle, writable } );
+
+	return (IOFileId)m_openFiles.size();
+}
+void CIOService::closeFile( IOFileId file )
+{
+	std::lock_guard<std::mutex> lock( m_fileMutex );
+
+	if( file == 0 || file > m_openFiles.size() )
+		return;
+	IOFile &ioFile = m_openFiles[file-1];
+	if( ioFile.nativeHandle == IO_INVALID_HANDLE )
+		return;
+#ifdef WIN32
+	CloseHandle( (HANDLE)ioFile.nativeHandle );
+#else
+	close( (int)ioFile.nativeHandle );
+#endif
+	ioFile.nativeHandle = IO_INVALID_HANDLE;
+}
+
+intptr_t CIOService::getNativeHandle( IOFileId file )
+{
+	std::lock_guard<std::mutex> lock( m_fileMutex );
+
+	if( file == 0 || file > m_openFiles.size() )
+		return IO_INVALID_HANDLE;
+	return m_openFiles[file-1].nativeHandle;
+}
+
+void CIOService::submit( std::unique_ptr<IORequest> request )
+{
+	assert( m_backend != IO_BACKEND_NONE );
+	assert( request );
+
+	m_requestsInFlight++;
+
+	if( m_backend == IO_BACKEND_THREADPOOL )
+	{
+		// std::function must be copyable, so hand the pool a raw pointer
+		IORequest *pRequest = request.release();
+		m_pFallbackPool->submit( [this, pRequest]() {
+			this->performBlocking( pRequest );
+			this->completeRequest( std::unique_ptr<IORequest>( pRequest ) );
+		} );
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock( m_submitMutex );
+		m_submitQueue.push_back( std::move( request ) );
+	}
+	m_submitAvailable.notify_one();
+}
+
+void CIOService::read( IOFileId file, uint64_t offset, size_t length, IOCompletionCallback callback )
+{
+	std::unique_ptr<IORequest> request( new IORequest() );
+	request->type = IO_REQUEST_READ;
+	request->file = file;
+	request->offset = offset;
+	request->buffer.resize( length );
+	request->result = 0;
+	request->callback = std::move( callback );
+	this->submit( std::move( request ) );
+}
+void CIOService::write( IOFileId file, uint64_t offset, std::vector<uint8_t> data, IOCompletionCallback callback )
+{
+	std::unique_ptr<IORequest> request( new IORequest() );
+	request->type = IO_REQUEST_WRITE;
+	request->file = file;
+	request->offset = offset;
+	request->buffer = std::move( data );
+	request->result = 0;
+	request->callback = std::move( callback );
+	this->submit( std::move( request ) );
+}
+
+void CIOService::performBlocking( IORequest *pRequest )
+{
+	intptr_t handle = this->getNativeHandle( pRequest->file );
+	if( handle == IO_INVALID_HANDLE ) {
+		pRequest->result = -1;
+		return;
+	}
+
+#ifdef WIN32
+	HANDLE fileHandle = (HANDLE)handle;
+	OVERLAPPED overlapped;
+	DWORD transferred = 0;
+	BOOL success;
+
+	memset( &overlapped, 0, sizeof( overlapped ) );
+	overlapped.Offset = (DWORD)(pRequest->offset & 0xFFFFFFFF);
+	overlapped.OffsetHigh = (DWORD)(pRequest->offset >> 32);
+	switch( pRequest->type )
+	{
+	case IO_REQUEST_READ:
+		success = ReadFile( fileHandle, pRequest->buffer.data(), (DWORD)pRequest->buffer.size(), &transferred, &overlapped );
+		// Reading past the end of the file is a short read, not an error
+		pRequest->result = (success || GetLastError() == ERROR_HANDLE_EOF) ? (int64_t)transferred : -(int64_t)GetLastError();
+		break;
+	case IO_REQUEST_WRITE:
+		success = WriteFile( fileHandle, pRequest->buffer.data(), (DWORD)pRequest->buffer.size(), &transferred, &overlapped );
+		pRequest->result = success ? (int64_t)transferred : -(int64_t)GetLastError();
+		break;
+	case IO_REQUEST_SYNC:
+		pRequest->result = FlushFileBuffers( fileHandle ) ? 0 : -(int64_t)GetLastError();
+		break;
+	}
+#else
+	int fd = (int)handle;
+	size_t done = 0;
+	ssize_t transferred = 0;
+
+	switch( pRequest->type )
+	{
+	case IO_REQUEST_READ:
+		while( done < pRequest->buffer.size() ) {
+			transferred = pread( fd, pRequest->buffer.data() + done, pRequest->buffer.size() - done, (off_t)(pRequest->offset + done) );
+			if( transferred < 0 && errno == EINTR )
+				continue;
+			if( transferred <= 0 )
+				break;
+			done += (size_t)transferred;
+		}
+		pRequest->result = (done > 0 || transferred >= 0) ? (int64_t)done : -(int64_t)errno;
+		break;
+	case IO_REQUEST_WRITE:
+		while( done < pRequest->buffer.size() ) {
+			transferred = pwrite( fd, pRequest->buffer.data() + done, pRequest->buffer.size() - done, (off_t)(pRequest->offset + done) );
+			if( transferred < 0 && errno == EINTR )
+				continue;
+			if( transferred <= 0 )
+				break;
+			done += (size_t)transferred;
+		}
+		pRequest->result = (done == pRequest->buffer.size()) ? (int64_t)done : -(int64_t)errno;
+		break;
+	case IO_REQUEST_SYNC:
+		pRequest->result = (fdatasync( fd ) == 0) ? 0 : -(int64_t)errno;
+		break;
+	}
+#endif
+}
+
+void CIOService::completeRequest( std::unique_ptr<IORequest> request )
+{
+	{
+		std::lock_guard<std::mutex> lock( m_completeMutex );
+		m_completeQueue.push_back( std::move( request ) );
+		m_requestsInFlight--;
+	}
+	m_requestsFinished.notify_all();
+}
+
+unsigned int CIOService::dispatchCompletions()
+{
+	// Swap out the queue so callbacks can submit new requests without holding the lock
+	{
+		std::lock_guard<std::mutex> lock( m_completeMutex );
+		if( m_completeQueue.empty() )
+			return 0;
+		m_dispatchQueue.swap( m_completeQueue );
+	}
+
+	unsigned int dispatched = 0;
+	for( auto &it: m_dispatchQueue ) {
+		if( it->callback )
+			it->callback( *it );
+		dispatched++;
+	}
+	m_dispatchQueue.clear();
+
+	return dispatched;
+}
+
+void CIOService::waitIdle()
+{
+	std::unique_lock<std::mutex> lock( m_completeMutex );
+	m_requestsFinished.wait( lock, [this] { return m_requestsInFlight == 0; } );
+}
+
+#ifdef IO_URING_SUPPORTED
+bool CIOService::createRing()
+{
+	io_uring_params params;
+	IOUring *pRing = new IOUring();
+
+	memset( &params, 0, sizeof( params ) );
+	pRing->ringFd = SysIOUringSetup( IO_QUEUE_DEPTH, &params );
+	if( pRing->ringFd < 0 ) {
+		delete pRing;
+		return false;
+	}
+
+	pRing->sqRingSize = params.sq_off.array + params.sq_entries*sizeof( unsigned int );
+	pRing->cqRingSize = params.cq_off.cqes + params.cq_entries*sizeof( io_uring_cqe );
+	if( params.features & IORING_FEAT_SINGLE_MMAP )
+		pRing->sqRingSize = pRing->cqRingSize = std::max( pRing->sqRingSize, pRing->cqRingSize );
+	pRing->sqesSize = params.sq_entries*sizeof( io_uring_sqe );
+
+	pRing->pSqRing = mmap( 0, pRing->sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, pRing->ringFd, IORING_OFF_SQ_RING );
+	if( params.features & IORING_FEAT_SINGLE_MMAP )
+		pRing->pCqRing = pRing->pSqRing;
+	else
+		pRing->pCqRing = mmap( 0, pRing->cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, pRing->ringFd, IORING_OFF_CQ_RING );
+	pRing->pSqes = (io_uring_sqe*)mmap( 0, pRing->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, pRing->ringFd, IORING_OFF_SQES );
+	if( pRing->pSqRing == MAP_FAILED || pRing->pCqRing == MAP_FAILED || pRing->pSqes == MAP_FAILED ) {
+		m_pRing = pRing;
+		this->destroyRing();
+		return false;
+	}
+
+	uint8_t *pSq = (uint8_t*)pRing->pSqRing;
+	uint8_t *pCq = (uint8_t*)pRing->pCqRing;
+	pRing->pSqTail = (unsigned int*)(pSq + params.sq_off.tail);
+	pRing->pSqMask = (unsigned int*)(pSq + params.sq_off.ring_mask);
+	pRing->pSqArray = (unsigned int*)(pSq + params.sq_off.array);
+	pRing->pCqHead = (unsigned int*)(pCq + params.cq_off.head);
+	pRing->pCqTail = (unsigned int*)(pCq + params.cq_off.tail);
+	pRing->pCqMask = (unsigned int*)(pCq + params.cq_off.ring_mask);
+	pRing->pCqes = (io_uring_cqe*)(pCq + params.cq_off.cqes);
+	pRing->opsInRing = 0;
+	pRing->opsUnsubmitted = 0;
+
+	m_pRing = pRing;
+
+	return true;
+}
+void CIOService::destroyRing()
+{
+	if( !m_pRing )
+		return;
+
+	if( m_pRing->pSqes && m_pRing->pSqes != MAP_FAILED )
+		munmap( m_pRing->pSqes, m_pRing->sqesSize );
+	if( m_pRing->pCqRing && m_pRing->pCqRing != MAP_FAILED && m_pRing->pCqRing != m_pRing->pSqRing )
+		munmap( m_pRing->pCqRing, m_pRing->cqRingSize );
+	if( m_pRing->pSqRing && m_pRing->pSqRing != MAP_FAILED )
+		munmap( m_pRing->pSqRing, m_pRing->sqRingSize );
+	close( m_pRing->ringFd );
+
+	delete m_pRing;
+	m_pRing = 0;
+}
+
+void CIOService::ringThreadMain()
+{
+	std::vector<std::unique_ptr<IORequest>> batch;
+
+	while( true )
+	{
+		// Take as many queued requests as there is room for in the ring
+		{
+			std::unique_lock<std::mutex> lock( m_submitMutex );
+			if( m_pRing->opsInRing == 0 )
+				m_submitAvailable.wait( lock, [this] { return !m_running || !m_submitQueue.empty(); } );
+			if( !m_running && m_submitQueue.empty() && m_pRing->opsInRing == 0 )
+				break;
+
+			size_t space = IO_QUEUE_DEPTH - m_pRing->opsInRing;
+			size_t take = std::min( space, m_submitQueue.size() );
+			for( size_t i = 0; i < take; i++ )
+				batch.push_back( std::move( m_submitQueue[i] ) );
+			m_submitQueue.erase( m_submitQueue.begin(), m_submitQueue.begin() + take );
+		}
+
+		// Fill submission queue entries for the whole batch, then make one system call
+		unsigned int tail = *m_pRing->pSqTail;
+		unsigned int mask = *m_pRing->pSqMask;
+		unsigned int filled = 0;
+		for( auto &it: batch )
+		{
+			intptr_t handle = this->getNativeHandle( it->file );
+			if( handle == IO_INVALID_HANDLE ) {
+				it->result = -EBADF;
+				this->completeRequest( std::move( it ) );
+				continue;
+			}
+
+			IOUring::RingOp *pOp = new IOUring::RingOp();
+			pOp->iov.iov_base = it->buffer.data();
+			pOp->iov.iov_len = it->buffer.size();
+
+			unsigned int index = tail & mask;
+			io_uring_sqe *pSqe = &m_pRing->pSqes[index];
+			memset( pSqe, 0, sizeof( io_uring_sqe ) );
+			pSqe->fd = (int)handle;
+			pSqe->off = it->offset;
+			pSqe->user_data = (uint64_t)(uintptr_t)pOp;
+			switch( it->type )
+			{
+			case IO_REQUEST_READ:
+				pSqe->opcode = IORING_OP_READV;
+				pSqe->addr = (uint64_t)(uintptr_t)&pOp->iov;
+				pSqe->len = 1;
+				break;
+			case IO_REQUEST_WRITE:
+				pSqe->opcode = IORING_OP_WRITEV;
+				pSqe->addr = (uint64_t)(uintptr_t)&pOp->iov;
+				pSqe->len = 1;
+				break;
+			case IO_REQUEST_SYNC:
+				pSqe->opcode = IORING_OP_FSYNC;
+				pSqe->fsync_flags = IORING_FSYNC_DATASYNC;
+				break;
+			}
+			pOp->request = std::move( it );
+			m_pRing->pSqArray[index] = index;
+			tail++;
+			filled++;
+		}
+		batch.clear();
+		// Publish the new tail after the entries are written
+		__atomic_store_n( m_pRing->pSqTail, tail, __ATOMIC_RELEASE );
+		m_pRing->opsInRing += filled;
+		m_pRing->opsUnsubmitted += filled;
+
+		// Submit everything the kernel has not taken yet, including entries left over from a short submit. Only wait
+		// for a completion if something was already submitted, entries that fail to submit would never complete.
+		uint32_t opsSubmitted = m_pRing->opsInRing - m_pRing->opsUnsubmitted;
+		int entered;
+		do {
+			entered = SysIOUringEnter( m_pRing->ringFd, m_pRing->opsUnsubmitted, opsSubmitted > 0 ? 1 : 0, opsSubmitted > 0 ? IORING_ENTER_GETEVENTS : 0 );
+		} while( entered < 0 && errno == EINTR );
+		bool backOff = false;
+		if( entered >= 0 )
+			m_pRing->opsUnsubmitted -= std::min( (uint32_t)entered, m_pRing->opsUnsubmitted );
+		else if( errno == EBUSY || errno == EAGAIN ) {
+			// Out of resources or the completion queue is full, reap what there is and try again
+			backOff = true;
+		}
+		else
+		{
+			int error = errno;
+			m_pGameHandle->getLogger()->printError( "io_uring_enter failed: %s", strerror( error ) );
+			// Take back the entries the kernel never saw and fail their requests
+			tail -= m_pRing->opsUnsubmitted;
+			for( uint32_t i = 0; i < m_pRing->opsUnsubmitted; i++ ) {
+				IOUring::RingOp *pOp = (IOUring::RingOp*)(uintptr_t)m_pRing->pSqes[(tail + i) & mask].user_data;
+				pOp->request->result = -error;
+				this->completeRequest( std::move( pOp->request ) );
+				delete pOp;
+			}
+			__atomic_store_n( m_pRing->pSqTail, tail, __ATOMIC_RELEASE );
+			m_pRing->opsInRing -= m_pRing->opsUnsubmitted;
+			m_pRing->opsUnsubmitted = 0;
+			backOff = true;
+		}
+
+		// Reap completions
+		unsigned int head = *m_pRing->pCqHead;
+		unsigned int cqTail = __atomic_load_n( m_pRing->pCqTail, __ATOMIC_ACQUIRE );
+		unsigned int cqMask = *m_pRing->pCqMask;
+		while( head != cqTail )
+		{
+			io_uring_cqe *pCqe = &m_pRing->pCqes[head & cqMask];
+			IOUring::RingOp *pOp = (IOUring::RingOp*)(uintptr_t)pCqe->user_data;
+			pOp->request->result = pCqe->res;
+			this->completeRequest( std::move( pOp->request ) );
+			delete pOp;
+			m_pRing->opsInRing--;
+			head++;
+		}
+		bool reaped = head != *m_pRing->pCqHead;
+		__atomic_store_n( m_pRing->pCqHead, head, __ATOMIC_RELEASE );
+
+		// Nothing moved, do not spin on the same failure
+		if( backOff && !reaped )
+			std::this_thread::sleep_for( std::chrono::milliseconds( IO_RING_RETRY_MS ) );
+	}
+}
+#endif
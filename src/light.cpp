@@ -0,0 +1,468 @@
+#include <assert.h>
+#include <algorithm>
+#include "light.h"
+#include "game.h"
+#include "logger.h"
+
+static_assert(LIGHT_LEVEL_MAX < CHUNK_SIZE, "Relit columns assume light does not cross a whole chunk");
+
+/////////////////
+// LightQueues //
+/////////////////
+
+bool CLightEngine::LightQueues::empty() const
+{
+	for( uint8_t channel = 0; channel < LIGHT_CHANNEL_COUNT; channel++ ) {
+		if( !add[channel].empty() || !remove[channel].empty() || !incomingAdd[channel].empty() || !incomingRemove[channel].empty() )
+			return false;
+	}
+	return true;
+}
+
+//////////////////
+// CLightEngine //
+//////////////////
+
+CLightEngine::CLightEngine( CGame *pGameHandle ) : m_pGameHandle( pGameHandle )
+{
+	m_pChunkStore = 0;
+}
+CLightEngine::~CLightEngine() {
+}
+
+bool CLightEngine::initialize( CChunkStore *pChunkStore )
+{
+	assert( pChunkStore );
+
+	m_pChunkStore = pChunkStore;
+	if( !m_threadPool.initialize( 0 ) ) {
+		m_pGameHandle->getLogger()->printError( "Failed to start light propagation threads" );
+		return false;
+	}
+
+	return true;
+}
+void CLightEngine::shutdown()
+{
+	m_threadPool.shutdown();
+	m_queues.clear();
+	m_tasks.clear();
+	m_pChunkStore = 0;
+}
+
+void CLightEngine::queueAdd( const ChunkPos &position, LightChannels channel, uint32_t index, uint8_t level )
+{
+	if( !m_pChunkStore->getChunk( position ) )
+		return;
+	m_queues[position].add[channel].push_back( PackEntry( index, level ) );
+}
+
+void CLightEngine::processChunk( LightTask &task )
+{
+	for( uint8_t channel = 0; channel < LIGHT_CHANNEL_COUNT; channel++ ) {
+		this->processRemoves( task, (LightChannels)channel );
+		this->processAdds( task, (LightChannels)channel );
+	}
+}
+
+void CLightEngine::processRemoves( LightTask &task, LightChannels channel )
+{
+	CChunk *pChunk = task.pChunk;
+	const ChunkPos &position = pChunk->getPosition();
+	CLightArray &light = (channel == LIGHT_CHANNEL_SKY) ? pChunk->getSkyLight() : pChunk->getBlockLight();
+	std::vector<uint32_t> &removeQueue = task.pQueues->remove[channel];
+	std::vector<uint32_t> &addQueue = task.pQueues->add[channel];
+
+	// Darken a cell if its light could have come from a darkened neighbour, otherwise spread it back
+	auto darken = [&]( uint32_t index, uint32_t sourceLevel, bool down ) {
+		uint8_t level = light.get( index );
+		if( level == 0 )
+			return;
+		// Sky light going down does not fade, so full light below full light came from the same place
+		if( level < sourceLevel || (down && sourceLevel == LIGHT_LEVEL_MAX && level == LIGHT_LEVEL_MAX) ) {
+			light.set( index, 0 );
+			removeQueue.push_back( PackEntry( index, level ) );
+			if( channel == LIGHT_CHANNEL_BLOCK ) {
+				uint8_t emission = GetBlockLightEmission( pChunk->getBlockByIndex( index ) );
+				if( emission ) {
+					light.set( index, emission );
+					addQueue.push_back( PackEntry( index, emission ) );
+				}
+			}
+		}
+		else
+			addQueue.push_back( PackEntry( index, level ) );
+	};
+
+	for( uint32_t entry: task.pQueues->incomingRemove[channel] )
+		darken( entry & LIGHT_ENTRY_INDEX_MASK, (entry >> LIGHT_ENTRY_LEVEL_SHIFT) & LIGHT_LEVEL_MAX, (entry & LIGHT_ENTRY_DOWN_BIT) != 0 );
+	task.pQueues->incomingRemove[channel].clear();
+
+	for( size_t i = 0; i < removeQueue.size(); i++ )
+	{
+		uint32_t index = removeQueue[i] & LIGHT_ENTRY_INDEX_MASK;
+		uint32_t level = (removeQueue[i] >> LIGHT_ENTRY_LEVEL_SHIFT) & LIGHT_LEVEL_MAX;
+		int32_t coords[3] = { (int32_t)(index & CHUNK_MASK), (int32_t)(index >> (CHUNK_SIZE_BITS*2)), (int32_t)((index >> CHUNK_SIZE_BITS) & CHUNK_MASK) };
+
+		for( uint8_t face = 0; face < FACE_COUNT; face++ )
+		{
+			int32_t x = coords[0] + FaceNormals[face][0];
+			int32_t y = coords[1] + FaceNormals[face][1];
+			int32_t z = coords[2] + FaceNormals[face][2];
+			bool down = (channel == LIGHT_CHANNEL_SKY && face == FACE_NEG_Y);
+
+			if( ((x | y | z) & ~CHUNK_MASK) == 0 )
+				darken( ChunkBlockIndex( x, y, z ), level, down );
+			else {
+				ChunkPos neighbour = { position.x + FaceNormals[face][0], position.y + FaceNormals[face][1], position.z + FaceNormals[face][2] };
+				task.outbox.push_back( { neighbour, (uint8_t)channel, true, PackEntry( ChunkBlockIndex( x & CHUNK_MASK, y & CHUNK_MASK, z & CHUNK_MASK ), level, down ) } );
+			}
+		}
+	}
+	removeQueue.clear();
+}
+
+void CLightEngine::processAdds( LightTask &task, LightChannels channel )
+{
+	CChunk *pChunk = task.pChunk;
+	const ChunkPos &position = pChunk->getPosition();
+	CLightArray &light = (channel == LIGHT_CHANNEL_SKY) ? pChunk->getSkyLight() : pChunk->getBlockLight();
+	std::vector<uint32_t> &addQueue = task.pQueues->add[channel];
+
+	for( uint32_t entry: task.pQueues->incomingAdd[channel] ) {
+		uint32_t index = entry & LIGHT_ENTRY_INDEX_MASK;
+		uint8_t level = (uint8_t)((entry >> LIGHT_ENTRY_LEVEL_SHIFT) & LIGHT_LEVEL_MAX);
+		if( light.get( index ) < level && !IsBlockOpaque( pChunk->getBlockByIndex( index ) ) ) {
+			light.set( index, level );
+			addQueue.push_back( entry );
+		}
+	}
+	task.pQueues->incomingAdd[channel].clear();
+
+	for( size_t i = 0; i < addQueue.size(); i++ )
+	{
+		uint32_t index = addQueue[i] & LIGHT_ENTRY_INDEX_MASK;
+		// The cell may have been darkened or brightened since it was queued
+		uint32_t level = light.get( index );
+		if( level <= 1 )
+			continue;
+		int32_t coords[3] = { (int32_t)(index & CHUNK_MASK), (int32_t)(index >> (CHUNK_SIZE_BITS*2)), (int32_t)((index >> CHUNK_SIZE_BITS) & CHUNK_MASK) };
+
+		for( uint8_t face = 0; face < FACE_COUNT; face++ )
+		{
+			uint8_t newLevel = (uint8_t)((channel == LIGHT_CHANNEL_SKY && face == FACE_NEG_Y && level == LIGHT_LEVEL_MAX) ? level : level - 1);
+			int32_t x = coords[0] + FaceNormals[face][0];
+			int32_t y = coords[1] + FaceNormals[face][1];
+			int32_t z = coords[2] + FaceNormals[face][2];
+
+			if( ((x | y | z) & ~CHUNK_MASK) == 0 ) {
+				uint32_t neighbourIndex = ChunkBlockIndex( x, y, z );
+				if( light.get( neighbourIndex ) < newLevel && !IsBlockOpaque( pChunk->getBlockByIndex( neighbourIndex ) ) ) {
+					light.set( neighbourIndex, newLevel );
+					addQueue.push_back( PackEntry( neighbourIndex, newLevel ) );
+				}
+			}
+			else {
+				ChunkPos neighbour = { position.x + FaceNormals[face][0], position.y + FaceNormals[face][1], position.z + FaceNormals[face][2] };
+				task.outbox.push_back( { neighbour, (uint8_t)channel, false, PackEntry( ChunkBlockIndex( x & CHUNK_MASK, y & CHUNK_MASK, z & CHUNK_MASK ), newLevel ) } );
+			}
+		}
+	}
+	addQueue.clear();
+}
+
+bool CLightEngine::update( unsigned int maxRounds )
+{
+	for( unsigned int round = 0; round < maxRounds; round++ )
+	{
+		// Every chunk with work is a task, work for chunks unloaded since it was queued is dropped
+		size_t taskCount = 0;
+		for( auto it = m_queues.begin(); it != m_queues.end(); )
+		{
+			CChunk *pChunk = m_pChunkStore->getChunk( it->first );
+			if( !pChunk || it->second.empty() ) {
+				it = m_queues.erase( it );
+				continue;
+			}
+			if( taskCount == m_tasks.size() )
+				m_tasks.push_back( LightTask() );
+			LightTask &task = m_tasks[taskCount++];
+			task.pChunk = pChunk;
+			task.pQueues = &it->second;
+			task.outbox.clear();
+			++it;
+		}
+		if( taskCount == 0 )
+			return false;
+
+		// Tasks only touch their own chunk, so they can all run at once
+		m_threadPool.parallelFor( taskCount, [this]( size_t i ) {
+			this->processChunk( m_tasks[i] );
+		} );
+
+		// Deliver the light that crossed into neighbouring chunks
+		for( size_t i = 0; i < taskCount; i++ )
+		{
+			ChunkPos lastTarget;
+			LightQueues *pTargetQueues = 0;
+			for( auto &message: m_tasks[i].outbox )
+			{
+				if( !pTargetQueues || message.target != lastTarget ) {
+					lastTarget = message.target;
+					pTargetQueues = m_pChunkStore->getChunk( message.target ) ? &m_queues[message.target] : 0;
+					if( !pTargetQueues )
+						continue;
+				}
+				if( message.remove )
+					pTargetQueues->incomingRemove[message.channel].push_back( message.entry );
+				else
+					pTargetQueues->incomingAdd[message.channel].push_back( message.entry );
+			}
+		}
+	}
+
+	for( auto it = m_queues.begin(); it != m_queues.end(); ) {
+		if( it->second.empty() )
+			it = m_queues.erase( it );
+		else
+			++it;
+	}
+	return !m_queues.empty();
+}
+
+void CLightEngine::finish()
+{
+	while( this->update( LIGHT_MAX_ROUNDS_PER_TICK ) );
+}
+
+void CLightEngine::lightColumn( int32_t columnX, int32_t columnZ )
+{
+	if( this->seedColumn( columnX, columnZ ) )
+		this->reconcileColumn( columnX, columnZ );
+}
+
+bool CLightEngine::seedColumn( int32_t columnX, int32_t columnZ )
+{
+	CChunk *pChunks[WORLD_HEIGHT_CHUNKS];
+	for( int32_t y = 0; y < WORLD_HEIGHT_CHUNKS; y++ ) {
+		pChunks[y] = m_pChunkStore->getChunk( { columnX, y, columnZ } );
+		if( !pChunks[y] )
+			return false;
+	}
+
+	// Find where sky light stops in every block column, the block above the highest opaque block
+	int32_t heights[CHUNK_SIZE][CHUNK_SIZE];
+	for( int32_t z = 0; z < CHUNK_SIZE; z++ )
+		std::fill( heights[z], heights[z] + CHUNK_SIZE, -1 );
+	for( int32_t y = WORLD_HEIGHT_CHUNKS-1; y >= 0; y-- )
+	{
+		CChunk *pChunk = pChunks[y];
+		if( pChunk->isUniform() ) {
+			if( !IsBlockOpaque( pChunk->getUniformBlock() ) )
+				continue;
+			for( int32_t z = 0; z < CHUNK_SIZE; z++ )
+				std::replace( heights[z], heights[z] + CHUNK_SIZE, -1, (y + 1)*CHUNK_SIZE );
+			break;
+		}
+		for( int32_t z = 0; z < CHUNK_SIZE; z++ ) {
+			for( int32_t x = 0; x < CHUNK_SIZE; x++ ) {
+				if( heights[z][x] != -1 )
+					continue;
+				for( int32_t ly = CHUNK_SIZE-1; ly >= 0; ly-- ) {
+					if( IsBlockOpaque( pChunk->getBlock( x, ly, z ) ) ) {
+						heights[z][x] = y*CHUNK_SIZE + ly + 1;
+						break;
+					}
+				}
+			}
+		}
+	}
+	int32_t minHeight = WORLD_HEIGHT, maxHeight = 0;
+	for( int32_t z = 0; z < CHUNK_SIZE; z++ ) {
+		for( int32_t x = 0; x < CHUNK_SIZE; x++ ) {
+			heights[z][x] = std::max( heights[z][x], 0 );
+			minHeight = std::min( minHeight, heights[z][x] );
+			maxHeight = std::max( maxHeight, heights[z][x] );
+		}
+	}
+
+	for( int32_t y = 0; y < WORLD_HEIGHT_CHUNKS; y++ )
+	{
+		CChunk *pChunk = pChunks[y];
+		int32_t chunkBottom = y*CHUNK_SIZE;
+
+		// Sky light straight down, chunks entirely above or below the surface stay uniform
+		CLightArray &skyLight = pChunk->getSkyLight();
+		if( chunkBottom >= maxHeight )
+			skyLight.fill( LIGHT_LEVEL_MAX );
+		else if( chunkBottom + CHUNK_SIZE <= minHeight )
+			skyLight.fill( 0 );
+		else {
+			skyLight.fill( 0 );
+			for( int32_t ly = 0; ly < CHUNK_SIZE; ly++ ) {
+				for( int32_t z = 0; z < CHUNK_SIZE; z++ ) {
+					for( int32_t x = 0; x < CHUNK_SIZE; x++ ) {
+						if( chunkBottom + ly >= heights[z][x] )
+							skyLight.set( ChunkBlockIndex( x, ly, z ), LIGHT_LEVEL_MAX );
+					}
+				}
+			}
+		}
+
+		// Light sources
+		pChunk->getBlockLight().fill( 0 );
+		if( pChunk->isUniform() && !GetBlockLightEmission( pChunk->getUniformBlock() ) )
+			continue;
+		for( uint32_t i = 0; i < CHUNK_VOLUME; i++ ) {
+			uint8_t emission = GetBlockLightEmission( pChunk->getBlockByIndex( i ) );
+			if( emission ) {
+				pChunk->getBlockLight().set( i, emission );
+				m_queues[pChunk->getPosition()].add[LIGHT_CHANNEL_BLOCK].push_back( PackEntry( i, emission ) );
+			}
+		}
+	}
+
+	// Sky light only needs to spread sideways where a neighbouring block column is in shadow
+	for( int32_t z = 0; z < CHUNK_SIZE; z++ )
+	{
+		for( int32_t x = 0; x < CHUNK_SIZE; x++ )
+		{
+			int32_t height = heights[z][x];
+			int32_t shadowTop = height;
+			if( x > 0 ) shadowTop = std::max( shadowTop, heights[z][x-1] );
+			if( x < CHUNK_SIZE-1 ) shadowTop = std::max( shadowTop, heights[z][x+1] );
+			if( z > 0 ) shadowTop = std::max( shadowTop, heights[z-1][x] );
+			if( z < CHUNK_SIZE-1 ) shadowTop = std::max( shadowTop, heights[z+1][x] );
+			for( int32_t y = height; y < shadowTop; y++ )
+				m_queues[pChunks[y >> CHUNK_SIZE_BITS]->getPosition()].add[LIGHT_CHANNEL_SKY].push_back( PackEntry( ChunkBlockIndex( x, y & CHUNK_MASK, z ), LIGHT_LEVEL_MAX ) );
+		}
+	}
+
+	return true;
+}
+
+void CLightEngine::reconcileColumn( int32_t columnX, int32_t columnZ )
+{
+	// Light crossing the sides of the column, in either direction
+	static const uint8_t sideFaces[4] = { FACE_NEG_X, FACE_POS_X, FACE_NEG_Z, FACE_POS_Z };
+	for( uint8_t face: sideFaces ) {
+		for( int32_t y = 0; y < WORLD_HEIGHT_CHUNKS; y++ ) {
+			CChunk *pChunk = m_pChunkStore->getChunk( { columnX, y, columnZ } );
+			CChunk *pNeighbour = m_pChunkStore->getChunk( { columnX + FaceNormals[face][0], y, columnZ + FaceNormals[face][2] } );
+			if( pChunk && pNeighbour )
+				this->reconcileBorder( pChunk, pNeighbour, face );
+		}
+	}
+}
+
+void CLightEngine::relightColumns( const std::vector<std::pair<int32_t, int32_t>> &columns )
+{
+	// Work queued before the edit would spread stale light into the recomputed columns
+	this->finish();
+
+	// Every column is reset before any border is compared, so no border sees the old light of a column still to reset
+	for( auto &it: columns )
+		this->seedColumn( it.first, it.second );
+	for( auto &it: columns )
+		this->reconcileColumn( it.first, it.second );
+}
+
+void CLightEngine::reconcileBorder( CChunk *pChunk, CChunk *pNeighbour, uint8_t face )
+{
+	const uint32_t axis = face / 2;
+	const bool positive = (face & 1) != 0;
+	uint32_t coords[3], neighbourCoords[3];
+	coords[axis] = positive ? CHUNK_SIZE-1 : 0;
+	neighbourCoords[axis] = positive ? 0 : CHUNK_SIZE-1;
+
+	for( uint32_t v = 0; v < CHUNK_SIZE; v++ )
+	{
+		coords[(axis + 2) % 3] = neighbourCoords[(axis + 2) % 3] = v;
+		for( uint32_t u = 0; u < CHUNK_SIZE; u++ )
+		{
+			coords[(axis + 1) % 3] = neighbourCoords[(axis + 1) % 3] = u;
+			uint32_t index = ChunkBlockIndex( coords[0], coords[1], coords[2] );
+			uint32_t neighbourIndex = ChunkBlockIndex( neighbourCoords[0], neighbourCoords[1], neighbourCoords[2] );
+
+			for( uint8_t channel = 0; channel < LIGHT_CHANNEL_COUNT; channel++ )
+			{
+				const CLightArray &light = (channel == LIGHT_CHANNEL_SKY) ? pChunk->getSkyLight() : pChunk->getBlockLight();
+				const CLightArray &neighbourLight = (channel == LIGHT_CHANNEL_SKY) ? pNeighbour->getSkyLight() : pNeighbour->getBlockLight();
+				uint8_t level = light.get( index );
+				uint8_t neighbourLevel = neighbourLight.get( neighbourIndex );
+
+				if( level > neighbourLevel + 1 && !IsBlockOpaque( pNeighbour->getBlockByIndex( neighbourIndex ) ) )
+					m_queues[pChunk->getPosition()].add[channel].push_back( PackEntry( index, level ) );
+				else if( neighbourLevel > level + 1 && !IsBlockOpaque( pChunk->getBlockByIndex( index ) ) )
+					m_queues[pNeighbour->getPosition()].add[channel].push_back( PackEntry( neighbourIndex, neighbourLevel ) );
+			}
+		}
+	}
+}
+
+void CLightEngine::onBlockChanged( int32_t x, int32_t y, int32_t z, BlockId oldBlock, BlockId newBlock )
+{
+	ChunkPos position = { BlockToChunkCoord( x ), BlockToChunkCoord( y ), BlockToChunkCoord( z ) };
+	CChunk *pChunk = m_pChunkStore->getChunk( position );
+	if( !pChunk )
+		return;
+	uint32_t index = ChunkBlockIndex( x & CHUNK_MASK, y & CHUNK_MASK, z & CHUNK_MASK );
+	bool opaque = IsBlockOpaque( newBlock );
+	LightQueues &queues = m_queues[position];
+
+	// Block light, anything lit through or by this block is darkened first
+	CLightArray &blockLight = pChunk->getBlockLight();
+	uint8_t level = blockLight.get( index );
+	if( level > 0 && (opaque || GetBlockLightEmission( oldBlock ) > 0) ) {
+		blockLight.set( index, 0 );
+		queues.remove[LIGHT_CHANNEL_BLOCK].push_back( PackEntry( index, level ) );
+	}
+	uint8_t emission = GetBlockLightEmission( newBlock );
+	if( emission > blockLight.get( index ) ) {
+		blockLight.set( index, emission );
+		queues.add[LIGHT_CHANNEL_BLOCK].push_back( PackEntry( index, emission ) );
+	}
+
+	// Sky light
+	CLightArray &skyLight = pChunk->getSkyLight();
+	level = skyLight.get( index );
+	if( level > 0 && opaque ) {
+		skyLight.set( index, 0 );
+		queues.remove[LIGHT_CHANNEL_SKY].push_back( PackEntry( index, level ) );
+	}
+
+	// An opening lets the light around it in
+	if( IsBlockOpaque( oldBlock ) && !opaque )
+	{
+		for( uint8_t face = 0; face < FACE_COUNT; face++ )
+		{
+			int32_t neighbourX = x + FaceNormals[face][0], neighbourY = y + FaceNormals[face][1], neighbourZ = z + FaceNormals[face][2];
+			ChunkPos neighbourPos = { BlockToChunkCoord( neighbourX ), BlockToChunkCoord( neighbourY ), BlockToChunkCoord( neighbourZ ) };
+			CChunk *pNeighbour = m_pChunkStore->getChunk( neighbourPos );
+			if( !pNeighbour )
+				continue;
+			uint32_t neighbourIndex = ChunkBlockIndex( neighbourX & CHUNK_MASK, neighbourY & CHUNK_MASK, neighbourZ & CHUNK_MASK );
+			uint8_t neighbourBlockLight = pNeighbour->getBlockLight().get( neighbourIndex );
+			uint8_t neighbourSkyLight = pNeighbour->getSkyLight().get( neighbourIndex );
+			if( neighbourBlockLight > 1 )
+				this->queueAdd( neighbourPos, LIGHT_CHANNEL_BLOCK, neighbourIndex, neighbourBlockLight );
+			if( neighbourSkyLight > 0 )
+				this->queueAdd( neighbourPos, LIGHT_CHANNEL_SKY, neighbourIndex, neighbourSkyLight );
+		}
+	}
+}
+
+uint8_t CLightEngine::getBlockLight( int32_t x, int32_t y, int32_t z )
+{
+	CChunk *pChunk = m_pChunkStore->getChunk( { BlockToChunkCoord( x ), BlockToChunkCoord( y ), BlockToChunkCoord( z ) } );
+	if( !pChunk )
+		return 0;
+	return pChunk->getBlockLight().get( ChunkBlockIndex( x & CHUNK_MASK, y & CHUNK_MASK, z & CHUNK_MASK ) );
+}
+uint8_t CLightEngine::getSkyLight( int32_t x, int32_t y, int32_t z )
+{
+	CChunk *pChunk = m_pChunkStore->getChunk( { BlockToChunkCoord( x ), BlockToChunkCoord( y ), BlockToChunkCoord( z ) } );
+	if( !pChunk )
+		return 0;
+	return pChunk->getSkyLight().get( ChunkBlockIndex( x & CHUNK_MASK, y & CHUNK_MASK, z & CHUNK_MASK ) );
+}
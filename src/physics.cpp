@@ -0,0 +1,223 @@
+#include <assert.h>
+#include <cmath>
+#include <algorithm>
+#include <chrono>
+#include "physics.h"
+#include "game.h"
+#include "logger.h"
+
+///////////////////
+// CVoxelPhysics //
+///////////////////
+
+CVoxelPhysics::CVoxelPhysics( CChunkStore *pChunkStore ) : m_chunkCache( pChunkStore )
+{
+	m_stats = PhysicsStats();
+}
+CVoxelPhysics::~CVoxelPhysics() {
+}
+
+void CVoxelPhysics::gatherSolidBlocks( const int32_t *pMin, const int32_t *pMax )
+{
+	m_candidates.clear();
+
+	// Nothing above or below the world
+	int32_t minY = std::max( pMin[1], 0 );
+	int32_t maxY = std::min( pMax[1], WORLD_HEIGHT-1 );
+	if( minY > maxY )
+		return;
+
+	// Visit each chunk once, and only the part of it inside the box
+	for( int32_t chunkY = BlockToChunkCoord( minY ); chunkY <= BlockToChunkCoord( maxY ); chunkY++ ) {
+		for( int32_t chunkZ = BlockToChunkCoord( pMin[2] ); chunkZ <= BlockToChunkCoord( pMax[2] ); chunkZ++ ) {
+			for( int32_t chunkX = BlockToChunkCoord( pMin[0] ); chunkX <= BlockToChunkCoord( pMax[0] ); chunkX++ )
+			{
+				CChunk *pChunk = m_chunkCache.getChunk( { chunkX, chunkY, chunkZ } );
+				if( pChunk && pChunk->isEmpty() )
+					continue;
+
+				int32_t startX = std::max( pMin[0], chunkX * CHUNK_SIZE ), endX = std::min( pMax[0], chunkX * CHUNK_SIZE + CHUNK_MASK );
+				int32_t startY = std::max( minY, chunkY * CHUNK_SIZE ), endY = std::min( maxY, chunkY * CHUNK_SIZE + CHUNK_MASK );
+				int32_t startZ = std::max( pMin[2], chunkZ * CHUNK_SIZE ), endZ = std::min( pMax[2], chunkZ * CHUNK_SIZE + CHUNK_MASK );
+
+				// Unloaded chunks are walls, uniform chunks are all or nothing
+				bool allSolid = !pChunk || (pChunk->isUniform() && IsBlockSolid( pChunk->getUniformBlock() ));
+				if( pChunk && pChunk->isUniform() && !allSolid )
+					continue;
+
+				for( int32_t y = startY; y <= endY; y++ ) {
+					for( int32_t z = startZ; z <= endZ; z++ ) {
+						for( int32_t x = startX; x <= endX; x++ ) {
+							if( allSolid || IsBlockSolid( pChunk->getBlock( x & CHUNK_MASK, y & CHUNK_MASK, z & CHUNK_MASK ) ) )
+								m_candidates.push_back( { x, y, z } );
+						}
+					}
+				}
+			}
+		}
+	}
+}
+
+float CVoxelPhysics::clipAxis( const glm::vec3 &boxMin, const glm::vec3 &boxMax, uint32_t axis, float delta ) const
+{
+	const uint32_t axisU = (axis + 1) % 3;
+	const uint32_t axisV = (axis + 2) % 3;
+
+	for( auto &it: m_candidates )
+	{
+		const float blockMin[3] = { (float)it.x, (float)it.y, (float)it.z };
+
+		// Only blocks the box overlaps across the move can stop it, touching does not count
+		if( boxMax[axisU] <= blockMin[axisU] + PHYSICS_EPSILON || boxMin[axisU] >= blockMin[axisU] + 1.0f - PHYSICS_EPSILON )
+			continue;
+		if( boxMax[axisV] <= blockMin[axisV] + PHYSICS_EPSILON || boxMin[axisV] >= blockMin[axisV] + 1.0f - PHYSICS_EPSILON )
+			continue;
+
+		if( delta > 0.0f && boxMax[axis] <= blockMin[axis] + PHYSICS_EPSILON )
+			delta = std::min( delta, blockMin[axis] - boxMax[axis] );
+		else if( delta < 0.0f && boxMin[axis] >= blockMin[axis] + 1.0f - PHYSICS_EPSILON )
+			delta = std::max( delta, blockMin[axis] + 1.0f - boxMin[axis] );
+	}
+
+	return delta;
+}
+
+void CVoxelPhysics::stepBody( PhysicsBody &body, float timestep )
+{
+	body.velocity.y = std::max( body.velocity.y - PHYSICS_GRAVITY * timestep, -PHYSICS_TERMINAL_VELOCITY );
+	glm::vec3 move = body.velocity * timestep;
+
+	glm::vec3 boxMin = body.position - body.halfExtents;
+	glm::vec3 boxMax = body.position + body.halfExtents;
+
+	// Every block the box could touch during the move
+	int32_t sweptMin[3], sweptMax[3];
+	for( uint32_t a = 0; a < 3; a++ ) {
+		sweptMin[a] = (int32_t)std::floor( std::min( boxMin[a], boxMin[a] + move[a] ) - PHYSICS_EPSILON );
+		sweptMax[a] = (int32_t)std::floor( std::max( boxMax[a], boxMax[a] + move[a] ) + PHYSICS_EPSILON );
+	}
+	this->gatherSolidBlocks( sweptMin, sweptMax );
+
+	// Vertical first so a body landing on a ledge is not pushed sideways off it
+	const uint32_t axisOrder[3] = { 1, 0, 2 };
+	body.onGround = false;
+	for( uint32_t i = 0; i < 3; i++ )
+	{
+		uint32_t axis = axisOrder[i];
+		if( move[axis] == 0.0f )
+			continue;
+
+		float clipped = m_candidates.empty() ? move[axis] : this->clipAxis( boxMin, boxMax, axis, move[axis] );
+		if( clipped != move[axis] ) {
+			if( axis == 1 && move[axis] < 0.0f )
+				body.onGround = true;
+			body.velocity[axis] = 0.0f;
+		}
+		boxMin[axis] += clipped;
+		boxMax[axis] += clipped;
+	}
+
+	body.position = boxMin + body.halfExtents;
+}
+
+void CVoxelPhysics::step( PhysicsBody *pBodies, size_t count, float timestep )
+{
+	assert( pBodies || count == 0 );
+
+	auto stepStart = std::chrono::high_resolution_clock::now();
+	// Chunks may have been unloaded since the last step
+	m_chunkCache.reset();
+
+	for( size_t i = 0; i < count; i++ )
+		this->stepBody( pBodies[i], timestep );
+
+	m_stats.bodySteps += count;
+	m_stats.seconds += std::chrono::duration<double>( std::chrono::high_resolution_clock::now() - stepStart ).count();
+}
+
+////////////////////
+// CPhysicsSystem //
+////////////////////
+
+CPhysicsSystem::CPhysicsSystem( CGame *pGameHandle, CECSCoordinator *pCoordinator )
+{
+	m_pGameHandle = pGameHandle;
+	m_pCoordinatorHandle = pCoordinator;
+
+	m_pPhysics = 0;
+	m_accumulator = 0.0f;
+}
+CPhysicsSystem::~CPhysicsSystem() {
+	this->shutdown();
+}
+
+bool CPhysicsSystem::initialize() {
+	return true;
+}
+void CPhysicsSystem::shutdown()
+{
+	if( m_pPhysics ) {
+		const PhysicsStats &stats = m_pPhysics->getStats();
+		if( stats.bodySteps > 0 )
+			m_pGameHandle->getLogger()->print( "Ran %llu body physics steps at %.0f per second", (unsigned long long)stats.bodySteps, stats.getBodyStepsPerSecond() );
+		delete m_pPhysics;
+		m_pPhysics = 0;
+	}
+	m_bodies.clear();
+	m_batchOrder.clear();
+}
+
+void CPhysicsSystem::setChunkStore( CChunkStore *pChunkStore )
+{
+	if( m_pPhysics )
+		delete m_pPhysics;
+	m_pPhysics = new CVoxelPhysics( pChunkStore );
+}
+
+bool CPhysicsSystem::update( float deltaT )
+{
+	if( !m_pPhysics )
+		return false;
+
+	m_accumulator += deltaT;
+	unsigned int steps = (unsigned int)(m_accumulator / PHYSICS_TIMESTEP);
+	m_accumulator -= steps * PHYSICS_TIMESTEP;
+	if( steps > PHYSICS_MAX_STEPS_PER_UPDATE ) {
+		steps = PHYSICS_MAX_STEPS_PER_UPDATE;
+		m_accumulator = 0.0f;
+	}
+	if( steps == 0 || m_entities.empty() )
+		return true;
+
+	// Copy out once, so each step runs over contiguous bodies instead of looking components up.
+	// Bodies in the same chunk column end up next to each other and share chunk lookups.
+	CComponentManager *pComponents = m_pCoordinatorHandle->getComponentManager();
+	m_batchOrder.clear();
+	for( auto it: m_entities ) {
+		const Position3D &position = pComponents->GetComponent<Position3D>( it );
+		uint32_t chunkX = (uint32_t)BlockToChunkCoord( (int32_t)std::floor( position.x ) );
+		uint32_t chunkZ = (uint32_t)BlockToChunkCoord( (int32_t)std::floor( position.z ) );
+		m_batchOrder.push_back( { ((uint64_t)chunkX << 32) | chunkZ, it } );
+	}
+	std::sort( m_batchOrder.begin(), m_batchOrder.end(), []( const BatchEntry &a, const BatchEntry &b ) { return a.chunkKey < b.chunkKey; } );
+	m_bodies.resize( m_batchOrder.size() );
+	for( size_t i = 0; i < m_batchOrder.size(); i++ ) {
+		const VelocityComponent &velocity = pComponents->GetComponent<VelocityComponent>( m_batchOrder[i].entity );
+		m_bodies[i].position = pComponents->GetComponent<Position3D>( m_batchOrder[i].entity );
+		m_bodies[i].velocity = velocity.velocity;
+		m_bodies[i].halfExtents = pComponents->GetComponent<AABBComponent>( m_batchOrder[i].entity ).halfExtents;
+		m_bodies[i].onGround = velocity.onGround;
+	}
+
+	for( unsigned int i = 0; i < steps; i++ )
+		m_pPhysics->step( &m_bodies[0], m_bodies.size(), PHYSICS_TIMESTEP );
+
+	for( size_t i = 0; i < m_batchOrder.size(); i++ ) {
+		VelocityComponent &velocity = pComponents->GetComponent<VelocityComponent>( m_batchOrder[i].entity );
+		pComponents->GetComponent<Position3D>( m_batchOrder[i].entity ) = m_bodies[i].position;
+		velocity.velocity = m_bodies[i].velocity;
+		velocity.onGround = m_bodies[i].onGround;
+	}
+
+	return true;
+}
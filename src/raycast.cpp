@@ -0,0 +1,166 @@
+#include <assert.h>
+#include <cmath>
+#include <limits>
+#include <chrono>
+#include "raycast.h"
+
+static inline bool StopsRay( BlockId block, RaycastStopTypes stopType )
+{
+	switch( stopType )
+	{
+	case RAYCAST_STOP_OPAQUE:
+		return IsBlockOpaque( block );
+	case RAYCAST_STOP_SOLID:
+		return IsBlockSolid( block );
+	default:
+		return block != BLOCK_AIR;
+	}
+}
+
+CVoxelRaycaster::CVoxelRaycaster( CChunkStore *pChunkStore ) : m_chunkCache( pChunkStore )
+{
+	m_stats = RaycastStats();
+}
+CVoxelRaycaster::~CVoxelRaycaster() {
+}
+
+bool CVoxelRaycaster::cast( const RaycastQuery &query, RaycastHit *pHit )
+{
+	// Chunks may have been unloaded since the last call
+	m_chunkCache.reset();
+	return this->castRay( query, pHit );
+}
+
+bool CVoxelRaycaster::castRay( const RaycastQuery &query, RaycastHit *pHit )
+{
+	assert( pHit );
+	pHit->hit = false;
+
+	float length = glm::length( query.direction );
+	if( !(length > 0.0f) )
+		return false;
+	const glm::vec3 direction = query.direction / length;
+	const float infinity = std::numeric_limits<float>::infinity();
+
+	// The block the ray is in, the distance to the next block boundary on each axis, and the distance between boundaries
+	int32_t cell[3], step[3];
+	float tMax[3], tDelta[3];
+	for( uint32_t a = 0; a < 3; a++ )
+	{
+		cell[a] = (int32_t)std::floor( query.origin[a] );
+		if( direction[a] > 0.0f ) {
+			step[a] = 1;
+			tDelta[a] = 1.0f / direction[a];
+			tMax[a] = ((float)cell[a] + 1.0f - query.origin[a]) * tDelta[a];
+		}
+		else if( direction[a] < 0.0f ) {
+			step[a] = -1;
+			tDelta[a] = -1.0f / direction[a];
+			tMax[a] = (query.origin[a] - (float)cell[a]) * tDelta[a];
+		}
+		else {
+			step[a] = 0;
+			tDelta[a] = infinity;
+			tMax[a] = infinity;
+		}
+	}
+
+	float t = 0.0f;
+	uint8_t face = FACE_COUNT;
+	uint64_t stepCount = 0;
+	while( t <= query.maxDistance )
+	{
+		// Nothing to hit above or below the world once the ray is leaving it
+		if( (cell[1] < 0 && step[1] <= 0) || (cell[1] >= WORLD_HEIGHT && step[1] >= 0) )
+			break;
+
+		CChunk *pChunk = m_chunkCache.getChunk( { BlockToChunkCoord( cell[0] ), BlockToChunkCoord( cell[1] ), BlockToChunkCoord( cell[2] ) } );
+		uint32_t skipBits;
+		if( !pChunk || pChunk->isEmpty() )
+			skipBits = CHUNK_SIZE_BITS;
+		else
+		{
+			uint32_t localX = cell[0] & CHUNK_MASK, localY = cell[1] & CHUNK_MASK, localZ = cell[2] & CHUNK_MASK;
+			if( !((pChunk->getSectionMask() >> ChunkSectionIndex( localX, localY, localZ )) & 1) )
+				skipBits = CHUNK_SECTION_BITS;
+			else
+			{
+				stepCount++;
+				BlockId block = pChunk->getBlock( localX, localY, localZ );
+				if( StopsRay( block, query.stopType ) ) {
+					pHit->hit = true;
+					pHit->x = cell[0];
+					pHit->y = cell[1];
+					pHit->z = cell[2];
+					pHit->block = block;
+					pHit->face = face;
+					pHit->distance = t;
+					m_stats.stepCount += stepCount;
+					return true;
+				}
+
+				// Step into the next block along the axis with the nearest boundary
+				uint32_t a = (tMax[0] < tMax[1]) ? (tMax[0] < tMax[2] ? 0 : 2) : (tMax[1] < tMax[2] ? 1 : 2);
+				t = tMax[a];
+				cell[a] += step[a];
+				tMax[a] += tDelta[a];
+				face = (uint8_t)(a*2 + (step[a] > 0 ? 0 : 1));
+				continue;
+			}
+		}
+
+		// Jump straight out of the empty box of (1 << skipBits) blocks containing the ray. Every axis advances by the
+		// number of boundaries the ray crosses before it leaves the box, found directly instead of block by block.
+		const int32_t boxSize = 1 << skipBits;
+		int32_t stepsToExit[3];
+		float tExitAxis[3];
+		for( uint32_t a = 0; a < 3; a++ ) {
+			int32_t boxStart = cell[a] & ~(boxSize - 1);
+			if( step[a] > 0 )
+				stepsToExit[a] = boxStart + boxSize - cell[a];
+			else if( step[a] < 0 )
+				stepsToExit[a] = cell[a] - boxStart + 1;
+			else
+				stepsToExit[a] = 0;
+			tExitAxis[a] = step[a] ? tMax[a] + (float)(stepsToExit[a] - 1) * tDelta[a] : infinity;
+		}
+		uint32_t exitAxis = (tExitAxis[0] < tExitAxis[1]) ? (tExitAxis[0] < tExitAxis[2] ? 0 : 2) : (tExitAxis[1] < tExitAxis[2] ? 1 : 2);
+		float tExit = tExitAxis[exitAxis];
+		for( uint32_t a = 0; a < 3; a++ )
+		{
+			// Axes the ray does not cross are left alone, their boundary distance is infinite
+			int32_t crossed;
+			if( a == exitAxis )
+				crossed = stepsToExit[a];
+			else if( step[a] && tMax[a] < tExit ) {
+				// Stay inside the box on the other axes, rounding can not carry them past it
+				float boundaries = (tExit - tMax[a]) / tDelta[a];
+				crossed = (boundaries >= (float)(stepsToExit[a] - 1)) ? stepsToExit[a] - 1 : (int32_t)boundaries + 1;
+			}
+			else
+				continue;
+			cell[a] += step[a] * crossed;
+			tMax[a] += (float)crossed * tDelta[a];
+		}
+		t = tExit;
+		face = (uint8_t)(exitAxis*2 + (step[exitAxis] > 0 ? 0 : 1));
+	}
+
+	m_stats.stepCount += stepCount;
+	return false;
+}
+
+size_t CVoxelRaycaster::castBatch( const std::vector<RaycastQuery> &queries, std::vector<RaycastHit> &hits )
+{
+	auto batchStart = std::chrono::high_resolution_clock::now();
+	m_chunkCache.reset();
+
+	hits.resize( queries.size() );
+	size_t hitCount = 0;
+	for( size_t i = 0; i < queries.size(); i++ )
+		hitCount += this->castRay( queries[i], &hits[i] ) ? 1 : 0;
+
+	m_stats.rayCount += queries.size();
+	m_stats.seconds += std::chrono::duration<double>( std::chrono::high_resolution_clock::now() - batchStart ).count();
+	return hitCount;
+}
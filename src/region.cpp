@@ -0,0 +1,529 @@
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <algorithm>
+#include <boost/endian/conversion.hpp>
+#include "region.h"
+#include "chunk.h"
+#include "game.h"
+#include "logger.h"
+
+/////////////////
+// CRegionFile //
+/////////////////
+
+CRegionFile::CRegionFile( CGame *pGameHandle ) : m_pGameHandle( pGameHandle )
+{
+	m_fileSectors = 0;
+}
+CRegionFile::~CRegionFile()
+{
+	this->close();
+}
+
+bool CRegionFile::open( boost::filesystem::path filePath )
+{
+	assert( !this->isOpen() );
+
+	m_filePath = filePath;
+
+	try
+	{
+		// Create an empty header if the file is new
+		if( !boost::filesystem::exists( m_filePath ) ) {
+			std::ofstream createFile( m_filePath.string(), std::ofstream::out | std::ofstream::binary );
+			if( !createFile ) {
+				m_pGameHandle->getLogger()->printError( "Failed to create region file \'%s\'", m_filePath.string().c_str() );
+				return false;
+			}
+			createFile.close();
+			boost::filesystem::resize_file( m_filePath, REGION_HEADER_SECTORS*REGION_SECTOR_SIZE );
+		}
+
+		// Round the file up to whole sectors
+		uintmax_t fileSize = boost::filesystem::file_size( m_filePath );
+		m_fileSectors = (uint32_t)((fileSize + REGION_SECTOR_SIZE - 1) / REGION_SECTOR_SIZE);
+		if( m_fileSectors < REGION_HEADER_SECTORS )
+			m_fileSectors = REGION_HEADER_SECTORS;
+		if( fileSize != (uintmax_t)m_fileSectors*REGION_SECTOR_SIZE )
+			boost::filesystem::resize_file( m_filePath, (uintmax_t)m_fileSectors*REGION_SECTOR_SIZE );
+
+		boost::interprocess::file_mapping( m_filePath.string().c_str(), boost::interprocess::read_write ).swap( m_fileMapping );
+		boost::interprocess::mapped_region( m_fileMapping, boost::interprocess::read_write ).swap( m_mappedRegion );
+	}
+	catch( const boost::filesystem::filesystem_error &e ) {
+		m_pGameHandle->getLogger()->printError( "Failed to open region file \'%s\': %s", m_filePath.string().c_str(), e.what() );
+		return false;
+	}
+	catch( const boost::interprocess::interprocess_exception &e ) {
+		m_pGameHandle->getLogger()->printError( "Failed to map region file \'%s\': %s", m_filePath.string().c_str(), e.what() );
+		return false;
+	}
+
+	// Build the free sector map from the location table
+	m_sectorsUsed.assign( m_fileSectors, false );
+	for( uint32_t i = 0; i < REGION_HEADER_SECTORS; i++ )
+		m_sectorsUsed[i] = true;
+
+	uint32_t *pLocations = this->getLocationTable();
+	for( uint32_t i = 0; i < REGION_COLUMN_COUNT; i++ )
+	{
+		uint32_t location = boost::endian::little_to_native( pLocations[i] );
+		if( !location )
+			continue;
+		uint32_t offset = CRegionFile::getLocationOffset( location );
+		uint32_t count = CRegionFile::getLocationCount( location );
+		if( offset < REGION_HEADER_SECTORS || count == 0 || offset + count > m_fileSectors ) {
+			m_pGameHandle->getLogger()->printWarn( "Region file \'%s\' has an invalid entry for column %u, it will be ignored", m_filePath.string().c_str(), i );
+			pLocations[i] = 0;
+			continue;
+		}
+		for( uint32_t j = offset; j < offset + count; j++ )
+			m_sectorsUsed[j] = true;
+	}
+
+	return true;
+}
+void CRegionFile::close()
+{
+	if( !this->isOpen() )
+		return;
+
+	this->commit();
+
+	boost::interprocess::mapped_region().swap( m_mappedRegion );
+	boost::interprocess::file_mapping().swap( m_fileMapping );
+	m_sectorsUsed.clear();
+	m_fileSectors = 0;
+}
+
+bool CRegionFile::resize( uint32_t sectorCount )
+{
+	// The file can not be resized while mapped on all platforms
+	boost::interprocess::mapped_region().swap( m_mappedRegion );
+	try {
+		boost::filesystem::resize_file( m_filePath, (uintmax_t)sectorCount*REGION_SECTOR_SIZE );
+		boost::interprocess::mapped_region( m_fileMapping, boost::interprocess::read_write ).swap( m_mappedRegion );
+	}
+	catch( const boost::filesystem::filesystem_error &e ) {
+		m_pGameHandle->getLogger()->printError( "Failed to grow region file \'%s\': %s", m_filePath.string().c_str(), e.what() );
+		boost::interprocess::mapped_region( m_fileMapping, boost::interprocess::read_write ).swap( m_mappedRegion );
+		return false;
+	}
+	catch( const boost::interprocess::interprocess_exception &e ) {
+		m_pGameHandle->getLogger()->printError( "Failed to remap region file \'%s\': %s", m_filePath.string().c_str(), e.what() );
+		return false;
+	}
+
+	m_fileSectors = sectorCount;
+	m_sectorsUsed.resize( m_fileSectors, false );
+
+	return true;
+}
+
+bool CRegionFile::allocateSectors( uint32_t sectorCount, uint32_t *pSectorOffset )
+{
+	assert( sectorCount > 0 );
+
+	// First fit
+	uint32_t runStart = 0, runLength = 0;
+	for( uint32_t i = REGION_HEADER_SECTORS; i < m_fileSectors; i++ )
+	{
+		if( m_sectorsUsed[i] ) {
+			runLength = 0;
+			continue;
+		}
+		if( runLength == 0 )
+			runStart = i;
+		if( ++runLength == sectorCount )
+			break;
+	}
+
+	// Append to the end of the file, reusing a free run at the end if there is one
+	if( runLength < sectorCount )
+	{
+		if( runLength == 0 )
+			runStart = m_fileSectors;
+		uint32_t needed = runStart + sectorCount - m_fileSectors;
+		if( !this->resize( m_fileSectors + std::max<uint32_t>( needed, REGION_GROW_SECTORS ) ) )
+			return false;
+	}
+
+	for( uint32_t i = runStart; i < runStart + sectorCount; i++ )
+		m_sectorsUsed[i] = true;
+	(*pSectorOffset) = runStart;
+
+	return true;
+}
+void CRegionFile::freeSectors( uint32_t sectorOffset, uint32_t sectorCount )
+{
+	for( uint32_t i = sectorOffset; i < sectorOffset + sectorCount && i < m_fileSectors; i++ )
+		m_sectorsUsed[i] = false;
+}
+
+bool CRegionFile::hasColumn( uint32_t localX, uint32_t localZ )
+{
+	assert( this->isOpen() );
+	assert( localX < REGION_SIZE && localZ < REGION_SIZE );
+
+	return this->getLocationTable()[CRegionFile::getColumnIndex( localX, localZ )] != 0;
+}
+
+bool CRegionFile::getColumnData( uint32_t localX, uint32_t localZ, const uint8_t **ppData, uint32_t *pLength, uint8_t *pCompression )
+{
+	assert( this->isOpen() );
+	assert( localX < REGION_SIZE && localZ < REGION_SIZE );
+	assert( ppData && pLength && pCompression );
+
+	uint32_t location = boost::endian::little_to_native( this->getLocationTable()[CRegionFile::getColumnIndex( localX, localZ )] );
+	if( !location )
+		return false;
+
+	if( !CRegionFile::parsePayload( this->getSector( CRegionFile::getLocationOffset( location ) ), (size_t)CRegionFile::getLocationCount( location )*REGION_SECTOR_SIZE, ppData, pLength, pCompression ) ) {
+		m_pGameHandle->getLogger()->printWarn( "Region file \'%s\' has a corrupt payload for column (%u, %u)", m_filePath.string().c_str(), localX, localZ );
+		return false;
+	}
+
+	return true;
+}
+
+uint32_t CRegionFile::getColumnLocation( uint32_t localX, uint32_t localZ )
+{
+	assert( this->isOpen() );
+	assert( localX < REGION_SIZE && localZ < REGION_SIZE );
+
+	return boost::endian::little_to_native( this->getLocationTable()[CRegionFile::getColumnIndex( localX, localZ )] );
+}
+
+bool CRegionFile::parsePayload( const uint8_t *pSectors, size_t sectorsLength, const uint8_t **ppData, uint32_t *pLength, uint8_t *pCompression )
+{
+	uint32_t length;
+
+	if( sectorsLength < REGION_PAYLOAD_HEADER_SIZE )
+		return false;
+	memcpy( &length, pSectors, sizeof( uint32_t ) );
+	boost::endian::little_to_native_inplace( length );
+	// Length includes the compression byte
+	if( length < 1 || length + sizeof( uint32_t ) > sectorsLength )
+		return false;
+
+	(*pCompression) = pSectors[4];
+	(*ppData) = pSectors + REGION_PAYLOAD_HEADER_SIZE;
+	(*pLength) = length - 1;
+
+	return true;
+}
+
+bool CRegionFile::writeColumn( uint32_t localX, uint32_t localZ, const uint8_t *pData, uint32_t length, uint8_t compression )
+{
+	assert( this->isOpen() );
+	assert( localX < REGION_SIZE && localZ < REGION_SIZE );
+
+	uint32_t columnIndex = CRegionFile::getColumnIndex( localX, localZ );
+	uint32_t sectorCount = (length + REGION_PAYLOAD_HEADER_SIZE + REGION_SECTOR_SIZE - 1) / REGION_SECTOR_SIZE;
+	uint32_t sectorOffset;
+
+	if( sectorCount > REGION_MAX_COLUMN_SECTORS ) {
+		m_pGameHandle->getLogger()->printError( "Column (%u, %u) is too large to save (%u bytes)", localX, localZ, length );
+		return false;
+	}
+
+	// A column written twice before a commit never published its first payload
+	auto pending = m_pendingLocations.find( columnIndex );
+	if( pending != m_pendingLocations.end() ) {
+		this->freeSectors( CRegionFile::getLocationOffset( pending->second ), CRegionFile::getLocationCount( pending->second ) );
+		m_pendingLocations.erase( pending );
+	}
+
+	// Never overwrite the committed payload, so an interrupted save leaves it intact
+	if( !this->allocateSectors( sectorCount, &sectorOffset ) )
+		return false;
+
+	uint8_t *pSector = this->getSector( sectorOffset );
+	uint32_t storedLength = boost::endian::native_to_little( length + 1 );
+	memcpy( pSector, &storedLength, sizeof( uint32_t ) );
+	pSector[4] = compression;
+	memcpy( pSector + REGION_PAYLOAD_HEADER_SIZE, pData, length );
+	// Zero the tail of the last sector so stale data is never left in the file
+	size_t used = length + REGION_PAYLOAD_HEADER_SIZE;
+	memset( pSector + used, 0, (size_t)sectorCount*REGION_SECTOR_SIZE - used );
+
+	m_pendingLocations[columnIndex] = CRegionFile::packLocation( sectorOffset, sectorCount );
+
+	return true;
+}
+
+bool CRegionFile::commit()
+{
+	if( m_pendingLocations.empty() )
+		return true;
+
+	// Payloads must reach the disk before the locations that point to them
+	if( !m_mappedRegion.flush( REGION_HEADER_SECTORS*REGION_SECTOR_SIZE, 0, false ) ) {
+		m_pGameHandle->getLogger()->printError( "Failed to flush region file \'%s\'", m_filePath.string().c_str() );
+		return false;
+	}
+
+	uint32_t *pLocations = this->getLocationTable();
+	uint32_t *pTimestamps = this->getTimestampTable();
+	uint32_t timestamp = (uint32_t)std::time( 0 );
+	for( auto it: m_pendingLocations )
+	{
+		uint32_t oldLocation = boost::endian::little_to_native( pLocations[it.first] );
+		// A single aligned 32-bit store, a column is either entirely old or entirely new
+		pLocations[it.first] = boost::endian::native_to_little( it.second );
+		pTimestamps[it.first] = boost::endian::native_to_little( timestamp );
+		if( oldLocation )
+			this->freeSectors( CRegionFile::getLocationOffset( oldLocation ), CRegionFile::getLocationCount( oldLocation ) );
+	}
+	m_pendingLocations.clear();
+
+	if( !m_mappedRegion.flush( 0, REGION_HEADER_SECTORS*REGION_SECTOR_SIZE, false ) ) {
+		m_pGameHandle->getLogger()->printError( "Failed to flush region file header \'%s\'", m_filePath.string().c_str() );
+		return false;
+	}
+
+	return true;
+}
+
+////////////////////
+// CRegionManager //
+////////////////////
+
+CRegionManager::CRegionManager( CGame *pGameHandle ) : m_pGameHandle( pGameHandle ) {
+	m_pIOService = 0;
+}
+CRegionManager::~CRegionManager() {
+	this->shutdown();
+}
+
+bool CRegionManager::initialize( boost::filesystem::path worldDirectory )
+{
+	m_regionDirectory = worldDirectory / REGION_DIRECTORY;
+
+	try {
+		if( !boost::filesystem::is_directory( m_regionDirectory ) ) {
+			m_pGameHandle->getLogger()->print( "Creating directory %s", m_regionDirectory.string().c_str() );
+			boost::filesystem::create_directories( m_regionDirectory );
+		}
+	}
+	catch( const boost::filesystem::filesystem_error &e ) {
+		m_pGameHandle->getLogger()->printError( "Failed to create region directory \'%s\': %s", m_regionDirectory.string().c_str(), e.what() );
+		return false;
+	}
+
+	// Never write saves with a codec that can not read them back
+	ChunkCodecBenchmark codecResults;
+	bool codecPassed = BenchmarkChunkCodec( REGION_CODEC_CHECK_REPEATS, &codecResults );
+	for( uint8_t s = 0; s < CODEC_SAMPLE_COUNT; s++ )
+	{
+		const char *pSampleName = GetChunkCodecSampleName( (ChunkCodecSamples)s );
+		if( !codecResults.roundTrip[s] ) {
+			m_pGameHandle->getLogger()->printError( "Chunk codec failed to round trip the %s sample (mode %d)", pSampleName, codecResults.modes[s] );
+			continue;
+		}
+		const ChunkCodecStats &encodeStats = codecResults.encodeStats[s];
+		const ChunkCodecStats &decodeStats = codecResults.decodeStats[s];
+		m_pGameHandle->getLogger()->print( "Chunk codec %s sample (mode %d): ratio %.2f, encode %.1f MB/s, decode %.1f MB/s",
+			pSampleName, codecResults.modes[s], encodeStats.getRatio(), encodeStats.getMBPerSecond(), decodeStats.getMBPerSecond() );
+	}
+	if( !codecPassed )
+		return false;
+
+	return true;
+}
+void CRegionManager::shutdown()
+{
+	if( m_pIOService ) {
+		for( auto it: m_regionIOFiles )
+			m_pIOService->closeFile( it.second );
+	}
+	m_regionIOFiles.clear();
+	for( auto it: m_openRegions )
+		it.second->close();
+	m_openRegions.clear();
+}
+
+std::shared_ptr<CRegionFile> CRegionManager::getRegion( int32_t columnX, int32_t columnZ, bool create )
+{
+	int32_t regionX = columnX >> REGION_SIZE_BITS;
+	int32_t regionZ = columnZ >> REGION_SIZE_BITS;
+	uint64_t key = CRegionManager::getRegionKey( regionX, regionZ );
+
+	auto it = m_openRegions.find( key );
+	if( it != m_openRegions.end() )
+		return it->second;
+
+	boost::filesystem::path regionPath = m_regionDirectory / ("r." + std::to_string( regionX ) + "." + std::to_string( regionZ ) + REGION_FILE_EXTENSION);
+	if( !create && !boost::filesystem::is_regular_file( regionPath ) )
+		return 0;
+
+	std::shared_ptr<CRegionFile> regionFile = std::make_shared<CRegionFile>( m_pGameHandle );
+	if( !regionFile->open( regionPath ) )
+		return 0;
+	m_openRegions.insert( std::pair<uint64_t, std::shared_ptr<CRegionFile>>( key, regionFile ) );
+
+	// Async loads read through a separate handle, a failure here only means loads fall back to the mapping
+	if( m_pIOService ) {
+		IOFileId ioFile = m_pIOService->openFile( regionPath, false );
+		if( ioFile )
+			m_regionIOFiles[key] = ioFile;
+	}
+
+	return regionFile;
+}
+
+bool CRegionManager::loadColumn( CChunkStore *pChunkStore, int32_t columnX, int32_t columnZ )
+{
+	const uint8_t *pData;
+	uint32_t length;
+	uint8_t compression;
+
+	std::shared_ptr<CRegionFile> regionFile = this->getRegion( columnX, columnZ, false );
+	if( !regionFile )
+		return false;
+	if( !regionFile->getColumnData( columnX & REGION_MASK, columnZ & REGION_MASK, &pData, &length, &compression ) )
+		return false;
+
+	return this->decodeColumn( pChunkStore, columnX, columnZ, pData, length, compression );
+}
+
+void CRegionManager::loadColumnAsync( CChunkStore *pChunkStore, int32_t columnX, int32_t columnZ, ColumnLoadCallback callback )
+{
+	std::shared_ptr<CRegionFile> regionFile = this->getRegion( columnX, columnZ, false );
+	if( !regionFile ) {
+		callback( false );
+		return;
+	}
+
+	uint32_t localX = columnX & REGION_MASK, localZ = columnZ & REGION_MASK;
+	uint32_t location = regionFile->getColumnLocation( localX, localZ );
+	if( !location ) {
+		callback( false );
+		return;
+	}
+
+	auto ioFile = m_regionIOFiles.find( CRegionManager::getRegionKey( columnX >> REGION_SIZE_BITS, columnZ >> REGION_SIZE_BITS ) );
+	if( !m_pIOService || ioFile == m_regionIOFiles.end() ) {
+		callback( this->loadColumn( pChunkStore, columnX, columnZ ) );
+		return;
+	}
+
+	uint64_t offset = (uint64_t)CRegionFile::getLocationOffset( location )*REGION_SECTOR_SIZE;
+	size_t length = (size_t)CRegionFile::getLocationCount( location )*REGION_SECTOR_SIZE;
+	m_pIOService->read( ioFile->second, offset, length, [this, pChunkStore, columnX, columnZ, location, localX, localZ, regionFile, callback]( IORequest &request ) {
+		const uint8_t *pData;
+		uint32_t payloadLength;
+		uint8_t compression;
+
+		// A commit since the read was submitted may have freed and reused these sectors
+		if( !regionFile->isOpen() || regionFile->getColumnLocation( localX, localZ ) != location ) {
+			callback( regionFile->isOpen() && this->loadColumn( pChunkStore, columnX, columnZ ) );
+			return;
+		}
+		if( request.result != (int64_t)request.buffer.size() ) {
+			m_pGameHandle->getLogger()->printWarn( "Failed to read column (%d, %d), falling back to a synchronous load", columnX, columnZ );
+			callback( this->loadColumn( pChunkStore, columnX, columnZ ) );
+			return;
+		}
+		if( !CRegionFile::parsePayload( request.buffer.data(), request.buffer.size(), &pData, &payloadLength, &compression ) ) {
+			m_pGameHandle->getLogger()->printWarn( "Region file \'%s\' has a corrupt payload for column (%d, %d)", regionFile->getFilePath().string().c_str(), columnX, columnZ );
+			callback( false );
+			return;
+		}
+		callback( this->decodeColumn( pChunkStore, columnX, columnZ, pData, payloadLength, compression ) );
+	} );
+}
+
+bool CRegionManager::saveColumn( CChunkStore *pChunkStore, int32_t columnX, int32_t columnZ )
+{
+	uint8_t compression;
+
+	std::shared_ptr<CRegionFile> regionFile = this->getRegion( columnX, columnZ, true );
+	if( !regionFile )
+		return false;
+
+	m_encodeBuffer.clear();
+	this->encodeColumn( pChunkStore, columnX, columnZ, m_encodeBuffer, &compression );
+	if( !regionFile->writeColumn( columnX & REGION_MASK, columnZ & REGION_MASK, &m_encodeBuffer[0], (uint32_t)m_encodeBuffer.size(), compression ) )
+		return false;
+
+	for( int32_t y = 0; y < WORLD_HEIGHT_CHUNKS; y++ ) {
+		CChunk *pChunk = pChunkStore->getChunk( { columnX, y, columnZ } );
+		if( pChunk )
+			pChunk->setModified( false );
+	}
+
+	return true;
+}
+
+bool CRegionManager::commitAll()
+{
+	bool success = true;
+	for( auto it: m_openRegions ) {
+		if( !it.second->commit() )
+			success = false;
+	}
+	return success;
+}
+
+bool CRegionManager::decodeColumn( CChunkStore *pChunkStore, int32_t columnX, int32_t columnZ, const uint8_t *pData, uint32_t length, uint8_t compression )
+{
+	if( compression != REGION_COMPRESSION_NONE && compression != REGION_COMPRESSION_CHUNKCODEC ) {
+		m_pGameHandle->getLogger()->printWarn( "Column (%d, %d) uses unknown compression type %u", columnX, columnZ, (unsigned int)compression );
+		return false;
+	}
+	if( length < 1 )
+		return false;
+
+	// Section mask, one bit per chunk in the column
+	uint8_t sectionMask = pData[0];
+	size_t readOffset = 1;
+
+	m_decoder.begin( pData + 1, length - 1 );
+	for( int32_t y = 0; y < WORLD_HEIGHT_CHUNKS; y++ )
+	{
+		if( !(sectionMask & (1 << y)) )
+			continue;
+
+		size_t bytesRead = 0;
+		bool valid;
+		CChunk *pChunk = pChunkStore->createChunk( { columnX, y, columnZ } );
+		if( compression == REGION_COMPRESSION_CHUNKCODEC )
+			valid = m_decoder.readChunk( pChunk );
+		else {
+			valid = pChunk->deserialize( pData + readOffset, length - readOffset, &bytesRead );
+			readOffset += bytesRead;
+		}
+		if( !valid ) {
+			m_pGameHandle->getLogger()->printWarn( "Column (%d, %d) has a corrupt section %d", columnX, columnZ, y );
+			return false;
+		}
+		pChunk->setModified( false );
+	}
+
+	return true;
+}
+
+void CRegionManager::encodeColumn( CChunkStore *pChunkStore, int32_t columnX, int32_t columnZ, std::vector<uint8_t> &payload, uint8_t *pCompression )
+{
+	static_assert(WORLD_HEIGHT_CHUNKS <= 8, "Section mask must fit in a byte");
+
+	size_t maskOffset = payload.size();
+	uint8_t sectionMask = 0;
+
+	payload.push_back( 0 );
+	m_encoder.begin( &payload );
+	for( int32_t y = 0; y < WORLD_HEIGHT_CHUNKS; y++ )
+	{
+		CChunk *pChunk = pChunkStore->getChunk( { columnX, y, columnZ } );
+		if( !pChunk )
+			continue;
+		sectionMask |= (1 << y);
+		m_encoder.writeChunk( pChunk );
+	}
+	m_encoder.finish();
+	payload[maskOffset] = sectionMask;
+
+	(*pCompression) = REGION_COMPRESSION_CHUNKCODEC;
+}
\ No newline at end of file
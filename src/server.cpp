@@ -9,6 +9,7 @@ CServer::CServer( CGame* pGameHandle ) : m_pGameHandle( pGameHandle )
 {
 	m_serverRunning = false;
 	m_pWorld = 0;
+	m_pMeshWorkers = 0;
 
 	testEntity = 0;
 }
@@ -47,6 +48,7 @@ void CServer::threadMainBody()
 {
 	// Create the world
 	m_pWorld = new CWorld( m_pGameHandle );
+	m_pWorld->setMeshWorkers( m_pMeshWorkers );
 	if( !m_pWorld->createWorld() )
 		return;
 
@@ -0,0 +1,114 @@
+#include <assert.h>
+#include <algorithm>
+#include "threadpool.h"
+
+CThreadPool::CThreadPool() {
+	m_shuttingDown = false;
+}
+CThreadPool::~CThreadPool() {
+	this->shutdown();
+}
+
+bool CThreadPool::initialize( unsigned int threadCount )
+{
+	assert( m_workerThreads.empty() );
+
+	if( threadCount == 0 )
+		threadCount = std::max( std::thread::hardware_concurrency(), 2u ) - 1;
+
+	m_shuttingDown = false;
+	try {
+		for( unsigned int i = 0; i < threadCount; i++ )
+			m_workerThreads.push_back( std::thread( &CThreadPool::workerMain, this ) );
+	}
+	catch( const std::system_error& ) {
+		this->shutdown();
+		return false;
+	}
+
+	return true;
+}
+void CThreadPool::shutdown()
+{
+	{
+		std::lock_guard<std::mutex> lock( m_taskMutex );
+		m_shuttingDown = true;
+	}
+	m_taskAvailable.notify_all();
+
+	for( auto &it: m_workerThreads ) {
+		if( it.joinable() )
+			it.join();
+	}
+	m_workerThreads.clear();
+}
+
+void CThreadPool::workerMain()
+{
+	std::function<void()> task;
+
+	while( true )
+	{
+		{
+			std::unique_lock<std::mutex> lock( m_taskMutex );
+			m_taskAvailable.wait( lock, [this] { return m_shuttingDown || !m_tasks.empty(); } );
+			// Drain the queue before exiting
+			if( m_tasks.empty() )
+				return;
+			task = std::move( m_tasks.front() );
+			m_tasks.pop();
+		}
+		task();
+	}
+}
+
+void CThreadPool::submit( std::function<void()> task )
+{
+	{
+		std::lock_guard<std::mutex> lock( m_taskMutex );
+		m_tasks.push( std::move( task ) );
+	}
+	m_taskAvailable.notify_one();
+}
+
+void CThreadPool::parallelFor( size_t count, const std::function<void( size_t )> &function )
+{
+	if( count == 0 )
+		return;
+	// Not worth waking anyone
+	if( count == 1 || m_workerThreads.empty() ) {
+		for( size_t i = 0; i < count; i++ )
+			function( i );
+		return;
+	}
+
+	std::atomic<size_t> nextIndex( 0 );
+	std::atomic<size_t> helpersRemaining( 0 );
+	std::mutex doneMutex;
+	std::condition_variable doneFlag;
+
+	auto runIndices = [&nextIndex, &function, count]() {
+		size_t index;
+		while( (index = nextIndex.fetch_add( 1 )) < count )
+			function( index );
+	};
+
+	size_t helperCount = std::min( count - 1, m_workerThreads.size() );
+	helpersRemaining = helperCount;
+	for( size_t i = 0; i < helperCount; i++ )
+	{
+		this->submit( [&runIndices, &helpersRemaining, &doneMutex, &doneFlag]() {
+			runIndices();
+			// Decrement under the lock, the caller frees these as soon as it sees zero
+			std::lock_guard<std::mutex> lock( doneMutex );
+			if( --helpersRemaining == 0 )
+				doneFlag.notify_all();
+		} );
+	}
+
+	// The calling thread works too
+	runIndices();
+
+	std::unique_lock<std::mutex> lock( doneMutex );
+	doneFlag.wait( lock, [&helpersRemaining] { return helpersRemaining == 0; } );
+}
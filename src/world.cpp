@@ -1,12 +1,34 @@
+#include <chrono>
+#include <cmath>
+#include <set>
+#include <algorithm>
 #include "world.h"
 #include "game.h"
 #include "logger.h"
+#include "filesystem.h"
 #include "components.h"
+#include "chunk.h"
+#include "region.h"
+#include "ioservice.h"
+#include "light.h"
+#include "physics.h"
+#include "blockticks.h"
+#include "fluid.h"
 #include "gfx/systems.h"
+#include "gfx/meshworkers.h"
 
 CWorld::CWorld( CGame* pGameHandle ) : m_pGameHandle( pGameHandle )
 {
 	m_pWorldEntCoordinator = 0;
+	m_pChunkStore = 0;
+	m_pRegionManager = 0;
+	m_pIOService = 0;
+	m_pMeshWorkers = 0;
+	m_pLightEngine = 0;
+	m_pRaycaster = 0;
+	m_pBlockTicks = 0;
+	m_pFluids = 0;
+	m_tickAccumulator = 0.0f;
 }
 CWorld::~CWorld()
 {
@@ -21,6 +43,56 @@ bool CWorld::createWorld()
 
 	m_pWorldEntCoordinator->getComponentManager()->RegisterComponent<Position3DComponent>();
 	m_pWorldEntCoordinator->getComponentManager()->RegisterComponent<Transform3DComponent>();
+	m_pWorldEntCoordinator->getComponentManager()->RegisterComponent<AABBComponent>();
+	m_pWorldEntCoordinator->getComponentManager()->RegisterComponent<VelocityComponent>();
+
+	ComponentSignature physicsSig;
+	physicsSig.set( m_pWorldEntCoordinator->getComponentManager()->GetComponentTypeId<Position3D>() );
+	physicsSig.set( m_pWorldEntCoordinator->getComponentManager()->GetComponentTypeId<AABBComponent>() );
+	physicsSig.set( m_pWorldEntCoordinator->getComponentManager()->GetComponentTypeId<VelocityComponent>() );
+	m_physicsSystem = m_pWorldEntCoordinator->getSystemManager()->RegisterSystem<CPhysicsSystem>( physicsSig );
+	if( !m_physicsSystem ) {
+		m_pGameHandle->getLogger()->printError( "Failed to register physics system." );
+		return false;
+	}
+
+	// Setup chunk storage and the world save
+	m_pIOService = new CIOService( m_pGameHandle );
+	if( !m_pIOService->initialize() )
+		return false;
+	m_pChunkStore = new CChunkStore();
+	m_pRaycaster = new CVoxelRaycaster( m_pChunkStore );
+	m_pBlockTicks = new CBlockTickScheduler( m_pChunkStore );
+	m_physicsSystem->setChunkStore( m_pChunkStore );
+	m_pRegionManager = new CRegionManager( m_pGameHandle );
+	m_pRegionManager->setIOService( m_pIOService );
+	if( !m_pRegionManager->initialize( m_pGameHandle->getFilesystem()->getGamePath( FilesystemLocations::LOCATION_SAVES, WORLD_DEFAULT_NAME ) ) )
+		return false;
+	m_pLightEngine = new CLightEngine( m_pGameHandle );
+	if( !m_pLightEngine->initialize( m_pChunkStore ) )
+		return false;
+	m_pFluids = new CFluidSimulator( m_pGameHandle );
+	if( !m_pFluids->initialize( m_pChunkStore ) )
+		return false;
+
+	// Load the area around the spawn, the reads are all submitted before waiting on any of them
+	m_pRegionManager->resetCodecStats();
+	auto loadStart = std::chrono::high_resolution_clock::now();
+	for( int32_t x = -WORLD_SPAWN_RADIUS; x <= WORLD_SPAWN_RADIUS; x++ ) {
+		for( int32_t z = -WORLD_SPAWN_RADIUS; z <= WORLD_SPAWN_RADIUS; z++ )
+			this->requestColumn( x, z );
+	}
+	this->finishColumnRequests();
+	float loadTimeMs = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - loadStart).count() / 1000.0f;
+	m_pGameHandle->getLogger()->print( "Loaded %d chunks in %.2f ms", (int)m_pChunkStore->getChunkCount(), loadTimeMs );
+	if( m_pRegionManager->getDecodeStats().chunkCount > 0 ) {
+		const ChunkCodecStats &codecStats = m_pRegionManager->getDecodeStats();
+		m_pGameHandle->getLogger()->print( "Decompressed %llu chunks at %.1f MB/s, ratio %.1f:1", (unsigned long long)codecStats.chunkCount, codecStats.getMBPerSecond(), codecStats.getRatio() );
+	}
+	auto lightStart = std::chrono::high_resolution_clock::now();
+	m_pLightEngine->finish();
+	float lightTimeMs = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - lightStart).count() / 1000.0f;
+	m_pGameHandle->getLogger()->print( "Lit spawn area in %.2f ms", lightTimeMs );
 
 	return true;
 }
@@ -29,6 +101,55 @@ void CWorld::destroyWorld()
 {
 	m_pGameHandle->getLogger()->print( "Cleaning up world..." );
 
+	// Columns still loading would be lost, or worse, overwrite the save with generated terrain later
+	if( m_pIOService && m_pChunkStore && m_pRegionManager )
+		this->finishColumnRequests();
+	if( m_pChunkStore && m_pRegionManager )
+		this->saveWorld();
+
+	if( m_pFluids ) {
+		const FluidStats &fluidStats = m_pFluids->getStats();
+		if( fluidStats.cellCount > 0 )
+			m_pGameHandle->getLogger()->print( "Ran %llu fluid updates at %.3f ms each, %.0f cells per second", (unsigned long long)fluidStats.updateCount, fluidStats.getMillisecondsPerUpdate(), fluidStats.getCellsPerSecond() );
+		m_pFluids->shutdown();
+		delete m_pFluids;
+		m_pFluids = 0;
+	}
+	if( m_pLightEngine ) {
+		m_pLightEngine->shutdown();
+		delete m_pLightEngine;
+		m_pLightEngine = 0;
+	}
+	if( m_pRegionManager ) {
+		m_pRegionManager->shutdown();
+		delete m_pRegionManager;
+		m_pRegionManager = 0;
+	}
+	if( m_pIOService ) {
+		m_pIOService->shutdown();
+		delete m_pIOService;
+		m_pIOService = 0;
+	}
+	m_pMeshWorkers = 0;
+	if( m_physicsSystem ) {
+		m_physicsSystem->shutdown();
+		m_physicsSystem.reset();
+	}
+	if( m_pBlockTicks ) {
+		delete m_pBlockTicks;
+		m_pBlockTicks = 0;
+	}
+	if( m_pRaycaster ) {
+		const RaycastStats &rayStats = m_pRaycaster->getStats();
+		if( rayStats.rayCount > 0 )
+			m_pGameHandle->getLogger()->print( "Cast %llu batched rays at %.0f rays per second", (unsigned long long)rayStats.rayCount, rayStats.getRaysPerSecond() );
+		delete m_pRaycaster;
+		m_pRaycaster = 0;
+	}
+	if( m_pChunkStore ) {
+		delete m_pChunkStore;
+		m_pChunkStore = 0;
+	}
 	if( m_pWorldEntCoordinator ) {
 		delete m_pWorldEntCoordinator;
 		m_pWorldEntCoordinator = 0;
@@ -49,5 +170,527 @@ void CWorld::destroyEntity( Entity entity )
 
 bool CWorld::updateWorld( float deltaT )
 {
+	// Finish any column loads that completed since the last tick
+	m_pIOService->dispatchCompletions();
+
+	// Move entities against the blocks as they are at the start of the tick
+	m_physicsSystem->update( deltaT );
+
+	m_tickAccumulator += deltaT;
+	unsigned int ticks = (unsigned int)(m_tickAccumulator * WORLD_TICK_RATE);
+	m_tickAccumulator -= (float)ticks / WORLD_TICK_RATE;
+	if( ticks > WORLD_MAX_TICKS_PER_UPDATE ) {
+		ticks = WORLD_MAX_TICKS_PER_UPDATE;
+		m_tickAccumulator = 0.0f;
+	}
+	for( unsigned int i = 0; i < ticks; i++ )
+		this->tickWorld();
+
+	// Spread light from this tick's edits and loads, large changes carry over to later ticks
+	m_pLightEngine->update( LIGHT_MAX_ROUNDS_PER_TICK );
+
+	// Edits and loads from this tick are meshed in the background
+	this->publishDirtyChunks();
+
 	return true;
-}
\ No newline at end of file
+}
+
+void CWorld::tickWorld()
+{
+	m_pBlockTicks->advance( [this]( int32_t x, int32_t y, int32_t z ) {
+		this->runBlockUpdate( x, y, z );
+	} );
+
+	// Water moves slower than the world ticks
+	if( m_pBlockTicks->getCurrentTick() % FLUID_TICK_INTERVAL == 0 ) {
+		m_pFluids->update( [this]( int32_t x, int32_t y, int32_t z, BlockId block ) {
+			this->changeBlock( x, y, z, block );
+		} );
+	}
+}
+
+void CWorld::runBlockUpdate( int32_t x, int32_t y, int32_t z )
+{
+	BlockId block = m_pChunkStore->getBlock( x, y, z );
+	if( !IsBlockFalling( block ) || y <= 0 )
+		return;
+
+	// Only fall into air in a loaded chunk, the store reads unloaded blocks as air
+	if( !m_pChunkStore->getChunk( { BlockToChunkCoord( x ), BlockToChunkCoord( y-1 ), BlockToChunkCoord( z ) } ) )
+		return;
+	if( m_pChunkStore->getBlock( x, y-1, z ) != BLOCK_AIR )
+		return;
+
+	// Each move schedules the next one, and the block above
+	this->setBlock( x, y, z, BLOCK_AIR );
+	this->setBlock( x, y-1, z, block );
+}
+
+void CWorld::publishDirtyChunks()
+{
+	if( !m_pMeshWorkers )
+		return;
+
+	// Chunks the renderer wants at another level of detail are copied again like edited ones
+	m_dirtyChunks.clear();
+	m_pMeshWorkers->takeRemeshRequests( m_dirtyChunks );
+	for( auto &it: m_dirtyChunks )
+		m_pChunkStore->markDirty( it );
+
+	m_dirtyChunks.clear();
+	m_pChunkStore->takeDirtyChunks( m_dirtyChunks );
+	for( auto &it: m_dirtyChunks )
+	{
+		ChunkMeshInput *pInput = m_pMeshWorkers->acquireInput();
+		if( pInput->gather( m_pChunkStore, it ) )
+			m_pMeshWorkers->submit( pInput );
+		else {
+			// Unloaded, or a neighbour of a loaded chunk that was never loaded itself
+			m_pMeshWorkers->releaseInput( pInput );
+			m_pMeshWorkers->cancel( it );
+		}
+	}
+}
+
+bool CWorld::loadColumn( int32_t columnX, int32_t columnZ )
+{
+	bool loaded = m_pRegionManager->loadColumn( m_pChunkStore, columnX, columnZ );
+	if( !loaded )
+		this->generateColumn( columnX, columnZ );
+	this->onColumnReady( columnX, columnZ );
+
+	return loaded;
+}
+
+void CWorld::onColumnReady( int32_t columnX, int32_t columnZ )
+{
+	// Light is not saved
+	m_pLightEngine->lightColumn( columnX, columnZ );
+
+	// Updates that came due while the column was unloaded
+	for( int32_t y = 0; y < WORLD_HEIGHT_CHUNKS; y++ )
+		m_pBlockTicks->resumeChunk( { columnX, y, columnZ } );
+	m_pFluids->onColumnLoaded( columnX, columnZ );
+}
+
+bool CWorld::setBlock( int32_t x, int32_t y, int32_t z, BlockId block )
+{
+	BlockId oldBlock = m_pChunkStore->getBlock( x, y, z );
+	if( !this->changeBlock( x, y, z, block ) )
+		return false;
+	m_pFluids->onBlockChanged( x, y, z, oldBlock, block );
+
+	return true;
+}
+
+bool CWorld::changeBlock( int32_t x, int32_t y, int32_t z, BlockId block )
+{
+	BlockId oldBlock = m_pChunkStore->getBlock( x, y, z );
+	if( !m_pChunkStore->setBlock( x, y, z, block ) )
+		return false;
+	if( oldBlock != block )
+		this->onBlockChanged( x, y, z, oldBlock, block );
+
+	return true;
+}
+
+void CWorld::onBlockChanged( int32_t x, int32_t y, int32_t z, BlockId oldBlock, BlockId newBlock )
+{
+	m_pLightEngine->onBlockChanged( x, y, z, oldBlock, newBlock );
+
+	// Wake the falling blocks that the edit may have left unsupported, including the new block itself
+	if( IsBlockFalling( newBlock ) )
+		this->scheduleBlockUpdate( x, y, z, WORLD_FALL_DELAY_TICKS );
+	if( y+1 < WORLD_HEIGHT && IsBlockFalling( m_pChunkStore->getBlock( x, y+1, z ) ) )
+		this->scheduleBlockUpdate( x, y+1, z, WORLD_FALL_DELAY_TICKS );
+}
+
+void CWorld::scheduleBlockUpdate( int32_t x, int32_t y, int32_t z, uint32_t delay )
+{
+	m_pBlockTicks->schedule( x, y, z, delay );
+}
+
+enum RegionEditTypes : uint8_t
+{
+	REGION_EDIT_FILL = 0,
+	REGION_EDIT_REPLACE,
+	REGION_EDIT_APPLY,
+	REGION_EDIT_PASTE
+};
+
+struct CWorld::RegionEdit
+{
+	RegionEditTypes type;
+	/** The block to fill with, or to replace with */
+	BlockId block;
+	/** The block being replaced */
+	BlockId oldBlock;
+	const BlockEditFunction *pFunction;
+	const BlockClipboard *pClipboard;
+	int32_t pasteOrigin[3];
+	bool pasteAir;
+};
+
+size_t CWorld::editRegion( const BlockBox &box, const RegionEdit &edit )
+{
+	// Nothing above or below the world
+	const int32_t minimum[3] = { std::min( box.minX, box.maxX ), std::max( std::min( box.minY, box.maxY ), 0 ), std::min( box.minZ, box.maxZ ) };
+	const int32_t maximum[3] = { std::max( box.minX, box.maxX ), std::min( std::max( box.minY, box.maxY ), WORLD_HEIGHT-1 ), std::max( box.minZ, box.maxZ ) };
+	if( minimum[1] > maximum[1] )
+		return 0;
+
+	auto editStart = std::chrono::high_resolution_clock::now();
+	size_t changedCount = 0;
+	bool bulk = false;
+	m_regionChanges.clear();
+	m_editedChunks.clear();
+	m_editBlocks.resize( CHUNK_VOLUME );
+
+	for( int32_t chunkY = BlockToChunkCoord( minimum[1] ); chunkY <= BlockToChunkCoord( maximum[1] ); chunkY++ ) {
+		for( int32_t chunkZ = BlockToChunkCoord( minimum[2] ); chunkZ <= BlockToChunkCoord( maximum[2] ); chunkZ++ ) {
+			for( int32_t chunkX = BlockToChunkCoord( minimum[0] ); chunkX <= BlockToChunkCoord( maximum[0] ); chunkX++ )
+			{
+				const ChunkPos position = { chunkX, chunkY, chunkZ };
+				CChunk *pChunk = m_pChunkStore->getChunk( position );
+				if( !pChunk )
+					continue;
+
+				// The part of the box inside the chunk, in chunk-local coordinates
+				const int32_t chunkOrigin[3] = { chunkX*CHUNK_SIZE, chunkY*CHUNK_SIZE, chunkZ*CHUNK_SIZE };
+				int32_t start[3], end[3];
+				bool wholeChunk = true;
+				for( uint32_t a = 0; a < 3; a++ ) {
+					start[a] = std::max( minimum[a] - chunkOrigin[a], 0 );
+					end[a] = std::min( maximum[a] - chunkOrigin[a], CHUNK_MASK );
+					wholeChunk = wholeChunk && start[a] == 0 && end[a] == CHUNK_MASK;
+				}
+
+				size_t chunkChanged = 0;
+				bool uniform = pChunk->isUniform();
+				BlockId uniformBlock = pChunk->getUniformBlock();
+
+				// Uniform chunks and whole chunks are handled without touching every block
+				if( uniform && ((edit.type == REGION_EDIT_FILL && uniformBlock == edit.block) || (edit.type == REGION_EDIT_REPLACE && uniformBlock != edit.oldBlock)) )
+					continue;
+				if( wholeChunk && (edit.type == REGION_EDIT_FILL || (edit.type == REGION_EDIT_REPLACE && uniform)) )
+				{
+					if( uniform )
+						chunkChanged = CHUNK_VOLUME;
+					else {
+						const BlockId *pBlocks = pChunk->getBlockData();
+						chunkChanged = CHUNK_VOLUME - (size_t)std::count( pBlocks, pBlocks + CHUNK_VOLUME, edit.block );
+					}
+					pChunk->fill( edit.block );
+					bulk = bulk || chunkChanged > 0;
+				}
+				else
+				{
+					if( uniform )
+						std::fill( m_editBlocks.begin(), m_editBlocks.end(), uniformBlock );
+					else
+						std::copy( pChunk->getBlockData(), pChunk->getBlockData() + CHUNK_VOLUME, m_editBlocks.begin() );
+
+					for( int32_t y = start[1]; y <= end[1]; y++ ) {
+						for( int32_t z = start[2]; z <= end[2]; z++ ) {
+							for( int32_t x = start[0]; x <= end[0]; x++ )
+							{
+								BlockId &block = m_editBlocks[ChunkBlockIndex( x, y, z )];
+								BlockId newBlock = block;
+								switch( edit.type )
+								{
+								case REGION_EDIT_FILL:
+									newBlock = edit.block;
+									break;
+								case REGION_EDIT_REPLACE:
+									if( block == edit.oldBlock )
+										newBlock = edit.block;
+									break;
+								case REGION_EDIT_APPLY:
+									newBlock = (*edit.pFunction)( chunkOrigin[0] + x, chunkOrigin[1] + y, chunkOrigin[2] + z, block );
+									break;
+								case REGION_EDIT_PASTE:
+									newBlock = edit.pClipboard->getBlock( chunkOrigin[0] + x - edit.pasteOrigin[0], chunkOrigin[1] + y - edit.pasteOrigin[1], chunkOrigin[2] + z - edit.pasteOrigin[2] );
+									if( newBlock == BLOCK_AIR && !edit.pasteAir )
+										newBlock = block;
+									break;
+								}
+								if( newBlock == block )
+									continue;
+
+								// Small edits are followed up block by block, like single edits
+								if( !bulk ) {
+									if( m_regionChanges.size() < WORLD_REGION_EDIT_BLOCK_LIMIT )
+										m_regionChanges.push_back( { chunkOrigin[0] + x, chunkOrigin[1] + y, chunkOrigin[2] + z, block, newBlock } );
+									else
+										bulk = true;
+								}
+								block = newBlock;
+								chunkChanged++;
+							}
+						}
+					}
+					if( chunkChanged > 0 )
+						pChunk->setBlockData( &m_editBlocks[0] );
+				}
+				if( chunkChanged == 0 )
+					continue;
+				changedCount += chunkChanged;
+				m_editedChunks.push_back( position );
+
+				// Remesh the chunk once, and the neighbours whose border the box touches
+				int32_t minOffset[3], maxOffset[3];
+				for( uint32_t a = 0; a < 3; a++ ) {
+					minOffset[a] = (start[a] == 0) ? -1 : 0;
+					maxOffset[a] = (end[a] == CHUNK_MASK) ? 1 : 0;
+				}
+				for( int32_t dy = minOffset[1]; dy <= maxOffset[1]; dy++ ) {
+					for( int32_t dz = minOffset[2]; dz <= maxOffset[2]; dz++ ) {
+						for( int32_t dx = minOffset[0]; dx <= maxOffset[0]; dx++ )
+							m_pChunkStore->markDirty( { chunkX + dx, chunkY + dy, chunkZ + dz } );
+					}
+				}
+			}
+		}
+	}
+	if( changedCount == 0 )
+		return 0;
+
+	if( !bulk ) {
+		for( auto &it: m_regionChanges ) {
+			this->onBlockChanged( it.x, it.y, it.z, it.oldBlock, it.newBlock );
+			m_pFluids->onBlockChanged( it.x, it.y, it.z, it.oldBlock, it.newBlock );
+		}
+	}
+	else
+	{
+		// Relight every edited column once, with the columns next to them that its light can reach
+		std::set<std::pair<int32_t, int32_t>> relitColumns;
+		for( auto &it: m_editedChunks ) {
+			for( int32_t dz = -1; dz <= 1; dz++ ) {
+				for( int32_t dx = -1; dx <= 1; dx++ )
+					relitColumns.insert( std::pair<int32_t, int32_t>( it.x + dx, it.z + dz ) );
+			}
+		}
+		m_pLightEngine->relightColumns( std::vector<std::pair<int32_t, int32_t>>( relitColumns.begin(), relitColumns.end() ) );
+		m_pFluids->onChunksEdited( m_editedChunks );
+
+		float editTimeMs = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - editStart).count() / 1000.0f;
+		m_pGameHandle->getLogger()->print( "Edited %llu blocks in %d chunks in %.2f ms", (unsigned long long)changedCount, (int)m_editedChunks.size(), editTimeMs );
+	}
+	m_regionChanges.clear();
+
+	return changedCount;
+}
+
+size_t CWorld::fillRegion( const BlockBox &box, BlockId block )
+{
+	RegionEdit edit = RegionEdit();
+	edit.type = REGION_EDIT_FILL;
+	edit.block = block;
+	return this->editRegion( box, edit );
+}
+
+size_t CWorld::replaceRegion( const BlockBox &box, BlockId oldBlock, BlockId newBlock )
+{
+	if( oldBlock == newBlock )
+		return 0;
+
+	RegionEdit edit = RegionEdit();
+	edit.type = REGION_EDIT_REPLACE;
+	edit.block = newBlock;
+	edit.oldBlock = oldBlock;
+	return this->editRegion( box, edit );
+}
+
+size_t CWorld::applyRegion( const BlockBox &box, const BlockEditFunction &function )
+{
+	RegionEdit edit = RegionEdit();
+	edit.type = REGION_EDIT_APPLY;
+	edit.pFunction = &function;
+	return this->editRegion( box, edit );
+}
+
+bool CWorld::copyRegion( const BlockBox &box, BlockClipboard &clipboard )
+{
+	const int32_t minimum[3] = { std::min( box.minX, box.maxX ), std::min( box.minY, box.maxY ), std::min( box.minZ, box.maxZ ) };
+	const int32_t maximum[3] = { std::max( box.minX, box.maxX ), std::max( box.minY, box.maxY ), std::max( box.minZ, box.maxZ ) };
+	clipboard.sizeX = maximum[0] - minimum[0] + 1;
+	clipboard.sizeY = maximum[1] - minimum[1] + 1;
+	clipboard.sizeZ = maximum[2] - minimum[2] + 1;
+	clipboard.blocks.assign( (size_t)clipboard.sizeX * clipboard.sizeY * clipboard.sizeZ, BLOCK_AIR );
+
+	// Only the part inside the world is read, the rest stays air
+	int32_t minY = std::max( minimum[1], 0 );
+	int32_t maxY = std::min( maximum[1], WORLD_HEIGHT-1 );
+	bool allLoaded = true;
+	for( int32_t chunkY = BlockToChunkCoord( minY ); chunkY <= BlockToChunkCoord( maxY ) && minY <= maxY; chunkY++ ) {
+		for( int32_t chunkZ = BlockToChunkCoord( minimum[2] ); chunkZ <= BlockToChunkCoord( maximum[2] ); chunkZ++ ) {
+			for( int32_t chunkX = BlockToChunkCoord( minimum[0] ); chunkX <= BlockToChunkCoord( maximum[0] ); chunkX++ )
+			{
+				CChunk *pChunk = m_pChunkStore->getChunk( { chunkX, chunkY, chunkZ } );
+				if( !pChunk ) {
+					allLoaded = false;
+					continue;
+				}
+				if( pChunk->isEmpty() )
+					continue;
+
+				int32_t startX = std::max( minimum[0], chunkX * CHUNK_SIZE ), endX = std::min( maximum[0], chunkX * CHUNK_SIZE + CHUNK_MASK );
+				int32_t startY = std::max( minY, chunkY * CHUNK_SIZE ), endY = std::min( maxY, chunkY * CHUNK_SIZE + CHUNK_MASK );
+				int32_t startZ = std::max( minimum[2], chunkZ * CHUNK_SIZE ), endZ = std::min( maximum[2], chunkZ * CHUNK_SIZE + CHUNK_MASK );
+				for( int32_t y = startY; y <= endY; y++ ) {
+					for( int32_t z = startZ; z <= endZ; z++ )
+					{
+						BlockId *pRow = &clipboard.blocks[((size_t)(y - minimum[1])*clipboard.sizeZ + (z - minimum[2]))*clipboard.sizeX + (startX - minimum[0])];
+						// Rows of a chunk are contiguous along X
+						if( pChunk->isUniform() )
+							std::fill( pRow, pRow + (endX - startX + 1), pChunk->getUniformBlock() );
+						else {
+							const BlockId *pSource = pChunk->getBlockData() + ChunkBlockIndex( startX & CHUNK_MASK, y & CHUNK_MASK, z & CHUNK_MASK );
+							std::copy( pSource, pSource + (endX - startX + 1), pRow );
+						}
+					}
+				}
+			}
+		}
+	}
+
+	return allLoaded;
+}
+
+size_t CWorld::pasteRegion( const BlockClipboard &clipboard, int32_t x, int32_t y, int32_t z, bool pasteAir )
+{
+	if( clipboard.sizeX <= 0 || clipboard.sizeY <= 0 || clipboard.sizeZ <= 0 )
+		return 0;
+
+	RegionEdit edit = RegionEdit();
+	edit.type = REGION_EDIT_PASTE;
+	edit.pClipboard = &clipboard;
+	edit.pasteOrigin[0] = x;
+	edit.pasteOrigin[1] = y;
+	edit.pasteOrigin[2] = z;
+	edit.pasteAir = pasteAir;
+	BlockBox box = { x, y, z, x + clipboard.sizeX - 1, y + clipboard.sizeY - 1, z + clipboard.sizeZ - 1 };
+	return this->editRegion( box, edit );
+}
+
+bool CWorld::raycast( const glm::vec3 &origin, const glm::vec3 &direction, float maxDistance, RaycastHit *pHit, RaycastStopTypes stopType )
+{
+	RaycastQuery query;
+	query.origin = origin;
+	query.direction = direction;
+	query.maxDistance = maxDistance;
+	query.stopType = stopType;
+	return m_pRaycaster->cast( query, pHit );
+}
+
+size_t CWorld::raycastBatch( const std::vector<RaycastQuery> &queries, std::vector<RaycastHit> &hits )
+{
+	return m_pRaycaster->castBatch( queries, hits );
+}
+
+void CWorld::requestColumn( int32_t columnX, int32_t columnZ )
+{
+	std::pair<int32_t, int32_t> column( columnX, columnZ );
+
+	if( m_pendingColumns.count( column ) || m_pChunkStore->getChunk( { columnX, 0, columnZ } ) )
+		return;
+	m_pendingColumns.insert( column );
+
+	m_pRegionManager->loadColumnAsync( m_pChunkStore, columnX, columnZ, [this, column]( bool loaded ) {
+		m_pendingColumns.erase( column );
+		if( !loaded )
+			this->generateColumn( column.first, column.second );
+		this->onColumnReady( column.first, column.second );
+	} );
+}
+
+void CWorld::finishColumnRequests()
+{
+	while( !m_pendingColumns.empty() ) {
+		m_pIOService->waitIdle();
+		// Stale reads fall back to synchronous loads inside the callbacks, so one dispatch always finishes them
+		if( m_pIOService->dispatchCompletions() == 0 )
+			break;
+	}
+}
+
+bool CWorld::saveWorld()
+{
+	// Find the columns containing modified chunks
+	std::set<std::pair<int32_t, int32_t>> modifiedColumns;
+	m_pChunkStore->forEachChunk( [&modifiedColumns]( CChunk *pChunk ) {
+		if( pChunk->isModified() )
+			modifiedColumns.insert( std::pair<int32_t, int32_t>( pChunk->getPosition().x, pChunk->getPosition().z ) );
+	} );
+	if( modifiedColumns.empty() )
+		return true;
+
+	auto saveStart = std::chrono::high_resolution_clock::now();
+	bool success = true;
+	m_pRegionManager->resetCodecStats();
+	for( auto it: modifiedColumns ) {
+		if( !m_pRegionManager->saveColumn( m_pChunkStore, it.first, it.second ) ) {
+			m_pGameHandle->getLogger()->printError( "Failed to save chunk column (%d, %d)", it.first, it.second );
+			success = false;
+		}
+	}
+	if( !m_pRegionManager->commitAll() )
+		success = false;
+	float saveTimeMs = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - saveStart).count() / 1000.0f;
+	m_pGameHandle->getLogger()->print( "Saved %d chunk columns in %.2f ms", (int)modifiedColumns.size(), saveTimeMs );
+	const ChunkCodecStats &codecStats = m_pRegionManager->getEncodeStats();
+	m_pGameHandle->getLogger()->print( "Compressed %llu chunks at %.1f MB/s, ratio %.1f:1", (unsigned long long)codecStats.chunkCount, codecStats.getMBPerSecond(), codecStats.getRatio() );
+
+	return success;
+}
+
+void CWorld::generateColumn( int32_t columnX, int32_t columnZ )
+{
+	int32_t heightMap[CHUNK_SIZE][CHUNK_SIZE];
+	int32_t minHeight = WORLD_HEIGHT, maxHeight = 0;
+
+	// Rolling hills
+	for( int32_t z = 0; z < CHUNK_SIZE; z++ ) {
+		for( int32_t x = 0; x < CHUNK_SIZE; x++ ) {
+			float worldX = (float)(columnX*CHUNK_SIZE + x);
+			float worldZ = (float)(columnZ*CHUNK_SIZE + z);
+			int32_t height = 64 + (int32_t)(8.0f*std::sin( worldX*0.05f ) + 8.0f*std::cos( worldZ*0.07f ));
+			heightMap[z][x] = height;
+			minHeight = std::min( minHeight, height );
+			maxHeight = std::max( maxHeight, height );
+		}
+	}
+
+	for( int32_t y = 0; y < WORLD_HEIGHT_CHUNKS; y++ )
+	{
+		CChunk *pChunk = m_pChunkStore->createChunk( { columnX, y, columnZ } );
+		int32_t chunkBottom = y*CHUNK_SIZE;
+
+		// Chunks entirely above or below the surface stay uniform
+		if( chunkBottom > maxHeight )
+			pChunk->fill( BLOCK_AIR );
+		else if( chunkBottom + CHUNK_SIZE <= minHeight - 4 )
+			pChunk->fill( BLOCK_STONE );
+		else
+		{
+			for( int32_t ly = 0; ly < CHUNK_SIZE; ly++ ) {
+				for( int32_t z = 0; z < CHUNK_SIZE; z++ ) {
+					for( int32_t x = 0; x < CHUNK_SIZE; x++ ) {
+						int32_t worldY = chunkBottom + ly;
+						int32_t height = heightMap[z][x];
+						BlockId block = BLOCK_AIR;
+						if( worldY < height - 4 )
+							block = BLOCK_STONE;
+						else if( worldY < height )
+							block = BLOCK_DIRT;
+						else if( worldY == height )
+							block = BLOCK_GRASS;
+						pChunk->setBlock( x, ly, z, block );
+					}
+				}
+			}
+		}
+		pChunk->setModified( true );
+	}
+}